@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "soc/soc_caps.h"
+
+/*
+    LEDC stand-in: keeps the duty of every channel, runs fades on the virtual clock and raises the fade end
+    interrupt when they end. Multi-segment fades (ledc_set_multi_fade) step through their ranges PWM cycle by
+    PWM cycle like the ESP32-C6/H2 LEDC does. Like the driver with the fade service installed, setting a duty or a new fade
+    on a channel that is still fading blocks until that fade ends (or is stopped).
+    Every applied duty and fade is recorded, see sim_ledc_events().
+*/
+
+typedef enum {
+    LEDC_LOW_SPEED_MODE = 0,
+    LEDC_SPEED_MODE_MAX,
+} ledc_mode_t;
+
+typedef enum {
+    LEDC_TIMER_0 = 0,
+    LEDC_TIMER_1,
+    LEDC_TIMER_2,
+    LEDC_TIMER_3,
+    LEDC_TIMER_MAX,
+} ledc_timer_t;
+
+typedef enum {
+    LEDC_CHANNEL_0 = 0,
+    LEDC_CHANNEL_1,
+    LEDC_CHANNEL_2,
+    LEDC_CHANNEL_3,
+    LEDC_CHANNEL_4,
+    LEDC_CHANNEL_5,
+    LEDC_CHANNEL_MAX,
+} ledc_channel_t;
+
+typedef enum {
+    LEDC_TIMER_1_BIT = 1,
+    LEDC_TIMER_2_BIT,
+    LEDC_TIMER_3_BIT,
+    LEDC_TIMER_4_BIT,
+    LEDC_TIMER_5_BIT,
+    LEDC_TIMER_6_BIT,
+    LEDC_TIMER_7_BIT,
+    LEDC_TIMER_8_BIT,
+    LEDC_TIMER_9_BIT,
+    LEDC_TIMER_10_BIT,
+    LEDC_TIMER_11_BIT,
+    LEDC_TIMER_12_BIT,
+    LEDC_TIMER_13_BIT,
+    LEDC_TIMER_14_BIT,
+    LEDC_TIMER_15_BIT,
+    LEDC_TIMER_16_BIT,
+    LEDC_TIMER_17_BIT,
+    LEDC_TIMER_18_BIT,
+    LEDC_TIMER_19_BIT,
+    LEDC_TIMER_20_BIT,
+    LEDC_TIMER_BIT_MAX,
+} ledc_timer_bit_t;
+
+typedef enum {
+    LEDC_AUTO_CLK = 0,
+    LEDC_USE_XTAL_CLK,
+    LEDC_USE_RC_FAST_CLK,
+} ledc_clk_cfg_t;
+
+typedef enum {
+    LEDC_INTR_DISABLE = 0,
+    LEDC_INTR_FADE_END,
+} ledc_intr_type_t;
+
+typedef enum {
+    LEDC_DUTY_DIR_DECREASE = 0,
+    LEDC_DUTY_DIR_INCREASE,
+} ledc_duty_direction_t;
+
+typedef enum {
+    LEDC_FADE_NO_WAIT = 0,
+    LEDC_FADE_WAIT_DONE,
+    LEDC_FADE_MAX,
+} ledc_fade_mode_t;
+
+typedef struct {
+    ledc_mode_t speed_mode;
+    ledc_timer_bit_t duty_resolution;
+    ledc_timer_t timer_num;
+    uint32_t freq_hz;
+    ledc_clk_cfg_t clk_cfg;
+    bool deconfigure;
+} ledc_timer_config_t;
+
+typedef struct {
+    int gpio_num;
+    ledc_mode_t speed_mode;
+    ledc_channel_t channel;
+    ledc_intr_type_t intr_type;
+    ledc_timer_t timer_sel;
+    uint32_t duty;
+    int hpoint;
+    struct {
+        unsigned int output_invert : 1;
+    } flags;
+} ledc_channel_config_t;
+
+typedef enum {
+    LEDC_FADE_END_EVT = 0,
+} ledc_cb_event_t;
+
+typedef struct {
+    ledc_cb_event_t event;
+    uint32_t speed_mode;
+    uint32_t channel;
+    uint32_t duty;
+} ledc_cb_param_t;
+
+// One range of a multi-segment fade: step_num steps of scale duty LSB, one every cycle_num PWM cycles
+typedef struct {
+    uint32_t dir : 1;
+    uint32_t cycle_num : SOC_LEDC_FADE_PARAMS_BIT_WIDTH;
+    uint32_t scale : SOC_LEDC_FADE_PARAMS_BIT_WIDTH;
+    uint32_t step_num : SOC_LEDC_FADE_PARAMS_BIT_WIDTH;
+} ledc_fade_param_config_t;
+
+typedef bool (*ledc_cb_t)(const ledc_cb_param_t *param, void *user_arg);
+
+typedef struct {
+    ledc_cb_t fade_cb;
+} ledc_cbs_t;
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf);
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf);
+esp_err_t ledc_fade_func_install(int intr_alloc_flags);
+void ledc_fade_func_uninstall(void);
+esp_err_t ledc_cb_register(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_cbs_t *cbs, void *user_arg);
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty);
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel);
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel);
+esp_err_t ledc_set_fade_with_time(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty, int max_fade_time_ms);
+esp_err_t ledc_set_multi_fade(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t start_duty, const ledc_fade_param_config_t *fade_params_list,
+                              uint32_t list_len);
+esp_err_t ledc_fade_start(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_fade_mode_t fade_mode);
+esp_err_t ledc_fade_stop(ledc_mode_t speed_mode, ledc_channel_t channel);
+esp_err_t ledc_set_duty_and_update(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty, uint32_t hpoint);
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty, uint32_t max_fade_time_ms,
+                                       ledc_fade_mode_t fade_mode);
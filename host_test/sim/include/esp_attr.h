@@ -0,0 +1,9 @@
+#pragma once
+
+// Placement attributes have no meaning on the host
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define NOINIT_ATTR
+#define EXT_RAM_BSS_ATTR
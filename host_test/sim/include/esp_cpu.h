@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sim.h"
+
+// Cycle counter of the virtual CPU, derived from the virtual clock
+typedef uint32_t esp_cpu_cycle_count_t;
+
+static inline esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void) { return (esp_cpu_cycle_count_t)(sim_now_us() * SIM_CPU_MHZ); }
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdint.h>
+
+// Log output of the host build, timestamps are virtual milliseconds.
+// The level of every tag starts at the value of the SIM_LOG_LEVEL environment variable (0-5, default 2 = warnings).
+
+typedef enum {
+    ESP_LOG_NONE = 0,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+esp_log_level_t esp_log_level_get(const char *tag);
+uint32_t esp_log_timestamp(void);
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOG_LEVEL(level, tag, letter, format, ...)                                                                                               \
+    do {                                                                                                                                             \
+        if (esp_log_level_get(tag) >= (level))                                                                                                       \
+            esp_log_write((level), (tag), letter " (%u) %s: " format "\n", (unsigned)esp_log_timestamp(), (tag), ##__VA_ARGS__);                   \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_ERROR, tag, "E", format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_WARN, tag, "W", format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_INFO, tag, "I", format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_DEBUG, tag, "D", format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_VERBOSE, tag, "V", format, ##__VA_ARGS__)
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Same results as the ROM implementation (zlib compatible CRC32)
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sim.h"
+
+static inline uint32_t esp_rom_get_cpu_ticks_per_us(void) { return SIM_CPU_MHZ; }
+static inline void esp_rom_delay_us(uint32_t us) { sim_consume_us(us); }
@@ -0,0 +1,177 @@
+#pragma once
+
+/*
+    FreeRTOS stand-in for the host build, see sim.h.
+
+    Declares the whole kernel API used by the firmware in one place, the other freertos/ headers only
+    include this one. Types and tick handling follow the ESP-IDF port (stack sizes in bytes).
+*/
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_attr.h"
+#include "esp_bit_defs.h"
+
+#ifndef SIM_TICK_RATE_HZ
+#define SIM_TICK_RATE_HZ 100
+#endif
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+#define errQUEUE_EMPTY ((BaseType_t)0)
+#define errQUEUE_FULL ((BaseType_t)0)
+
+#define configTICK_RATE_HZ SIM_TICK_RATE_HZ
+#define configMAX_PRIORITIES 25
+#define configMAX_TASK_NAME_LEN 16
+#define configTIMER_TASK_PRIORITY 1
+#define configTIMER_QUEUE_LENGTH 10
+#define configTIMER_TASK_STACK_DEPTH 2048
+#define configASSERT(x) assert(x)
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * (uint64_t)configTICK_RATE_HZ) / 1000U))
+#define pdTICKS_TO_MS(ticks) ((uint32_t)(((uint64_t)(ticks) * 1000U) / configTICK_RATE_HZ))
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+#define tskNO_AFFINITY 0x7fffffff
+
+/* Critical sections: the simulation has one thread, they only forbid blocking and task switches */
+
+typedef struct {
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {.owner = 0, .count = 0}
+
+void sim_critical_enter(portMUX_TYPE *mux);
+void sim_critical_exit(portMUX_TYPE *mux);
+#define portENTER_CRITICAL(mux) sim_critical_enter(mux)
+#define portEXIT_CRITICAL(mux) sim_critical_exit(mux)
+#define portENTER_CRITICAL_ISR(mux) sim_critical_enter(mux)
+#define portEXIT_CRITICAL_ISR(mux) sim_critical_exit(mux)
+#define portENTER_CRITICAL_SAFE(mux) sim_critical_enter(mux)
+#define portEXIT_CRITICAL_SAFE(mux) sim_critical_exit(mux)
+#define taskENTER_CRITICAL(mux) sim_critical_enter(mux)
+#define taskEXIT_CRITICAL(mux) sim_critical_exit(mux)
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+/* Tasks */
+
+typedef struct sim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef enum { eNoAction = 0, eSetBits, eIncrement, eSetValueWithOverwrite, eSetValueWithoutOverwrite } eNotifyAction;
+typedef enum { eRunning = 0, eReady, eBlocked, eSuspended, eDeleted, eInvalid } eTaskState;
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *params, UBaseType_t priority, TaskHandle_t *created);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *params, UBaseType_t priority,
+                                   TaskHandle_t *created, BaseType_t core_id);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void taskYIELD(void);
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TaskHandle_t xTaskGetHandle(const char *name);
+char *pcTaskGetName(TaskHandle_t task);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+eTaskState eTaskGetState(TaskHandle_t task);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+void vTaskSuspend(TaskHandle_t task);
+void vTaskResume(TaskHandle_t task);
+
+BaseType_t xTaskGenericNotify(TaskHandle_t task, uint32_t value, eNotifyAction action, uint32_t *previous_value);
+BaseType_t xTaskGenericNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, uint32_t *previous_value, BaseType_t *woken);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+#define xTaskNotify(task, value, action) xTaskGenericNotify((task), (value), (action), NULL)
+#define xTaskNotifyAndQuery(task, value, action, previous) xTaskGenericNotify((task), (value), (action), (previous))
+#define xTaskNotifyGive(task) xTaskGenericNotify((task), 0, eIncrement, NULL)
+#define xTaskNotifyFromISR(task, value, action, woken) xTaskGenericNotifyFromISR((task), (value), (action), NULL, (woken))
+#define vTaskNotifyGiveFromISR(task, woken) ((void)xTaskGenericNotifyFromISR((task), 0, eIncrement, NULL, (woken)))
+
+/* Queues */
+
+typedef struct sim_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks);
+BaseType_t xQueueSendToBackFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken);
+BaseType_t xQueueOverwriteFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken);
+BaseType_t xQueueReceiveFromISR(QueueHandle_t queue, void *item, BaseType_t *woken);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+BaseType_t xQueueReset(QueueHandle_t queue);
+#define xQueueSend(queue, item, ticks) xQueueSendToBack((queue), (item), (ticks))
+#define xQueueSendFromISR(queue, item, woken) xQueueSendToBackFromISR((queue), (item), (woken))
+
+/* Semaphores and mutexes */
+
+typedef struct sim_sem *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t sem, BaseType_t *woken);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken);
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem);
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t sem);
+
+/* Event groups */
+
+typedef struct sim_event_group *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+void vEventGroupDelete(EventGroupHandle_t group);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t ticks);
+
+/* Software timers, run by the timer service task like in FreeRTOS */
+
+typedef struct sim_timer *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+typedef void (*PendedFunction_t)(void *param1, uint32_t param2);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *timer_id, TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks);
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks);
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks);
+BaseType_t xTimerStartFromISR(TimerHandle_t timer, BaseType_t *woken);
+BaseType_t xTimerStopFromISR(TimerHandle_t timer, BaseType_t *woken);
+BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t *woken);
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+void vTimerSetTimerID(TimerHandle_t timer, void *timer_id);
+const char *pcTimerGetName(TimerHandle_t timer);
+TickType_t xTimerGetPeriod(TimerHandle_t timer);
+TickType_t xTimerGetExpiryTime(TimerHandle_t timer);
+BaseType_t xTimerPendFunctionCall(PendedFunction_t fn, void *param1, uint32_t param2, TickType_t ticks);
+BaseType_t xTimerPendFunctionCallFromISR(PendedFunction_t fn, void *param1, uint32_t param2, BaseType_t *woken);
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Host simulation of the ESP-IDF / FreeRTOS services used by the firmware.
+
+    Everything runs in a single host thread under a virtual clock. Tasks are coroutines scheduled like
+    FreeRTOS on one core: the highest priority ready task runs, and it only gives up the CPU when it
+    blocks or wakes a task of higher priority. When no task is ready the clock jumps straight to the next
+    deadline (timeout, software timer, esp_timer, fade end interrupt), so seconds of firmware time run
+    in milliseconds and every run of a scenario is identical.
+
+    Code itself takes no virtual time, a stand-in that should cost time (a flash write) charges it with
+    sim_consume_us. The schedule can be perturbed with sim_configure (random yields and CPU jitter).
+    Mutexes taken in both orders by some tasks are reported, whether they deadlocked in this run or not.
+*/
+
+// Virtual CPU clock, esp_cpu_get_cycle_count() advances by this many cycles per microsecond
+#define SIM_CPU_MHZ 160
+
+// Longest virtual time sim_run waits for main, guards against scenarios that never end
+#define SIM_DEFAULT_TIME_LIMIT_US (3600LL * 1000000)
+
+// Host stack of every task: host frames are larger than on the target, requested sizes are only recorded
+#define SIM_TASK_HOST_STACK_SIZE (256 * 1024)
+
+typedef struct {
+    uint32_t seed;           // seed of the random schedule perturbations
+    uint16_t yield_permille; // chance that a scheduling point switches to another ready task of the same priority
+    uint32_t jitter_us;      // max random CPU time charged at a scheduling point
+    int64_t time_limit_us;   // 0 = SIM_DEFAULT_TIME_LIMIT_US
+} sim_config_t;
+
+typedef void (*sim_main_fn_t)(void *arg);
+typedef void (*sim_event_fn_t)(void *arg);
+
+typedef enum {
+    SIM_RUN_DONE = 0,       // main returned
+    SIM_RUN_DEADLOCK = 1,   // every task blocked forever
+    SIM_RUN_RESTART = 2,    // esp_restart() was called
+    SIM_RUN_TIME_LIMIT = 3, // main still running at the time limit
+} sim_run_result_e;
+
+void sim_configure(const sim_config_t *config);
+// Run main_fn as the "main" task (priority 1 like app_main) until it returns, can only be called once per process
+sim_run_result_e sim_run(sim_main_fn_t main_fn, void *arg);
+
+int64_t sim_now_us(void);
+// Monotonic host clock, for measuring the host CPU time of code under the simulation
+uint64_t sim_host_ns(void);
+// Charge CPU time to the running task, interrupts and timers due meanwhile fire, higher priority tasks preempt it
+void sim_consume_us(uint32_t us);
+// Block the running task for a number of microseconds (not rounded to ticks like vTaskDelay)
+void sim_sleep_us(int64_t us);
+bool sim_in_isr(void);
+// Pseudo-random numbers from the seed given to sim_configure
+uint32_t sim_random(void);
+
+// Run fn in interrupt context at virtual time at_us, returns an id for sim_cancel_event
+uint32_t sim_schedule_event(int64_t at_us, sim_event_fn_t fn, void *arg);
+void sim_cancel_event(uint32_t id);
+
+// Print all tasks with their state and what they wait for
+void sim_dump_tasks(void);
+// Pairs of mutexes taken in both orders by some tasks (a possible deadlock), each is reported on stderr when first seen
+uint32_t sim_lock_order_violations(void);
+
+/* LEDC */
+
+typedef enum {
+    SIM_LEDC_DUTY = 0,   // duty applied by ledc_update_duty
+    SIM_LEDC_FADE_START, // fade from duty to target over fade_us (linear, or stepping through the ranges of a multi-segment fade)
+    SIM_LEDC_FADE_END,   // fade reached target (interrupt)
+    SIM_LEDC_FADE_STOP,  // fade frozen at duty by ledc_fade_stop
+} sim_ledc_event_e;
+
+typedef struct {
+    int64_t time_us;
+    uint8_t type; // sim_ledc_event_e
+    uint8_t channel;
+    uint32_t duty;
+    uint32_t target;  // SIM_LEDC_FADE_START only
+    uint32_t fade_us; // SIM_LEDC_FADE_START only
+} sim_ledc_event_t;
+
+typedef void (*sim_ledc_listener_t)(const sim_ledc_event_t *event, void *arg);
+
+// Every duty write and fade since the last clear, in time order
+const sim_ledc_event_t *sim_ledc_events(size_t *count);
+void sim_ledc_clear_events(void);
+// Duty output by a channel right now, follows a running fade
+uint32_t sim_ledc_duty(uint8_t channel);
+bool sim_ledc_fading(uint8_t channel);
+// Called for every recorded event, from the task or interrupt that caused it
+void sim_ledc_set_listener(sim_ledc_listener_t listener, void *arg);
+
+/* NVS */
+
+typedef struct {
+    uint32_t writes;  // set / erase operations
+    uint32_t commits; // nvs_commit calls
+    uint32_t bytes;   // bytes written by set operations
+} sim_nvs_stats_t;
+
+void sim_nvs_get_stats(sim_nvs_stats_t *stats);
+// CPU time charged to the caller of every set / erase / commit, models the flash write
+void sim_nvs_set_write_cost_us(uint32_t us);
+// The next count set / commit operations fail with ESP_ERR_NVS_NOT_ENOUGH_SPACE, like a full flash
+void sim_nvs_fail_writes(uint32_t count);
+// Persist the whole NVS content to a file and back, to carry it over a simulated reboot
+bool sim_nvs_save(const char *path);
+bool sim_nvs_load(const char *path);
@@ -0,0 +1,12 @@
+#pragma once
+
+// LEDC of a chip without hardware gamma curve fades: transitions take the software tick path on the host.
+// Building with SIM_LEDC_GAMMA_CURVE_FADE=1 models the ESP32-C6/H2 LEDC instead, with multi-segment fades.
+#define SOC_LEDC_CHANNEL_NUM 6
+#define SOC_LEDC_TIMER_BIT_WIDTH 20
+#define SOC_LEDC_FADE_PARAMS_BIT_WIDTH 10
+
+#if defined(SIM_LEDC_GAMMA_CURVE_FADE) && SIM_LEDC_GAMMA_CURVE_FADE == 1
+#define SOC_LEDC_GAMMA_CURVE_FADE_SUPPORTED 1
+#define SOC_LEDC_GAMMA_CURVE_FADE_RANGE_MAX 16
+#endif
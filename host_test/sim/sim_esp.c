@@ -0,0 +1,312 @@
+#include "sim_internal.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+/* --- esp_err --- */
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_INITIALIZED:
+        return "ESP_ERR_NVS_NOT_INITIALIZED";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_TYPE_MISMATCH:
+        return "ESP_ERR_NVS_TYPE_MISMATCH";
+    case ESP_ERR_NVS_READ_ONLY:
+        return "ESP_ERR_NVS_READ_ONLY";
+    case ESP_ERR_NVS_NOT_ENOUGH_SPACE:
+        return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+    case ESP_ERR_NVS_INVALID_NAME:
+        return "ESP_ERR_NVS_INVALID_NAME";
+    case ESP_ERR_NVS_INVALID_HANDLE:
+        return "ESP_ERR_NVS_INVALID_HANDLE";
+    case ESP_ERR_NVS_KEY_TOO_LONG:
+        return "ESP_ERR_NVS_KEY_TOO_LONG";
+    case ESP_ERR_NVS_INVALID_LENGTH:
+        return "ESP_ERR_NVS_INVALID_LENGTH";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+/* --- esp_log --- */
+
+#define SIM_LOG_MAX_TAGS 32
+
+typedef struct {
+    const char *tag;
+    esp_log_level_t level;
+} sim_log_tag_t;
+
+static sim_log_tag_t log_tags[SIM_LOG_MAX_TAGS];
+static size_t log_tag_count;
+static int log_default_level = -1;
+
+static esp_log_level_t sim_log_default_level(void) {
+    if (log_default_level < 0) {
+        const char *env = getenv("SIM_LOG_LEVEL");
+        log_default_level = env != NULL ? atoi(env) : ESP_LOG_WARN;
+    }
+    return (esp_log_level_t)log_default_level;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    if (strcmp(tag, "*") == 0) {
+        log_default_level = level;
+        log_tag_count = 0;
+        return;
+    }
+    for (size_t i = 0; i < log_tag_count; i++) {
+        if (strcmp(log_tags[i].tag, tag) == 0) {
+            log_tags[i].level = level;
+            return;
+        }
+    }
+    if (log_tag_count < SIM_LOG_MAX_TAGS)
+        log_tags[log_tag_count++] = (sim_log_tag_t){.tag = tag, .level = level};
+}
+
+esp_log_level_t esp_log_level_get(const char *tag) {
+    for (size_t i = 0; i < log_tag_count; i++) {
+        if (strcmp(log_tags[i].tag, tag) == 0)
+            return log_tags[i].level;
+    }
+    return sim_log_default_level();
+}
+
+uint32_t esp_log_timestamp(void) { return (uint32_t)(sim_now_us() / 1000); }
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    if (esp_log_level_get(tag) < level)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+/* --- esp_rom_crc --- */
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+/* --- esp_system --- */
+
+#define SIM_SHUTDOWN_HANDLERS 5
+#define SIM_FREE_HEAP (200 * 1024)
+
+static shutdown_handler_t shutdown_handlers[SIM_SHUTDOWN_HANDLERS];
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+    for (int i = 0; i < SIM_SHUTDOWN_HANDLERS; i++) {
+        if (shutdown_handlers[i] == handler)
+            return ESP_ERR_INVALID_STATE;
+        if (shutdown_handlers[i] == NULL) {
+            shutdown_handlers[i] = handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_unregister_shutdown_handler(shutdown_handler_t handler) {
+    for (int i = 0; i < SIM_SHUTDOWN_HANDLERS; i++) {
+        if (shutdown_handlers[i] == handler) {
+            shutdown_handlers[i] = NULL;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_STATE;
+}
+
+void esp_restart(void) {
+    // Newest handler first, like esp_restart on the target
+    for (int i = SIM_SHUTDOWN_HANDLERS - 1; i >= 0; i--) {
+        if (shutdown_handlers[i] != NULL)
+            shutdown_handlers[i]();
+    }
+    sim_request_restart();
+}
+
+uint32_t esp_get_free_heap_size(void) { return SIM_FREE_HEAP; }
+
+uint32_t esp_get_minimum_free_heap_size(void) { return SIM_FREE_HEAP; }
+
+/* --- esp_timer --- */
+
+// Priority and stack of the esp_timer task in ESP-IDF
+#define SIM_ESP_TIMER_TASK_PRIORITY 22
+#define SIM_ESP_TIMER_TASK_STACK_SIZE 3584
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    esp_timer_dispatch_t dispatch_method;
+    bool armed; // stays set until the callback of a one-shot timer is dispatched
+    uint64_t period_us;
+    int64_t alarm_us;
+    uint32_t event;
+    bool pending; // alarm fired, waiting for the esp_timer task
+    struct esp_timer *next_pending;
+};
+
+static TaskHandle_t esp_timer_task;
+static esp_timer_handle_t pending_head;
+
+static void sim_esp_timer_unqueue(esp_timer_handle_t timer) {
+    for (esp_timer_handle_t *link = &pending_head; *link != NULL; link = &(*link)->next_pending) {
+        if (*link == timer) {
+            *link = timer->next_pending;
+            break;
+        }
+    }
+    timer->pending = false;
+    timer->next_pending = NULL;
+}
+
+static void sim_esp_timer_dispatch(esp_timer_handle_t timer) {
+    if (timer->period_us == 0)
+        timer->armed = false;
+    timer->callback(timer->arg);
+}
+
+// Alarm interrupt of one timer
+static void sim_esp_timer_alarm(void *arg) {
+    esp_timer_handle_t timer = arg;
+    timer->event = 0;
+    if (timer->period_us > 0) {
+        timer->alarm_us += timer->period_us;
+        timer->event = sim_schedule_event(timer->alarm_us, sim_esp_timer_alarm, timer);
+    }
+
+    if (timer->dispatch_method == ESP_TIMER_ISR) {
+        sim_esp_timer_dispatch(timer);
+        return;
+    }
+    if (!timer->pending) {
+        esp_timer_handle_t *link = &pending_head;
+        while (*link != NULL) {
+            link = &(*link)->next_pending;
+        }
+        *link = timer;
+        timer->pending = true;
+    }
+    vTaskNotifyGiveFromISR(esp_timer_task, NULL);
+}
+
+static void sim_esp_timer_task(void *params) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (pending_head != NULL) {
+            esp_timer_handle_t timer = pending_head;
+            sim_esp_timer_unqueue(timer);
+            sim_esp_timer_dispatch(timer);
+        }
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    if (create_args == NULL || create_args->callback == NULL || out_handle == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (esp_timer_task == NULL)
+        esp_timer_task = sim_create_task(sim_esp_timer_task, "esp_timer", SIM_ESP_TIMER_TASK_STACK_SIZE, NULL, SIM_ESP_TIMER_TASK_PRIORITY);
+
+    esp_timer_handle_t timer = calloc(1, sizeof(*timer));
+    if (timer == NULL)
+        return ESP_ERR_NO_MEM;
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+    timer->dispatch_method = create_args->dispatch_method;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t sim_esp_timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    if (timer == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (timer->armed)
+        return ESP_ERR_INVALID_STATE;
+
+    timer->armed = true;
+    timer->period_us = period_us;
+    timer->alarm_us = sim_now_us() + (int64_t)timeout_us;
+    timer->event = sim_schedule_event(timer->alarm_us, sim_esp_timer_alarm, timer);
+    // An alarm in the past fires at once and the esp_timer task preempts the caller
+    sim_preempt_point();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) { return sim_esp_timer_start(timer, timeout_us, 0); }
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    if (period == 0)
+        return ESP_ERR_INVALID_ARG;
+    return sim_esp_timer_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (timer == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (!timer->armed)
+        return ESP_ERR_INVALID_STATE;
+
+    if (timer->event != 0) {
+        sim_cancel_event(timer->event);
+        timer->event = 0;
+    }
+    sim_esp_timer_unqueue(timer);
+    timer->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (timer->armed)
+        return ESP_ERR_INVALID_STATE;
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) { return timer->armed; }
+
+int64_t esp_timer_get_time(void) { return sim_now_us(); }
@@ -0,0 +1,801 @@
+#include "sim_internal.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+static const char *const NOTIFY_WAIT = "notification";
+
+static void *sim_alloc(size_t size) {
+    void *ptr = calloc(1, size);
+    if (ptr == NULL)
+        sim_fatal("out of memory");
+    return ptr;
+}
+
+// Deadline of a blocking call, computed once when it first has to wait
+static inline int64_t sim_deadline(int64_t *deadline, TickType_t ticks) {
+    if (*deadline < 0)
+        *deadline = sim_ticks_deadline(ticks);
+    return *deadline;
+}
+
+static inline BaseType_t sim_woken_higher(const sim_task_t *task) {
+    const sim_task_t *self = sim_current();
+    return task != NULL && (self == NULL || task->priority > self->priority) ? pdTRUE : pdFALSE;
+}
+
+/* --- tasks --- */
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *params, UBaseType_t priority, TaskHandle_t *created) {
+    sim_task_t *task = sim_create_task(fn, name, stack_depth, params, priority);
+    if (created != NULL)
+        *created = task;
+    sim_preempt_point();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *params, UBaseType_t priority,
+                                   TaskHandle_t *created, BaseType_t core_id) {
+    return xTaskCreate(fn, name, stack_depth, params, priority, created);
+}
+
+void vTaskDelete(TaskHandle_t task) { sim_delete_task(task != NULL ? task : sim_current()); }
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        sim_yield();
+        return;
+    }
+    sim_block(NULL, sim_ticks_deadline(ticks), "delay", NULL);
+}
+
+void taskYIELD(void) { sim_yield(); }
+
+TickType_t xTaskGetTickCount(void) { return (TickType_t)(sim_now_us() / sim_tick_us()); }
+
+TickType_t xTaskGetTickCountFromISR(void) { return xTaskGetTickCount(); }
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return sim_current(); }
+
+TaskHandle_t xTaskGetHandle(const char *name) { return sim_find_task(name); }
+
+char *pcTaskGetName(TaskHandle_t task) { return (task != NULL ? task : sim_current())->name; }
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) { return (task != NULL ? task : sim_current())->priority; }
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    sim_task_t *t = task != NULL ? task : sim_current();
+    // An inherited priority is kept until the mutexes are given back
+    if (t->priority == t->base_priority || priority > t->priority)
+        t->priority = priority;
+    t->base_priority = priority;
+    sim_priority_changed(t);
+}
+
+eTaskState eTaskGetState(TaskHandle_t task) {
+    switch (task->state) {
+    case SIM_TASK_RUNNING:
+        return eRunning;
+    case SIM_TASK_READY:
+        return eReady;
+    case SIM_TASK_BLOCKED:
+        return eBlocked;
+    case SIM_TASK_SUSPENDED:
+        return eSuspended;
+    default:
+        return eDeleted;
+    }
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) { return sim_task_stack_unused(task != NULL ? task : sim_current()); }
+
+void vTaskSuspend(TaskHandle_t task) {
+    sim_task_t *t = task != NULL ? task : sim_current();
+    if (t == sim_current()) {
+        sim_block(NULL, SIM_WAIT_FOREVER, "suspended", NULL);
+        return;
+    }
+    if (t->state == SIM_TASK_BLOCKED || t->state == SIM_TASK_READY) {
+        sim_make_ready(t);
+        t->state = SIM_TASK_SUSPENDED;
+    }
+}
+
+void vTaskResume(TaskHandle_t task) {
+    if (task->state == SIM_TASK_SUSPENDED || (task->state == SIM_TASK_BLOCKED && task->wait_what != NULL && strcmp(task->wait_what, "suspended") == 0)) {
+        sim_make_ready(task);
+        sim_preempt_point();
+    }
+}
+
+/* --- notifications --- */
+
+static BaseType_t sim_notify(sim_task_t *task, uint32_t value, eNotifyAction action, uint32_t *previous_value) {
+    if (task == NULL)
+        sim_fatal("notification sent to a NULL task");
+    if (previous_value != NULL)
+        *previous_value = task->notify_value;
+
+    switch (action) {
+    case eSetBits:
+        task->notify_value |= value;
+        break;
+    case eIncrement:
+        task->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notify_value = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (task->notify_pending)
+            return pdFAIL;
+        task->notify_value = value;
+        break;
+    case eNoAction:
+        break;
+    }
+    task->notify_pending = true;
+
+    if (task->state == SIM_TASK_BLOCKED && task->wait_what == NOTIFY_WAIT)
+        sim_make_ready(task);
+    return pdPASS;
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t task, uint32_t value, eNotifyAction action, uint32_t *previous_value) {
+    sim_preempt_point();
+    BaseType_t ret = sim_notify(task, value, action, previous_value);
+    sim_preempt_point();
+    return ret;
+}
+
+BaseType_t xTaskGenericNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, uint32_t *previous_value, BaseType_t *woken) {
+    bool was_waiting = task != NULL && task->state == SIM_TASK_BLOCKED && task->wait_what == NOTIFY_WAIT;
+    BaseType_t ret = sim_notify(task, value, action, previous_value);
+    if (woken != NULL && was_waiting && sim_woken_higher(task))
+        *woken = pdTRUE;
+    return ret;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks) {
+    sim_task_t *self = sim_current();
+    if (!self->notify_pending) {
+        self->notify_value &= ~clear_on_entry;
+        if (ticks != 0)
+            sim_block(NULL, sim_ticks_deadline(ticks), NOTIFY_WAIT, &self->notify_value);
+    }
+
+    if (value != NULL)
+        *value = self->notify_value;
+
+    BaseType_t ret = pdFALSE;
+    if (self->notify_pending) {
+        self->notify_value &= ~clear_on_exit;
+        ret = pdTRUE;
+    }
+    self->notify_pending = false;
+    return ret;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    sim_task_t *self = sim_current();
+    if (self->notify_value == 0 && ticks != 0)
+        sim_block(NULL, sim_ticks_deadline(ticks), NOTIFY_WAIT, &self->notify_value);
+
+    uint32_t value = self->notify_value;
+    if (value != 0)
+        self->notify_value = clear_on_exit ? 0 : value - 1;
+    self->notify_pending = false;
+    return value;
+}
+
+/* --- queues --- */
+
+struct sim_queue {
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head; // index of the oldest item
+    sim_waitq_t senders;
+    sim_waitq_t receivers;
+};
+
+typedef enum { SIM_QUEUE_BACK, SIM_QUEUE_FRONT, SIM_QUEUE_OVERWRITE } sim_queue_pos_e;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct sim_queue *queue = sim_alloc(sizeof(*queue));
+    queue->storage = sim_alloc((size_t)length * (item_size > 0 ? item_size : 1));
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (!sim_waitq_empty(&queue->senders) || !sim_waitq_empty(&queue->receivers))
+        sim_fatal("queue deleted while tasks wait on it");
+    free(queue->storage);
+    free(queue);
+}
+
+static void sim_queue_copy_in(QueueHandle_t queue, const void *item, sim_queue_pos_e pos) {
+    UBaseType_t index;
+    if (pos == SIM_QUEUE_OVERWRITE && queue->count == queue->length) {
+        // Overwrite is only allowed on a queue of length 1, replace its item
+        index = queue->head;
+    } else if (pos == SIM_QUEUE_FRONT) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        index = queue->head;
+        queue->count++;
+    } else {
+        index = (queue->head + queue->count) % queue->length;
+        queue->count++;
+    }
+    if (queue->item_size > 0)
+        memcpy(queue->storage + (size_t)index * queue->item_size, item, queue->item_size);
+}
+
+static void sim_queue_copy_out(QueueHandle_t queue, void *item, bool peek) {
+    if (queue->item_size > 0)
+        memcpy(item, queue->storage + (size_t)queue->head * queue->item_size, queue->item_size);
+    if (!peek) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+    }
+}
+
+static BaseType_t sim_queue_send(QueueHandle_t queue, const void *item, TickType_t ticks, sim_queue_pos_e pos) {
+    if (pos == SIM_QUEUE_OVERWRITE && queue->length != 1)
+        sim_fatal("xQueueOverwrite on a queue of length %u", (unsigned)queue->length);
+
+    sim_preempt_point();
+    int64_t deadline = -1;
+    while (1) {
+        if (queue->count < queue->length || pos == SIM_QUEUE_OVERWRITE) {
+            sim_queue_copy_in(queue, item, pos);
+            sim_wake_one(&queue->receivers);
+            sim_preempt_point();
+            return pdPASS;
+        }
+        if (ticks == 0 || !sim_block(&queue->senders, sim_deadline(&deadline, ticks), "queue send", queue))
+            return errQUEUE_FULL;
+    }
+}
+
+static BaseType_t sim_queue_receive(QueueHandle_t queue, void *item, TickType_t ticks, bool peek) {
+    sim_preempt_point();
+    int64_t deadline = -1;
+    while (1) {
+        if (queue->count > 0) {
+            sim_queue_copy_out(queue, item, peek);
+            if (!peek) {
+                sim_wake_one(&queue->senders);
+                sim_preempt_point();
+            }
+            return pdPASS;
+        }
+        if (ticks == 0 || !sim_block(&queue->receivers, sim_deadline(&deadline, ticks), "queue receive", queue))
+            return errQUEUE_EMPTY;
+    }
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks) { return sim_queue_send(queue, item, ticks, SIM_QUEUE_BACK); }
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks) { return sim_queue_send(queue, item, ticks, SIM_QUEUE_FRONT); }
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) { return sim_queue_send(queue, item, 0, SIM_QUEUE_OVERWRITE); }
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) { return sim_queue_receive(queue, item, ticks, false); }
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks) { return sim_queue_receive(queue, item, ticks, true); }
+
+static BaseType_t sim_queue_send_from_isr(QueueHandle_t queue, const void *item, BaseType_t *woken, sim_queue_pos_e pos) {
+    if (queue->count == queue->length && pos != SIM_QUEUE_OVERWRITE)
+        return errQUEUE_FULL;
+    sim_queue_copy_in(queue, item, pos);
+    sim_task_t *task = sim_wake_one(&queue->receivers);
+    if (woken != NULL && sim_woken_higher(task))
+        *woken = pdTRUE;
+    return pdPASS;
+}
+
+BaseType_t xQueueSendToBackFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken) {
+    return sim_queue_send_from_isr(queue, item, woken, SIM_QUEUE_BACK);
+}
+
+BaseType_t xQueueOverwriteFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken) {
+    return sim_queue_send_from_isr(queue, item, woken, SIM_QUEUE_OVERWRITE);
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t queue, void *item, BaseType_t *woken) {
+    if (queue->count == 0)
+        return errQUEUE_EMPTY;
+    sim_queue_copy_out(queue, item, false);
+    sim_task_t *task = sim_wake_one(&queue->senders);
+    if (woken != NULL && sim_woken_higher(task))
+        *woken = pdTRUE;
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return queue->count; }
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) { return queue->length - queue->count; }
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    queue->count = 0;
+    queue->head = 0;
+    sim_wake_one(&queue->senders);
+    sim_preempt_point();
+    return pdPASS;
+}
+
+/* --- semaphores and mutexes --- */
+
+typedef enum { SIM_SEM_BINARY, SIM_SEM_COUNTING, SIM_SEM_MUTEX, SIM_SEM_RECURSIVE_MUTEX } sim_sem_type_e;
+
+struct sim_sem {
+    sim_sem_type_e type;
+    UBaseType_t count;
+    UBaseType_t max_count;
+    sim_task_t *holder;
+    UBaseType_t recursion;
+    sim_waitq_t waiters;
+    uint32_t lock_class;                    // mutexes: 1 + creation index, 0 when not checked
+    char creator[configMAX_TASK_NAME_LEN]; // task that created the mutex, names it in reports
+};
+
+// lock_order[a][b]: a task took mutex class b while holding class a
+static bool lock_order[SIM_LOCK_CLASSES][SIM_LOCK_CLASSES];
+static uint32_t lock_class_count;
+static uint32_t lock_order_violations;
+
+static SemaphoreHandle_t sim_sem_create(sim_sem_type_e type, UBaseType_t max_count, UBaseType_t initial_count) {
+    struct sim_sem *sem = sim_alloc(sizeof(*sem));
+    sem->type = type;
+    sem->max_count = max_count;
+    sem->count = initial_count;
+    if ((type == SIM_SEM_MUTEX || type == SIM_SEM_RECURSIVE_MUTEX) && lock_class_count < SIM_LOCK_CLASSES) {
+        sem->lock_class = ++lock_class_count;
+        const sim_task_t *self = sim_current();
+        snprintf(sem->creator, sizeof(sem->creator), "%s", self != NULL ? self->name : "startup");
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return sim_sem_create(SIM_SEM_MUTEX, 1, 1); }
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) { return sim_sem_create(SIM_SEM_RECURSIVE_MUTEX, 1, 1); }
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) { return sim_sem_create(SIM_SEM_BINARY, 1, 0); }
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    return sim_sem_create(SIM_SEM_COUNTING, max_count, initial_count);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    if (!sim_waitq_empty(&sem->waiters))
+        sim_fatal("semaphore deleted while tasks wait on it");
+    free(sem);
+}
+
+static inline bool sim_is_mutex(SemaphoreHandle_t sem) { return sem->type == SIM_SEM_MUTEX || sem->type == SIM_SEM_RECURSIVE_MUTEX; }
+
+// Priority of a mutex holder: its own, raised to the highest task waiting for the mutex
+static void sim_mutex_update_inheritance(SemaphoreHandle_t sem) {
+    sim_task_t *holder = sem->holder;
+    if (holder == NULL)
+        return;
+    UBaseType_t priority = holder->base_priority;
+    for (sim_task_t *t = sem->waiters.head; t != NULL; t = t->wait_next) {
+        if (t->priority > priority)
+            priority = t->priority;
+    }
+    if (priority > holder->priority || holder->mutexes_held == 1)
+        holder->priority = priority;
+}
+
+// Record the order of the mutexes held by self and sem, a pair taken both ways round can deadlock even if it did not yet
+static void sim_lock_order_check(sim_task_t *self, SemaphoreHandle_t sem) {
+    uint32_t b = sem->lock_class;
+    uint32_t held = self->mutexes_held < SIM_TASK_MAX_HELD ? self->mutexes_held : SIM_TASK_MAX_HELD;
+    for (uint32_t i = 0; i < held && b != 0; i++) {
+        uint32_t a = self->held[i]->lock_class;
+        if (a == 0 || a == b || lock_order[a - 1][b - 1])
+            continue;
+        lock_order[a - 1][b - 1] = true;
+        if (lock_order[b - 1][a - 1]) {
+            lock_order_violations++;
+            fprintf(stderr, "SIM LOCK ORDER at %" PRId64 " us: %s takes mutex %" PRIu32 " (created by %s) holding mutex %" PRIu32
+                            " (created by %s), they were taken the other way round before\n",
+                    sim_now_us(), self->name, b, sem->creator, a, self->held[i]->creator);
+        }
+    }
+}
+
+static void sim_mutex_acquired(sim_task_t *self, SemaphoreHandle_t sem) {
+    sem->holder = self;
+    sem->recursion = 1;
+    if (self->mutexes_held < SIM_TASK_MAX_HELD)
+        self->held[self->mutexes_held] = sem;
+    self->mutexes_held++;
+}
+
+static void sim_mutex_released(sim_task_t *self, SemaphoreHandle_t sem) {
+    uint32_t held = self->mutexes_held < SIM_TASK_MAX_HELD ? self->mutexes_held : SIM_TASK_MAX_HELD;
+    for (uint32_t i = 0; i < held; i++) {
+        if (self->held[i] == sem) {
+            memmove(&self->held[i], &self->held[i + 1], (held - i - 1) * sizeof(self->held[0]));
+            break;
+        }
+    }
+    sem->holder = NULL;
+    self->mutexes_held--;
+}
+
+static BaseType_t sim_sem_take(SemaphoreHandle_t sem, TickType_t ticks) {
+    sim_task_t *self = sim_current();
+    if (sim_is_mutex(sem) && (self == NULL || sim_in_isr()))
+        sim_fatal("mutex taken from an interrupt");
+
+    sim_preempt_point();
+    if (sem->type == SIM_SEM_RECURSIVE_MUTEX && sem->holder == self) {
+        sem->recursion++;
+        return pdTRUE;
+    }
+    if (sim_is_mutex(sem))
+        sim_lock_order_check(self, sem);
+
+    int64_t deadline = -1;
+    while (1) {
+        if (sem->count > 0) {
+            sem->count--;
+            if (sim_is_mutex(sem))
+                sim_mutex_acquired(self, sem);
+            return pdTRUE;
+        }
+        if (ticks == 0)
+            return pdFALSE;
+
+        if (sim_is_mutex(sem) && sem->holder->priority < self->priority)
+            sem->holder->priority = self->priority;
+        if (!sim_block(&sem->waiters, sim_deadline(&deadline, ticks), sim_is_mutex(sem) ? "mutex" : "semaphore", sem)) {
+            if (sim_is_mutex(sem))
+                sim_mutex_update_inheritance(sem);
+            return pdFALSE;
+        }
+    }
+}
+
+static BaseType_t sim_sem_give(SemaphoreHandle_t sem) {
+    sim_task_t *self = sim_current();
+    if (sim_is_mutex(sem)) {
+        if (sem->holder != self)
+            sim_fatal("mutex given by %s, it is held by %s", self != NULL ? self->name : "an interrupt",
+                      sem->holder != NULL ? sem->holder->name : "nobody");
+        if (sem->type == SIM_SEM_RECURSIVE_MUTEX && --sem->recursion > 0)
+            return pdTRUE;
+
+        sim_mutex_released(self, sem);
+        // Like FreeRTOS the inherited priority is only dropped once the task holds no mutex at all
+        if (self->mutexes_held == 0)
+            self->priority = self->base_priority;
+    } else if (sem->count >= sem->max_count) {
+        return pdFALSE;
+    }
+
+    sem->count++;
+    sim_wake_one(&sem->waiters);
+    sim_preempt_point();
+    return pdTRUE;
+}
+
+uint32_t sim_lock_order_violations(void) { return lock_order_violations; }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    if (sem->type == SIM_SEM_RECURSIVE_MUTEX)
+        sim_fatal("xSemaphoreTake on a recursive mutex");
+    return sim_sem_take(sem, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    if (sem->type == SIM_SEM_RECURSIVE_MUTEX)
+        sim_fatal("xSemaphoreGive on a recursive mutex");
+    return sim_sem_give(sem);
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks) { return sim_sem_take(sem, ticks); }
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) { return sim_sem_give(sem); }
+
+BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t sem, BaseType_t *woken) {
+    if (sim_is_mutex(sem))
+        sim_fatal("mutex taken from an interrupt");
+    if (sem->count == 0)
+        return pdFALSE;
+    sem->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken) {
+    if (sim_is_mutex(sem))
+        sim_fatal("mutex given from an interrupt");
+    if (sem->count >= sem->max_count)
+        return pdFALSE;
+    sem->count++;
+    sim_task_t *task = sim_wake_one(&sem->waiters);
+    if (woken != NULL && sim_woken_higher(task))
+        *woken = pdTRUE;
+    return pdTRUE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem) { return sem->count; }
+
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t sem) { return sem->holder; }
+
+/* --- event groups --- */
+
+struct sim_event_group {
+    EventBits_t bits;
+    sim_waitq_t waiters; // all woken on every change, each checks its own condition
+};
+
+EventGroupHandle_t xEventGroupCreate(void) { return sim_alloc(sizeof(struct sim_event_group)); }
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    if (!sim_waitq_empty(&group->waiters))
+        sim_fatal("event group deleted with tasks waiting on it");
+    free(group);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    group->bits |= bits;
+    EventBits_t set = group->bits;
+    sim_wake_all(&group->waiters);
+    sim_preempt_point();
+    return set;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) { return group->bits; }
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t ticks) {
+    sim_preempt_point();
+    int64_t deadline = -1;
+    while (1) {
+        EventBits_t current = group->bits;
+        bool met = wait_for_all ? (current & bits) == bits : (current & bits) != 0;
+        if (met) {
+            if (clear_on_exit)
+                group->bits &= ~bits;
+            return current;
+        }
+        if (ticks == 0 || !sim_block(&group->waiters, sim_deadline(&deadline, ticks), "event group", group))
+            return group->bits;
+    }
+}
+
+/* --- software timers --- */
+
+/*
+    Same structure as the FreeRTOS timer service: the API only sends commands to a queue of
+    configTIMER_QUEUE_LENGTH entries, the "Tmr Svc" task applies them in order and runs the callbacks.
+    A timer is active only once its start command has been processed, and a start that is processed late
+    still counts its period from the tick it was sent at.
+*/
+
+typedef enum {
+    SIM_TIMER_CMD_START = 0,
+    SIM_TIMER_CMD_RESET,
+    SIM_TIMER_CMD_STOP,
+    SIM_TIMER_CMD_CHANGE_PERIOD,
+    SIM_TIMER_CMD_DELETE,
+    SIM_TIMER_CMD_PEND_CALL,
+} sim_timer_cmd_e;
+
+struct sim_timer {
+    const char *name;
+    TickType_t period;
+    bool auto_reload;
+    void *timer_id;
+    TimerCallbackFunction_t callback;
+    bool active;
+    TickType_t expiry;
+    struct sim_timer *next_active; // active timers sorted by expiry
+};
+
+typedef struct {
+    sim_timer_cmd_e cmd;
+    TimerHandle_t timer;
+    TickType_t value; // tick the command was sent at, new period for SIM_TIMER_CMD_CHANGE_PERIOD
+    PendedFunction_t fn;
+    void *param1;
+    uint32_t param2;
+} sim_timer_msg_t;
+
+static QueueHandle_t timer_queue;
+static TimerHandle_t active_timers;
+
+static void sim_timer_unlink(TimerHandle_t timer) {
+    for (TimerHandle_t *link = &active_timers; *link != NULL; link = &(*link)->next_active) {
+        if (*link == timer) {
+            *link = timer->next_active;
+            break;
+        }
+    }
+    timer->next_active = NULL;
+}
+
+static void sim_timer_insert(TimerHandle_t timer, TickType_t expiry) {
+    sim_timer_unlink(timer);
+    timer->expiry = expiry;
+    timer->active = true;
+    TimerHandle_t *link = &active_timers;
+    while (*link != NULL && (int32_t)((*link)->expiry - expiry) <= 0) {
+        link = &(*link)->next_active;
+    }
+    timer->next_active = *link;
+    *link = timer;
+}
+
+// Expiry of a timer at tick `expired_at`, a late auto-reload timer catches up on the periods it missed
+static void sim_timer_expire(TimerHandle_t timer, TickType_t expired_at, TickType_t now) {
+    sim_timer_unlink(timer);
+    if (timer->auto_reload) {
+        TickType_t expiry = expired_at + timer->period;
+        while ((int32_t)(expiry - now) <= 0) {
+            timer->callback(timer);
+            expiry += timer->period;
+        }
+        sim_timer_insert(timer, expiry);
+    } else {
+        timer->active = false;
+    }
+    timer->callback(timer);
+}
+
+static void sim_timer_process(const sim_timer_msg_t *msg) {
+    TickType_t now = xTaskGetTickCount();
+    TimerHandle_t timer = msg->timer;
+
+    switch (msg->cmd) {
+    case SIM_TIMER_CMD_START:
+    case SIM_TIMER_CMD_RESET: {
+        TickType_t expiry = msg->value + timer->period;
+        if ((int32_t)(expiry - now) <= 0) {
+            // Expired before the command was processed
+            timer->active = true;
+            sim_timer_expire(timer, expiry, now);
+        } else {
+            sim_timer_insert(timer, expiry);
+        }
+        break;
+    }
+    case SIM_TIMER_CMD_STOP:
+        sim_timer_unlink(timer);
+        timer->active = false;
+        break;
+    case SIM_TIMER_CMD_CHANGE_PERIOD:
+        timer->period = msg->value;
+        sim_timer_insert(timer, now + timer->period);
+        break;
+    case SIM_TIMER_CMD_DELETE:
+        sim_timer_unlink(timer);
+        free(timer);
+        break;
+    case SIM_TIMER_CMD_PEND_CALL:
+        msg->fn(msg->param1, msg->param2);
+        break;
+    }
+}
+
+static void sim_timer_task(void *params) {
+    sim_timer_msg_t msg;
+    while (1) {
+        TickType_t now = xTaskGetTickCount();
+        if (active_timers != NULL && (int32_t)(active_timers->expiry - now) <= 0) {
+            sim_timer_expire(active_timers, active_timers->expiry, now);
+        } else {
+            TickType_t wait = active_timers != NULL ? active_timers->expiry - now : portMAX_DELAY;
+            // Wait without taking the command, it is processed below with the others
+            if (xQueuePeek(timer_queue, &msg, wait) != pdTRUE)
+                continue;
+        }
+
+        while (xQueueReceive(timer_queue, &msg, 0) == pdTRUE) {
+            sim_timer_process(&msg);
+        }
+    }
+}
+
+static void sim_timer_service_start(void) {
+    if (timer_queue != NULL)
+        return;
+    timer_queue = xQueueCreate(configTIMER_QUEUE_LENGTH, sizeof(sim_timer_msg_t));
+    sim_create_task(sim_timer_task, "Tmr Svc", configTIMER_TASK_STACK_DEPTH, NULL, configTIMER_TASK_PRIORITY);
+}
+
+static BaseType_t sim_timer_command(const sim_timer_msg_t *msg, TickType_t ticks) {
+    sim_timer_service_start();
+    if (sim_in_isr())
+        return xQueueSendToBackFromISR(timer_queue, msg, NULL);
+    return xQueueSendToBack(timer_queue, msg, ticks);
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *timer_id, TimerCallbackFunction_t callback) {
+    if (period == 0)
+        sim_fatal("timer %s created with a zero period", name);
+    sim_timer_service_start();
+
+    TimerHandle_t timer = sim_alloc(sizeof(*timer));
+    timer->name = name;
+    timer->period = period;
+    timer->auto_reload = auto_reload != pdFALSE;
+    timer->timer_id = timer_id;
+    timer->callback = callback;
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks) {
+    sim_timer_msg_t msg = {.cmd = SIM_TIMER_CMD_START, .timer = timer, .value = xTaskGetTickCount()};
+    return sim_timer_command(&msg, ticks);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks) {
+    sim_timer_msg_t msg = {.cmd = SIM_TIMER_CMD_STOP, .timer = timer};
+    return sim_timer_command(&msg, ticks);
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks) {
+    sim_timer_msg_t msg = {.cmd = SIM_TIMER_CMD_RESET, .timer = timer, .value = xTaskGetTickCount()};
+    return sim_timer_command(&msg, ticks);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks) {
+    if (period == 0)
+        sim_fatal("timer %s period changed to zero", timer->name);
+    sim_timer_msg_t msg = {.cmd = SIM_TIMER_CMD_CHANGE_PERIOD, .timer = timer, .value = period};
+    return sim_timer_command(&msg, ticks);
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks) {
+    sim_timer_msg_t msg = {.cmd = SIM_TIMER_CMD_DELETE, .timer = timer};
+    return sim_timer_command(&msg, ticks);
+}
+
+BaseType_t xTimerStartFromISR(TimerHandle_t timer, BaseType_t *woken) { return xTimerStart(timer, 0); }
+
+BaseType_t xTimerStopFromISR(TimerHandle_t timer, BaseType_t *woken) { return xTimerStop(timer, 0); }
+
+BaseType_t xTimerResetFromISR(TimerHandle_t timer, BaseType_t *woken) { return xTimerReset(timer, 0); }
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer) { return timer->active ? pdTRUE : pdFALSE; }
+
+void *pvTimerGetTimerID(TimerHandle_t timer) { return timer->timer_id; }
+
+void vTimerSetTimerID(TimerHandle_t timer, void *timer_id) { timer->timer_id = timer_id; }
+
+const char *pcTimerGetName(TimerHandle_t timer) { return timer->name; }
+
+TickType_t xTimerGetPeriod(TimerHandle_t timer) { return timer->period; }
+
+TickType_t xTimerGetExpiryTime(TimerHandle_t timer) { return timer->expiry; }
+
+BaseType_t xTimerPendFunctionCall(PendedFunction_t fn, void *param1, uint32_t param2, TickType_t ticks) {
+    sim_timer_msg_t msg = {.cmd = SIM_TIMER_CMD_PEND_CALL, .fn = fn, .param1 = param1, .param2 = param2};
+    return sim_timer_command(&msg, ticks);
+}
+
+BaseType_t xTimerPendFunctionCallFromISR(PendedFunction_t fn, void *param1, uint32_t param2, BaseType_t *woken) {
+    return xTimerPendFunctionCall(fn, param1, param2, 0);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// Scheduler internals shared by the stand-ins, not part of the host API
+
+#include <stdint.h>
+#include <ucontext.h>
+
+#include "freertos/FreeRTOS.h"
+#include "sim.h"
+
+#define SIM_WAIT_FOREVER INT64_MAX
+#define SIM_TASK_MAX_HELD 8
+// Mutexes the lock order check tells apart, later ones are not checked
+#define SIM_LOCK_CLASSES 64
+
+typedef enum {
+    SIM_TASK_READY = 0,
+    SIM_TASK_RUNNING,
+    SIM_TASK_BLOCKED,
+    SIM_TASK_SUSPENDED,
+    SIM_TASK_DELETED,
+} sim_task_state_e;
+
+struct sim_task;
+
+// Tasks blocked on one object, woken highest priority first (FIFO among equal priorities)
+typedef struct {
+    struct sim_task *head;
+} sim_waitq_t;
+
+struct sim_task {
+    ucontext_t ctx;
+    char name[configMAX_TASK_NAME_LEN];
+    TaskFunction_t fn;
+    void *params;
+    UBaseType_t base_priority;
+    UBaseType_t priority; // raised above base_priority by mutex priority inheritance
+    sim_task_state_e state;
+    uint64_t ready_seq; // order among ready tasks of equal priority
+
+    // blocking
+    int64_t wake_us; // timeout, SIM_WAIT_FOREVER without one
+    sim_waitq_t *waitq;
+    struct sim_task *wait_next;
+    const char *wait_what;
+    const void *wait_obj;
+    bool timed_out;
+
+    // notification (index 0)
+    uint32_t notify_value;
+    bool notify_pending;
+
+    // mutexes currently held, for priority inheritance and the lock order check (the first SIM_TASK_MAX_HELD of them)
+    uint32_t mutexes_held;
+    SemaphoreHandle_t held[SIM_TASK_MAX_HELD];
+
+    uint8_t *stack;
+    uint32_t stack_requested;
+
+    struct sim_task *next; // all tasks
+};
+
+typedef struct sim_task sim_task_t;
+
+sim_task_t *sim_current(void);
+// Create a ready task, the caller decides when to call sim_preempt_point
+sim_task_t *sim_create_task(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *params, UBaseType_t priority);
+sim_task_t *sim_find_task(const char *name);
+void sim_delete_task(sim_task_t *task);
+// Stack high water mark in bytes, measured against the requested stack size
+uint32_t sim_task_stack_unused(const sim_task_t *task);
+
+// Block the running task on q (may be NULL) until woken or until wake_us, returns false on timeout
+bool sim_block(sim_waitq_t *q, int64_t wake_us, const char *what, const void *obj);
+// Make a blocked task ready, the caller decides when to call sim_preempt_point
+void sim_make_ready(sim_task_t *task);
+sim_task_t *sim_wake_one(sim_waitq_t *q);
+void sim_wake_all(sim_waitq_t *q);
+bool sim_waitq_empty(const sim_waitq_t *q);
+// Give the CPU to a higher priority ready task, applies the random schedule perturbations
+void sim_preempt_point(void);
+// Voluntary yield to tasks of the same priority
+void sim_yield(void);
+// Reschedule after a priority change of a ready task
+void sim_priority_changed(sim_task_t *task);
+
+// Absolute wake time of a timeout given in ticks (aligned to tick boundaries like the FreeRTOS tick interrupt)
+int64_t sim_ticks_deadline(TickType_t ticks);
+int64_t sim_tick_us(void);
+bool sim_in_critical(void);
+// Abort with a message and the task list, for API misuse that would crash or assert on the target
+void sim_fatal(const char *format, ...) __attribute__((format(printf, 1, 2), noreturn));
+void sim_request_restart(void) __attribute__((noreturn));
@@ -0,0 +1,312 @@
+#include "sim_internal.h"
+
+#include <stdlib.h>
+
+#include "driver/ledc.h"
+
+// Ranges a multi-segment fade may have, like SOC_LEDC_GAMMA_CURVE_FADE_RANGE_MAX of the ESP32-C6/H2
+#define SIM_LEDC_FADE_RANGE_MAX 16
+
+typedef struct {
+    uint32_t freq_hz;
+    uint32_t max_duty;
+} sim_ledc_timer_t;
+
+typedef struct {
+    uint32_t duty;     // output while not fading
+    uint32_t set_duty; // written by ledc_set_duty, output from ledc_update_duty on
+    bool fading;
+    uint32_t fade_from;
+    uint32_t fade_to;
+    int64_t fade_start_us;
+    uint32_t fade_us;
+    uint32_t fade_end_event;
+    uint32_t freq_hz;   // of the timer the channel is bound to
+    uint32_t max_duty;
+    uint8_t fade_ranges; // ranges of a running multi-segment fade, 0 for a linear fade
+    ledc_fade_param_config_t ranges[SIM_LEDC_FADE_RANGE_MAX];
+    bool fade_prepared; // ledc_set_fade_with_time / ledc_set_multi_fade called, waiting for ledc_fade_start
+    uint32_t prepared_target;
+    uint32_t prepared_ms;
+    uint32_t prepared_start;
+    uint8_t prepared_ranges;
+    ledc_fade_param_config_t prepared_list[SIM_LEDC_FADE_RANGE_MAX];
+    ledc_cb_t fade_cb;
+    void *fade_cb_arg;
+    sim_waitq_t fade_waiters; // tasks blocked until the running fade releases the channel
+} sim_ledc_channel_t;
+
+static sim_ledc_timer_t timers[LEDC_TIMER_MAX];
+static sim_ledc_channel_t channels[LEDC_CHANNEL_MAX];
+static bool fade_installed;
+
+static sim_ledc_event_t *events;
+static size_t event_count;
+static size_t event_capacity;
+static sim_ledc_listener_t listener;
+static void *listener_arg;
+
+static void sim_ledc_record(sim_ledc_event_e type, ledc_channel_t channel, uint32_t duty, uint32_t target, uint32_t fade_us) {
+    if (event_count == event_capacity) {
+        event_capacity = event_capacity > 0 ? event_capacity * 2 : 1024;
+        events = realloc(events, event_capacity * sizeof(*events));
+        if (events == NULL)
+            sim_fatal("out of memory recording LEDC events");
+    }
+    sim_ledc_event_t *event = &events[event_count++];
+    *event = (sim_ledc_event_t){
+        .time_us = sim_now_us(), .type = type, .channel = channel, .duty = duty, .target = target, .fade_us = fade_us};
+    if (listener != NULL)
+        listener(event, listener_arg);
+}
+
+// Duty of a multi-segment fade after `cycles` PWM cycles, the duty changes at the end of every step
+static uint32_t sim_ledc_ranges_duty(uint32_t start, const ledc_fade_param_config_t *ranges, uint8_t count, uint64_t cycles) {
+    int64_t duty = start;
+    for (uint8_t i = 0; i < count; i++) {
+        uint64_t range_cycles = (uint64_t)ranges[i].step_num * ranges[i].cycle_num;
+        uint64_t steps = cycles >= range_cycles ? ranges[i].step_num : cycles / ranges[i].cycle_num;
+        int64_t change = (int64_t)(steps * ranges[i].scale);
+        duty += ranges[i].dir == LEDC_DUTY_DIR_INCREASE ? change : -change;
+        if (cycles < range_cycles)
+            break;
+        cycles -= range_cycles;
+    }
+    return (uint32_t)duty;
+}
+
+static uint32_t sim_ledc_current(const sim_ledc_channel_t *ch) {
+    if (!ch->fading)
+        return ch->duty;
+    int64_t elapsed_us = sim_now_us() - ch->fade_start_us;
+    if (elapsed_us >= ch->fade_us)
+        return ch->fade_to;
+    if (ch->fade_ranges > 0)
+        return sim_ledc_ranges_duty(ch->fade_from, ch->ranges, ch->fade_ranges, (uint64_t)elapsed_us * ch->freq_hz / 1000000);
+    int64_t delta = (int64_t)ch->fade_to - (int64_t)ch->fade_from;
+    return (uint32_t)((int64_t)ch->fade_from + delta * elapsed_us / ch->fade_us);
+}
+
+static sim_ledc_channel_t *sim_ledc_channel(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    if (speed_mode >= LEDC_SPEED_MODE_MAX || channel >= LEDC_CHANNEL_MAX)
+        return NULL;
+    return &channels[channel];
+}
+
+// Like the driver with the fade service installed, a channel is only changed once its running fade has released it
+static void sim_ledc_acquire(sim_ledc_channel_t *ch) {
+    while (fade_installed && ch->fading) {
+        sim_block(&ch->fade_waiters, SIM_WAIT_FOREVER, "ledc fade", ch);
+    }
+}
+
+static void sim_ledc_fade_end(void *arg) {
+    sim_ledc_channel_t *ch = arg;
+    ledc_channel_t channel = (ledc_channel_t)(ch - channels);
+
+    ch->fade_end_event = 0;
+    ch->fading = false;
+    ch->duty = ch->fade_to;
+    ch->set_duty = ch->fade_to;
+    sim_ledc_record(SIM_LEDC_FADE_END, channel, ch->duty, 0, 0);
+    sim_wake_all(&ch->fade_waiters);
+
+    if (ch->fade_cb != NULL) {
+        ledc_cb_param_t param = {.event = LEDC_FADE_END_EVT, .speed_mode = LEDC_LOW_SPEED_MODE, .channel = channel, .duty = ch->duty};
+        ch->fade_cb(&param, ch->fade_cb_arg);
+    }
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf) {
+    if (timer_conf == NULL || timer_conf->speed_mode >= LEDC_SPEED_MODE_MAX || timer_conf->timer_num >= LEDC_TIMER_MAX)
+        return ESP_ERR_INVALID_ARG;
+    if (timer_conf->freq_hz == 0 || timer_conf->duty_resolution >= LEDC_TIMER_BIT_MAX)
+        return ESP_ERR_INVALID_ARG;
+    timers[timer_conf->timer_num] = (sim_ledc_timer_t){.freq_hz = timer_conf->freq_hz, .max_duty = 1u << timer_conf->duty_resolution};
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf) {
+    sim_ledc_channel_t *ch = sim_ledc_channel(ledc_conf->speed_mode, ledc_conf->channel);
+    if (ch == NULL || ledc_conf->timer_sel >= LEDC_TIMER_MAX)
+        return ESP_ERR_INVALID_ARG;
+    ch->freq_hz = timers[ledc_conf->timer_sel].freq_hz;
+    ch->max_duty = timers[ledc_conf->timer_sel].max_duty;
+    ch->duty = ledc_conf->duty;
+    ch->set_duty = ledc_conf->duty;
+    sim_ledc_record(SIM_LEDC_DUTY, ledc_conf->channel, ch->duty, 0, 0);
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags) {
+    if (fade_installed)
+        return ESP_ERR_INVALID_STATE;
+    fade_installed = true;
+    return ESP_OK;
+}
+
+void ledc_fade_func_uninstall(void) { fade_installed = false; }
+
+esp_err_t ledc_cb_register(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_cbs_t *cbs, void *user_arg) {
+    sim_ledc_channel_t *ch = sim_ledc_channel(speed_mode, channel);
+    if (ch == NULL || cbs == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (!fade_installed)
+        return ESP_ERR_INVALID_STATE;
+    ch->fade_cb = cbs->fade_cb;
+    ch->fade_cb_arg = user_arg;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty) {
+    sim_ledc_channel_t *ch = sim_ledc_channel(speed_mode, channel);
+    if (ch == NULL)
+        return ESP_ERR_INVALID_ARG;
+    sim_ledc_acquire(ch);
+    ch->set_duty = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    sim_ledc_channel_t *ch = sim_ledc_channel(speed_mode, channel);
+    if (ch == NULL)
+        return ESP_ERR_INVALID_ARG;
+    ch->duty = ch->set_duty;
+    sim_ledc_record(SIM_LEDC_DUTY, channel, ch->duty, 0, 0);
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    sim_ledc_channel_t *ch = sim_ledc_channel(speed_mode, channel);
+    return ch != NULL ? sim_ledc_current(ch) : 0;
+}
+
+esp_err_t ledc_set_fade_with_time(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty, int max_fade_time_ms) {
+    sim_ledc_channel_t *ch = sim_ledc_channel(speed_mode, channel);
+    if (ch == NULL || max_fade_time_ms < 0)
+        return ESP_ERR_INVALID_ARG;
+    if (!fade_installed)
+        return ESP_ERR_INVALID_STATE;
+    sim_ledc_acquire(ch);
+    ch->fade_prepared = true;
+    ch->prepared_target = target_duty;
+    ch->prepared_ms = (uint32_t)max_fade_time_ms;
+    ch->prepared_ranges = 0;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_multi_fade(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t start_duty, const ledc_fade_param_config_t *fade_params_list,
+                              uint32_t list_len) {
+    sim_ledc_channel_t *ch = sim_ledc_channel(speed_mode, channel);
+    if (ch == NULL || fade_params_list == NULL || list_len == 0 || list_len > SIM_LEDC_FADE_RANGE_MAX || ch->freq_hz == 0)
+        return ESP_ERR_INVALID_ARG;
+    if (!fade_installed)
+        return ESP_ERR_INVALID_STATE;
+
+    // Ranges without steps or cycles are rejected, and so is a duty leaving the timer range at any step
+    int64_t duty = start_duty;
+    for (uint32_t i = 0; i < list_len; i++) {
+        if (fade_params_list[i].step_num == 0 || fade_params_list[i].cycle_num == 0)
+            return ESP_ERR_INVALID_ARG;
+        int64_t change = (int64_t)fade_params_list[i].step_num * fade_params_list[i].scale;
+        duty += fade_params_list[i].dir == LEDC_DUTY_DIR_INCREASE ? change : -change;
+        if (duty < 0 || duty > ch->max_duty)
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    sim_ledc_acquire(ch);
+    ch->fade_prepared = true;
+    ch->prepared_start = start_duty;
+    ch->prepared_ranges = (uint8_t)list_len;
+    for (uint32_t i = 0; i < list_len; i++) {
+        ch->prepared_list[i] = fade_params_list[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_start(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_fade_mode_t fade_mode) {
+    sim_ledc_channel_t *ch = sim_ledc_channel(speed_mode, channel);
+    if (ch == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (!fade_installed || !ch->fade_prepared)
+        return ESP_ERR_INVALID_STATE;
+
+    ch->fade_prepared = false;
+    ch->fade_start_us = sim_now_us();
+    ch->fade_ranges = ch->prepared_ranges;
+    if (ch->fade_ranges > 0) {
+        // A multi-segment fade starts from its own start duty and lasts as many PWM cycles as its ranges add up to
+        uint64_t cycles = 0;
+        for (uint8_t i = 0; i < ch->fade_ranges; i++) {
+            ch->ranges[i] = ch->prepared_list[i];
+            cycles += (uint64_t)ch->ranges[i].step_num * ch->ranges[i].cycle_num;
+        }
+        ch->fade_from = ch->prepared_start;
+        ch->fade_to = sim_ledc_ranges_duty(ch->fade_from, ch->ranges, ch->fade_ranges, cycles);
+        ch->fade_us = (uint32_t)((cycles * 1000000 + ch->freq_hz - 1) / ch->freq_hz);
+    } else {
+        ch->fade_from = sim_ledc_current(ch);
+        ch->fade_to = ch->prepared_target;
+        ch->fade_us = ch->prepared_ms * 1000;
+    }
+    ch->fading = true;
+    sim_ledc_record(SIM_LEDC_FADE_START, channel, ch->fade_from, ch->fade_to, ch->fade_us);
+    ch->fade_end_event = sim_schedule_event(ch->fade_start_us + ch->fade_us, sim_ledc_fade_end, ch);
+
+    if (fade_mode == LEDC_FADE_WAIT_DONE) {
+        sim_ledc_acquire(ch);
+    } else {
+        sim_preempt_point();
+    }
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_stop(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    sim_ledc_channel_t *ch = sim_ledc_channel(speed_mode, channel);
+    if (ch == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (!fade_installed)
+        return ESP_ERR_INVALID_STATE;
+    if (!ch->fading)
+        return ESP_OK;
+
+    // The fade end interrupt of a stopped fade is not raised
+    ch->duty = sim_ledc_current(ch);
+    ch->set_duty = ch->duty;
+    ch->fading = false;
+    sim_cancel_event(ch->fade_end_event);
+    ch->fade_end_event = 0;
+    sim_ledc_record(SIM_LEDC_FADE_STOP, channel, ch->duty, 0, 0);
+    sim_wake_all(&ch->fade_waiters);
+    sim_preempt_point();
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty_and_update(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty, uint32_t hpoint) {
+    esp_err_t err = ledc_set_duty(speed_mode, channel, duty);
+    return err == ESP_OK ? ledc_update_duty(speed_mode, channel) : err;
+}
+
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty, uint32_t max_fade_time_ms,
+                                       ledc_fade_mode_t fade_mode) {
+    esp_err_t err = ledc_set_fade_with_time(speed_mode, channel, target_duty, (int)max_fade_time_ms);
+    return err == ESP_OK ? ledc_fade_start(speed_mode, channel, fade_mode) : err;
+}
+
+// --- host API ---
+
+const sim_ledc_event_t *sim_ledc_events(size_t *count) {
+    *count = event_count;
+    return events;
+}
+
+void sim_ledc_clear_events(void) { event_count = 0; }
+
+uint32_t sim_ledc_duty(uint8_t channel) { return channel < LEDC_CHANNEL_MAX ? sim_ledc_current(&channels[channel]) : 0; }
+
+bool sim_ledc_fading(uint8_t channel) { return channel < LEDC_CHANNEL_MAX && channels[channel].fading; }
+
+void sim_ledc_set_listener(sim_ledc_listener_t fn, void *arg) {
+    listener_arg = arg;
+    listener = fn;
+}
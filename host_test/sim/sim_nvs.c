@@ -0,0 +1,370 @@
+#include "sim_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define SIM_NVS_MAX_HANDLES 8
+#define SIM_NVS_NAMESPACE_MAX_SIZE 16
+#define SIM_NVS_FILE_MAGIC 0x53564e53u // "SNVS"
+
+typedef enum {
+    SIM_NVS_TYPE_U8 = 0x01,
+    SIM_NVS_TYPE_U16 = 0x02,
+    SIM_NVS_TYPE_U32 = 0x04,
+    SIM_NVS_TYPE_I32 = 0x14,
+    SIM_NVS_TYPE_STR = 0x21,
+    SIM_NVS_TYPE_BLOB = 0x42,
+} sim_nvs_type_e;
+
+typedef struct sim_nvs_entry {
+    char namespace_name[SIM_NVS_NAMESPACE_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t type;
+    uint32_t length;
+    uint8_t *data;
+    struct sim_nvs_entry *next;
+} sim_nvs_entry_t;
+
+typedef struct {
+    bool used;
+    bool read_only;
+    char namespace_name[SIM_NVS_NAMESPACE_MAX_SIZE];
+} sim_nvs_handle_t;
+
+static bool initialized;
+static sim_nvs_entry_t *entries;
+static sim_nvs_handle_t handles[SIM_NVS_MAX_HANDLES];
+static sim_nvs_stats_t stats;
+static uint32_t write_cost_us;
+static uint32_t failing_writes;
+
+// Consume one injected failure, see sim_nvs_fail_writes()
+static bool sim_nvs_write_fails(void) {
+    if (failing_writes == 0)
+        return false;
+    failing_writes--;
+    return true;
+}
+
+static void sim_nvs_charge(void) {
+    if (write_cost_us > 0 && !sim_in_isr())
+        sim_consume_us(write_cost_us);
+}
+
+static sim_nvs_handle_t *sim_nvs_handle(nvs_handle_t handle) {
+    if (handle == 0 || handle > SIM_NVS_MAX_HANDLES || !handles[handle - 1].used)
+        return NULL;
+    return &handles[handle - 1];
+}
+
+static sim_nvs_entry_t **sim_nvs_find(const char *namespace_name, const char *key) {
+    sim_nvs_entry_t **link = &entries;
+    while (*link != NULL) {
+        if (strcmp((*link)->namespace_name, namespace_name) == 0 && strcmp((*link)->key, key) == 0)
+            break;
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+static void sim_nvs_free(sim_nvs_entry_t *entry) {
+    free(entry->data);
+    free(entry);
+}
+
+static esp_err_t sim_nvs_set(nvs_handle_t handle, const char *key, uint8_t type, const void *value, size_t length) {
+    sim_nvs_handle_t *h = sim_nvs_handle(handle);
+    if (h == NULL)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (h->read_only)
+        return ESP_ERR_NVS_READ_ONLY;
+    if (key == NULL || key[0] == '\0')
+        return ESP_ERR_NVS_INVALID_NAME;
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    if (sim_nvs_write_fails())
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    sim_nvs_entry_t **link = sim_nvs_find(h->namespace_name, key);
+    sim_nvs_entry_t *entry = *link;
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(*entry));
+        if (entry == NULL)
+            return ESP_ERR_NO_MEM;
+        strcpy(entry->namespace_name, h->namespace_name);
+        strcpy(entry->key, key);
+        *link = entry;
+    }
+
+    uint8_t *data = malloc(length > 0 ? length : 1);
+    if (data == NULL)
+        return ESP_ERR_NO_MEM;
+    memcpy(data, value, length);
+    free(entry->data);
+    entry->data = data;
+    entry->length = (uint32_t)length;
+    entry->type = type;
+
+    stats.writes++;
+    stats.bytes += (uint32_t)length;
+    sim_nvs_charge();
+    return ESP_OK;
+}
+
+static esp_err_t sim_nvs_get(nvs_handle_t handle, const char *key, uint8_t type, const sim_nvs_entry_t **out_entry) {
+    sim_nvs_handle_t *h = sim_nvs_handle(handle);
+    if (h == NULL)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    const sim_nvs_entry_t *entry = *sim_nvs_find(h->namespace_name, key);
+    if (entry == NULL)
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (entry->type != type)
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    *out_entry = entry;
+    return ESP_OK;
+}
+
+static esp_err_t sim_nvs_get_fixed(nvs_handle_t handle, const char *key, uint8_t type, void *out_value, size_t length) {
+    const sim_nvs_entry_t *entry;
+    esp_err_t err = sim_nvs_get(handle, key, type, &entry);
+    if (err == ESP_OK)
+        memcpy(out_value, entry->data, length);
+    return err;
+}
+
+static esp_err_t sim_nvs_get_variable(nvs_handle_t handle, const char *key, uint8_t type, void *out_value, size_t *length) {
+    const sim_nvs_entry_t *entry;
+    esp_err_t err = sim_nvs_get(handle, key, type, &entry);
+    if (err != ESP_OK)
+        return err;
+    if (length == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (out_value == NULL) {
+        *length = entry->length;
+        return ESP_OK;
+    }
+    if (*length < entry->length) {
+        *length = entry->length;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, entry->data, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void) {
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    while (entries != NULL) {
+        sim_nvs_entry_t *entry = entries;
+        entries = entry->next;
+        sim_nvs_free(entry);
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_deinit(void) {
+    if (!initialized)
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    initialized = false;
+    memset(handles, 0, sizeof(handles));
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (!initialized)
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    if (namespace_name == NULL || namespace_name[0] == '\0' || strlen(namespace_name) >= SIM_NVS_NAMESPACE_MAX_SIZE)
+        return ESP_ERR_NVS_INVALID_NAME;
+
+    // A read-only open of a namespace that was never written fails like on the target
+    if (open_mode == NVS_READONLY) {
+        bool exists = false;
+        for (const sim_nvs_entry_t *entry = entries; entry != NULL && !exists; entry = entry->next) {
+            exists = strcmp(entry->namespace_name, namespace_name) == 0;
+        }
+        if (!exists)
+            return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    for (int i = 0; i < SIM_NVS_MAX_HANDLES; i++) {
+        if (!handles[i].used) {
+            handles[i].used = true;
+            handles[i].read_only = open_mode == NVS_READONLY;
+            strcpy(handles[i].namespace_name, namespace_name);
+            *out_handle = (nvs_handle_t)(i + 1);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    sim_nvs_handle_t *h = sim_nvs_handle(handle);
+    if (h != NULL)
+        h->used = false;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    if (sim_nvs_handle(handle) == NULL)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (sim_nvs_write_fails())
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    stats.commits++;
+    sim_nvs_charge();
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    sim_nvs_handle_t *h = sim_nvs_handle(handle);
+    if (h == NULL)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (h->read_only)
+        return ESP_ERR_NVS_READ_ONLY;
+    sim_nvs_entry_t **link = sim_nvs_find(h->namespace_name, key);
+    sim_nvs_entry_t *entry = *link;
+    if (entry == NULL)
+        return ESP_ERR_NVS_NOT_FOUND;
+    *link = entry->next;
+    sim_nvs_free(entry);
+    stats.writes++;
+    sim_nvs_charge();
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    sim_nvs_handle_t *h = sim_nvs_handle(handle);
+    if (h == NULL)
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (h->read_only)
+        return ESP_ERR_NVS_READ_ONLY;
+    sim_nvs_entry_t **link = &entries;
+    while (*link != NULL) {
+        sim_nvs_entry_t *entry = *link;
+        if (strcmp(entry->namespace_name, h->namespace_name) == 0) {
+            *link = entry->next;
+            sim_nvs_free(entry);
+        } else {
+            link = &entry->next;
+        }
+    }
+    stats.writes++;
+    sim_nvs_charge();
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+    return sim_nvs_set(handle, key, SIM_NVS_TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char *key, uint16_t value) {
+    return sim_nvs_set(handle, key, SIM_NVS_TYPE_U16, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return sim_nvs_set(handle, key, SIM_NVS_TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char *key, int32_t value) {
+    return sim_nvs_set(handle, key, SIM_NVS_TYPE_I32, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    return sim_nvs_set(handle, key, SIM_NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return sim_nvs_set(handle, key, SIM_NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value) {
+    return sim_nvs_get_fixed(handle, key, SIM_NVS_TYPE_U8, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char *key, uint16_t *out_value) {
+    return sim_nvs_get_fixed(handle, key, SIM_NVS_TYPE_U16, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    return sim_nvs_get_fixed(handle, key, SIM_NVS_TYPE_U32, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char *key, int32_t *out_value) {
+    return sim_nvs_get_fixed(handle, key, SIM_NVS_TYPE_I32, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    return sim_nvs_get_variable(handle, key, SIM_NVS_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    return sim_nvs_get_variable(handle, key, SIM_NVS_TYPE_BLOB, out_value, length);
+}
+
+// --- host API ---
+
+void sim_nvs_get_stats(sim_nvs_stats_t *out) { *out = stats; }
+
+void sim_nvs_set_write_cost_us(uint32_t us) { write_cost_us = us; }
+
+void sim_nvs_fail_writes(uint32_t count) { failing_writes = count; }
+
+bool sim_nvs_save(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return false;
+
+    uint32_t magic = SIM_NVS_FILE_MAGIC;
+    bool ok = fwrite(&magic, sizeof(magic), 1, file) == 1;
+    for (const sim_nvs_entry_t *entry = entries; entry != NULL && ok; entry = entry->next) {
+        ok = fwrite(entry->namespace_name, sizeof(entry->namespace_name), 1, file) == 1 &&
+             fwrite(entry->key, sizeof(entry->key), 1, file) == 1 && fwrite(&entry->type, sizeof(entry->type), 1, file) == 1 &&
+             fwrite(&entry->length, sizeof(entry->length), 1, file) == 1 &&
+             (entry->length == 0 || fwrite(entry->data, entry->length, 1, file) == 1);
+    }
+    return fclose(file) == 0 && ok;
+}
+
+bool sim_nvs_load(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+
+    uint32_t magic = 0;
+    bool ok = fread(&magic, sizeof(magic), 1, file) == 1 && magic == SIM_NVS_FILE_MAGIC;
+    if (ok)
+        nvs_flash_erase();
+
+    sim_nvs_entry_t **tail = &entries;
+    while (ok) {
+        sim_nvs_entry_t entry = {0};
+        if (fread(entry.namespace_name, sizeof(entry.namespace_name), 1, file) != 1)
+            break; // end of file
+        ok = fread(entry.key, sizeof(entry.key), 1, file) == 1 && fread(&entry.type, sizeof(entry.type), 1, file) == 1 &&
+             fread(&entry.length, sizeof(entry.length), 1, file) == 1;
+        if (!ok)
+            break;
+
+        sim_nvs_entry_t *copy = malloc(sizeof(*copy));
+        uint8_t *data = malloc(entry.length > 0 ? entry.length : 1);
+        ok = copy != NULL && data != NULL && (entry.length == 0 || fread(data, entry.length, 1, file) == 1);
+        if (!ok) {
+            free(copy);
+            free(data);
+            break;
+        }
+        *copy = entry;
+        copy->data = data;
+        *tail = copy;
+        tail = &copy->next;
+    }
+    fclose(file);
+    return ok;
+}
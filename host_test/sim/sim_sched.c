@@ -0,0 +1,472 @@
+#include "sim_internal.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Untouched stack bytes keep this pattern, the stack high water mark is measured with it
+#define SIM_STACK_PAINT 0xa5
+
+typedef struct sim_event {
+    uint32_t id;
+    int64_t at_us;
+    sim_event_fn_t fn;
+    void *arg;
+    struct sim_event *next;
+} sim_event_t;
+
+static int64_t now_us;
+static sim_config_t config = {.seed = 1, .time_limit_us = SIM_DEFAULT_TIME_LIMIT_US};
+static uint64_t rng_state = 1;
+
+static sim_task_t *tasks;
+static sim_task_t *current;
+static sim_task_t *main_task;
+static sim_task_t *reap_task; // deleted while running, freed once the scheduler is back on its own stack
+static ucontext_t scheduler_ctx;
+static uint64_t ready_seq;
+static uint32_t isr_nesting;
+static uint32_t critical_nesting;
+
+static sim_event_t *events; // sorted by time, FIFO for equal times
+static uint32_t next_event_id;
+
+static bool started;
+static bool main_done;
+static bool restart_requested;
+
+static void sim_print_tasks(FILE *out) {
+    static const char *const state_names[] = {"ready", "running", "blocked", "suspended", "deleted"};
+    for (sim_task_t *t = tasks; t != NULL; t = t->next) {
+        fprintf(out, "  %-16s prio %2" PRIu32 "/%2" PRIu32 " %-9s", t->name, t->priority, t->base_priority, state_names[t->state]);
+        if (t->state == SIM_TASK_BLOCKED) {
+            fprintf(out, " on %s %p", t->wait_what != NULL ? t->wait_what : "?", t->wait_obj);
+            if (t->wake_us != SIM_WAIT_FOREVER)
+                fprintf(out, " until %" PRId64 " us", t->wake_us);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+void sim_fatal(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "SIM FATAL at %" PRId64 " us in %s: ", now_us, current != NULL ? current->name : "scheduler");
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    sim_print_tasks(stderr);
+    abort();
+}
+
+void sim_dump_tasks(void) { sim_print_tasks(stdout); }
+
+// --- random schedule ---
+
+uint32_t sim_random(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+void sim_configure(const sim_config_t *cfg) {
+    config = *cfg;
+    if (config.time_limit_us == 0)
+        config.time_limit_us = SIM_DEFAULT_TIME_LIMIT_US;
+    rng_state = config.seed != 0 ? config.seed : 1;
+}
+
+// --- events ---
+
+uint32_t sim_schedule_event(int64_t at_us, sim_event_fn_t fn, void *arg) {
+    sim_event_t *event = malloc(sizeof(*event));
+    if (event == NULL)
+        sim_fatal("out of memory");
+    *event = (sim_event_t){.id = ++next_event_id, .at_us = at_us < now_us ? now_us : at_us, .fn = fn, .arg = arg};
+
+    sim_event_t **link = &events;
+    while (*link != NULL && (*link)->at_us <= event->at_us) {
+        link = &(*link)->next;
+    }
+    event->next = *link;
+    *link = event;
+    return event->id;
+}
+
+void sim_cancel_event(uint32_t id) {
+    for (sim_event_t **link = &events; *link != NULL; link = &(*link)->next) {
+        if ((*link)->id == id) {
+            sim_event_t *event = *link;
+            *link = event->next;
+            free(event);
+            return;
+        }
+    }
+}
+
+// Run the interrupts due until `until_us`, each one at its own time
+static void sim_fire_events(int64_t until_us) {
+    while (events != NULL && events->at_us <= until_us) {
+        sim_event_t *event = events;
+        events = event->next;
+        if (event->at_us > now_us)
+            now_us = event->at_us;
+
+        isr_nesting++;
+        event->fn(event->arg);
+        isr_nesting--;
+        free(event);
+    }
+}
+
+static void sim_expire_timeouts(void) {
+    for (sim_task_t *t = tasks; t != NULL; t = t->next) {
+        if (t->state == SIM_TASK_BLOCKED && t->wake_us <= now_us) {
+            sim_make_ready(t);
+            t->timed_out = true;
+        }
+    }
+}
+
+// Move the clock forward, interrupts stay pending while they are masked (critical section or ISR)
+static void sim_advance(int64_t target_us) {
+    if (isr_nesting > 0 || critical_nesting > 0) {
+        if (target_us > now_us)
+            now_us = target_us;
+        return;
+    }
+
+    sim_fire_events(target_us);
+    if (target_us > now_us)
+        now_us = target_us;
+    sim_expire_timeouts();
+}
+
+// --- tasks ---
+
+sim_task_t *sim_current(void) { return current; }
+
+bool sim_in_isr(void) { return isr_nesting > 0; }
+
+bool sim_in_critical(void) { return critical_nesting > 0; }
+
+int64_t sim_now_us(void) { return now_us; }
+
+uint64_t sim_host_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int64_t sim_tick_us(void) { return 1000000 / configTICK_RATE_HZ; }
+
+int64_t sim_ticks_deadline(TickType_t ticks) {
+    if (ticks == portMAX_DELAY)
+        return SIM_WAIT_FOREVER;
+    int64_t tick_us = sim_tick_us();
+    return (now_us / tick_us + (int64_t)ticks) * tick_us;
+}
+
+static sim_task_t *sim_pick_ready(void) {
+    sim_task_t *best = NULL;
+    for (sim_task_t *t = tasks; t != NULL; t = t->next) {
+        if (t->state != SIM_TASK_READY)
+            continue;
+        if (best == NULL || t->priority > best->priority || (t->priority == best->priority && t->ready_seq < best->ready_seq))
+            best = t;
+    }
+    return best;
+}
+
+static void sim_return_to_scheduler(void) {
+    sim_task_t *self = current;
+    swapcontext(&self->ctx, &scheduler_ctx);
+}
+
+static void sim_task_entry(void) {
+    sim_task_t *self = current;
+    self->fn(self->params);
+
+    if (self != main_task)
+        sim_fatal("task %s returned from its function", self->name);
+    main_done = true;
+    sim_delete_task(self);
+}
+
+sim_task_t *sim_create_task(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *params, UBaseType_t priority) {
+    if (priority >= configMAX_PRIORITIES)
+        priority = configMAX_PRIORITIES - 1;
+
+    sim_task_t *task = calloc(1, sizeof(*task));
+    uint8_t *stack = malloc(SIM_TASK_HOST_STACK_SIZE);
+    if (task == NULL || stack == NULL)
+        sim_fatal("out of memory creating task %s", name);
+    memset(stack, SIM_STACK_PAINT, SIM_TASK_HOST_STACK_SIZE);
+
+    snprintf(task->name, sizeof(task->name), "%s", name != NULL ? name : "");
+    task->fn = fn;
+    task->params = params;
+    task->base_priority = priority;
+    task->priority = priority;
+    task->wake_us = SIM_WAIT_FOREVER;
+    task->stack = stack;
+    task->stack_requested = stack_depth;
+
+    getcontext(&task->ctx);
+    task->ctx.uc_stack.ss_sp = stack;
+    task->ctx.uc_stack.ss_size = SIM_TASK_HOST_STACK_SIZE;
+    task->ctx.uc_link = NULL;
+    makecontext(&task->ctx, sim_task_entry, 0);
+
+    // Append, the task list order is the creation order
+    sim_task_t **link = &tasks;
+    while (*link != NULL) {
+        link = &(*link)->next;
+    }
+    *link = task;
+
+    sim_make_ready(task);
+    return task;
+}
+
+sim_task_t *sim_find_task(const char *name) {
+    for (sim_task_t *t = tasks; t != NULL; t = t->next) {
+        if (strcmp(t->name, name) == 0)
+            return t;
+    }
+    return NULL;
+}
+
+static void sim_waitq_remove(sim_task_t *task) {
+    if (task->waitq == NULL)
+        return;
+    for (sim_task_t **link = &task->waitq->head; *link != NULL; link = &(*link)->wait_next) {
+        if (*link == task) {
+            *link = task->wait_next;
+            break;
+        }
+    }
+    task->waitq = NULL;
+    task->wait_next = NULL;
+}
+
+static void sim_free_task(sim_task_t *task) {
+    free(task->stack);
+    free(task);
+}
+
+void sim_delete_task(sim_task_t *task) {
+    sim_waitq_remove(task);
+    for (sim_task_t **link = &tasks; *link != NULL; link = &(*link)->next) {
+        if (*link == task) {
+            *link = task->next;
+            break;
+        }
+    }
+    task->state = SIM_TASK_DELETED;
+
+    if (task == current) {
+        reap_task = task;
+        sim_return_to_scheduler();
+        sim_fatal("deleted task resumed");
+    }
+    sim_free_task(task);
+}
+
+uint32_t sim_task_stack_unused(const sim_task_t *task) {
+    // The stack grows down, count the painted bytes left at its bottom
+    uint32_t untouched = 0;
+    while (untouched < SIM_TASK_HOST_STACK_SIZE && task->stack[untouched] == SIM_STACK_PAINT) {
+        untouched++;
+    }
+    uint32_t used = SIM_TASK_HOST_STACK_SIZE - untouched;
+    return used < task->stack_requested ? task->stack_requested - used : 0;
+}
+
+bool sim_block(sim_waitq_t *q, int64_t wake_us, const char *what, const void *obj) {
+    sim_task_t *self = current;
+    if (self == NULL || isr_nesting > 0)
+        sim_fatal("blocking call (%s) from an interrupt", what);
+    if (critical_nesting > 0)
+        sim_fatal("blocking call (%s) inside a critical section", what);
+
+    self->state = SIM_TASK_BLOCKED;
+    self->wake_us = wake_us;
+    self->timed_out = false;
+    self->wait_what = what;
+    self->wait_obj = obj;
+    if (q != NULL) {
+        sim_task_t **link = &q->head;
+        while (*link != NULL) {
+            link = &(*link)->wait_next;
+        }
+        *link = self;
+        self->waitq = q;
+    }
+
+    sim_return_to_scheduler();
+    return !self->timed_out;
+}
+
+void sim_make_ready(sim_task_t *task) {
+    sim_waitq_remove(task);
+    task->state = SIM_TASK_READY;
+    task->wake_us = SIM_WAIT_FOREVER;
+    task->timed_out = false;
+    task->ready_seq = ++ready_seq;
+}
+
+sim_task_t *sim_wake_one(sim_waitq_t *q) {
+    sim_task_t *best = NULL;
+    for (sim_task_t *t = q->head; t != NULL; t = t->wait_next) {
+        if (best == NULL || t->priority > best->priority)
+            best = t;
+    }
+    if (best != NULL)
+        sim_make_ready(best);
+    return best;
+}
+
+void sim_wake_all(sim_waitq_t *q) {
+    while (q->head != NULL) {
+        sim_make_ready(q->head);
+    }
+}
+
+bool sim_waitq_empty(const sim_waitq_t *q) { return q->head == NULL; }
+
+void sim_preempt_point(void) {
+    sim_task_t *self = current;
+    if (self == NULL || isr_nesting > 0 || critical_nesting > 0)
+        return;
+
+    // Interrupts raised by the call that led here (an alarm set in the past) are taken first
+    int64_t target_us = now_us;
+    if (config.jitter_us > 0)
+        target_us += sim_random() % (config.jitter_us + 1);
+    sim_advance(target_us);
+
+    sim_task_t *best = sim_pick_ready();
+    if (best == NULL)
+        return;
+
+    bool yield = best->priority > self->priority;
+    if (!yield && best->priority == self->priority && config.yield_permille > 0 && sim_random() % 1000 < config.yield_permille) {
+        // Time slice ended, go behind the other ready tasks of this priority
+        self->ready_seq = ++ready_seq;
+        yield = true;
+    }
+    if (yield) {
+        self->state = SIM_TASK_READY;
+        sim_return_to_scheduler();
+    }
+}
+
+void sim_yield(void) {
+    sim_task_t *self = current;
+    if (self == NULL || isr_nesting > 0 || critical_nesting > 0)
+        return;
+    self->state = SIM_TASK_READY;
+    self->ready_seq = ++ready_seq;
+    sim_return_to_scheduler();
+}
+
+void sim_priority_changed(sim_task_t *task) { sim_preempt_point(); }
+
+void sim_consume_us(uint32_t us) {
+    sim_advance(now_us + us);
+    sim_preempt_point();
+}
+
+void sim_sleep_us(int64_t us) {
+    if (us <= 0) {
+        sim_yield();
+        return;
+    }
+    sim_block(NULL, now_us + us, "sleep", NULL);
+}
+
+void sim_critical_enter(portMUX_TYPE *mux) {
+    critical_nesting++;
+    mux->count++;
+}
+
+void sim_critical_exit(portMUX_TYPE *mux) {
+    if (mux->count == 0 || critical_nesting == 0)
+        sim_fatal("critical section exited more often than entered");
+    mux->count--;
+    critical_nesting--;
+
+    // Interrupts that became due while masked are taken now
+    if (critical_nesting == 0 && isr_nesting == 0 && current != NULL) {
+        sim_advance(now_us);
+        sim_preempt_point();
+    }
+}
+
+void sim_request_restart(void) {
+    restart_requested = true;
+    if (current == NULL)
+        sim_fatal("esp_restart outside of a task");
+    current->state = SIM_TASK_SUSPENDED;
+    sim_return_to_scheduler();
+    sim_fatal("restarted task resumed");
+}
+
+// --- scheduler ---
+
+static int64_t sim_next_deadline(void) {
+    int64_t next = events != NULL ? events->at_us : SIM_WAIT_FOREVER;
+    for (sim_task_t *t = tasks; t != NULL; t = t->next) {
+        if (t->state == SIM_TASK_BLOCKED && t->wake_us < next)
+            next = t->wake_us;
+    }
+    return next;
+}
+
+sim_run_result_e sim_run(sim_main_fn_t main_fn, void *arg) {
+    if (started)
+        sim_fatal("sim_run can only be called once");
+    started = true;
+
+    main_task = sim_create_task(main_fn, "main", 3584, arg, 1);
+
+    while (!main_done && !restart_requested) {
+        sim_advance(now_us);
+
+        sim_task_t *task = sim_pick_ready();
+        if (task != NULL) {
+            current = task;
+            task->state = SIM_TASK_RUNNING;
+            swapcontext(&scheduler_ctx, &task->ctx);
+            current = NULL;
+            if (task->state == SIM_TASK_RUNNING)
+                sim_fatal("task %s left the CPU without a state", task->name);
+            if (reap_task != NULL) {
+                sim_free_task(reap_task);
+                reap_task = NULL;
+            }
+            continue;
+        }
+
+        int64_t next = sim_next_deadline();
+        if (next == SIM_WAIT_FOREVER) {
+            fprintf(stderr, "SIM DEADLOCK at %" PRId64 " us, every task is blocked forever:\n", now_us);
+            sim_print_tasks(stderr);
+            return SIM_RUN_DEADLOCK;
+        }
+        if (next > config.time_limit_us) {
+            fprintf(stderr, "SIM TIME LIMIT: main did not finish within %" PRId64 " us:\n", config.time_limit_us);
+            sim_print_tasks(stderr);
+            return SIM_RUN_TIME_LIMIT;
+        }
+        now_us = next;
+    }
+
+    return restart_requested ? SIM_RUN_RESTART : SIM_RUN_DONE;
+}
@@ -0,0 +1,96 @@
+#include "host_test.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs_flash.h"
+
+#include "deferred_log.h"
+#include "latency_trace.h"
+#include "led_controller.h"
+#include "zb_app.h"
+#include "zcctlm_cmd.h"
+#include "zcctlm_gamma_lut.h"
+#include "zigbee_cct_light_model.h"
+
+int ht_failures;
+
+void ht_fail(const char *file, int line, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s:%d: [%.3f ms] check failed: ", file, line, sim_now_us() / 1000.0);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+    ht_failures++;
+}
+
+int ht_run_boot(const ht_boot_t *boot) {
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        if (boot->nvs_in != NULL && !sim_nvs_load(boot->nvs_in)) {
+            fprintf(stderr, "%s: cannot load NVS from %s\n", boot->name, boot->nvs_in);
+            _exit(1);
+        }
+        if (boot->config != NULL)
+            sim_configure(boot->config);
+
+        sim_run_result_e result = sim_run(boot->fn, NULL);
+        if (result != boot->expect)
+            ht_fail(__FILE__, __LINE__, "%s ended with %d, expected %d", boot->name, result, boot->expect);
+        if (boot->nvs_out != NULL && !sim_nvs_save(boot->nvs_out))
+            ht_fail(__FILE__, __LINE__, "%s: cannot save NVS to %s", boot->name, boot->nvs_out);
+
+        fflush(stdout);
+        _exit(ht_failures > 255 ? 255 : ht_failures);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        fprintf(stderr, "%s: crashed\n", boot->name);
+        return 1;
+    }
+    int failures = WEXITSTATUS(status);
+    printf("%s %s\n", failures == 0 ? "PASS" : "FAIL", boot->name);
+    return failures;
+}
+
+void ht_init_firmware(void) {
+    ESP_ERROR_CHECK(nvs_flash_init());
+    dlog_init();
+    ltr_init();
+    lc_init();
+    zcctlm_init();
+    zcctlm_cmd_init();
+    appzb_init();
+}
+
+void ht_delay_ms(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+
+void ht_expected_duty(bool on_off, uint8_t brightness, uint16_t mireds, uint16_t *warm_duty, uint16_t *cold_duty) {
+    if (!on_off || brightness == 0) {
+        *warm_duty = LC_OFF_DUTY;
+        *cold_duty = LC_OFF_DUTY;
+        return;
+    }
+    uint32_t total = zcctlm_gamma_lut[brightness];
+    *warm_duty = (uint16_t)(total * (ZCCTLM_MAX_TEMP - mireds) / (ZCCTLM_MAX_TEMP - ZCCTLM_MIN_TEMP));
+    *cold_duty = (uint16_t)(total * (mireds - ZCCTLM_MIN_TEMP) / (ZCCTLM_MAX_TEMP - ZCCTLM_MIN_TEMP));
+}
+
+int64_t ht_last_ledc_event_us(void) {
+    size_t count;
+    const sim_ledc_event_t *events = sim_ledc_events(&count);
+    return count > 0 ? events[count - 1].time_us : 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sim.h"
+
+/*
+    Minimal test harness of the host build.
+
+    Every simulated boot runs in a forked child process (sim_run can only run once per process), the
+    NVS content can be handed from one boot to the next through a file to test persistence over a reboot.
+    Checks print the failing expression with the virtual time and count failures, the scenario goes on.
+*/
+
+extern int ht_failures;
+
+#define HT_CHECK(cond)                                                                                                                               \
+    do {                                                                                                                                             \
+        if (!(cond))                                                                                                                                 \
+            ht_fail(__FILE__, __LINE__, "%s", #cond);                                                                                                \
+    } while (0)
+
+#define HT_CHECK_EQ(actual, expected)                                                                                                                \
+    do {                                                                                                                                             \
+        long long ht_a = (long long)(actual), ht_e = (long long)(expected);                                                                          \
+        if (ht_a != ht_e)                                                                                                                            \
+            ht_fail(__FILE__, __LINE__, "%s == %s (%lld != %lld)", #actual, #expected, ht_a, ht_e);                                                  \
+    } while (0)
+
+#define HT_CHECK_NEAR(actual, expected, tolerance)                                                                                                   \
+    do {                                                                                                                                             \
+        long long ht_a = (long long)(actual), ht_e = (long long)(expected);                                                                          \
+        if (ht_a < ht_e - (long long)(tolerance) || ht_a > ht_e + (long long)(tolerance))                                                            \
+            ht_fail(__FILE__, __LINE__, "%s ~= %s +- %lld (%lld)", #actual, #expected, (long long)(tolerance), ht_a);                                 \
+    } while (0)
+
+void ht_fail(const char *file, int line, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+typedef struct {
+    const char *name;
+    sim_main_fn_t fn;            // runs as app_main
+    const char *nvs_in;          // NVS content at boot, NULL for erased flash
+    const char *nvs_out;         // NVS content saved when the boot ends, NULL to drop it
+    sim_run_result_e expect;     // how the boot is expected to end
+    const sim_config_t *config;  // NULL for an unperturbed schedule
+} ht_boot_t;
+
+// Run one boot in a child process, returns its number of failures (a crash counts as one)
+int ht_run_boot(const ht_boot_t *boot);
+
+// Firmware init of app_main without the button and the status LED, the Zigbee stack is started but not waited for
+void ht_init_firmware(void);
+void ht_delay_ms(uint32_t ms);
+
+// Final duty of the LED channels for a model state, computed independently of the model
+void ht_expected_duty(bool on_off, uint8_t brightness, uint16_t mireds, uint16_t *warm_duty, uint16_t *cold_duty);
+// Time of the last LEDC event on any channel, 0 without events
+int64_t ht_last_ledc_event_us(void);
@@ -0,0 +1,464 @@
+// Light model scenarios on the host build: LED output, settle window, command bursts and NVS write-behind
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "host_test.h"
+
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+
+#include "light_transition.h"
+#include "led_controller.h"
+#include "zb_attr_report.h"
+#include "zb_config.h"
+#include "zb_sim.h"
+#include "zcctlm_cmd.h"
+#include "zigbee_cct_light_model.h"
+
+#define NVS_AFTER_CHANGES "light_model_changes.nvs"
+#define NVS_AFTER_FAILED_COMMIT "light_model_failed_commit.nvs"
+
+// Time for a command with the default transition to reach its final duty, with margin
+#define SETTLED_MS (ZCCTLM_SETTLE_WINDOW_MS + ZCCTLM_DEFAULT_TRANSITION_TIME_MS + 200)
+
+static void check_output(bool on_off, uint8_t brightness, uint16_t mireds) {
+    uint16_t warm_duty, cold_duty;
+    ht_expected_duty(on_off, brightness, mireds, &warm_duty, &cold_duty);
+    HT_CHECK_EQ(sim_ledc_duty(LC_WARM_CHANNEL), warm_duty);
+    HT_CHECK_EQ(sim_ledc_duty(LC_COLD_CHANNEL), cold_duty);
+}
+
+// First duty write that lights a channel, -1 when the LEDs stayed dark
+static int64_t first_lit_us(void) {
+    size_t count;
+    const sim_ledc_event_t *events = sim_ledc_events(&count);
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].duty != 0 || (events[i].type == SIM_LEDC_FADE_START && events[i].target != 0))
+            return events[i].time_us;
+    }
+    return -1;
+}
+
+static void boot_default_state(void *arg) {
+    ht_init_firmware();
+    ht_delay_ms(1000);
+
+    // Startup OFF without a stored record: the LEDs never light up
+    HT_CHECK_EQ(first_lit_us(), -1);
+    check_output(false, 0, 0);
+
+    // On with the default level and color, held for the settle window and then faded in
+    sim_ledc_clear_events();
+    int64_t start_us = sim_now_us();
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_ON_OFF, 1);
+    ht_delay_ms(SETTLED_MS);
+    check_output(true, ZCCTLM_DEFAULT_BRIGHTNESS, ZCCTLM_AVG_TEMP);
+    HT_CHECK(first_lit_us() >= start_us + ZCCTLM_SETTLE_WINDOW_MS * 1000);
+    HT_CHECK(ht_last_ledc_event_us() - start_us <= (ZCCTLM_SETTLE_WINDOW_MS + ZCCTLM_DEFAULT_TRANSITION_TIME_MS) * 1000 + LT_TICK_PERIOD_US);
+
+    // While lit, a change reaches the LEDs within one transition tick
+    sim_ledc_clear_events();
+    start_us = sim_now_us();
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_BRIGHTNESS, 200);
+    ht_delay_ms(SETTLED_MS);
+    check_output(true, 200, ZCCTLM_AVG_TEMP);
+    size_t count;
+    const sim_ledc_event_t *events = sim_ledc_events(&count);
+    HT_CHECK(count > 0);
+    if (count > 0)
+        HT_CHECK(events[0].time_us - start_us <= LT_TICK_PERIOD_US);
+
+    // Off fades out to dark
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_ON_OFF, 0);
+    ht_delay_ms(SETTLED_MS);
+    check_output(false, 0, 0);
+}
+
+static void boot_settle_window(void *arg) {
+    ht_init_firmware();
+    ht_delay_ms(500);
+
+    // Home Assistant turns a light on with separate On, level and color commands
+    sim_ledc_clear_events();
+    int64_t start_us = sim_now_us();
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_ON_OFF, 1);
+    ht_delay_ms(30);
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_BRIGHTNESS, 180);
+    ht_delay_ms(30);
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_COLOR_TEMP, 330);
+    ht_delay_ms(SETTLED_MS);
+
+    check_output(true, 180, 330);
+    zcctlm_settle_stats_t settle;
+    zcctlm_get_settle_stats(&settle);
+    HT_CHECK_EQ(settle.windows, 1);
+    HT_CHECK_EQ(settle.merged, 2);
+    HT_CHECK(first_lit_us() >= start_us + ZCCTLM_SETTLE_WINDOW_MS * 1000);
+
+    // The LEDs fade straight to the merged state: the total output only rises (sampled once both channels are written)
+    size_t count;
+    const sim_ledc_event_t *events = sim_ledc_events(&count);
+    uint32_t duty[2] = {0, 0};
+    uint32_t last_total = 0;
+    for (size_t i = 0; i < count; i++) {
+        HT_CHECK(events[i].channel < 2);
+        if (events[i].channel >= 2)
+            continue;
+        duty[events[i].channel] = events[i].duty;
+        if (i + 1 < count && events[i + 1].time_us == events[i].time_us)
+            continue;
+        // Each channel is rounded down separately
+        HT_CHECK(duty[0] + duty[1] + 1 >= last_total);
+        last_total = duty[0] + duty[1];
+    }
+}
+
+static void boot_command_burst(void *arg) {
+    ht_init_firmware();
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_ON_OFF, 1);
+    ht_delay_ms(SETTLED_MS);
+
+    // A dimmer dragged across the range, one command every tick
+    for (int level = 10; level <= 250; level += 10) {
+        zcctlm_cmd_post(ZCCTLM_CMD_SET_BRIGHTNESS, (uint16_t)level);
+        ht_delay_ms(10);
+    }
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_COLOR_TEMP, ZCCTLM_MIN_TEMP);
+    ht_delay_ms(SETTLED_MS);
+
+    check_output(true, 250, ZCCTLM_MIN_TEMP);
+    zcctlm_cmd_stats_t cmd;
+    zcctlm_cmd_get_stats(&cmd);
+    HT_CHECK_EQ(cmd.coalesced, 0);
+    HT_CHECK_EQ(cmd.stalled, 0);
+    lc_stats_t leds;
+    lc_get_stats(&leds);
+    HT_CHECK_EQ(leds.dropped, 0);
+}
+
+// More commands than the ring holds without yielding: values coalesce, the ordered command waits, none is lost
+static void boot_command_overflow(void *arg) {
+    ht_init_firmware();
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_ON_OFF, 1);
+    ht_delay_ms(SETTLED_MS);
+
+    // Post like the Zigbee task, above the model task
+    vTaskPrioritySet(NULL, ZCCTLM_CMD_TASK_PRIORITY + 1);
+    for (int i = 0; i < 3 * ZCCTLM_CMD_QUEUE_SIZE; i++)
+        zcctlm_cmd_post(ZCCTLM_CMD_SET_BRIGHTNESS, (uint16_t)(1 + i));
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_COLOR_TEMP, ZCCTLM_MAX_TEMP);
+    zcctlm_cmd_post_ex(ZCCTLM_CMD_MOVE_TO_LEVEL, 200, 0, 0);
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_COLOR_TEMP, ZCCTLM_MIN_TEMP);
+    ht_delay_ms(SETTLED_MS);
+
+    check_output(true, 200, ZCCTLM_MIN_TEMP);
+    zcctlm_cmd_stats_t cmd;
+    zcctlm_cmd_get_stats(&cmd);
+    HT_CHECK_EQ(cmd.coalesced, 2 * ZCCTLM_CMD_QUEUE_SIZE + 1);
+    HT_CHECK_EQ(cmd.stalled, 1);
+    HT_CHECK(cmd.high_water <= ZCCTLM_CMD_QUEUE_SIZE);
+}
+
+static void boot_level_ramps(void *arg) {
+    ht_init_firmware();
+    zcctlm_set_on_off(true);
+    zcctlm_set_brightness(3);
+    ht_delay_ms(SETTLED_MS);
+    check_output(true, 3, ZCCTLM_AVG_TEMP);
+
+    // MoveToLevelWithOnOff down to MinLevel: the duty reaches 0 before the ramp ends, the light is switched off at its end
+    zcctlm_move_to_level(ZCCTLM_MIN_ON_BRIGHTNESS, 2000, true);
+    ht_delay_ms(2000 + 500);
+    zcctlm_state_t state;
+    zcctlm_get_state(&state);
+    HT_CHECK(!state.on_off);
+    check_output(false, 0, 0);
+
+    zcctlm_set_on_off(true);
+    zcctlm_set_brightness(100);
+    ht_delay_ms(SETTLED_MS);
+
+    // A ramp to the current level still completes and reports its end
+    zbattr_report_stats_t before, after;
+    zbattr_get_report_stats(&before);
+    zcctlm_move_to_level(100, 1000, false);
+    ht_delay_ms(1000 + 500);
+    zbattr_get_report_stats(&after);
+    HT_CHECK(after.changes > before.changes);
+    check_output(true, 100, ZCCTLM_AVG_TEMP);
+
+    // Same for color: RemainingTime is cleared once the ramp to the current color temperature has ended
+    zcctlm_move_to_color_temp(ZCCTLM_AVG_TEMP, 1000);
+    ht_delay_ms(500);
+    uint32_t remaining_time = 0;
+    HT_CHECK(zbsim_read_attribute(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_REMAINING_TIME_ID, &remaining_time));
+    HT_CHECK(remaining_time > 0);
+    ht_delay_ms(500 + 500);
+    HT_CHECK(zbsim_read_attribute(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_REMAINING_TIME_ID, &remaining_time));
+    HT_CHECK_EQ(remaining_time, 0);
+}
+
+// A slider dragged in Home Assistant: one LED job per tick, each with the default fade time
+#define BURST_UPDATES 50
+#define BURST_FADE_MS ZCCTLM_DEFAULT_TRANSITION_TIME_MS
+
+static void boot_fade_burst(void *arg) {
+    ht_init_firmware();
+    ht_delay_ms(1000);
+
+    lc_stats_t before, after;
+    lc_get_stats(&before);
+    for (int i = 0; i < BURST_UPDATES; i++) {
+        uint16_t duty = (uint16_t)(LC_MIN_DUTY + i * 30);
+        lc_set_duty(duty, duty, BURST_FADE_MS);
+        ht_delay_ms(10);
+    }
+    uint16_t last_duty = (uint16_t)(LC_MIN_DUTY + (BURST_UPDATES - 1) * 30);
+    ht_delay_ms(LC_QUEUE_SIZE * BURST_FADE_MS + 500);
+    lc_get_stats(&after);
+
+    printf("%s burst: %d updates, command to settled max %" PRIu32 " us, last %" PRIu32 " us, %" PRIu32 " preempted, %" PRIu32
+           " dropped\n",
+           LC_FADE_MODE == LC_FADE_MODE_FIFO ? "fifo" : "latest", BURST_UPDATES, after.max_settle_us, after.last_settle_us,
+           after.preempted - before.preempted, after.dropped - before.dropped);
+    HT_CHECK_EQ(after.jobs + after.dropped - before.jobs - before.dropped, BURST_UPDATES);
+
+#if LC_FADE_MODE == LC_FADE_MODE_LATEST
+    // Each update retargets the running fade, the last one settles one fade after it was sent whatever came before
+    HT_CHECK_EQ(after.preempted - before.preempted, BURST_UPDATES - 1);
+    HT_CHECK(after.max_settle_us <= (BURST_FADE_MS + portTICK_PERIOD_MS) * 1000);
+    HT_CHECK_EQ(sim_ledc_duty(LC_WARM_CHANNEL), last_duty);
+    HT_CHECK_EQ(sim_ledc_duty(LC_COLD_CHANNEL), last_duty);
+#else
+    // Every accepted update plays out as a full fade: the latency grows with the queue, updates beyond it are dropped
+    HT_CHECK_EQ(after.preempted, before.preempted);
+    HT_CHECK(after.max_settle_us >= (LC_QUEUE_SIZE - 1) * BURST_FADE_MS * 1000);
+    (void)last_duty;
+#endif
+}
+
+static size_t count_ledc_events(sim_ledc_event_e type, uint8_t channel) {
+    size_t count, found = 0;
+    const sim_ledc_event_t *events = sim_ledc_events(&count);
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].type == type && events[i].channel == channel)
+            found++;
+    }
+    return found;
+}
+
+// Fades longer than LC_FADE_MAX_TIME_MS ramp in chunks along the same line instead of jumping to their target
+#define LONG_FADE_MS (3 * LC_FADE_MAX_TIME_MS)
+
+// OnTransitionTime beyond 655 (UINT16_MAX ms) plays out in full instead of being cut to 65.5 s
+#define LONG_TRANSITION_TIME 700 // 1/10 s
+
+static void boot_long_transition_time(void *arg) {
+    ht_init_firmware();
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_ON_TRANSITION_TIME, LONG_TRANSITION_TIME);
+    ht_delay_ms(100);
+    zcctlm_state_t state;
+    zcctlm_get_state(&state);
+    HT_CHECK_EQ(state.on_transition_time, ZB_TRANSITION_TIME_TO_MS(LONG_TRANSITION_TIME));
+
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_ON_OFF, 1);
+    ht_delay_ms(ZCCTLM_SETTLE_WINDOW_MS + UINT16_MAX + 1000);
+    uint16_t warm_duty, cold_duty;
+    ht_expected_duty(true, ZCCTLM_DEFAULT_BRIGHTNESS, ZCCTLM_AVG_TEMP, &warm_duty, &cold_duty);
+    HT_CHECK(sim_ledc_duty(LC_WARM_CHANNEL) != warm_duty || sim_ledc_duty(LC_COLD_CHANNEL) != cold_duty);
+
+    ht_delay_ms(ZB_TRANSITION_TIME_TO_MS(LONG_TRANSITION_TIME) - UINT16_MAX);
+    check_output(true, ZCCTLM_DEFAULT_BRIGHTNESS, ZCCTLM_AVG_TEMP);
+}
+
+static void boot_long_fade(void *arg) {
+    ht_init_firmware();
+    ht_delay_ms(1000);
+
+    // Warm ramps 0 -> 1200, cold 0 -> 2 holds through the first chunk
+    sim_ledc_clear_events();
+    lc_stats_t stats;
+    lc_set_duty(1200, 2, LONG_FADE_MS);
+    ht_delay_ms(LC_FADE_MAX_TIME_MS / 2);
+    HT_CHECK_NEAR(sim_ledc_duty(LC_WARM_CHANNEL), 200, 10);
+    HT_CHECK_EQ(sim_ledc_duty(LC_COLD_CHANNEL), 0);
+    ht_delay_ms(LC_FADE_MAX_TIME_MS);
+    HT_CHECK_NEAR(sim_ledc_duty(LC_WARM_CHANNEL), 600, 10);
+    ht_delay_ms(LC_FADE_MAX_TIME_MS * 3 / 2 + 100);
+    HT_CHECK_EQ(sim_ledc_duty(LC_WARM_CHANNEL), 1200);
+    HT_CHECK_EQ(sim_ledc_duty(LC_COLD_CHANNEL), 2);
+    HT_CHECK_EQ(count_ledc_events(SIM_LEDC_FADE_START, LC_WARM_CHANNEL), 3);
+    HT_CHECK_EQ(count_ledc_events(SIM_LEDC_FADE_START, LC_COLD_CHANNEL), 2);
+    HT_CHECK_EQ(count_ledc_events(SIM_LEDC_DUTY, LC_WARM_CHANNEL), 0);
+    lc_get_stats(&stats);
+    HT_CHECK_NEAR(stats.last_settle_us, LONG_FADE_MS * 1000, portTICK_PERIOD_MS * 1000);
+
+    // A chunk in which neither channel changes still takes its time
+    lc_set_duty(1201, 2, LONG_FADE_MS);
+    ht_delay_ms(LC_FADE_MAX_TIME_MS + LC_FADE_MAX_TIME_MS / 2);
+    HT_CHECK_EQ(sim_ledc_duty(LC_WARM_CHANNEL), 1200);
+    ht_delay_ms(LC_FADE_MAX_TIME_MS * 3 / 2 + 100);
+    HT_CHECK_EQ(sim_ledc_duty(LC_WARM_CHANNEL), 1201);
+    lc_get_stats(&stats);
+    HT_CHECK_NEAR(stats.last_settle_us, LONG_FADE_MS * 1000, portTICK_PERIOD_MS * 1000);
+}
+
+#if LC_HW_CURVE_FADE_SUPPORTED == 1
+typedef struct {
+    uint32_t fade_ms;
+    uint8_t segments;
+    uint16_t warm[LC_CURVE_MAX_SEGMENTS];
+    uint16_t cold[LC_CURVE_MAX_SEGMENTS];
+} curve_case_t;
+
+static const curve_case_t curve_cases[] = {
+    // 500 PWM cycles per segment: faster and slower than one LSB per cycle, held, both directions
+    {80, 4, {700, 1000, 1000, 999}, {1, 0, 3, 2047}},
+    // 6250 cycles per segment, the small changes need steps longer than a fade parameter can hold
+    {2000, 8, {1005, 1005, 1000, 1950, 1940, 1947, 1947, 1946}, {2047, 2040, 1100, 1100, 1101, 150, 151, 0}},
+};
+
+static const sim_ledc_event_t *find_ledc_event(sim_ledc_event_e type, uint8_t channel) {
+    size_t count;
+    const sim_ledc_event_t *events = sim_ledc_events(&count);
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].type == type && events[i].channel == channel)
+            return &events[i];
+    }
+    return NULL;
+}
+
+// Hardware curve fades hit every point exactly at the end of its segment, without a duty snap when they end
+static void boot_curve_segments(void *arg) {
+    ht_init_firmware();
+    ht_delay_ms(1000);
+
+    for (size_t c = 0; c < sizeof(curve_cases) / sizeof(curve_cases[0]); c++) {
+        const curve_case_t *curve = &curve_cases[c];
+        sim_ledc_clear_events();
+        int64_t start_us = sim_now_us();
+        lc_set_duty_curve(curve->warm, curve->cold, curve->segments, curve->fade_ms);
+
+        for (uint8_t s = 0; s < curve->segments; s++) {
+            int64_t end_us = start_us + (int64_t)curve->fade_ms * 1000 * (s + 1) / curve->segments;
+            ht_delay_ms((uint32_t)((end_us - sim_now_us()) / 1000));
+            HT_CHECK_EQ(sim_now_us(), end_us);
+            HT_CHECK_EQ(sim_ledc_duty(LC_WARM_CHANNEL), curve->warm[s]);
+            HT_CHECK_EQ(sim_ledc_duty(LC_COLD_CHANNEL), curve->cold[s]);
+        }
+        ht_delay_ms(100);
+
+        uint8_t channels[] = {LC_WARM_CHANNEL, LC_COLD_CHANNEL};
+        for (size_t i = 0; i < sizeof(channels); i++) {
+            const sim_ledc_event_t *fade_start = find_ledc_event(SIM_LEDC_FADE_START, channels[i]);
+            const sim_ledc_event_t *fade_end = find_ledc_event(SIM_LEDC_FADE_END, channels[i]);
+            HT_CHECK(fade_start != NULL && fade_end != NULL);
+            if (fade_start == NULL || fade_end == NULL)
+                continue;
+            HT_CHECK_EQ(fade_start->time_us, start_us);
+            HT_CHECK_EQ(fade_start->fade_us, curve->fade_ms * 1000);
+            HT_CHECK_EQ(fade_end->time_us, start_us + curve->fade_ms * 1000);
+            HT_CHECK(find_ledc_event(SIM_LEDC_DUTY, channels[i]) == NULL);
+        }
+    }
+}
+#endif
+
+static void boot_write_behind(void *arg) {
+    ht_init_firmware();
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_STARTUP_BEHAVIOR, ZCCTL_STARTUP_PREVIOUS);
+    ht_delay_ms(ZCCTLM_NVS_COMMIT_DELAY_MS + 100);
+
+    sim_nvs_stats_t before, after;
+    sim_nvs_get_stats(&before);
+    HT_CHECK(before.commits > 0);
+
+    // Changes are committed together once they stop for ZCCTLM_NVS_COMMIT_DELAY_MS
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_ON_OFF, 1);
+    for (int i = 0; i < 10; i++) {
+        ht_delay_ms(100);
+        zcctlm_cmd_post(ZCCTLM_CMD_SET_BRIGHTNESS, (uint16_t)(100 + i));
+    }
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_COLOR_TEMP, 220);
+    ht_delay_ms(ZCCTLM_NVS_COMMIT_DELAY_MS - 200);
+    sim_nvs_get_stats(&after);
+    HT_CHECK_EQ(after.commits, before.commits);
+
+    ht_delay_ms(400);
+    sim_nvs_get_stats(&after);
+    HT_CHECK_EQ(after.commits, before.commits + 1);
+    check_output(true, 109, 220);
+}
+
+// A commit the flash rejects keeps its changes pending, the retry after the commit delay writes them
+static void boot_failed_commit(void *arg) {
+    ht_init_firmware();
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_STARTUP_BEHAVIOR, ZCCTL_STARTUP_PREVIOUS);
+    ht_delay_ms(ZCCTLM_NVS_COMMIT_DELAY_MS + 100);
+
+    sim_nvs_stats_t before, after;
+    sim_nvs_get_stats(&before);
+    sim_nvs_fail_writes(1);
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_ON_OFF, 1);
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_BRIGHTNESS, 42);
+    ht_delay_ms(ZCCTLM_NVS_COMMIT_DELAY_MS + 100);
+    sim_nvs_get_stats(&after);
+    HT_CHECK_EQ(after.commits, before.commits);
+
+    ht_delay_ms(ZCCTLM_NVS_COMMIT_DELAY_MS);
+    sim_nvs_get_stats(&after);
+    HT_CHECK_EQ(after.commits, before.commits + 1);
+}
+
+static void boot_after_failed_commit(void *arg) {
+    ht_init_firmware();
+    ht_delay_ms(SETTLED_MS);
+    check_output(true, 42, ZCCTLM_AVG_TEMP);
+}
+
+static void boot_restore_previous(void *arg) {
+    ht_init_firmware();
+    ht_delay_ms(SETTLED_MS);
+
+    // Startup PREVIOUS brings back the state of the last boot
+    check_output(true, 109, 220);
+
+    // Pending changes are flushed by the shutdown handler of esp_restart
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_BRIGHTNESS, 30);
+    ht_delay_ms(50);
+    esp_restart();
+}
+
+static void boot_after_restart(void *arg) {
+    ht_init_firmware();
+    ht_delay_ms(SETTLED_MS);
+    check_output(true, 30, 220);
+}
+
+int main(void) {
+    int failures = 0;
+    failures += ht_run_boot(&(ht_boot_t){.name = "default state", .fn = boot_default_state});
+    failures += ht_run_boot(&(ht_boot_t){.name = "settle window", .fn = boot_settle_window});
+    failures += ht_run_boot(&(ht_boot_t){.name = "command burst", .fn = boot_command_burst});
+    failures += ht_run_boot(&(ht_boot_t){.name = "command overflow", .fn = boot_command_overflow});
+    failures += ht_run_boot(&(ht_boot_t){.name = "level ramps", .fn = boot_level_ramps});
+    failures += ht_run_boot(&(ht_boot_t){.name = "fade burst", .fn = boot_fade_burst});
+    failures += ht_run_boot(&(ht_boot_t){.name = "long fade", .fn = boot_long_fade});
+    failures += ht_run_boot(&(ht_boot_t){.name = "long transition time", .fn = boot_long_transition_time});
+#if LC_HW_CURVE_FADE_SUPPORTED == 1
+    failures += ht_run_boot(&(ht_boot_t){.name = "curve segments", .fn = boot_curve_segments});
+#endif
+    failures += ht_run_boot(&(ht_boot_t){.name = "write-behind", .fn = boot_write_behind, .nvs_out = NVS_AFTER_CHANGES});
+    failures += ht_run_boot(&(ht_boot_t){.name = "failed commit", .fn = boot_failed_commit, .nvs_out = NVS_AFTER_FAILED_COMMIT});
+    failures += ht_run_boot(&(ht_boot_t){.name = "after failed commit", .fn = boot_after_failed_commit, .nvs_in = NVS_AFTER_FAILED_COMMIT});
+    failures += ht_run_boot(&(ht_boot_t){.name = "restore previous",
+                                         .fn = boot_restore_previous,
+                                         .nvs_in = NVS_AFTER_CHANGES,
+                                         .nvs_out = NVS_AFTER_CHANGES,
+                                         .expect = SIM_RUN_RESTART});
+    failures += ht_run_boot(&(ht_boot_t){.name = "after restart", .fn = boot_after_restart, .nvs_in = NVS_AFTER_CHANGES});
+    remove(NVS_AFTER_CHANGES);
+    remove(NVS_AFTER_FAILED_COMMIT);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
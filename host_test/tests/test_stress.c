@@ -0,0 +1,361 @@
+// Concurrency stress of the light model: every task that writes the model state hammers it at once, with a randomized schedule
+//
+// Writers as on the target: the model task (Zigbee frames), the esp_timer task (button callbacks), the FreeRTOS timer
+// task (NVS flush, settle window, transition end) and app_main (state reports). Each seed runs two phases:
+//   chaos  - every kind of frame and button action, checks that the LEDs end at the model state, that the reported
+//            attributes agree, that no mutex pair is taken in both orders and that lock waits and latency stay bounded
+//   parity - button toggles against level / color writes, checks that no toggle and no write got lost
+// STRESS_SEEDS and STRESS_SECONDS in the environment override the number of seeds and the length of a phase.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host_test.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "latency_trace.h"
+#include "led_controller.h"
+#include "light_presets.h"
+#include "zb_app.h"
+#include "zb_attr_report.h"
+#include "zb_config.h"
+#include "zb_sim.h"
+#include "zcctlm_cmd.h"
+#include "zcctlm_effects.h"
+#include "zigbee_cct_light_model.h"
+
+#define STRESS_DEFAULT_SEEDS 8
+#define STRESS_DEFAULT_SECONDS 10
+#define STRESS_PARITY_SECONDS 5
+// Schedule perturbation: chance of switching between ready tasks of equal priority, CPU time charged per switch
+#define STRESS_YIELD_PERMILLE 300
+#define STRESS_JITTER_US 200
+
+// Pause between actions of each agent, in us
+#define STRESS_ZB_GAP_MIN_US 2000
+#define STRESS_ZB_GAP_MAX_US 15000
+#define STRESS_BUTTON_GAP_MIN_US 5000
+#define STRESS_BUTTON_GAP_MAX_US 60000
+#define STRESS_FLUSH_GAP_MIN_MS 20
+#define STRESS_FLUSH_GAP_MAX_MS 200
+#define STRESS_MAIN_GAP_MIN_US 10000
+#define STRESS_MAIN_GAP_MAX_US 100000
+
+// Slowest Move rates used, a Move across the whole range ends within STRESS_SETTLE_MS
+#define STRESS_MIN_LEVEL_RATE 50
+#define STRESS_MIN_MIREDS_RATE 50
+#define STRESS_MAX_IDENTIFY_S 2
+// Once the agents stopped: every ramp and effect has ended after this time, then the LEDs must stay still
+#define STRESS_SETTLE_MS 6000
+#define STRESS_QUIET_US (500 * 1000)
+
+// Bounds of the chaos phase: longest wait for state_mutex, stack callback until the LEDs react (settle window included)
+#define STRESS_MAX_LOCK_WAIT_US 20000
+#define STRESS_MAX_LATENCY_US (ZCCTLM_SETTLE_WINDOW_MS * 1000 + 100 * 1000)
+
+typedef enum { PHASE_CHAOS = 0, PHASE_PARITY } stress_phase_e;
+
+typedef struct {
+    volatile bool stop;
+    stress_phase_e phase;
+    uint32_t frames;
+    uint32_t frames_lost;
+    uint32_t button_actions;
+    uint32_t toggles;
+    uint32_t flushes;
+    uint32_t reads;
+    // last values written by Zigbee in the parity phase, -1 none
+    int32_t last_level;
+    int32_t last_mireds;
+} stress_t;
+
+static stress_t stress;
+static uint32_t phase_seconds = STRESS_DEFAULT_SECONDS;
+// Seed of the boot, set before it is forked
+static uint32_t seed;
+static volatile bool zb_agent_done;
+static esp_timer_handle_t button_timer;
+
+static uint32_t random_between(uint32_t min, uint32_t max) { return min + sim_random() % (max - min + 1); }
+
+static void put_u16(uint8_t *data, uint16_t value) {
+    data[0] = value & 0xff;
+    data[1] = value >> 8;
+}
+
+/* --- agents --- */
+
+static bool inject_level(uint8_t level) {
+    return zbsim_inject_set_attr(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, ESP_ZB_ZCL_ATTR_TYPE_U8,
+                                 &level);
+}
+
+static bool inject_color_temp(uint16_t mireds) {
+    return zbsim_inject_set_attr(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, ESP_ZB_ZCL_ATTR_TYPE_U16,
+                                 &mireds);
+}
+
+// Any frame the firmware handles, with random arguments
+static bool inject_random_frame() {
+    uint8_t data[9];
+    bool with_on_off = sim_random() & 1;
+    switch (sim_random() % 14) {
+    case 0: {
+        bool on_off = sim_random() & 1;
+        return zbsim_inject_set_attr(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, ESP_ZB_ZCL_ATTR_TYPE_BOOL, &on_off);
+    }
+    case 1:
+        return inject_level((uint8_t)random_between(0, ZCCTLM_MAX_BRIGHTNESS));
+    case 2:
+        return inject_color_temp((uint16_t)random_between(ZCCTLM_MIN_TEMP, ZCCTLM_MAX_TEMP));
+    case 3:
+        data[0] = (uint8_t)random_between(0, ZCCTLM_MAX_BRIGHTNESS);
+        put_u16(&data[1], (uint16_t)random_between(0, 10));
+        return zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                                    with_on_off ? ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL_WITH_ON_OFF : ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL,
+                                    data, 3);
+    case 4:
+        data[0] = sim_random() & 1;
+        data[1] = (uint8_t)random_between(STRESS_MIN_LEVEL_RATE, 0xff);
+        return zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                                    with_on_off ? ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_WITH_ON_OFF : ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE, data, 2);
+    case 5:
+        data[0] = sim_random() & 1;
+        data[1] = (uint8_t)random_between(1, 50);
+        put_u16(&data[2], (uint16_t)random_between(0, 5));
+        return zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                                    with_on_off ? ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STEP_WITH_ON_OFF : ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STEP, data, 4);
+    case 6:
+        return zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STOP, NULL, 0);
+    case 7:
+        put_u16(&data[0], (uint16_t)random_between(ZCCTLM_MIN_TEMP, ZCCTLM_MAX_TEMP));
+        put_u16(&data[2], (uint16_t)random_between(0, 10));
+        return zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_CMD_COLOR_CONTROL_MOVE_TO_COLOR_TEMPERATURE, data, 4);
+    case 8: {
+        static const uint8_t modes[] = {0x00, 0x01, 0x03};
+        data[0] = modes[sim_random() % 3];
+        put_u16(&data[1], (uint16_t)random_between(STRESS_MIN_MIREDS_RATE, 300));
+        put_u16(&data[3], 0);
+        put_u16(&data[5], 0);
+        return zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_CMD_COLOR_CONTROL_MOVE_COLOR_TEMPERATURE, data, 7);
+    }
+    case 9:
+        data[0] = sim_random() & 1 ? 0x01 : 0x03;
+        put_u16(&data[1], (uint16_t)random_between(1, 60));
+        put_u16(&data[3], (uint16_t)random_between(0, 5));
+        put_u16(&data[5], 0);
+        put_u16(&data[7], 0);
+        return zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_CMD_COLOR_CONTROL_STEP_COLOR_TEMPERATURE, data, 9);
+    case 10: {
+        uint16_t identify_time = (uint16_t)random_between(0, STRESS_MAX_IDENTIFY_S);
+        return zbsim_inject_set_attr(ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY, ESP_ZB_ZCL_ATTR_IDENTIFY_IDENTIFY_TIME_ID, ESP_ZB_ZCL_ATTR_TYPE_U16,
+                                     &identify_time);
+    }
+    case 11: {
+        static const uint8_t effects[] = {ZCCTLM_EFFECT_BLINK,          ZCCTLM_EFFECT_BREATHE, ZCCTLM_EFFECT_OKAY,
+                                          ZCCTLM_EFFECT_CHANNEL_CHANGE, ZCCTLM_EFFECT_FINISH,  ZCCTLM_EFFECT_STOP};
+        data[0] = effects[sim_random() % sizeof(effects)];
+        data[1] = 0;
+        return zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY, ESP_ZB_ZCL_CMD_IDENTIFY_TRIGGER_EFFECT_ID, data, 2);
+    }
+    case 12:
+        return zbsim_inject_store_scene(0, (uint8_t)random_between(1, 3));
+    default:
+        return zbsim_inject_recall_scene(0, (uint8_t)random_between(1, 3), (uint16_t)random_between(0, 5), NULL);
+    }
+}
+
+// Frames from the network, arriving in the Zigbee task and handed to the model task
+static void zb_agent_task(void *arg) {
+    while (!stress.stop) {
+        sim_sleep_us(random_between(STRESS_ZB_GAP_MIN_US, STRESS_ZB_GAP_MAX_US));
+        bool sent;
+        if (stress.phase == PHASE_CHAOS) {
+            sent = inject_random_frame();
+        } else if (sim_random() & 1) {
+            uint8_t level = (uint8_t)random_between(1, ZCCTLM_MAX_BRIGHTNESS);
+            sent = inject_level(level);
+            if (sent)
+                stress.last_level = level;
+        } else {
+            uint16_t mireds = (uint16_t)random_between(ZCCTLM_MIN_TEMP, ZCCTLM_MAX_TEMP);
+            sent = inject_color_temp(mireds);
+            if (sent)
+                stress.last_mireds = mireds;
+        }
+        stress.frames++;
+        if (!sent)
+            stress.frames_lost++;
+    }
+    zb_agent_done = true;
+    vTaskDelete(NULL);
+}
+
+// Button callbacks run in the esp_timer task, straight into the model like input_handler.c
+static void button_cb(void *arg) {
+    if (stress.stop)
+        return;
+    if (stress.phase == PHASE_PARITY || sim_random() & 1) {
+        zcctlm_toggle_on_off();
+        stress.toggles++;
+    } else {
+        light_presets_cycle();
+    }
+    stress.button_actions++;
+    esp_timer_start_once(button_timer, random_between(STRESS_BUTTON_GAP_MIN_US, STRESS_BUTTON_GAP_MAX_US));
+}
+
+// Flushes in the timer task, next to the firmware's own commit, settle and transition timers
+static void flush_timer_cb(TimerHandle_t timer) {
+    if (stress.stop)
+        return;
+    zcctlm_flush_nvs();
+    stress.flushes++;
+    xTimerChangePeriod(timer, pdMS_TO_TICKS(random_between(STRESS_FLUSH_GAP_MIN_MS, STRESS_FLUSH_GAP_MAX_MS)), 0);
+}
+
+// Run every agent for a number of seconds, app_main reads and reports the state meanwhile
+static void run_phase(stress_phase_e phase, uint32_t seconds) {
+    stress.stop = false;
+    stress.phase = phase;
+    zb_agent_done = false;
+
+    xTaskCreate(zb_agent_task, "stress_zb", 4096, NULL, 2, NULL);
+    esp_timer_create(&(esp_timer_create_args_t){.callback = button_cb, .name = "stress_button"}, &button_timer);
+    esp_timer_start_once(button_timer, STRESS_BUTTON_GAP_MIN_US);
+    TimerHandle_t flush_timer = xTimerCreate("stress_flush", pdMS_TO_TICKS(STRESS_FLUSH_GAP_MIN_MS), pdFALSE, NULL, flush_timer_cb);
+    xTimerStart(flush_timer, 0);
+
+    int64_t end_us = sim_now_us() + (int64_t)seconds * 1000000;
+    while (sim_now_us() < end_us) {
+        zcctlm_state_t snapshot;
+        zcctlm_get_state(&snapshot);
+        if (sim_random() % 4 == 0)
+            zcctlm_report_current_state();
+        stress.reads++;
+        sim_sleep_us(random_between(STRESS_MAIN_GAP_MIN_US, STRESS_MAIN_GAP_MAX_US));
+    }
+
+    stress.stop = true;
+    while (!zb_agent_done)
+        ht_delay_ms(10);
+    esp_timer_stop(button_timer);
+    esp_timer_delete(button_timer);
+    xTimerStop(flush_timer, 0);
+    xTimerDelete(flush_timer, 0);
+}
+
+// Wait until every ramp and effect has ended and the LEDs stayed still for STRESS_QUIET_US
+static void wait_settled() {
+    ht_delay_ms(STRESS_SETTLE_MS);
+    while (sim_now_us() - ht_last_ledc_event_us() < STRESS_QUIET_US)
+        ht_delay_ms(100);
+    zbsim_flush();
+    ht_delay_ms(ZBATTR_REPORT_COALESCE_MS + 100);
+}
+
+// The LEDs and the attributes the network reads show the model state
+static void check_consistent(const zcctlm_state_t *state) {
+    uint16_t warm_duty, cold_duty;
+    ht_expected_duty(state->on_off, state->brightness, state->mireds, &warm_duty, &cold_duty);
+    HT_CHECK_EQ(sim_ledc_duty(LC_WARM_CHANNEL), warm_duty);
+    HT_CHECK_EQ(sim_ledc_duty(LC_COLD_CHANNEL), cold_duty);
+    HT_CHECK(!sim_ledc_fading(LC_WARM_CHANNEL) && !sim_ledc_fading(LC_COLD_CHANNEL));
+
+    uint32_t value = 0;
+    HT_CHECK(zbsim_read_attribute(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, &value));
+    HT_CHECK_EQ(value, state->on_off);
+    HT_CHECK(zbsim_read_attribute(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, &value));
+    HT_CHECK_EQ(value, state->brightness);
+    HT_CHECK(zbsim_read_attribute(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, &value));
+    HT_CHECK_EQ(value, state->mireds);
+}
+
+static void boot_stress(void *arg) {
+    ht_init_firmware();
+    appzb_wait_until_connected();
+    // Every change is persistent, the NVS flushes have something to write
+    zcctlm_cmd_post(ZCCTLM_CMD_SET_STARTUP_BEHAVIOR, ZCCTL_STARTUP_PREVIOUS);
+    ht_delay_ms(500);
+
+    zcctlm_lock_stats_t locks_before, locks;
+    zcctlm_cmd_stats_t cmd_before, cmd;
+    zcctlm_get_lock_stats(&locks_before);
+    zcctlm_cmd_get_stats(&cmd_before);
+    ltr_reset();
+
+    // Chaos: the output and the reports follow the model whatever happened
+    run_phase(PHASE_CHAOS, phase_seconds);
+    ltr_histogram_t lock_wait, end_to_end;
+    ltr_get_histogram(LTR_STAGE_LOCK_WAIT, &lock_wait);
+    ltr_get_histogram(LTR_STAGE_END_TO_END, &end_to_end);
+    wait_settled();
+
+    zcctlm_state_t state;
+    zcctlm_get_state(&state);
+    check_consistent(&state);
+    HT_CHECK_EQ(sim_lock_order_violations(), 0);
+    HT_CHECK(lock_wait.max_us <= STRESS_MAX_LOCK_WAIT_US);
+    HT_CHECK(end_to_end.max_us <= STRESS_MAX_LATENCY_US);
+
+    zcctlm_get_lock_stats(&locks);
+    zcctlm_cmd_get_stats(&cmd);
+    printf("seed %u chaos: %u frames (%u lost, %u commands coalesced, %u stalled), %u button, %u flushes, %u reads\n", (unsigned)seed,
+           (unsigned)stress.frames, (unsigned)stress.frames_lost, (unsigned)(cmd.coalesced - cmd_before.coalesced),
+           (unsigned)(cmd.stalled - cmd_before.stalled), (unsigned)stress.button_actions,
+           (unsigned)stress.flushes, (unsigned)stress.reads);
+    printf("seed %u chaos: state_mutex %u takes, %u contended, wait p50 %u p99 %u max %u us; end to end p50 %u p99 %u max %u us\n",
+           (unsigned)seed, (unsigned)(locks.lock_taken - locks_before.lock_taken), (unsigned)(locks.lock_contended - locks_before.lock_contended),
+           (unsigned)ltr_percentile(&lock_wait, 500), (unsigned)ltr_percentile(&lock_wait, 990), (unsigned)lock_wait.max_us,
+           (unsigned)ltr_percentile(&end_to_end, 500), (unsigned)ltr_percentile(&end_to_end, 990), (unsigned)end_to_end.max_us);
+
+    // Parity: toggles and absolute writes race, none of them may get lost
+    stress.toggles = 0;
+    stress.last_level = -1;
+    stress.last_mireds = -1;
+    bool initial_on_off = state.on_off;
+    zcctlm_cmd_get_stats(&cmd_before);
+    run_phase(PHASE_PARITY, STRESS_PARITY_SECONDS);
+    wait_settled();
+
+    zcctlm_get_state(&state);
+    zcctlm_cmd_get_stats(&cmd);
+    HT_CHECK_EQ(cmd.coalesced, cmd_before.coalesced);
+    HT_CHECK_EQ(cmd.stalled, cmd_before.stalled);
+    HT_CHECK_EQ(state.on_off, initial_on_off ^ (stress.toggles & 1));
+    if (stress.last_level >= 0)
+        HT_CHECK_EQ(state.brightness, stress.last_level);
+    if (stress.last_mireds >= 0)
+        HT_CHECK_EQ(state.mireds, stress.last_mireds);
+    check_consistent(&state);
+    HT_CHECK_EQ(sim_lock_order_violations(), 0);
+    printf("seed %u parity: %u toggles, level %d, mireds %d\n", (unsigned)seed, (unsigned)stress.toggles, (int)stress.last_level,
+           (int)stress.last_mireds);
+}
+
+static uint32_t env_u32(const char *name, uint32_t fallback) {
+    const char *value = getenv(name);
+    return value != NULL && atoi(value) > 0 ? (uint32_t)atoi(value) : fallback;
+}
+
+int main(void) {
+    uint32_t seeds = env_u32("STRESS_SEEDS", STRESS_DEFAULT_SEEDS);
+    phase_seconds = env_u32("STRESS_SECONDS", STRESS_DEFAULT_SECONDS);
+
+    int failures = 0;
+    for (seed = 1; seed <= seeds; seed++) {
+        char name[32];
+        snprintf(name, sizeof(name), "stress seed %u", (unsigned)seed);
+        // A deadlock or a task that never lets main run again ends the boot early
+        sim_config_t config = {
+            .seed = seed,
+            .yield_permille = STRESS_YIELD_PERMILLE,
+            .jitter_us = STRESS_JITTER_US,
+            .time_limit_us = (int64_t)(phase_seconds + STRESS_PARITY_SECONDS + 60) * 1000000,
+        };
+        failures += ht_run_boot(&(ht_boot_t){.name = name, .fn = boot_stress, .config = &config});
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
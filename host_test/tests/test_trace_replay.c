@@ -0,0 +1,282 @@
+// Command traces: recording on the lamp, the trace format and log capture, and replays of typical traffic with their latency and flicker
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "host_test.h"
+#include "trace_replay.h"
+
+#include "command_trace.h"
+#include "led_controller.h"
+#include "zb_app.h"
+#include "zcctlm_cmd.h"
+#include "zigbee_cct_light_model.h"
+
+#define TRACE_FILE "trace_replay.bin"
+#define LOG_FILE "trace_replay.log"
+#define CSV_FILE "trace_replay_slider.csv"
+#define JSON_FILE "trace_replay_slider.json"
+
+// Longest acceptable time from a frame to the first LEDC update of its command: settle window plus scheduling
+#define MAX_LATENCY_US ((ZCCTLM_SETTLE_WINDOW_MS + 50) * 1000)
+
+static void check_output(bool on_off, uint8_t brightness, uint16_t mireds) {
+    uint16_t warm_duty, cold_duty;
+    ht_expected_duty(on_off, brightness, mireds, &warm_duty, &cold_duty);
+    HT_CHECK_EQ(sim_ledc_duty(LC_WARM_CHANNEL), warm_duty);
+    HT_CHECK_EQ(sim_ledc_duty(LC_COLD_CHANNEL), cold_duty);
+}
+
+static void start_lamp(void) {
+    ht_init_firmware();
+    appzb_wait_until_connected();
+    ht_delay_ms(1000);
+}
+
+static void add_on_off(tr_trace_t *trace, uint32_t time_us, bool on_off) {
+    tr_add_set_attr(trace, time_us, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, ESP_ZB_ZCL_ATTR_TYPE_BOOL, &on_off, 1);
+}
+
+static void add_level(tr_trace_t *trace, uint32_t time_us, uint8_t level) {
+    tr_add_set_attr(trace, time_us, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, ESP_ZB_ZCL_ATTR_TYPE_U8,
+                    &level, 1);
+}
+
+static void add_color_temp(tr_trace_t *trace, uint32_t time_us, uint16_t mireds) {
+    const uint8_t value[] = {mireds & 0xff, mireds >> 8};
+    tr_add_set_attr(trace, time_us, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, ESP_ZB_ZCL_ATTR_TYPE_U16,
+                    value, sizeof(value));
+}
+
+static void add_move_to_level(tr_trace_t *trace, uint32_t time_us, uint8_t level, uint16_t transition_time) {
+    const uint8_t payload[] = {level, transition_time & 0xff, transition_time >> 8};
+    tr_add_command(trace, time_us, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL_WITH_ON_OFF, payload,
+                   sizeof(payload));
+}
+
+// Recall with the extension fields of the scene: OnOff, CurrentLevel and ColorTemperatureMireds (offset 11 of the color field set)
+static void add_recall_scene(tr_trace_t *trace, uint32_t time_us, uint8_t scene_id, uint16_t transition_time, uint8_t level, uint16_t mireds) {
+    uint8_t fields[] = {
+        ESP_ZB_ZCL_CLUSTER_ID_ON_OFF & 0xff, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF >> 8, 1, 1,
+        ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL & 0xff, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL >> 8, 1, level,
+        ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL & 0xff, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL >> 8, 13, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    };
+    fields[sizeof(fields) - 2] = mireds & 0xff;
+    fields[sizeof(fields) - 1] = mireds >> 8;
+    tr_add_recall_scene(trace, time_us, 0x0001, scene_id, transition_time, fields, sizeof(fields));
+}
+
+/*
+ * Home Assistant slider drag: MoveToLevelWithOnOff every 80 ms while the slider moves up, 1/10 s transitions.
+ * The output must follow without a jump or a quick reversal.
+ */
+static void build_slider_drag(tr_trace_t *trace) {
+    for (int i = 0; i < 30; i++)
+        add_move_to_level(trace, i * 80000, (uint8_t)(60 + i * 5), 1);
+}
+
+/*
+ * Group scene changes: a wall switch recalls "evening" then "reading" for the group, 1 s transitions,
+ * and an automation turns the group off a few seconds later.
+ */
+static void build_group_scenes(tr_trace_t *trace) {
+    add_recall_scene(trace, 0, 1, 10, 90, 350);
+    add_recall_scene(trace, 3000000, 2, 10, 220, 220);
+    add_on_off(trace, 6000000, false);
+}
+
+/*
+ * Automation burst: ten automations firing together, each writing OnOff, CurrentLevel and ColorTemperature
+ * within a few ms, the automations 20 ms apart.
+ */
+static void build_automation_burst(tr_trace_t *trace) {
+    for (int i = 0; i < 10; i++) {
+        uint32_t time_us = i * 20000;
+        add_on_off(trace, time_us, true);
+        add_level(trace, time_us + 2000, (uint8_t)(100 + i * 10));
+        add_color_temp(trace, time_us + 4000, (uint16_t)(200 + i * 15));
+    }
+}
+
+static void check_same_frames(const tr_trace_t *actual, const tr_trace_t *expected, uint32_t time_tolerance_us) {
+    HT_CHECK_EQ(actual->count, expected->count);
+    for (size_t i = 0; i < actual->count && i < expected->count; i++) {
+        const tr_frame_t *a = &actual->frames[i], *e = &expected->frames[i];
+        HT_CHECK_NEAR(a->time_us, e->time_us, time_tolerance_us);
+        HT_CHECK_EQ(a->kind, e->kind);
+        HT_CHECK_EQ(a->cluster_id, e->cluster_id);
+        HT_CHECK_EQ(a->id, e->id);
+        HT_CHECK_EQ(a->size, e->size);
+        HT_CHECK(memcmp(a->data, e->data, a->size < e->size ? a->size : e->size) == 0);
+    }
+}
+
+// The trace format round trips through a file and through the hex lines of a captured log
+static void boot_trace_format(void *arg) {
+    tr_trace_t trace = {0}, loaded[2] = {0};
+    build_group_scenes(&trace);
+    build_automation_burst(&trace);
+    tr_add_store_scene(&trace, 9000000, 0x0001, 3);
+
+    HT_CHECK(tr_save(TRACE_FILE, &trace));
+    HT_CHECK_EQ(tr_load(TRACE_FILE, loaded, 2), 1);
+    check_same_frames(&loaded[0], &trace, 0);
+    tr_free(&loaded[0]);
+
+    // Two dumps as ctr_dump writes them, between other logs
+    size_t size = tr_encoded_size(&trace);
+    uint8_t *data = malloc(size);
+    HT_CHECK_EQ(tr_encode(&trace, data, size), size);
+    FILE *log = fopen(LOG_FILE, "w");
+    for (int dump = 0; dump < 2; dump++) {
+        fprintf(log, "I (1200) main: unrelated line\n");
+        for (size_t offset = 0; offset < size; offset += CTR_LOG_LINE_BYTES) {
+            fprintf(log, "I (%d) CTR: " CTR_LOG_PREFIX "%04zx ", 5000 + dump, offset);
+            for (size_t i = offset; i < size && i < offset + CTR_LOG_LINE_BYTES; i++)
+                fprintf(log, "%02x", data[i]);
+            fprintf(log, "\r\n");
+        }
+        fprintf(log, "I (%d) CTR: " CTR_LOG_PREFIX "end, %zu records, 0 lost\n", 5000 + dump, trace.count);
+    }
+    fclose(log);
+    free(data);
+
+    HT_CHECK_EQ(tr_load(LOG_FILE, loaded, 2), 2);
+    check_same_frames(&loaded[0], &trace, 0);
+    check_same_frames(&loaded[1], &trace, 0);
+    tr_free(&loaded[0]);
+    tr_free(&loaded[1]);
+    tr_free(&trace);
+    remove(TRACE_FILE);
+    remove(LOG_FILE);
+}
+
+// The recorder of the firmware captures what a replay injects, with the same timing
+static void boot_record(void *arg) {
+    start_lamp();
+    tr_trace_t trace = {0};
+    build_automation_burst(&trace);
+    tr_add_store_scene(&trace, 400000, 0x0001, 3);
+    add_recall_scene(&trace, 500000, 1, 10, 90, 350);
+    tr_replay_t replay;
+    tr_replay(&trace, &replay);
+    tr_replay_free(&replay);
+
+    static uint8_t data[CTR_BUFFER_SIZE];
+    esp_zb_lock_acquire(portMAX_DELAY);
+    size_t size = ctr_get_trace(data, sizeof(data));
+    esp_zb_lock_release();
+
+    tr_trace_t recorded;
+    HT_CHECK(tr_decode(data, size, &recorded));
+    HT_CHECK_EQ(recorded.lost, 0);
+    check_same_frames(&recorded, &trace, 1000);
+    tr_free(&recorded);
+
+    // Dumped once the lamp was idle for CTR_IDLE_DUMP_MS
+    ht_delay_ms(CTR_IDLE_DUMP_MS);
+    esp_zb_lock_acquire(portMAX_DELAY);
+    HT_CHECK_EQ(ctr_get_trace(data, sizeof(data)), sizeof(ctr_header_t));
+    esp_zb_lock_release();
+    tr_free(&trace);
+}
+
+static void boot_slider_drag(void *arg) {
+    start_lamp();
+    tr_trace_t trace = {0};
+    build_slider_drag(&trace);
+    tr_replay_t replay;
+    tr_replay(&trace, &replay);
+
+    const tr_metrics_t *metrics = &replay.metrics;
+    tr_write_metrics(stdout, "slider drag", metrics);
+    check_output(true, 60 + 29 * 5, ZCCTLM_DEFAULT_TEMP);
+    HT_CHECK_EQ(metrics->lost_frames, 0);
+    HT_CHECK_EQ(metrics->cmd_stalled, 0);
+    HT_CHECK(metrics->updates > 0);
+    HT_CHECK(metrics->latency_max_us <= MAX_LATENCY_US);
+    HT_CHECK_EQ(metrics->reversals, 0);
+    // Turning on from off jumps to the minimum duty, everything after that fades
+    HT_CHECK(metrics->max_step <= LC_MAX_DUTY / 10);
+
+    // Timelines for a look at the fades, ctest keeps them in the build directory
+    HT_CHECK(tr_write_csv(CSV_FILE, &replay));
+    HT_CHECK(tr_write_chrome_trace(JSON_FILE, &trace, &replay));
+    FILE *csv = fopen(CSV_FILE, "r");
+    HT_CHECK(csv != NULL);
+    size_t rows = 0;
+    for (int c; csv != NULL && (c = fgetc(csv)) != EOF;)
+        rows += c == '\n';
+    if (csv != NULL)
+        fclose(csv);
+    HT_CHECK_EQ(rows, replay.point_count + 1);
+
+    tr_replay_free(&replay);
+    tr_free(&trace);
+}
+
+static void boot_group_scenes(void *arg) {
+    start_lamp();
+    tr_trace_t trace = {0};
+    build_group_scenes(&trace);
+
+    // Scene 2 is half way through, then the group goes off
+    tr_replay_t replay;
+    tr_replay(&trace, &replay);
+    const tr_metrics_t *metrics = &replay.metrics;
+    tr_write_metrics(stdout, "group scenes", metrics);
+    check_output(false, 0, 0);
+    HT_CHECK_EQ(metrics->updates, 3);
+    HT_CHECK(metrics->latency_max_us <= MAX_LATENCY_US);
+    HT_CHECK_EQ(metrics->reversals, 0);
+
+    // Each channel reached the value of scene 2 before the group went off
+    uint16_t warm_duty, cold_duty;
+    ht_expected_duty(true, 220, 220, &warm_duty, &cold_duty);
+    bool warm_seen = false, cold_seen = false;
+    for (size_t i = 0; i < replay.point_count; i++) {
+        const tr_point_t *point = &replay.points[i];
+        warm_seen |= point->channel == LC_WARM_CHANNEL && point->duty == warm_duty && point->time_us < replay.frames[2].inject_us;
+        cold_seen |= point->channel == LC_COLD_CHANNEL && point->duty == cold_duty && point->time_us < replay.frames[2].inject_us;
+    }
+    HT_CHECK(warm_seen);
+    HT_CHECK(cold_seen);
+
+    tr_replay_free(&replay);
+    tr_free(&trace);
+}
+
+static void boot_automation_burst(void *arg) {
+    start_lamp();
+    tr_trace_t trace = {0};
+    build_automation_burst(&trace);
+    tr_replay_t replay;
+    tr_replay(&trace, &replay);
+
+    const tr_metrics_t *metrics = &replay.metrics;
+    tr_write_metrics(stdout, "automation burst", metrics);
+    check_output(true, 190, 335);
+    HT_CHECK_EQ(metrics->lost_frames, 0);
+    HT_CHECK_EQ(metrics->cmd_stalled, 0);
+    HT_CHECK(metrics->cmd_high_water < ZCCTLM_CMD_QUEUE_SIZE);
+    HT_CHECK(metrics->latency_max_us <= MAX_LATENCY_US);
+    HT_CHECK_EQ(metrics->reversals, 0);
+    // Bursts replay far faster than they happened
+    HT_CHECK(metrics->host_ns < (uint64_t)metrics->virtual_us * 1000);
+
+    tr_replay_free(&replay);
+    tr_free(&trace);
+}
+
+int main(void) {
+    int failures = 0;
+    failures += ht_run_boot(&(ht_boot_t){.name = "trace format", .fn = boot_trace_format});
+    failures += ht_run_boot(&(ht_boot_t){.name = "record", .fn = boot_record});
+    failures += ht_run_boot(&(ht_boot_t){.name = "slider drag", .fn = boot_slider_drag});
+    failures += ht_run_boot(&(ht_boot_t){.name = "group scenes", .fn = boot_group_scenes});
+    failures += ht_run_boot(&(ht_boot_t){.name = "automation burst", .fn = boot_automation_burst});
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
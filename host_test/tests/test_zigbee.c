@@ -0,0 +1,407 @@
+// Zigbee glue on the host build: commissioning, frames from the network down to the LEDs, handler throughput and report amplification
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host_test.h"
+
+#include "led_controller.h"
+#include "zb_app.h"
+#include "zb_attr_report.h"
+#include "zb_config.h"
+#include "zb_sim.h"
+#include "zcctlm_cmd.h"
+#include "zigbee_cct_light_model.h"
+
+#define NVS_JOINED "zigbee_joined.nvs"
+
+// Time for a change with the default transition to reach its final duty and be reported, with margin
+#define SETTLED_MS (ZCCTLM_SETTLE_WINDOW_MS + ZCCTLM_DEFAULT_TRANSITION_TIME_MS + ZBATTR_REPORT_COALESCE_MS + 300)
+
+// Frames of the throughput scenario and the interval between them
+#define BURST_FRAMES 5000
+#define BURST_INTERVAL_US 200
+
+static void check_output(bool on_off, uint8_t brightness, uint16_t mireds) {
+    uint16_t warm_duty, cold_duty;
+    ht_expected_duty(on_off, brightness, mireds, &warm_duty, &cold_duty);
+    HT_CHECK_EQ(sim_ledc_duty(LC_WARM_CHANNEL), warm_duty);
+    HT_CHECK_EQ(sim_ledc_duty(LC_COLD_CHANNEL), cold_duty);
+}
+
+static void check_attribute(uint16_t cluster_id, uint16_t attr_id, uint32_t expected) {
+    uint32_t value = 0;
+    HT_CHECK(zbsim_read_attribute(cluster_id, attr_id, &value));
+    HT_CHECK_EQ(value, expected);
+}
+
+// Value of the last report frame of an attribute, -1 without one
+static int64_t last_report_value(uint16_t cluster_id, uint16_t attr_id) {
+    size_t count;
+    const zbsim_report_t *reports = zbsim_reports(&count);
+    for (size_t i = count; i > 0; i--) {
+        if (reports[i - 1].cluster_id == cluster_id && reports[i - 1].attr_id == attr_id)
+            return reports[i - 1].value;
+    }
+    return -1;
+}
+
+static void set_on_off(bool on_off) {
+    zbsim_inject_set_attr(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, ESP_ZB_ZCL_ATTR_TYPE_BOOL, &on_off);
+}
+
+static void set_level(uint8_t level) {
+    zbsim_inject_set_attr(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, ESP_ZB_ZCL_ATTR_TYPE_U8, &level);
+}
+
+static void set_color_temp(uint16_t mireds) {
+    zbsim_inject_set_attr(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, &mireds);
+}
+
+static void set_light(uint8_t level, uint16_t mireds) {
+    set_on_off(true);
+    set_level(level);
+    set_color_temp(mireds);
+    ht_delay_ms(SETTLED_MS);
+}
+
+// AddGroup with an empty name, the stack adds the endpoint to the group
+static void add_group(uint16_t group_id) {
+    const uint8_t payload[] = {group_id & 0xff, group_id >> 8, 0};
+    zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_GROUPS, ESP_ZB_ZCL_CMD_GROUPS_ADD_GROUP, payload, sizeof(payload));
+}
+
+// RecallScene with the extension fields the stack keeps for the scene: on, level and ColorTemperatureMireds (offset 11)
+static void recall_scene(uint16_t group_id, uint8_t scene_id, uint8_t level, uint16_t mireds) {
+    uint8_t on_off = 1;
+    uint8_t color[13] = {0};
+    color[11] = mireds & 0xff;
+    color[12] = mireds >> 8;
+    esp_zb_zcl_scenes_extension_field_t color_field = {
+        .cluster_id = ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, .length = sizeof(color), .extension_field_attribute_value_list = color};
+    esp_zb_zcl_scenes_extension_field_t level_field = {
+        .cluster_id = ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, .length = 1, .extension_field_attribute_value_list = &level, .next = &color_field};
+    esp_zb_zcl_scenes_extension_field_t on_off_field = {
+        .cluster_id = ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, .length = 1, .extension_field_attribute_value_list = &on_off, .next = &level_field};
+    zbsim_inject_recall_scene(group_id, scene_id, 0, &on_off_field);
+    ht_delay_ms(SETTLED_MS);
+}
+
+static void boot_first_join(void *arg) {
+    ht_init_firmware();
+    ht_delay_ms(ZBSIM_STEERING_TIME_MS / 2);
+    HT_CHECK(!appzb_is_connected());
+
+    // A factory new device steers and joins
+    appzb_wait_until_connected();
+    HT_CHECK(sim_now_us() <= (ZBSIM_STEERING_TIME_MS + 100) * 1000);
+    HT_CHECK(zbsim_is_joined());
+
+    // The state reported after joining is the one of the clusters
+    zcctlm_report_current_state();
+    ht_delay_ms(SETTLED_MS);
+    HT_CHECK_EQ(last_report_value(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID), ZCCTLM_DEFAULT_ONOFF);
+    HT_CHECK_EQ(last_report_value(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID), ZCCTLM_DEFAULT_BRIGHTNESS);
+    HT_CHECK_EQ(last_report_value(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID), ZCCTLM_DEFAULT_TEMP);
+}
+
+static void boot_rejoin(void *arg) {
+    ht_init_firmware();
+
+    // The network is kept over a reboot, no steering
+    ht_delay_ms(50);
+    HT_CHECK(appzb_is_connected());
+}
+
+static void boot_attribute_writes(void *arg) {
+    ht_init_firmware();
+    appzb_wait_until_connected();
+
+    // Home Assistant turning a light on: OnOff, CurrentLevel and ColorTemperature within a few ms
+    zbsim_clear_reports();
+    set_on_off(true);
+    ht_delay_ms(20);
+    set_level(150);
+    ht_delay_ms(20);
+    set_color_temp(300);
+    ht_delay_ms(SETTLED_MS);
+
+    check_output(true, 150, 300);
+    check_attribute(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, 150);
+    HT_CHECK_EQ(last_report_value(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID), 1);
+    HT_CHECK_EQ(last_report_value(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID), 150);
+    HT_CHECK_EQ(last_report_value(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID), 300);
+
+    // One frame per attribute for the whole sequence
+    size_t count;
+    zbsim_reports(&count);
+    HT_CHECK(count <= 3);
+
+    // A type the attribute does not have never reaches the application
+    zbsim_stats_t stats;
+    uint16_t level = 20;
+    zbsim_inject_set_attr(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, &level);
+    zbsim_flush();
+    zbsim_get_stats(&stats);
+    HT_CHECK_EQ(stats.unsupported, 1);
+    HT_CHECK_EQ(stats.action_errors, 0);
+}
+
+static void boot_privilege_commands(void *arg) {
+    ht_init_firmware();
+    appzb_wait_until_connected();
+
+    // MoveToLevelWithOnOff: level 200 in 0.5 s
+    const uint8_t move_to_level[] = {200, 5, 0};
+    zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL_WITH_ON_OFF, move_to_level,
+                         sizeof(move_to_level));
+    ht_delay_ms(ZCCTLM_SETTLE_WINDOW_MS + 500 + 300);
+    check_output(true, 200, ZCCTLM_DEFAULT_TEMP);
+
+    // MoveToColorTemperature: 200 mireds in 0.3 s
+    const uint8_t move_to_color_temp[] = {200, 0, 3, 0};
+    zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_CMD_COLOR_CONTROL_MOVE_TO_COLOR_TEMPERATURE, move_to_color_temp,
+                         sizeof(move_to_color_temp));
+    ht_delay_ms(300 + 300);
+    check_output(true, 200, 200);
+    HT_CHECK_EQ(last_report_value(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID), 200);
+
+    zbsim_stats_t stats;
+    zbsim_get_stats(&stats);
+    HT_CHECK_EQ(stats.action_errors, 0);
+    HT_CHECK_EQ(stats.unsupported, 0);
+}
+
+// Scenes the stack overwrites or removes are dropped from the local table, recalls use the stack's fields again
+static void boot_scene_changes(void *arg) {
+    ht_init_firmware();
+    appzb_wait_until_connected();
+
+    add_group(0x0001);
+    add_group(0x0002);
+    set_light(100, 300);
+    zbsim_inject_store_scene(0x0001, 1);
+    zbsim_inject_store_scene(0x0001, 2);
+    ht_delay_ms(100);
+    HT_CHECK_EQ(zcctlm_scenes_count(), 2);
+
+    // AddScene overwrites scene 1: its new fields are recalled, not the values stored before
+    const uint8_t add_scene[] = {0x01, 0x00, 1, 0, 0, 0};
+    zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_SCENES, ESP_ZB_ZCL_CMD_SCENES_ADD_SCENE, add_scene, sizeof(add_scene));
+    recall_scene(0x0001, 1, 200, 200);
+    check_output(true, 200, 200);
+    HT_CHECK_EQ(zcctlm_scenes_count(), 1);
+
+    // RemoveScene then AddScene again: the removed scene is not recalled either
+    const uint8_t remove_scene[] = {0x01, 0x00, 2};
+    zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_SCENES, ESP_ZB_ZCL_CMD_SCENES_REMOVE_SCENE, remove_scene, sizeof(remove_scene));
+    ht_delay_ms(100);
+    HT_CHECK_EQ(zcctlm_scenes_count(), 0);
+    recall_scene(0x0001, 2, 50, 350);
+    check_output(true, 50, 350);
+
+    // Scenes of other groups are kept
+    zbsim_inject_store_scene(0x0002, 1);
+    zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_SCENES, ESP_ZB_ZCL_CMD_SCENES_REMOVE_SCENE, remove_scene, sizeof(remove_scene));
+    ht_delay_ms(100);
+    HT_CHECK_EQ(zcctlm_scenes_count(), 1);
+
+    // The stack rejects AddScene and RemoveScene for a group the endpoint is not a member of, the local scene stays
+    // (the simulated stack does not check StoreScene)
+    const uint8_t add_scene_3[] = {0x03, 0x00, 1, 0, 0, 0};
+    const uint8_t remove_scene_3[] = {0x03, 0x00, 1};
+    zbsim_inject_store_scene(0x0003, 1);
+    zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_SCENES, ESP_ZB_ZCL_CMD_SCENES_ADD_SCENE, add_scene_3, sizeof(add_scene_3));
+    zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_SCENES, ESP_ZB_ZCL_CMD_SCENES_REMOVE_SCENE, remove_scene_3, sizeof(remove_scene_3));
+    ht_delay_ms(100);
+    HT_CHECK_EQ(zcctlm_scenes_count(), 2);
+    HT_CHECK(zcctlm_scenes_find(0x0003, 1, &(zcctlm_scene_t){0}));
+}
+
+// RemoveAllScenes, RemoveGroup and RemoveAllGroups drop every scene of the groups, the global scenes stay
+static void boot_group_scene_removal(void *arg) {
+    ht_init_firmware();
+    appzb_wait_until_connected();
+
+    for (uint16_t group_id = 0x0001; group_id <= 0x0003; group_id++) {
+        add_group(group_id);
+    }
+    set_light(100, 300);
+    for (uint8_t scene_id = 1; scene_id <= 2; scene_id++) {
+        zbsim_inject_store_scene(0x0000, scene_id);
+        zbsim_inject_store_scene(0x0001, scene_id);
+        zbsim_inject_store_scene(0x0002, scene_id);
+        zbsim_inject_store_scene(0x0003, scene_id);
+    }
+    ht_delay_ms(100);
+    HT_CHECK_EQ(zcctlm_scenes_count(), 8);
+
+    const uint8_t group_1[] = {0x01, 0x00};
+    zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_SCENES, ESP_ZB_ZCL_CMD_SCENES_REMOVE_ALL_SCENES, group_1, sizeof(group_1));
+    recall_scene(0x0001, 1, 200, 200);
+    check_output(true, 200, 200);
+    HT_CHECK_EQ(zcctlm_scenes_count(), 6);
+
+    const uint8_t group_2[] = {0x02, 0x00};
+    zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_GROUPS, ESP_ZB_ZCL_CMD_GROUPS_REMOVE_GROUP, group_2, sizeof(group_2));
+    recall_scene(0x0002, 2, 50, 350);
+    check_output(true, 50, 350);
+    HT_CHECK_EQ(zcctlm_scenes_count(), 4);
+
+    zbsim_inject_command(ESP_ZB_ZCL_CLUSTER_ID_GROUPS, ESP_ZB_ZCL_CMD_GROUPS_REMOVE_ALL_GROUPS, NULL, 0);
+    recall_scene(0x0003, 1, 150, 250);
+    check_output(true, 150, 250);
+    HT_CHECK_EQ(zcctlm_scenes_count(), 2);
+
+    // The global scenes still come from the local table
+    recall_scene(0x0000, 1, 20, 340);
+    check_output(true, 100, 300);
+}
+
+/*
+ * A dimmer sending far more than a radio could: BURST_FRAMES CurrentLevel writes, one every BURST_INTERVAL_US.
+ * Every frame must reach the handler, the LEDs must end at the last value and the network must hear only a
+ * few frames (report amplification = frames sent per change received).
+ */
+static void boot_throughput(void *arg) {
+    ht_init_firmware();
+    appzb_wait_until_connected();
+    set_on_off(true);
+    ht_delay_ms(SETTLED_MS);
+
+    zbsim_clear_reports();
+    zbsim_reset_stats();
+    int64_t start_us = sim_now_us();
+    uint8_t level = 0;
+    for (int i = 0; i < BURST_FRAMES; i++) {
+        level = (uint8_t)(1 + i % ZCCTLM_MAX_BRIGHTNESS);
+        set_level(level);
+        sim_sleep_us(BURST_INTERVAL_US);
+    }
+    int64_t burst_us = sim_now_us() - start_us;
+    ht_delay_ms(SETTLED_MS + ZBATTR_REPORT_CLUSTER_INTERVAL_MS);
+
+    check_output(true, level, ZCCTLM_DEFAULT_TEMP);
+    HT_CHECK_EQ(last_report_value(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID), level);
+
+    zbsim_stats_t stats;
+    zbsim_get_stats(&stats);
+    HT_CHECK_EQ(stats.lost, 0);
+    HT_CHECK_EQ(stats.actions, BURST_FRAMES);
+    HT_CHECK_EQ(stats.action_errors, 0);
+    zcctlm_cmd_stats_t cmd;
+    zcctlm_cmd_get_stats(&cmd);
+
+    // The level cluster may send once per interval, plus the final value
+    size_t frames = zbsim_count_reports(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID);
+    HT_CHECK(frames <= (size_t)(burst_us / (ZBATTR_REPORT_CLUSTER_INTERVAL_MS * 1000)) + 2);
+
+    double host_s = stats.action_host_ns / 1e9;
+    printf("throughput: frames %u, virtual rate %.0f/s, handler %.2f us avg %.2f us max, host rate %.0f/s, "
+           "cmd coalesced %u stalled %u, level reports %zu, amplification %.4f\n",
+           stats.actions, BURST_FRAMES / (burst_us / 1e6), host_s * 1e6 / stats.actions, stats.action_max_host_ns / 1e3,
+           host_s > 0 ? stats.actions / host_s : 0.0, (unsigned)cmd.coalesced, (unsigned)cmd.stalled, frames,
+           (double)stats.app_reports / stats.actions);
+}
+
+/*
+ * Once a remote configured reporting of CurrentLevel, the stack reports it on its own: a sweep produces at most one
+ * frame per min interval, and only changes of at least the reportable change.
+ */
+static void boot_configured_reporting(void *arg) {
+    ht_init_firmware();
+    appzb_wait_until_connected();
+    set_on_off(true);
+    ht_delay_ms(SETTLED_MS);
+
+    const uint16_t min_interval_s = 1;
+    const uint32_t delta = 10;
+    zbsim_configure_reporting(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, min_interval_s, 300, delta);
+    zbsim_flush();
+
+    zbsim_clear_reports();
+    zbsim_reset_stats();
+    int64_t start_us = sim_now_us();
+    for (int level = 10; level <= 250; level++) {
+        set_level((uint8_t)level);
+        ht_delay_ms(10);
+    }
+    int64_t sweep_us = sim_now_us() - start_us;
+    ht_delay_ms(min_interval_s * 1000 + SETTLED_MS);
+
+    check_output(true, 250, ZCCTLM_DEFAULT_TEMP);
+    zbsim_stats_t stats;
+    zbsim_get_stats(&stats);
+    HT_CHECK_EQ(stats.app_reports - zbsim_count_reports(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID), 0);
+    HT_CHECK(stats.stack_reports >= 1);
+    HT_CHECK(stats.stack_reports <= (uint32_t)(sweep_us / (min_interval_s * 1000000)) + 2);
+    HT_CHECK_EQ(last_report_value(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID), 250);
+
+    size_t count;
+    const zbsim_report_t *reports = zbsim_reports(&count);
+    for (size_t i = 1; i < count; i++) {
+        if (reports[i].source == ZBSIM_REPORT_STACK && reports[i - 1].source == ZBSIM_REPORT_STACK)
+            HT_CHECK(reports[i].time_us - reports[i - 1].time_us >= min_interval_s * 1000000);
+    }
+
+    zbattr_report_stats_t report_stats;
+    zbattr_get_report_stats(&report_stats);
+    HT_CHECK(report_stats.delegated > 0);
+    printf("configured reporting: changes %u, stack frames %u, amplification %.4f\n", stats.actions, stats.stack_reports,
+           (double)stats.stack_reports / stats.actions);
+}
+
+static void boot_not_joinable(void *arg) {
+    zbsim_set_joinable(false);
+    ht_init_firmware();
+    ht_delay_ms(5 * ZBSIM_STEERING_TIME_MS);
+    HT_CHECK(!appzb_is_connected());
+
+    // The light works without a network, nothing is reported
+    set_on_off(true);
+    set_level(120);
+    ht_delay_ms(SETTLED_MS);
+    check_output(true, 120, ZCCTLM_DEFAULT_TEMP);
+    size_t count;
+    zbsim_reports(&count);
+    HT_CHECK_EQ(count, 0);
+
+    // Joins once the network opens, the next steering attempt succeeds
+    zbsim_set_joinable(true);
+    ht_delay_ms(2 * ZBSIM_STEERING_TIME_MS + 100);
+    HT_CHECK(appzb_is_connected());
+}
+
+static void boot_leave(void *arg) {
+    ht_init_firmware();
+    appzb_wait_until_connected();
+
+    // Removed from the network: the stack and the light model are reset and the device restarts
+    zbsim_inject_signal(ESP_ZB_ZDO_SIGNAL_LEAVE, ESP_OK);
+    ht_delay_ms(100);
+    HT_CHECK(false); // not reached
+}
+
+static void boot_after_leave(void *arg) {
+    ht_init_firmware();
+    ht_delay_ms(ZBSIM_STEERING_TIME_MS / 2);
+    HT_CHECK(!appzb_is_connected());
+    appzb_wait_until_connected();
+}
+
+int main(void) {
+    int failures = 0;
+    failures += ht_run_boot(&(ht_boot_t){.name = "first join", .fn = boot_first_join, .nvs_out = NVS_JOINED});
+    failures += ht_run_boot(&(ht_boot_t){.name = "rejoin", .fn = boot_rejoin, .nvs_in = NVS_JOINED});
+    failures += ht_run_boot(&(ht_boot_t){.name = "attribute writes", .fn = boot_attribute_writes});
+    failures += ht_run_boot(&(ht_boot_t){.name = "privilege commands", .fn = boot_privilege_commands});
+    failures += ht_run_boot(&(ht_boot_t){.name = "scene changes", .fn = boot_scene_changes});
+    failures += ht_run_boot(&(ht_boot_t){.name = "group scene removal", .fn = boot_group_scene_removal});
+    failures += ht_run_boot(&(ht_boot_t){.name = "throughput", .fn = boot_throughput});
+    failures += ht_run_boot(&(ht_boot_t){.name = "configured reporting", .fn = boot_configured_reporting});
+    failures += ht_run_boot(&(ht_boot_t){.name = "not joinable", .fn = boot_not_joinable});
+    failures += ht_run_boot(&(ht_boot_t){.name = "leave", .fn = boot_leave, .nvs_in = NVS_JOINED, .nvs_out = NVS_JOINED, .expect = SIM_RUN_RESTART});
+    failures += ht_run_boot(&(ht_boot_t){.name = "after leave", .fn = boot_after_leave, .nvs_in = NVS_JOINED});
+    remove(NVS_JOINED);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,564 @@
+#include "trace_replay.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "sim.h"
+
+#include "latency_trace.h"
+#include "led_controller.h"
+#include "zcctlm_cmd.h"
+
+// Longest wait for the output to settle after the last frame, an endless effect would never be quiet
+#define TR_SETTLE_LIMIT_US (60LL * 1000 * 1000)
+
+static const uint8_t tracked_channels[] = {LC_WARM_CHANNEL, LC_COLD_CHANNEL};
+#define TRACKED_CHANNEL_COUNT (sizeof(tracked_channels) / sizeof(tracked_channels[0]))
+
+static const char *channel_name(uint8_t channel) {
+    switch (channel) {
+    case LC_WARM_CHANNEL:
+        return "warm";
+    case LC_COLD_CHANNEL:
+        return "cold";
+    default:
+        return "other";
+    }
+}
+
+static const char *const kind_names[CTR_KIND_COUNT] = {
+    [CTR_SET_ATTR] = "set_attr",
+    [CTR_COMMAND] = "command",
+    [CTR_STORE_SCENE] = "store_scene",
+    [CTR_RECALL_SCENE] = "recall_scene",
+};
+
+/* --- traces --- */
+
+void tr_free(tr_trace_t *trace) {
+    free(trace->frames);
+    memset(trace, 0, sizeof(*trace));
+}
+
+static tr_frame_t *tr_append(tr_trace_t *trace, uint32_t time_us, ctr_kind_e kind, uint16_t cluster_id, uint16_t id) {
+    if (trace->count == trace->capacity) {
+        trace->capacity = trace->capacity > 0 ? trace->capacity * 2 : 64;
+        trace->frames = realloc(trace->frames, trace->capacity * sizeof(*trace->frames));
+    }
+    tr_frame_t *frame = &trace->frames[trace->count++];
+    *frame = (tr_frame_t){.time_us = time_us, .kind = kind, .cluster_id = cluster_id, .id = id};
+    return frame;
+}
+
+static void tr_append_data(tr_frame_t *frame, const void *data, size_t size) {
+    if (size > (size_t)(CTR_DATA_MAX - frame->size))
+        size = CTR_DATA_MAX - frame->size;
+    if (size > 0)
+        memcpy(&frame->data[frame->size], data, size);
+    frame->size += size;
+}
+
+void tr_add_set_attr(tr_trace_t *trace, uint32_t time_us, uint16_t cluster_id, uint16_t attr_id, esp_zb_zcl_attr_type_t type, const void *value,
+                     uint8_t size) {
+    tr_frame_t *frame = tr_append(trace, time_us, CTR_SET_ATTR, cluster_id, attr_id);
+    tr_append_data(frame, &(uint8_t){type}, 1);
+    tr_append_data(frame, value, size);
+}
+
+void tr_add_command(tr_trace_t *trace, uint32_t time_us, uint16_t cluster_id, uint8_t command_id, const void *payload, uint8_t size) {
+    tr_append_data(tr_append(trace, time_us, CTR_COMMAND, cluster_id, command_id), payload, size);
+}
+
+void tr_add_store_scene(tr_trace_t *trace, uint32_t time_us, uint16_t group_id, uint8_t scene_id) {
+    tr_append_data(tr_append(trace, time_us, CTR_STORE_SCENE, ESP_ZB_ZCL_CLUSTER_ID_SCENES, group_id), &scene_id, 1);
+}
+
+void tr_add_recall_scene(tr_trace_t *trace, uint32_t time_us, uint16_t group_id, uint8_t scene_id, uint16_t transition_time, const uint8_t *fields,
+                         uint8_t size) {
+    tr_frame_t *frame = tr_append(trace, time_us, CTR_RECALL_SCENE, ESP_ZB_ZCL_CLUSTER_ID_SCENES, group_id);
+    const uint8_t head[] = {scene_id, transition_time & 0xff, transition_time >> 8};
+    tr_append_data(frame, head, sizeof(head));
+    tr_append_data(frame, fields, size);
+}
+
+bool tr_decode(const uint8_t *data, size_t size, tr_trace_t *trace) {
+    memset(trace, 0, sizeof(*trace));
+    ctr_header_t header;
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != CTR_MAGIC || header.version != CTR_VERSION)
+        return false;
+    trace->lost = header.lost;
+
+    size_t offset = sizeof(header);
+    for (uint16_t i = 0; i < header.record_count; i++) {
+        ctr_record_t record;
+        if (size - offset < sizeof(record))
+            goto malformed;
+        memcpy(&record, &data[offset], sizeof(record));
+        offset += sizeof(record);
+        if (record.kind >= CTR_KIND_COUNT || record.size > CTR_DATA_MAX || size - offset < record.size)
+            goto malformed;
+        tr_append_data(tr_append(trace, record.time_us, record.kind, record.cluster_id, record.id), &data[offset], record.size);
+        offset += record.size;
+    }
+    return true;
+
+malformed:
+    tr_free(trace);
+    return false;
+}
+
+size_t tr_encoded_size(const tr_trace_t *trace) {
+    size_t size = sizeof(ctr_header_t);
+    for (size_t i = 0; i < trace->count; i++)
+        size += sizeof(ctr_record_t) + trace->frames[i].size;
+    return size;
+}
+
+size_t tr_encode(const tr_trace_t *trace, uint8_t *data, size_t size) {
+    size_t needed = tr_encoded_size(trace);
+    if (size < needed || trace->count > UINT16_MAX)
+        return 0;
+
+    ctr_header_t header = {.magic = CTR_MAGIC, .version = CTR_VERSION, .record_count = (uint16_t)trace->count, .lost = trace->lost};
+    memcpy(data, &header, sizeof(header));
+    size_t offset = sizeof(header);
+    for (size_t i = 0; i < trace->count; i++) {
+        const tr_frame_t *frame = &trace->frames[i];
+        ctr_record_t record = {
+            .time_us = frame->time_us,
+            .kind = frame->kind,
+            .size = frame->size,
+            .cluster_id = frame->cluster_id,
+            .id = frame->id,
+        };
+        memcpy(&data[offset], &record, sizeof(record));
+        memcpy(&data[offset + sizeof(record)], frame->data, frame->size);
+        offset += sizeof(record) + frame->size;
+    }
+    return offset;
+}
+
+bool tr_save(const char *path, const tr_trace_t *trace) {
+    size_t size = tr_encoded_size(trace);
+    uint8_t *data = malloc(size);
+    FILE *file = fopen(path, "wb");
+    bool ok = file != NULL && tr_encode(trace, data, size) == size && fwrite(data, 1, size, file) == size;
+    if (file != NULL && fclose(file) != 0)
+        ok = false;
+    free(data);
+    return ok;
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+    size_t capacity = 4096;
+    uint8_t *data = malloc(capacity);
+    *size = 0;
+    size_t count;
+    while ((count = fread(&data[*size], 1, capacity - *size, file)) > 0) {
+        *size += count;
+        if (*size == capacity)
+            data = realloc(data, capacity *= 2);
+    }
+    fclose(file);
+    return data;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Parse the CTR_LOG_PREFIX lines of a captured log, every dump starts at offset 0
+static size_t tr_parse_log(const char *text, size_t length, tr_trace_t *traces, size_t max_traces) {
+    size_t count = 0;
+    uint8_t dump[CTR_BUFFER_SIZE];
+    size_t dump_size = 0;
+    bool valid = false;
+
+    const char *end = text + length;
+    for (const char *line = text; line < end && count < max_traces;) {
+        const char *line_end = memchr(line, '\n', end - line);
+        if (line_end == NULL)
+            line_end = end;
+
+        const char *prefix = NULL;
+        for (const char *p = line; p + strlen(CTR_LOG_PREFIX) <= line_end; p++) {
+            if (memcmp(p, CTR_LOG_PREFIX, strlen(CTR_LOG_PREFIX)) == 0) {
+                prefix = p + strlen(CTR_LOG_PREFIX);
+                break;
+            }
+        }
+
+        unsigned offset = 0;
+        int digits = 0;
+        while (prefix != NULL && digits < 4 && prefix + digits < line_end && hex_digit(prefix[digits]) >= 0)
+            offset = offset * 16 + hex_digit(prefix[digits++]);
+
+        if (prefix != NULL && digits == 4 && prefix + 4 < line_end && prefix[4] == ' ') {
+            // A dump line, a new dump starts at offset 0, a gap drops the dump
+            if (offset == 0) {
+                dump_size = 0;
+                valid = true;
+            }
+            if (offset != dump_size)
+                valid = false;
+            for (const char *p = prefix + 5; valid && p + 1 < line_end && hex_digit(p[0]) >= 0 && hex_digit(p[1]) >= 0; p += 2) {
+                if (dump_size == sizeof(dump)) {
+                    valid = false;
+                    break;
+                }
+                dump[dump_size++] = hex_digit(p[0]) * 16 + hex_digit(p[1]);
+            }
+        } else if (prefix != NULL && strncmp(prefix, "end", 3) == 0) {
+            if (valid && tr_decode(dump, dump_size, &traces[count]))
+                count++;
+            valid = false;
+        }
+        line = line_end + 1;
+    }
+    return count;
+}
+
+size_t tr_load(const char *path, tr_trace_t *traces, size_t max_traces) {
+    size_t size;
+    uint8_t *data = read_file(path, &size);
+    if (data == NULL || max_traces == 0) {
+        free(data);
+        return 0;
+    }
+
+    size_t count;
+    uint32_t magic = 0;
+    if (size >= sizeof(magic))
+        memcpy(&magic, data, sizeof(magic));
+    if (magic == CTR_MAGIC)
+        count = tr_decode(data, size, &traces[0]) ? 1 : 0;
+    else
+        count = tr_parse_log((const char *)data, size, traces, max_traces);
+    free(data);
+    return count;
+}
+
+/* --- replay --- */
+
+static bool tr_inject(const tr_frame_t *frame) {
+    switch (frame->kind) {
+    case CTR_SET_ATTR:
+        if (frame->size < 1)
+            return false;
+        return zbsim_inject_set_attr(frame->cluster_id, frame->id, frame->data[0], &frame->data[1]);
+
+    case CTR_COMMAND:
+        return zbsim_inject_command(frame->cluster_id, (uint8_t)frame->id, frame->data, frame->size);
+
+    case CTR_STORE_SCENE:
+        return frame->size >= 1 && zbsim_inject_store_scene(frame->id, frame->data[0]);
+
+    case CTR_RECALL_SCENE: {
+        if (frame->size < 3)
+            return false;
+        esp_zb_zcl_scenes_extension_field_t fields[CTR_DATA_MAX / 3];
+        size_t field_count = 0;
+        size_t size = frame->size < CTR_DATA_MAX ? frame->size : CTR_DATA_MAX;
+        for (size_t offset = 3; offset + 3 <= size && field_count < CTR_DATA_MAX / 3;) {
+            uint8_t length = frame->data[offset + 2];
+            if (offset + 3 + length > size)
+                break;
+            fields[field_count] = (esp_zb_zcl_scenes_extension_field_t){
+                .cluster_id = frame->data[offset] | frame->data[offset + 1] << 8,
+                .length = length,
+                .extension_field_attribute_value_list = (uint8_t *)&frame->data[offset + 3],
+            };
+            if (field_count > 0)
+                fields[field_count - 1].next = &fields[field_count];
+            field_count++;
+            offset += 3 + length;
+        }
+        uint16_t transition_time = frame->data[1] | frame->data[2] << 8;
+        return zbsim_inject_recall_scene(frame->id, frame->data[0], transition_time, field_count > 0 ? fields : NULL);
+    }
+
+    default:
+        return false;
+    }
+}
+
+typedef struct {
+    bool ramp;
+    uint32_t duty; // output at time_us, or start of the fade
+    int64_t time_us;
+    uint32_t target;
+    int64_t end_us;
+} tr_channel_state_t;
+
+static uint32_t tr_channel_duty(const tr_channel_state_t *state, int64_t time_us) {
+    if (!state->ramp || time_us <= state->time_us)
+        return state->duty;
+    if (time_us >= state->end_us)
+        return state->target;
+    int64_t delta = (int64_t)state->target - state->duty;
+    return (uint32_t)(state->duty + delta * (time_us - state->time_us) / (state->end_us - state->time_us));
+}
+
+static void tr_add_point(tr_replay_t *replay, size_t *capacity, int64_t time_us, uint8_t channel, uint32_t duty, bool ramp) {
+    if (replay->point_count == *capacity) {
+        *capacity = *capacity > 0 ? *capacity * 2 : 256;
+        replay->points = realloc(replay->points, *capacity * sizeof(*replay->points));
+    }
+    replay->points[replay->point_count++] = (tr_point_t){.time_us = time_us, .channel = channel, .ramp = ramp, .duty = duty};
+}
+
+// Turn LEDC events into the piecewise linear output of the tracked channels
+static void tr_build_points(tr_replay_t *replay, const uint32_t *initial_duty, const sim_ledc_event_t *events, size_t count) {
+    tr_channel_state_t states[TRACKED_CHANNEL_COUNT];
+    size_t capacity = 0;
+    for (size_t i = 0; i < TRACKED_CHANNEL_COUNT; i++) {
+        states[i] = (tr_channel_state_t){.duty = initial_duty[i], .time_us = replay->start_us};
+        tr_add_point(replay, &capacity, replay->start_us, tracked_channels[i], states[i].duty, false);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const sim_ledc_event_t *event = &events[i];
+        size_t c = 0;
+        while (c < TRACKED_CHANNEL_COUNT && tracked_channels[c] != event->channel)
+            c++;
+        if (c == TRACKED_CHANNEL_COUNT)
+            continue;
+
+        tr_channel_state_t *state = &states[c];
+        uint32_t before = tr_channel_duty(state, event->time_us);
+        if (state->ramp || before != event->duty)
+            tr_add_point(replay, &capacity, event->time_us, event->channel, before, false);
+
+        if (event->type == SIM_LEDC_FADE_START && event->fade_us > 0 && event->target != event->duty) {
+            *state = (tr_channel_state_t){
+                .ramp = true,
+                .duty = event->duty,
+                .time_us = event->time_us,
+                .target = event->target,
+                .end_us = event->time_us + event->fade_us,
+            };
+        } else {
+            uint32_t duty = event->type == SIM_LEDC_FADE_START ? event->target : event->duty;
+            *state = (tr_channel_state_t){.duty = duty, .time_us = event->time_us};
+        }
+        if (state->ramp || before != state->duty)
+            tr_add_point(replay, &capacity, event->time_us, event->channel, state->duty, state->ramp);
+    }
+
+    // Close every channel at the end of the replay
+    for (size_t i = 0; i < TRACKED_CHANNEL_COUNT; i++)
+        tr_add_point(replay, &capacity, replay->end_us, tracked_channels[i], tr_channel_duty(&states[i], replay->end_us), false);
+}
+
+static uint32_t tr_percentile(const ltr_histogram_t *histogram, uint32_t permille) {
+    uint32_t limit = ltr_percentile(histogram, permille);
+    return limit < histogram->max_us ? limit : histogram->max_us;
+}
+
+static void tr_compute_metrics(tr_replay_t *replay) {
+    tr_metrics_t *metrics = &replay->metrics;
+    for (size_t i = 0; i < replay->frame_count; i++)
+        metrics->lost_frames += replay->frames[i].lost;
+
+    ltr_histogram_t histogram;
+    ltr_get_histogram(LTR_STAGE_END_TO_END, &histogram);
+    metrics->updates = histogram.count;
+    metrics->latency_p50_us = tr_percentile(&histogram, 500);
+    metrics->latency_p99_us = tr_percentile(&histogram, 990);
+    metrics->latency_max_us = histogram.max_us;
+    ltr_get_histogram(LTR_STAGE_CMD_QUEUE, &histogram);
+    metrics->cmd_queue_max_us = histogram.max_us;
+    ltr_get_histogram(LTR_STAGE_LED_QUEUE, &histogram);
+    metrics->led_queue_max_us = histogram.max_us;
+
+    zcctlm_cmd_stats_t cmd_stats;
+    zcctlm_cmd_get_stats(&cmd_stats);
+    metrics->cmd_high_water = cmd_stats.high_water;
+    metrics->cmd_stalled = cmd_stats.stalled;
+
+    // Reversals of each channel, with TR_FLICKER_MIN_DUTY of hysteresis: the output turns once it moved that much back from its extreme
+    for (size_t c = 0; c < TRACKED_CHANNEL_COUNT; c++) {
+        const tr_point_t *previous = NULL;
+        int direction = 0;
+        uint32_t extreme = 0;
+        int64_t extreme_us = 0, direction_us = 0;
+        for (size_t i = 0; i < replay->point_count; i++) {
+            const tr_point_t *point = &replay->points[i];
+            if (point->channel != tracked_channels[c])
+                continue;
+            if (previous == NULL) {
+                extreme = point->duty;
+                extreme_us = direction_us = point->time_us;
+            } else if (point->time_us == previous->time_us && !previous->ramp) {
+                uint32_t step = point->duty > previous->duty ? point->duty - previous->duty : previous->duty - point->duty;
+                if (step > metrics->max_step)
+                    metrics->max_step = step;
+            }
+            previous = point;
+
+            int64_t moved = (int64_t)point->duty - extreme;
+            if (direction * moved >= 0 && moved != 0 && direction != 0) {
+                // Further in the current direction
+                extreme = point->duty;
+                extreme_us = point->time_us;
+            } else if (moved > TR_FLICKER_MIN_DUTY || moved < -TR_FLICKER_MIN_DUTY) {
+                if (direction != 0 && extreme_us - direction_us < TR_FLICKER_WINDOW_US)
+                    metrics->reversals++;
+                direction = moved > 0 ? 1 : -1;
+                direction_us = extreme_us;
+                extreme = point->duty;
+                extreme_us = point->time_us;
+            }
+        }
+    }
+}
+
+void tr_replay(const tr_trace_t *trace, tr_replay_t *replay) {
+    memset(replay, 0, sizeof(*replay));
+    replay->frame_count = trace->count;
+    replay->frames = calloc(trace->count + 1, sizeof(*replay->frames));
+
+    size_t first_event;
+    sim_ledc_events(&first_event);
+    ltr_reset();
+    uint32_t initial_duty[TRACKED_CHANNEL_COUNT];
+    for (size_t i = 0; i < TRACKED_CHANNEL_COUNT; i++)
+        initial_duty[i] = sim_ledc_duty(tracked_channels[i]);
+    uint64_t host_start_ns = sim_host_ns();
+
+    replay->start_us = sim_now_us();
+    for (size_t i = 0; i < trace->count; i++) {
+        int64_t at_us = replay->start_us + trace->frames[i].time_us;
+        if (at_us > sim_now_us())
+            sim_sleep_us(at_us - sim_now_us());
+        replay->frames[i].inject_us = sim_now_us();
+        replay->frames[i].lost = !tr_inject(&trace->frames[i]);
+    }
+
+    // Wait until nothing moved for TR_QUIET_US
+    int64_t last_frame_us = sim_now_us();
+    for (;;) {
+        int64_t last_us = ht_last_ledc_event_us() > last_frame_us ? ht_last_ledc_event_us() : last_frame_us;
+        bool fading = false;
+        for (size_t i = 0; i < TRACKED_CHANNEL_COUNT; i++)
+            fading |= sim_ledc_fading(tracked_channels[i]);
+        if ((!fading && sim_now_us() - last_us >= TR_QUIET_US) || sim_now_us() - last_frame_us >= TR_SETTLE_LIMIT_US)
+            break;
+        sim_sleep_us(fading ? TR_QUIET_US / 10 : last_us + TR_QUIET_US - sim_now_us());
+    }
+
+    size_t count;
+    const sim_ledc_event_t *events = sim_ledc_events(&count);
+    events += first_event;
+    count -= first_event;
+    replay->end_us = count > 0 && events[count - 1].time_us > last_frame_us ? events[count - 1].time_us : last_frame_us;
+
+    tr_metrics_t *metrics = &replay->metrics;
+    metrics->frames = trace->count;
+    for (size_t i = 0; i < count; i++) {
+        metrics->duty_writes += events[i].type == SIM_LEDC_DUTY;
+        metrics->fades += events[i].type == SIM_LEDC_FADE_START;
+    }
+    tr_build_points(replay, initial_duty, events, count);
+    tr_compute_metrics(replay);
+
+    metrics->virtual_us = replay->end_us - replay->start_us;
+    metrics->host_ns = sim_host_ns() - host_start_ns;
+}
+
+void tr_replay_free(tr_replay_t *replay) {
+    free(replay->frames);
+    free(replay->points);
+    memset(replay, 0, sizeof(*replay));
+}
+
+/* --- output --- */
+
+void tr_write_metrics(FILE *file, const char *name, const tr_metrics_t *metrics) {
+    double speedup = metrics->host_ns > 0 ? metrics->virtual_us * 1000.0 / metrics->host_ns : 0;
+    fprintf(file,
+            "{\"name\": \"%s\", \"frames\": %" PRIu32 ", \"lost_frames\": %" PRIu32 ", \"updates\": %" PRIu32 ", \"latency_p50_us\": %" PRIu32
+            ", \"latency_p99_us\": %" PRIu32 ", \"latency_max_us\": %" PRIu32 ", \"cmd_queue_max_us\": %" PRIu32 ", \"led_queue_max_us\": %" PRIu32
+            ", \"cmd_high_water\": %" PRIu32 ", \"cmd_stalled\": %" PRIu32 ", \"duty_writes\": %" PRIu32 ", \"fades\": %" PRIu32
+            ", \"max_step\": %" PRIu32 ", \"full_scale\": %d, \"reversals\": %" PRIu32 ", \"virtual_us\": %" PRId64 ", \"host_us\": %" PRIu64
+            ", \"speedup\": %.0f}\n",
+            name, metrics->frames, metrics->lost_frames, metrics->updates, metrics->latency_p50_us, metrics->latency_p99_us, metrics->latency_max_us,
+            metrics->cmd_queue_max_us, metrics->led_queue_max_us, metrics->cmd_high_water, metrics->cmd_stalled, metrics->duty_writes, metrics->fades,
+            metrics->max_step, LC_MAX_DUTY, metrics->reversals, metrics->virtual_us, metrics->host_ns / 1000, speedup);
+}
+
+bool tr_write_csv(const char *path, const tr_replay_t *replay) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+    fprintf(file, "time_us,channel,duty\n");
+    for (size_t i = 0; i < replay->point_count; i++) {
+        const tr_point_t *point = &replay->points[i];
+        fprintf(file, "%" PRId64 ",%s,%" PRIu32 "\n", point->time_us - replay->start_us, channel_name(point->channel), point->duty);
+    }
+    return fclose(file) == 0;
+}
+
+static void json_counter(FILE *file, int64_t time_us, uint8_t channel, uint32_t duty) {
+    fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %" PRId64 ", \"pid\": 1, \"args\": {\"duty\": %" PRIu32 "}}", channel_name(channel),
+            time_us, duty);
+}
+
+bool tr_write_chrome_trace(const char *path, const tr_trace_t *trace, const tr_replay_t *replay) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"replay\"}},\n");
+    fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"frames\"}}");
+
+    for (size_t i = 0; i < replay->point_count; i++) {
+        const tr_point_t *point = &replay->points[i];
+        json_counter(file, point->time_us - replay->start_us, point->channel, point->duty);
+        if (!point->ramp)
+            continue;
+
+        // Counters are drawn as steps, sample the fade up to the next point of the channel
+        const tr_point_t *next = NULL;
+        for (size_t j = i + 1; j < replay->point_count && next == NULL; j++) {
+            if (replay->points[j].channel == point->channel)
+                next = &replay->points[j];
+        }
+        if (next == NULL || next->time_us <= point->time_us)
+            continue;
+        for (int64_t t = point->time_us + TR_JSON_FADE_STEP_US; t < next->time_us; t += TR_JSON_FADE_STEP_US) {
+            int64_t delta = (int64_t)next->duty - point->duty;
+            uint32_t duty = (uint32_t)(point->duty + delta * (t - point->time_us) / (next->time_us - point->time_us));
+            json_counter(file, t - replay->start_us, point->channel, duty);
+        }
+    }
+
+    for (size_t i = 0; i < replay->frame_count && i < trace->count; i++) {
+        const tr_frame_t *frame = &trace->frames[i];
+        const tr_frame_result_t *result = &replay->frames[i];
+        fprintf(file,
+                ",\n{\"name\": \"%s 0x%04x/0x%04x\", \"cat\": \"zigbee\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %" PRId64
+                ", \"pid\": 1, \"tid\": 1, \"args\": {\"data\": \"",
+                kind_names[frame->kind], frame->cluster_id, frame->id, result->inject_us - replay->start_us);
+        for (size_t j = 0; j < frame->size; j++)
+            fprintf(file, "%02x", frame->data[j]);
+        fprintf(file, "\", \"lost\": %s}}", result->lost ? "true" : "false");
+    }
+
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "command_trace.h"
+#include "zb_sim.h"
+
+/*
+    Replay of recorded command traces (command_trace.h format) on the host build.
+
+    A trace is loaded from a binary file or from a log captured on a lamp (the CTR_LOG_PREFIX hex lines of
+    ctr_dump, one trace per dump), and its frames are injected into the Zigbee stand-in at their recorded
+    times. They run through zb_action_handler, the command pipeline, the model and the LED controller
+    like on the target while the virtual clock skips every idle interval, so minutes of traffic replay in
+    milliseconds.
+
+    The LEDC events of the replay give the per channel duty timeline (CSV or Chrome trace event JSON, open
+    it in chrome://tracing or ui.perfetto.dev) and the flicker metrics (duty jumps and quick direction
+    reversals of a channel). Latency and queueing come from the latency_trace histograms of the firmware,
+    LTR_ENABLE is set in the host build.
+*/
+
+// Output of the replay is idle for this long after the last frame: the trace is over
+#define TR_QUIET_US (1000 * 1000)
+// Direction reversal of a channel within this time of the previous one counts as flicker
+#define TR_FLICKER_WINDOW_US (100 * 1000)
+// Smaller duty changes against the direction of a channel are rounding noise, not a reversal
+#define TR_FLICKER_MIN_DUTY 8
+// Chrome trace counters are step functions, fades are sampled with this period
+#define TR_JSON_FADE_STEP_US (10 * 1000)
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t kind; // ctr_kind_e
+    uint8_t size;
+    uint16_t cluster_id;
+    uint16_t id;
+    uint8_t data[CTR_DATA_MAX];
+} tr_frame_t;
+
+typedef struct {
+    tr_frame_t *frames;
+    size_t count;
+    size_t capacity;
+    uint32_t lost; // records the lamp could not keep, the trace has gaps
+} tr_trace_t;
+
+/* Traces */
+
+void tr_free(tr_trace_t *trace);
+// Append a frame, frames must be added in time order
+void tr_add_set_attr(tr_trace_t *trace, uint32_t time_us, uint16_t cluster_id, uint16_t attr_id, esp_zb_zcl_attr_type_t type, const void *value,
+                     uint8_t size);
+void tr_add_command(tr_trace_t *trace, uint32_t time_us, uint16_t cluster_id, uint8_t command_id, const void *payload, uint8_t size);
+void tr_add_store_scene(tr_trace_t *trace, uint32_t time_us, uint16_t group_id, uint8_t scene_id);
+// fields: extension fields in trace format (cluster u16, length u8, value), may be NULL
+void tr_add_recall_scene(tr_trace_t *trace, uint32_t time_us, uint16_t group_id, uint8_t scene_id, uint16_t transition_time, const uint8_t *fields,
+                         uint8_t size);
+
+// Trace format from and to memory, decode fails on a malformed trace
+bool tr_decode(const uint8_t *data, size_t size, tr_trace_t *trace);
+size_t tr_encoded_size(const tr_trace_t *trace);
+size_t tr_encode(const tr_trace_t *trace, uint8_t *data, size_t size);
+
+bool tr_save(const char *path, const tr_trace_t *trace);
+// Load a binary trace or every trace of a captured log, returns the number of traces (0 on error), free each with tr_free
+size_t tr_load(const char *path, tr_trace_t *traces, size_t max_traces);
+
+/* Replay, from a simulated task once the device has joined */
+
+typedef struct {
+    int64_t inject_us; // virtual time the frame was injected
+    bool lost;         // Zigbee inbox full
+} tr_frame_result_t;
+
+// Percentiles are upper bounds of the latency_trace buckets (powers of two), maxima are exact
+typedef struct {
+    uint32_t frames;
+    uint32_t lost_frames;      // rejected by the Zigbee inbox
+    uint32_t updates;          // commands that reached the LEDs
+    uint32_t latency_p50_us;   // stack callback until the first LEDC update of its command
+    uint32_t latency_p99_us;
+    uint32_t latency_max_us;
+    uint32_t cmd_queue_max_us; // command waiting for the model task
+    uint32_t led_queue_max_us; // LED job waiting for the leds task
+    uint32_t cmd_high_water;   // commands waiting at once in the model pipeline, since boot
+    uint32_t cmd_stalled;
+    uint32_t duty_writes;      // ledc_update_duty calls
+    uint32_t fades;            // hardware fades started
+    uint32_t max_step;         // largest instant duty change of a channel
+    uint32_t reversals;        // direction reversals within TR_FLICKER_WINDOW_US
+    int64_t virtual_us;        // virtual time from the first frame until the output settled
+    uint64_t host_ns;          // host time of the replay
+} tr_metrics_t;
+
+// Output of a LED channel at a point in time, between two points of a channel it is constant or changes linearly
+typedef struct {
+    int64_t time_us;
+    uint8_t channel;
+    bool ramp; // fading linearly towards the next point of the channel
+    uint32_t duty;
+} tr_point_t;
+
+typedef struct {
+    int64_t start_us; // virtual time of the first frame
+    int64_t end_us;   // output settled
+    tr_frame_result_t *frames;
+    size_t frame_count;
+    tr_point_t *points; // duty timeline of the warm and cold channels, in time order
+    size_t point_count;
+    tr_metrics_t metrics;
+} tr_replay_t;
+
+// Inject the frames at their times and wait until the output has been quiet for TR_QUIET_US, free with tr_replay_free
+// Channels are expected to be still when the replay starts
+void tr_replay(const tr_trace_t *trace, tr_replay_t *replay);
+void tr_replay_free(tr_replay_t *replay);
+
+/* Output */
+
+void tr_write_metrics(FILE *file, const char *name, const tr_metrics_t *metrics);
+// One row per change of a channel: time_us,channel,duty (fades are linear between their rows)
+bool tr_write_csv(const char *path, const tr_replay_t *replay);
+// Chrome trace events: a duty counter per channel and an instant event per frame
+bool tr_write_chrome_trace(const char *path, const tr_trace_t *trace, const tr_replay_t *replay);
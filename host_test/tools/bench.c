@@ -0,0 +1,37 @@
+// Hot path microbenchmarks (bench.h) on the host build: bench
+// Prints the BENCH lines of the firmware suite, timed with the host clock, fails when a case took no samples.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host_test.h"
+
+#include "bench.h"
+#include "zb_app.h"
+
+static int empty_cases;
+
+static void bench_main(void *arg) {
+    // Like app_main: the suite runs once the device has joined the network
+    ht_init_firmware();
+    appzb_wait_until_connected();
+    bench_run();
+
+    size_t count;
+    const bench_result_t *results = bench_get_results(&count);
+    for (size_t i = 0; i < count; i++) {
+        if (results[i].iterations == 0) {
+            fprintf(stderr, "%s: no samples\n", results[i].name);
+            empty_cases++;
+        }
+    }
+    if (count == 0)
+        empty_cases++;
+}
+
+int main(void) {
+    sim_run_result_e result = sim_run(bench_main, NULL);
+    if (result != SIM_RUN_DONE)
+        fprintf(stderr, "benchmark ended with %d\n", result);
+    return result == SIM_RUN_DONE && empty_cases == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,96 @@
+// Replay command traces recorded on a lamp against the host build: trace_replay [--csv FILE] [--json FILE] TRACE
+// TRACE is a binary trace or a log with ctr_dump output, every trace in it is replayed in order.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "trace_replay.h"
+
+#include "zb_app.h"
+
+#define MAX_TRACES 64
+
+typedef struct {
+    const char *csv_path;
+    const char *json_path;
+    tr_trace_t traces[MAX_TRACES];
+    size_t trace_count;
+    int failures;
+} replay_args_t;
+
+// path with the trace index before its extension when the log holds several traces
+static void output_path(char *buffer, size_t size, const char *path, size_t index, size_t count) {
+    const char *dot = strrchr(path, '.');
+    if (count == 1 || dot == NULL)
+        snprintf(buffer, size, "%s", path);
+    else
+        snprintf(buffer, size, "%.*s.%zu%s", (int)(dot - path), path, index, dot);
+}
+
+static void replay_main(void *arg) {
+    replay_args_t *args = arg;
+    ht_init_firmware();
+    appzb_wait_until_connected();
+    ht_delay_ms(1000);
+
+    for (size_t i = 0; i < args->trace_count; i++) {
+        tr_replay_t replay;
+        tr_replay(&args->traces[i], &replay);
+
+        char name[32], path[512];
+        snprintf(name, sizeof(name), "trace %zu", i);
+        tr_write_metrics(stdout, name, &replay.metrics);
+        if (args->traces[i].lost > 0)
+            fprintf(stderr, "%s: %u records lost on the lamp\n", name, (unsigned)args->traces[i].lost);
+        if (args->csv_path != NULL) {
+            output_path(path, sizeof(path), args->csv_path, i, args->trace_count);
+            if (!tr_write_csv(path, &replay)) {
+                fprintf(stderr, "cannot write %s\n", path);
+                args->failures++;
+            }
+        }
+        if (args->json_path != NULL) {
+            output_path(path, sizeof(path), args->json_path, i, args->trace_count);
+            if (!tr_write_chrome_trace(path, &args->traces[i], &replay)) {
+                fprintf(stderr, "cannot write %s\n", path);
+                args->failures++;
+            }
+        }
+        tr_replay_free(&replay);
+    }
+}
+
+int main(int argc, char **argv) {
+    static replay_args_t args;
+    const char *trace_path = NULL;
+    bool usage = false;
+    for (int i = 1; i < argc && !usage; i++) {
+        if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+            args.csv_path = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            args.json_path = argv[++i];
+        else if (argv[i][0] != '-' && trace_path == NULL)
+            trace_path = argv[i];
+        else
+            usage = true;
+    }
+    if (usage || trace_path == NULL) {
+        fprintf(stderr, "usage: %s [--csv FILE] [--json FILE] TRACE\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    args.trace_count = tr_load(trace_path, args.traces, MAX_TRACES);
+    if (args.trace_count == 0) {
+        fprintf(stderr, "%s: no trace found\n", trace_path);
+        return EXIT_FAILURE;
+    }
+
+    // Traces are up to 71 minutes long, the default time limit would cut them
+    sim_configure(&(sim_config_t){.time_limit_us = INT64_MAX / 2});
+    sim_run_result_e result = sim_run(replay_main, &args);
+    if (result != SIM_RUN_DONE)
+        fprintf(stderr, "replay ended with %d\n", result);
+    return result == SIM_RUN_DONE && args.failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
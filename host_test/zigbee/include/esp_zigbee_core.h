@@ -0,0 +1,464 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/*
+    ESP Zigbee SDK API of the host build, implemented by zb_sim.c (see zb_sim.h).
+
+    Only the subset used by the firmware is declared. Names, types and constant values follow the SDK so the
+    firmware compiles unchanged, the message and report structures only carry the fields the firmware reads.
+*/
+
+#define ESP_ZB_TRANSCEIVER_ALL_CHANNELS_MASK 0x07FFF800U
+#define ESP_ZB_ED_AGING_TIMEOUT_64MIN 6
+
+#define ESP_ZB_AF_HA_PROFILE_ID 0x0104U
+#define ESP_ZB_HA_ON_OFF_LIGHT_DEVICE_ID 0x0100U
+
+typedef uint8_t esp_zb_ieee_addr_t[8];
+typedef void (*esp_zb_callback_t)(uint8_t param);
+
+/* Stack and platform configuration */
+
+typedef enum {
+    ESP_ZB_DEVICE_TYPE_COORDINATOR = 0x0,
+    ESP_ZB_DEVICE_TYPE_ROUTER = 0x1,
+    ESP_ZB_DEVICE_TYPE_ED = 0x2,
+    ESP_ZB_DEVICE_TYPE_NONE = 0x3,
+} esp_zb_nwk_device_type_t;
+
+typedef struct {
+    uint8_t ed_timeout;
+    uint32_t keep_alive;
+} esp_zb_zed_cfg_t;
+
+typedef struct {
+    uint8_t max_children;
+} esp_zb_zczr_cfg_t;
+
+typedef struct {
+    esp_zb_nwk_device_type_t esp_zb_role;
+    bool install_code_policy;
+    union {
+        esp_zb_zczr_cfg_t zczr_cfg;
+        esp_zb_zed_cfg_t zed_cfg;
+    } nwk_cfg;
+} esp_zb_cfg_t;
+
+typedef enum {
+    ZB_RADIO_MODE_NATIVE = 0x0,
+    ZB_RADIO_MODE_UART_RCP = 0x1,
+} esp_zb_radio_mode_t;
+
+typedef enum {
+    ZB_HOST_CONNECTION_MODE_NONE = 0x0,
+    ZB_HOST_CONNECTION_MODE_UART = 0x1,
+} esp_zb_host_connection_mode_t;
+
+typedef struct {
+    esp_zb_radio_mode_t radio_mode;
+} esp_zb_radio_config_t;
+
+typedef struct {
+    esp_zb_host_connection_mode_t host_connection_mode;
+} esp_zb_host_config_t;
+
+typedef struct {
+    esp_zb_radio_config_t radio_config;
+    esp_zb_host_config_t host_config;
+} esp_zb_platform_config_t;
+
+/* Application signals */
+
+typedef enum {
+    ESP_ZB_ZDO_SIGNAL_DEFAULT_START = 0x00,
+    ESP_ZB_ZDO_SIGNAL_SKIP_STARTUP = 0x01,
+    ESP_ZB_ZDO_SIGNAL_DEVICE_ANNCE = 0x02,
+    ESP_ZB_ZDO_SIGNAL_LEAVE = 0x03,
+    ESP_ZB_ZDO_SIGNAL_ERROR = 0x04,
+    ESP_ZB_BDB_SIGNAL_DEVICE_FIRST_START = 0x05,
+    ESP_ZB_BDB_SIGNAL_DEVICE_REBOOT = 0x06,
+    ESP_ZB_BDB_SIGNAL_STEERING = 0x0a,
+    ESP_ZB_BDB_SIGNAL_FORMATION = 0x0b,
+    ESP_ZB_COMMON_SIGNAL_CAN_SLEEP = 0x16,
+    ESP_ZB_ZDO_SIGNAL_PRODUCTION_CONFIG_READY = 0x17,
+} esp_zb_app_signal_type_t;
+
+typedef struct {
+    uint32_t *p_app_signal;
+    esp_err_t esp_err_status;
+} esp_zb_app_signal_t;
+
+typedef enum {
+    ESP_ZB_BDB_MODE_INITIALIZATION = 0,
+    ESP_ZB_BDB_MODE_TOUCHLINK_COMMISSIONING = 1,
+    ESP_ZB_BDB_MODE_NETWORK_STEERING = 2,
+    ESP_ZB_BDB_MODE_NETWORK_FORMATION = 4,
+} esp_zb_bdb_commissioning_mode_t;
+
+// Defined by the application
+void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct);
+const char *esp_zb_zdo_signal_to_string(esp_zb_app_signal_type_t signal);
+
+/* ZCL basics */
+
+typedef enum {
+    ESP_ZB_ZCL_STATUS_SUCCESS = 0x00,
+    ESP_ZB_ZCL_STATUS_FAIL = 0x01,
+    ESP_ZB_ZCL_STATUS_INVALID_VALUE = 0x87,
+    ESP_ZB_ZCL_STATUS_UNSUP_ATTRIB = 0x86,
+    ESP_ZB_ZCL_STATUS_INVALID_TYPE = 0x8d,
+} esp_zb_zcl_status_t;
+
+typedef enum {
+    ESP_ZB_ZCL_ATTR_TYPE_BOOL = 0x10,
+    ESP_ZB_ZCL_ATTR_TYPE_8BITMAP = 0x18,
+    ESP_ZB_ZCL_ATTR_TYPE_16BITMAP = 0x19,
+    ESP_ZB_ZCL_ATTR_TYPE_U8 = 0x20,
+    ESP_ZB_ZCL_ATTR_TYPE_U16 = 0x21,
+    ESP_ZB_ZCL_ATTR_TYPE_U32 = 0x23,
+    ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM = 0x30,
+    ESP_ZB_ZCL_ATTR_TYPE_CHAR_STRING = 0x42,
+} esp_zb_zcl_attr_type_t;
+
+typedef enum {
+    ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY = 0x01,
+    ESP_ZB_ZCL_ATTR_ACCESS_WRITE_ONLY = 0x02,
+    ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE = 0x03,
+    ESP_ZB_ZCL_ATTR_ACCESS_REPORTING = 0x04,
+} esp_zb_zcl_attr_access_t;
+
+typedef enum {
+    ESP_ZB_ZCL_CLUSTER_SERVER_ROLE = 0x01,
+    ESP_ZB_ZCL_CLUSTER_CLIENT_ROLE = 0x02,
+} esp_zb_zcl_cluster_role_t;
+
+typedef enum {
+    ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV = 0x00,
+    ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI = 0x01,
+} esp_zb_zcl_cmd_direction_t;
+
+typedef enum {
+    ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT = 0x00,
+    ESP_ZB_APS_ADDR_MODE_16_GROUP_ENDP_NOT_PRESENT = 0x01,
+    ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT = 0x02,
+    ESP_ZB_APS_ADDR_MODE_64_ENDP_PRESENT = 0x03,
+} esp_zb_aps_address_mode_t;
+
+#define ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC 0xFFFFU
+
+/* Clusters */
+
+#define ESP_ZB_ZCL_CLUSTER_ID_BASIC 0x0000U
+#define ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY 0x0003U
+#define ESP_ZB_ZCL_CLUSTER_ID_GROUPS 0x0004U
+#define ESP_ZB_ZCL_CLUSTER_ID_SCENES 0x0005U
+#define ESP_ZB_ZCL_CLUSTER_ID_ON_OFF 0x0006U
+#define ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL 0x0008U
+#define ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL 0x0300U
+
+/* Attributes */
+
+#define ESP_ZB_ZCL_ATTR_BASIC_ZCL_VERSION_ID 0x0000U
+#define ESP_ZB_ZCL_ATTR_BASIC_APPLICATION_VERSION_ID 0x0001U
+#define ESP_ZB_ZCL_ATTR_BASIC_STACK_VERSION_ID 0x0002U
+#define ESP_ZB_ZCL_ATTR_BASIC_HW_VERSION_ID 0x0003U
+#define ESP_ZB_ZCL_ATTR_BASIC_MANUFACTURER_NAME_ID 0x0004U
+#define ESP_ZB_ZCL_ATTR_BASIC_MODEL_IDENTIFIER_ID 0x0005U
+#define ESP_ZB_ZCL_ATTR_BASIC_DATE_CODE_ID 0x0006U
+#define ESP_ZB_ZCL_ATTR_BASIC_POWER_SOURCE_ID 0x0007U
+#define ESP_ZB_ZCL_BASIC_ZCL_VERSION_DEFAULT_VALUE 0x08
+
+#define ESP_ZB_ZCL_ATTR_IDENTIFY_IDENTIFY_TIME_ID 0x0000U
+
+#define ESP_ZB_ZCL_ATTR_GROUPS_NAME_SUPPORT_ID 0x0000U
+
+#define ESP_ZB_ZCL_ATTR_SCENES_SCENE_COUNT_ID 0x0000U
+#define ESP_ZB_ZCL_ATTR_SCENES_CURRENT_SCENE_ID 0x0001U
+#define ESP_ZB_ZCL_ATTR_SCENES_CURRENT_GROUP_ID 0x0002U
+#define ESP_ZB_ZCL_ATTR_SCENES_SCENE_VALID_ID 0x0003U
+#define ESP_ZB_ZCL_ATTR_SCENES_NAME_SUPPORT_ID 0x0004U
+
+#define ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID 0x0000U
+#define ESP_ZB_ZCL_ATTR_ON_OFF_START_UP_ON_OFF 0x4003U
+
+#define ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID 0x0000U
+#define ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_ON_TRANSITION_TIME_ID 0x0012U
+#define ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_OFF_TRANSITION_TIME_ID 0x0013U
+
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_REMAINING_TIME_ID 0x0002U
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID 0x0003U
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID 0x0004U
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID 0x0007U
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID 0x0008U
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_OPTIONS_ID 0x000fU
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID 0x4001U
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_CAPABILITIES_ID 0x400aU
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MIN_MIREDS_ID 0x400bU
+#define ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MAX_MIREDS_ID 0x400cU
+#define ESP_ZB_ZCL_COLOR_CONTROL_CURRENT_X_DEF_VALUE 0x616b
+#define ESP_ZB_ZCL_COLOR_CONTROL_CURRENT_Y_DEF_VALUE 0x607d
+#define ESP_ZB_ZCL_COLOR_CONTROL_OPTIONS_DEFAULT_VALUE 0x00
+#define ESP_ZB_ZCL_COLOR_CONTROL_ENHANCED_COLOR_MODE_DEFAULT_VALUE 0x01
+
+/* Commands */
+
+#define ESP_ZB_ZCL_CMD_IDENTIFY_TRIGGER_EFFECT_ID 0x40U
+
+#define ESP_ZB_ZCL_CMD_GROUPS_ADD_GROUP 0x00U
+#define ESP_ZB_ZCL_CMD_GROUPS_REMOVE_GROUP 0x03U
+#define ESP_ZB_ZCL_CMD_GROUPS_REMOVE_ALL_GROUPS 0x04U
+
+#define ESP_ZB_ZCL_CMD_SCENES_ADD_SCENE 0x00U
+#define ESP_ZB_ZCL_CMD_SCENES_REMOVE_SCENE 0x02U
+#define ESP_ZB_ZCL_CMD_SCENES_REMOVE_ALL_SCENES 0x03U
+#define ESP_ZB_ZCL_CMD_SCENES_STORE_SCENE 0x04U
+#define ESP_ZB_ZCL_CMD_SCENES_RECALL_SCENE 0x05U
+
+#define ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL 0x00U
+#define ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE 0x01U
+#define ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STEP 0x02U
+#define ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STOP 0x03U
+#define ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL_WITH_ON_OFF 0x04U
+#define ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_WITH_ON_OFF 0x05U
+#define ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STEP_WITH_ON_OFF 0x06U
+#define ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STOP_WITH_ON_OFF 0x07U
+
+#define ESP_ZB_ZCL_CMD_COLOR_CONTROL_MOVE_TO_COLOR_TEMPERATURE 0x0aU
+#define ESP_ZB_ZCL_CMD_COLOR_CONTROL_STOP_MOVE_STEP 0x47U
+#define ESP_ZB_ZCL_CMD_COLOR_CONTROL_MOVE_COLOR_TEMPERATURE 0x4bU
+#define ESP_ZB_ZCL_CMD_COLOR_CONTROL_STEP_COLOR_TEMPERATURE 0x4cU
+
+/* Cluster configurations */
+
+typedef struct {
+    uint8_t zcl_version;
+    uint8_t power_source;
+} esp_zb_basic_cluster_cfg_t;
+
+typedef struct {
+    uint16_t identify_time;
+} esp_zb_identify_cluster_cfg_t;
+
+typedef struct {
+    uint8_t groups_name_support_id;
+} esp_zb_groups_cluster_cfg_t;
+
+typedef struct {
+    uint8_t scenes_count;
+    uint8_t current_scene;
+    uint16_t current_group;
+    bool scene_valid;
+    uint8_t name_support;
+} esp_zb_scenes_cluster_cfg_t;
+
+typedef struct {
+    bool on_off;
+} esp_zb_on_off_cluster_cfg_t;
+
+typedef struct {
+    uint16_t current_x;
+    uint16_t current_y;
+    uint8_t color_mode;
+    uint8_t options;
+    uint8_t enhanced_color_mode;
+    uint16_t color_capabilities;
+} esp_zb_color_cluster_cfg_t;
+
+/* Data model, opaque outside the stack */
+
+typedef struct esp_zb_attribute_list_s esp_zb_attribute_list_t;
+typedef struct esp_zb_cluster_list_s esp_zb_cluster_list_t;
+typedef struct esp_zb_ep_list_s esp_zb_ep_list_t;
+
+typedef struct {
+    uint8_t endpoint;
+    uint16_t app_profile_id;
+    uint16_t app_device_id;
+    uint32_t app_device_version;
+} esp_zb_endpoint_config_t;
+
+/* Action callbacks */
+
+typedef enum {
+    ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID = 0x0000,
+    ESP_ZB_CORE_SCENES_STORE_SCENE_CB_ID = 0x0001,
+    ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID = 0x0002,
+    ESP_ZB_CORE_IDENTIFY_EFFECT_CB_ID = 0x0003,
+    ESP_ZB_CORE_CMD_PRIVILEGE_COMMAND_REQ_CB_ID = 0x1007,
+} esp_zb_core_action_callback_id_t;
+
+typedef esp_err_t (*esp_zb_core_action_callback_t)(esp_zb_core_action_callback_id_t callback_id, const void *message);
+// Sees every ZCL command before the stack, the payload is read with the ZBOSS buffer API. true: handled, the stack drops it
+typedef bool (*esp_zb_zcl_raw_command_callback_t)(uint8_t bufid);
+
+typedef struct {
+    esp_zb_zcl_status_t status;
+    uint8_t dst_endpoint;
+    uint16_t cluster;
+} esp_zb_device_cb_common_info_t;
+
+typedef struct {
+    esp_zb_zcl_attr_type_t type;
+    uint16_t size;
+    void *value;
+} esp_zb_zcl_attribute_data_t;
+
+typedef struct {
+    uint16_t id;
+    esp_zb_zcl_attribute_data_t data;
+} esp_zb_zcl_attribute_t;
+
+typedef struct {
+    esp_zb_device_cb_common_info_t info;
+    esp_zb_zcl_attribute_t attribute;
+} esp_zb_zcl_set_attr_value_message_t;
+
+typedef struct {
+    esp_zb_device_cb_common_info_t info;
+    uint16_t group_id;
+    uint8_t scene_id;
+} esp_zb_zcl_store_scene_message_t;
+
+typedef struct esp_zb_zcl_scenes_extension_field_s {
+    uint16_t cluster_id;
+    uint8_t length;
+    uint8_t *extension_field_attribute_value_list;
+    struct esp_zb_zcl_scenes_extension_field_s *next;
+} esp_zb_zcl_scenes_extension_field_t;
+
+typedef struct {
+    esp_zb_device_cb_common_info_t info;
+    uint16_t group_id;
+    uint8_t scene_id;
+    uint16_t transition_time;
+    esp_zb_zcl_scenes_extension_field_t *field_set;
+} esp_zb_zcl_recall_scene_message_t;
+
+typedef struct {
+    esp_zb_zcl_status_t status;
+    uint8_t dst_endpoint;
+    uint16_t cluster;
+    struct {
+        uint8_t id;
+        uint8_t direction;
+        uint8_t is_common;
+    } command;
+} esp_zb_zcl_cmd_info_t;
+
+typedef struct {
+    esp_zb_zcl_cmd_info_t info;
+    uint16_t size;
+    void *data;
+} esp_zb_zcl_privilege_command_message_t;
+
+/* Reporting */
+
+typedef struct {
+    uint16_t dst_addr_u16;
+    uint8_t dst_endpoint;
+    uint8_t src_endpoint;
+} esp_zb_zcl_basic_cmd_t;
+
+typedef struct {
+    esp_zb_zcl_basic_cmd_t zcl_basic_cmd;
+    esp_zb_aps_address_mode_t address_mode;
+    uint16_t clusterID;
+    uint8_t manuf_specific;
+    uint8_t direction;
+    uint8_t dis_defalut_resp;
+    uint16_t manuf_code;
+    uint16_t attributeID;
+} esp_zb_zcl_report_attr_cmd_t;
+
+typedef struct {
+    uint8_t endpoint_id;
+    uint16_t cluster_id;
+    uint8_t cluster_role;
+    uint16_t manuf_code;
+    uint16_t attr_id;
+} esp_zb_zcl_attr_location_info_t;
+
+typedef struct {
+    uint8_t direction;
+    uint8_t ep;
+    uint16_t cluster_id;
+    uint8_t cluster_role;
+    uint16_t attr_id;
+    uint16_t manuf_code;
+    union {
+        struct {
+            uint16_t min_interval; // seconds
+            uint16_t max_interval; // seconds, 0xFFFF switches reporting off
+            uint32_t delta;        // reportable change
+            uint32_t reported_value;
+        } send_info;
+    } u;
+} esp_zb_zcl_reporting_info_t;
+
+/* Stack */
+
+void esp_zb_init(esp_zb_cfg_t *nwk_cfg);
+esp_err_t esp_zb_platform_config(esp_zb_platform_config_t *config);
+esp_err_t esp_zb_start(bool autostart);
+void esp_zb_stack_main_loop(void);
+esp_err_t esp_zb_device_register(esp_zb_ep_list_t *ep_list);
+void esp_zb_core_action_handler_register(esp_zb_core_action_callback_t cb);
+void esp_zb_raw_command_handler_register(esp_zb_zcl_raw_command_callback_t cb);
+esp_err_t esp_zb_set_primary_network_channel_set(uint32_t channel_mask);
+void esp_zb_sleep_enable(bool enable);
+
+bool esp_zb_lock_acquire(uint32_t block_ticks);
+void esp_zb_lock_release(void);
+void esp_zb_scheduler_alarm(esp_zb_callback_t cb, uint8_t param, uint32_t time);
+
+esp_err_t esp_zb_bdb_start_top_level_commissioning(uint8_t mode_mask);
+bool esp_zb_bdb_is_factory_new(void);
+void esp_zb_factory_reset(void);
+void esp_zb_get_extended_pan_id(esp_zb_ieee_addr_t ext_pan_id);
+uint16_t esp_zb_get_pan_id(void);
+uint8_t esp_zb_get_current_channel(void);
+uint16_t esp_zb_get_short_address(void);
+
+/* Data model */
+
+esp_zb_attribute_list_t *esp_zb_zcl_attr_list_create(uint16_t cluster_id);
+esp_zb_attribute_list_t *esp_zb_basic_cluster_create(esp_zb_basic_cluster_cfg_t *basic_cfg);
+esp_zb_attribute_list_t *esp_zb_identify_cluster_create(esp_zb_identify_cluster_cfg_t *identify_cfg);
+esp_zb_attribute_list_t *esp_zb_groups_cluster_create(esp_zb_groups_cluster_cfg_t *groups_cfg);
+esp_zb_attribute_list_t *esp_zb_scenes_cluster_create(esp_zb_scenes_cluster_cfg_t *scene_cfg);
+esp_zb_attribute_list_t *esp_zb_on_off_cluster_create(esp_zb_on_off_cluster_cfg_t *on_off_cfg);
+esp_zb_attribute_list_t *esp_zb_color_control_cluster_create(esp_zb_color_cluster_cfg_t *color_cfg);
+
+esp_err_t esp_zb_basic_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p);
+esp_err_t esp_zb_on_off_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p);
+esp_err_t esp_zb_level_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p);
+esp_err_t esp_zb_color_control_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p);
+esp_err_t esp_zb_custom_cluster_add_custom_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, uint8_t attr_type, uint8_t attr_access,
+                                                void *value_p);
+
+esp_zb_cluster_list_t *esp_zb_zcl_cluster_list_create(void);
+esp_err_t esp_zb_cluster_list_add_basic_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_identify_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_groups_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_scenes_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_on_off_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_level_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_color_control_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list,
+                                                        uint8_t role_mask);
+esp_err_t esp_zb_cluster_list_add_custom_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask);
+
+esp_zb_ep_list_t *esp_zb_ep_list_create(void);
+esp_err_t esp_zb_ep_list_add_ep(esp_zb_ep_list_t *ep_list, esp_zb_cluster_list_t *cluster_list, esp_zb_endpoint_config_t endpoint_config);
+
+/* ZCL */
+
+esp_zb_zcl_status_t esp_zb_zcl_set_attribute_val(uint8_t endpoint, uint16_t cluster_id, uint8_t cluster_role, uint16_t attr_id, void *value_p,
+                                                 bool check);
+esp_err_t esp_zb_zcl_report_attr_cmd_req(esp_zb_zcl_report_attr_cmd_t *cmd_req);
+esp_zb_zcl_reporting_info_t *esp_zb_zcl_find_reporting_info(esp_zb_zcl_attr_location_info_t attr_info);
+esp_err_t esp_zb_zcl_add_privilege_command(uint8_t endpoint, uint16_t cluster, uint16_t command);
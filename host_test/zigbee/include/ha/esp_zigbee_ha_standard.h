@@ -0,0 +1,4 @@
+#pragma once
+
+// The host stand-in declares the whole API in esp_zigbee_core.h
+#include "esp_zigbee_core.h"
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_zigbee_core.h"
+
+/*
+    Host stand-in of the ESP Zigbee stack, implements the esp_zb_* subset used by the firmware.
+
+    esp_zb_stack_main_loop runs in the task that calls it (Zigbee_main of zb_app.c) and processes an inbox of
+    frames the test injects as if they came from the network: attribute writes, privilege commands, scene
+    commands, Configure Reporting and app signals. Each one is handled with the Zigbee lock taken and ends
+    up in the registered action handler or esp_zb_app_signal_handler, exactly like on the target. Commands
+    are shown to the raw command handler first (read with the zboss_api.h buffer API). The group table of the
+    stack follows AddGroup, RemoveGroup and RemoveAllGroups, its scene table is not modeled. Scheduler alarms
+    run in the same loop.
+
+    Commissioning is simulated: a factory new device joins ZBSIM_STEERING_TIME_MS after network steering
+    starts (unless the network is not joinable), the joined state is kept in NVS ("zb_storage") so the next
+    boot reports DEVICE_REBOOT. esp_zb_factory_reset drops it and restarts.
+
+    Every report frame is captured, whether the application sent it (esp_zb_zcl_report_attr_cmd_req) or the
+    stack sent it for a reporting configuration (min interval and reportable change, the max interval only
+    switches reporting off at 0xFFFF). Attribute and report APIs abort when called outside the Zigbee task
+    without the lock, the target would corrupt the stack.
+*/
+
+#define ZBSIM_INBOX_LENGTH 32
+#define ZBSIM_PAYLOAD_MAX 64
+#define ZBSIM_STEERING_TIME_MS 1000
+#define ZBSIM_PAN_ID 0x1a62
+#define ZBSIM_CHANNEL 15
+#define ZBSIM_SHORT_ADDRESS 0x4c7e
+
+// Network steering succeeds, true by default, may be changed at any time
+void zbsim_set_joinable(bool joinable);
+bool zbsim_is_joined(void);
+
+/* Frames from the network, may be called from any task, return false when the inbox is full (frame lost) */
+
+// Attribute changed by a remote (write or command handled by the stack), value has the size of the type
+bool zbsim_inject_set_attr(uint16_t cluster_id, uint16_t attr_id, esp_zb_zcl_attr_type_t type, const void *value);
+// Cluster command with its ZCL payload, seen by the raw command handler, only privilege commands reach the action handler
+bool zbsim_inject_command(uint16_t cluster_id, uint8_t command_id, const void *payload, uint16_t size);
+bool zbsim_inject_store_scene(uint16_t group_id, uint8_t scene_id);
+// fields: extension field sets kept by the stack for the scene (linked list, copied), may be NULL
+bool zbsim_inject_recall_scene(uint16_t group_id, uint8_t scene_id, uint16_t transition_time, const esp_zb_zcl_scenes_extension_field_t *fields);
+bool zbsim_inject_signal(esp_zb_app_signal_type_t signal, esp_err_t status);
+// Configure Reporting of a server attribute, max_interval_s 0xFFFF switches it off
+bool zbsim_configure_reporting(uint16_t cluster_id, uint16_t attr_id, uint16_t min_interval_s, uint16_t max_interval_s, uint32_t delta);
+// Block until the stack has processed every injected frame
+void zbsim_flush(void);
+
+// Current value of a server attribute (widened), false when the device has no such attribute
+bool zbsim_read_attribute(uint16_t cluster_id, uint16_t attr_id, uint32_t *value);
+
+/* Captured report frames */
+
+typedef enum {
+    ZBSIM_REPORT_APP = 0, // esp_zb_zcl_report_attr_cmd_req
+    ZBSIM_REPORT_STACK,   // reporting configuration
+} zbsim_report_source_e;
+
+typedef struct {
+    int64_t time_us;
+    uint16_t cluster_id;
+    uint16_t attr_id;
+    uint32_t value; // attribute value when the frame was sent, widened
+    uint8_t source; // zbsim_report_source_e
+} zbsim_report_t;
+
+const zbsim_report_t *zbsim_reports(size_t *count);
+void zbsim_clear_reports(void);
+size_t zbsim_count_reports(uint16_t cluster_id, uint16_t attr_id);
+
+/* Counters */
+
+typedef struct {
+    uint32_t injected;           // frames accepted into the inbox
+    uint32_t lost;               // frames lost because the inbox was full
+    uint32_t unsupported;        // frames for an attribute or command the device does not handle
+    uint32_t actions;            // action handler calls
+    uint32_t action_errors;      // action handler calls that did not return ESP_OK
+    uint64_t action_host_ns;     // host CPU time spent in the action handler
+    uint64_t action_max_host_ns; // longest single call, host CPU time
+    uint32_t attr_writes;        // esp_zb_zcl_set_attribute_val calls
+    uint32_t app_reports;        // frames sent by the application
+    uint32_t stack_reports;      // frames sent for a reporting configuration
+} zbsim_stats_t;
+
+void zbsim_get_stats(zbsim_stats_t *stats);
+void zbsim_reset_stats(void);
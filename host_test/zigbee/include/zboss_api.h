@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    ZBOSS API of the host build, implemented by zb_sim.c (see zb_sim.h).
+
+    Only what a raw command handler needs to read an incoming ZCL command: the parsed header kept as the
+    buffer parameter and the payload left in the buffer. The parsed header only carries the fields the
+    firmware reads. Group membership comes from the group table of the simulated stack.
+*/
+
+typedef uint8_t zb_bufid_t;
+typedef unsigned int zb_uint_t;
+typedef uint8_t zb_bool_t;
+
+#define ZB_FALSE 0U
+#define ZB_TRUE 1U
+
+#define ZB_ZCL_FRAME_DIRECTION_TO_SRV 0x00U
+#define ZB_ZCL_FRAME_DIRECTION_TO_CLI 0x01U
+
+typedef struct {
+    union {
+        struct {
+            uint16_t source;
+            uint8_t dst_endpoint;
+            uint8_t src_endpoint;
+        } common_data;
+    } addr_data;
+    uint16_t cluster_id;
+    uint16_t profile_id;
+    uint8_t cmd_id;
+    uint8_t cmd_direction;
+    uint8_t seq_number;
+    bool is_common_command;
+} zb_zcl_parsed_hdr_t;
+
+void *zb_buf_get_tail_func(zb_bufid_t buf, zb_uint_t size);
+void *zb_buf_begin(zb_bufid_t buf);
+zb_uint_t zb_buf_len(zb_bufid_t buf);
+
+#define ZB_BUF_GET_PARAM(buf, type) ((type *)zb_buf_get_tail_func((buf), sizeof(type)))
+
+zb_bool_t zb_aps_is_endpoint_in_group(uint16_t group_id, uint8_t endpoint);
@@ -0,0 +1,1153 @@
+#include "zb_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "sim.h"
+#include "zboss_api.h"
+
+static const char *TAG = "zb_sim";
+
+#define ZBSIM_ATTR_VALUE_MAX 32
+#define ZBSIM_MAX_ENDPOINTS 4
+#define ZBSIM_MAX_ALARMS 32
+#define ZBSIM_MAX_PRIVILEGE_COMMANDS 32
+#define ZBSIM_MAX_REPORTING 16
+#define ZBSIM_SCENE_FIELDS_MAX 4
+#define ZBSIM_MAX_GROUPS 16
+#define ZBSIM_RAW_BUFID 1
+
+#define ZBSIM_NVS_NAMESPACE "zb_storage"
+#define ZBSIM_NVS_KEY_JOINED "joined"
+
+#define ZBSIM_REPORTING_OFF 0xFFFF
+
+/* --- data model --- */
+
+typedef struct zbsim_attr {
+    uint16_t id;
+    uint8_t type;
+    uint8_t value[ZBSIM_ATTR_VALUE_MAX];
+    struct zbsim_attr *next;
+} zbsim_attr_t;
+
+struct esp_zb_attribute_list_s {
+    uint16_t cluster_id;
+    uint8_t role;
+    zbsim_attr_t *attrs;
+    struct esp_zb_attribute_list_s *next;
+};
+
+struct esp_zb_cluster_list_s {
+    esp_zb_attribute_list_t *clusters;
+};
+
+typedef struct {
+    esp_zb_endpoint_config_t config;
+    esp_zb_cluster_list_t *clusters;
+} zbsim_endpoint_t;
+
+struct esp_zb_ep_list_s {
+    zbsim_endpoint_t endpoints[ZBSIM_MAX_ENDPOINTS];
+    size_t count;
+};
+
+/* --- inbox --- */
+
+typedef enum {
+    ZBSIM_EVENT_WAKE = 0, // re-evaluate the alarms
+    ZBSIM_EVENT_SIGNAL,
+    ZBSIM_EVENT_SET_ATTR,
+    ZBSIM_EVENT_COMMAND,
+    ZBSIM_EVENT_STORE_SCENE,
+    ZBSIM_EVENT_RECALL_SCENE,
+    ZBSIM_EVENT_CONFIGURE_REPORTING,
+} zbsim_event_type_e;
+
+typedef struct {
+    uint16_t cluster_id;
+    uint8_t length;
+    uint8_t offset; // in payload
+} zbsim_scene_field_t;
+
+typedef struct {
+    uint8_t type;
+    uint16_t cluster_id;
+    uint16_t id; // attribute, command or signal
+    uint8_t attr_type;
+    esp_err_t status;
+    uint16_t group_id;
+    uint8_t scene_id;
+    uint16_t transition_time;
+    uint16_t min_interval;
+    uint16_t max_interval;
+    uint32_t delta;
+    uint8_t field_count;
+    zbsim_scene_field_t fields[ZBSIM_SCENE_FIELDS_MAX];
+    uint16_t size;
+    uint8_t payload[ZBSIM_PAYLOAD_MAX];
+} zbsim_event_t;
+
+/* --- stack state --- */
+
+typedef struct {
+    int64_t due_us;
+    esp_zb_callback_t cb;
+    uint8_t param;
+    bool active;
+} zbsim_alarm_t;
+
+typedef struct {
+    uint8_t endpoint;
+    uint16_t cluster_id;
+    uint16_t command_id;
+} zbsim_privilege_command_t;
+
+typedef struct {
+    uint16_t group_id;
+    uint8_t endpoint;
+} zbsim_group_t;
+
+typedef struct {
+    esp_zb_zcl_reporting_info_t info;
+    int64_t last_report_us;
+    bool pending; // change waiting for the min interval
+} zbsim_reporting_t;
+
+static SemaphoreHandle_t zb_lock;
+static QueueHandle_t inbox;
+static TaskHandle_t stack_task;
+static esp_zb_core_action_callback_t action_handler;
+static esp_zb_zcl_raw_command_callback_t raw_command_handler;
+static esp_zb_ep_list_t *device;
+static bool started;
+static bool busy; // a frame taken from the inbox is being processed
+static bool joinable = true;
+static bool joined;
+static bool factory_new = true;
+
+static zbsim_alarm_t alarms[ZBSIM_MAX_ALARMS];
+static zbsim_privilege_command_t privilege_commands[ZBSIM_MAX_PRIVILEGE_COMMANDS];
+static size_t privilege_command_count;
+static zbsim_reporting_t reporting[ZBSIM_MAX_REPORTING];
+static zbsim_group_t groups[ZBSIM_MAX_GROUPS];
+static size_t group_count;
+static size_t reporting_count;
+
+static zbsim_report_t *reports;
+static size_t report_count;
+static size_t report_capacity;
+static zbsim_stats_t stats;
+
+// The only buffer of the stack, holds the command passed to the raw command handler
+static struct {
+    zb_zcl_parsed_hdr_t hdr;
+    uint8_t *data;
+    uint16_t size;
+} raw_buf;
+
+static void zbsim_fatal(const char *what) {
+    fprintf(stderr, "zb_sim: %s\n", what);
+    sim_dump_tasks();
+    abort();
+}
+
+// The stack is not thread safe, any task but the Zigbee task itself must hold the lock
+static void zbsim_check_locked(const char *api) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (self == stack_task || (zb_lock != NULL && xSemaphoreGetMutexHolder(zb_lock) == self))
+        return;
+
+    char message[128];
+    snprintf(message, sizeof(message), "%s called by %s without the Zigbee lock", api, pcTaskGetName(NULL));
+    zbsim_fatal(message);
+}
+
+static int64_t zbsim_host_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static QueueHandle_t zbsim_inbox(void) {
+    if (inbox == NULL)
+        inbox = xQueueCreate(ZBSIM_INBOX_LENGTH, sizeof(zbsim_event_t));
+    return inbox;
+}
+
+static bool zbsim_post(const zbsim_event_t *event) {
+    if (xQueueSend(zbsim_inbox(), event, 0) != pdPASS) {
+        stats.lost++;
+        return false;
+    }
+    if (event->type != ZBSIM_EVENT_WAKE)
+        stats.injected++;
+    return true;
+}
+
+/* --- attributes --- */
+
+// Type of the standard attributes the SDK cluster helpers create, 0 when unknown
+static uint8_t zbsim_standard_attr_type(uint16_t cluster_id, uint16_t attr_id) {
+    switch (cluster_id) {
+    case ESP_ZB_ZCL_CLUSTER_ID_BASIC:
+        if (attr_id >= ESP_ZB_ZCL_ATTR_BASIC_MANUFACTURER_NAME_ID && attr_id <= ESP_ZB_ZCL_ATTR_BASIC_DATE_CODE_ID)
+            return ESP_ZB_ZCL_ATTR_TYPE_CHAR_STRING;
+        if (attr_id == ESP_ZB_ZCL_ATTR_BASIC_POWER_SOURCE_ID)
+            return ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM;
+        return attr_id <= ESP_ZB_ZCL_ATTR_BASIC_HW_VERSION_ID ? ESP_ZB_ZCL_ATTR_TYPE_U8 : 0;
+    case ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY:
+        return attr_id == ESP_ZB_ZCL_ATTR_IDENTIFY_IDENTIFY_TIME_ID ? ESP_ZB_ZCL_ATTR_TYPE_U16 : 0;
+    case ESP_ZB_ZCL_CLUSTER_ID_GROUPS:
+        return attr_id == ESP_ZB_ZCL_ATTR_GROUPS_NAME_SUPPORT_ID ? ESP_ZB_ZCL_ATTR_TYPE_8BITMAP : 0;
+    case ESP_ZB_ZCL_CLUSTER_ID_SCENES:
+        switch (attr_id) {
+        case ESP_ZB_ZCL_ATTR_SCENES_SCENE_COUNT_ID:
+        case ESP_ZB_ZCL_ATTR_SCENES_CURRENT_SCENE_ID:
+            return ESP_ZB_ZCL_ATTR_TYPE_U8;
+        case ESP_ZB_ZCL_ATTR_SCENES_CURRENT_GROUP_ID:
+            return ESP_ZB_ZCL_ATTR_TYPE_U16;
+        case ESP_ZB_ZCL_ATTR_SCENES_SCENE_VALID_ID:
+            return ESP_ZB_ZCL_ATTR_TYPE_BOOL;
+        case ESP_ZB_ZCL_ATTR_SCENES_NAME_SUPPORT_ID:
+            return ESP_ZB_ZCL_ATTR_TYPE_8BITMAP;
+        default:
+            return 0;
+        }
+    case ESP_ZB_ZCL_CLUSTER_ID_ON_OFF:
+        if (attr_id == ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID)
+            return ESP_ZB_ZCL_ATTR_TYPE_BOOL;
+        return attr_id == ESP_ZB_ZCL_ATTR_ON_OFF_START_UP_ON_OFF ? ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM : 0;
+    case ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL:
+        if (attr_id == ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID)
+            return ESP_ZB_ZCL_ATTR_TYPE_U8;
+        if (attr_id == ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_ON_TRANSITION_TIME_ID || attr_id == ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_OFF_TRANSITION_TIME_ID)
+            return ESP_ZB_ZCL_ATTR_TYPE_U16;
+        return 0;
+    case ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL:
+        switch (attr_id) {
+        case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_REMAINING_TIME_ID:
+        case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID:
+        case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID:
+        case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID:
+        case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MIN_MIREDS_ID:
+        case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MAX_MIREDS_ID:
+            return ESP_ZB_ZCL_ATTR_TYPE_U16;
+        case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID:
+        case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID:
+            return ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM;
+        case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_OPTIONS_ID:
+            return ESP_ZB_ZCL_ATTR_TYPE_8BITMAP;
+        case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_CAPABILITIES_ID:
+            return ESP_ZB_ZCL_ATTR_TYPE_16BITMAP;
+        default:
+            return 0;
+        }
+    default:
+        return 0;
+    }
+}
+
+// Bytes of a value of the type, strings carry their length in the first byte
+static size_t zbsim_value_size(uint8_t type, const void *value) {
+    switch (type) {
+    case ESP_ZB_ZCL_ATTR_TYPE_BOOL:
+    case ESP_ZB_ZCL_ATTR_TYPE_8BITMAP:
+    case ESP_ZB_ZCL_ATTR_TYPE_U8:
+    case ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM:
+        return 1;
+    case ESP_ZB_ZCL_ATTR_TYPE_16BITMAP:
+    case ESP_ZB_ZCL_ATTR_TYPE_U16:
+        return 2;
+    case ESP_ZB_ZCL_ATTR_TYPE_U32:
+        return 4;
+    case ESP_ZB_ZCL_ATTR_TYPE_CHAR_STRING: {
+        size_t size = 1 + *(const uint8_t *)value;
+        return size < ZBSIM_ATTR_VALUE_MAX ? size : ZBSIM_ATTR_VALUE_MAX;
+    }
+    default:
+        return 0;
+    }
+}
+
+static uint32_t zbsim_attr_widen(const zbsim_attr_t *attr) {
+    switch (zbsim_value_size(attr->type, attr->value)) {
+    case 1:
+        return attr->value[0];
+    case 2:
+        return (uint32_t)attr->value[0] | (uint32_t)attr->value[1] << 8;
+    case 4:
+        return (uint32_t)attr->value[0] | (uint32_t)attr->value[1] << 8 | (uint32_t)attr->value[2] << 16 | (uint32_t)attr->value[3] << 24;
+    default:
+        return 0;
+    }
+}
+
+static esp_err_t zbsim_add_attr(esp_zb_attribute_list_t *list, uint16_t attr_id, uint8_t type, const void *value) {
+    if (list == NULL || value == NULL || zbsim_value_size(type, value) == 0)
+        return ESP_ERR_INVALID_ARG;
+    for (const zbsim_attr_t *attr = list->attrs; attr != NULL; attr = attr->next) {
+        if (attr->id == attr_id)
+            return ESP_ERR_INVALID_STATE;
+    }
+
+    zbsim_attr_t *attr = calloc(1, sizeof(*attr));
+    if (attr == NULL)
+        return ESP_ERR_NO_MEM;
+    attr->id = attr_id;
+    attr->type = type;
+    memcpy(attr->value, value, zbsim_value_size(type, value));
+
+    zbsim_attr_t **link = &list->attrs;
+    while (*link != NULL) {
+        link = &(*link)->next;
+    }
+    *link = attr;
+    return ESP_OK;
+}
+
+static esp_err_t zbsim_add_standard_attr(esp_zb_attribute_list_t *list, uint16_t cluster_id, uint16_t attr_id, const void *value) {
+    if (list == NULL || list->cluster_id != cluster_id)
+        return ESP_ERR_INVALID_ARG;
+    uint8_t type = zbsim_standard_attr_type(cluster_id, attr_id);
+    if (type == 0)
+        return ESP_ERR_NOT_SUPPORTED;
+    return zbsim_add_attr(list, attr_id, type, value);
+}
+
+static const zbsim_endpoint_t *zbsim_endpoint(uint8_t endpoint) {
+    if (device == NULL)
+        return NULL;
+    for (size_t i = 0; i < device->count; i++) {
+        if (device->endpoints[i].config.endpoint == endpoint)
+            return &device->endpoints[i];
+    }
+    return NULL;
+}
+
+static zbsim_attr_t *zbsim_find_attr(uint8_t endpoint, uint16_t cluster_id, uint8_t role, uint16_t attr_id) {
+    const zbsim_endpoint_t *ep = zbsim_endpoint(endpoint);
+    if (ep == NULL)
+        return NULL;
+    for (esp_zb_attribute_list_t *list = ep->clusters->clusters; list != NULL; list = list->next) {
+        if (list->cluster_id != cluster_id || (list->role & role) == 0)
+            continue;
+        for (zbsim_attr_t *attr = list->attrs; attr != NULL; attr = attr->next) {
+            if (attr->id == attr_id)
+                return attr;
+        }
+    }
+    return NULL;
+}
+
+// Endpoint the network talks to, the first one registered
+static uint8_t zbsim_app_endpoint(void) { return device != NULL && device->count > 0 ? device->endpoints[0].config.endpoint : 0; }
+
+/* --- reporting --- */
+
+static void zbsim_capture_report(uint16_t cluster_id, uint16_t attr_id, uint32_t value, zbsim_report_source_e source) {
+    if (report_count == report_capacity) {
+        size_t capacity = report_capacity > 0 ? report_capacity * 2 : 256;
+        zbsim_report_t *grown = realloc(reports, capacity * sizeof(*grown));
+        if (grown == NULL)
+            zbsim_fatal("out of memory for report frames");
+        reports = grown;
+        report_capacity = capacity;
+    }
+    reports[report_count++] = (zbsim_report_t){
+        .time_us = sim_now_us(),
+        .cluster_id = cluster_id,
+        .attr_id = attr_id,
+        .value = value,
+        .source = (uint8_t)source,
+    };
+    if (source == ZBSIM_REPORT_APP)
+        stats.app_reports++;
+    else
+        stats.stack_reports++;
+}
+
+static zbsim_reporting_t *zbsim_find_reporting(uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id) {
+    for (size_t i = 0; i < reporting_count; i++) {
+        const esp_zb_zcl_reporting_info_t *info = &reporting[i].info;
+        if (info->ep == endpoint && info->cluster_id == cluster_id && info->attr_id == attr_id)
+            return &reporting[i];
+    }
+    return NULL;
+}
+
+static bool zbsim_reportable_change(const zbsim_reporting_t *entry, uint32_t value) {
+    uint32_t last = entry->info.u.send_info.reported_value;
+    uint32_t change = value > last ? value - last : last - value;
+    return change != 0 && change >= entry->info.u.send_info.delta;
+}
+
+static void zbsim_add_alarm(esp_zb_callback_t cb, uint8_t param, int64_t due_us);
+
+static void zbsim_reporting_alarm(uint8_t index);
+
+// Stack side reporting of one attribute, called with the lock taken after its value changed
+static void zbsim_reporting_check(zbsim_reporting_t *entry) {
+    if (entry->info.u.send_info.max_interval == ZBSIM_REPORTING_OFF || !joined)
+        return;
+
+    zbsim_attr_t *attr = zbsim_find_attr(entry->info.ep, entry->info.cluster_id, entry->info.cluster_role, entry->info.attr_id);
+    if (attr == NULL)
+        return;
+    uint32_t value = zbsim_attr_widen(attr);
+    if (!zbsim_reportable_change(entry, value))
+        return;
+
+    int64_t next_us = entry->last_report_us + (int64_t)entry->info.u.send_info.min_interval * 1000000;
+    if (entry->last_report_us >= 0 && sim_now_us() < next_us) {
+        if (!entry->pending) {
+            entry->pending = true;
+            zbsim_add_alarm(zbsim_reporting_alarm, (uint8_t)(entry - reporting), next_us);
+        }
+        return;
+    }
+
+    entry->info.u.send_info.reported_value = value;
+    entry->last_report_us = sim_now_us();
+    zbsim_capture_report(entry->info.cluster_id, entry->info.attr_id, value, ZBSIM_REPORT_STACK);
+}
+
+static void zbsim_reporting_alarm(uint8_t index) {
+    reporting[index].pending = false;
+    zbsim_reporting_check(&reporting[index]);
+}
+
+static void zbsim_configure(const zbsim_event_t *event) {
+    uint8_t endpoint = zbsim_app_endpoint();
+    if (zbsim_find_attr(endpoint, event->cluster_id, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, event->id) == NULL) {
+        stats.unsupported++;
+        return;
+    }
+
+    zbsim_reporting_t *entry = zbsim_find_reporting(endpoint, event->cluster_id, event->id);
+    if (entry == NULL) {
+        if (reporting_count == ZBSIM_MAX_REPORTING)
+            zbsim_fatal("too many reporting configurations");
+        entry = &reporting[reporting_count++];
+        entry->info = (esp_zb_zcl_reporting_info_t){
+            .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV,
+            .ep = endpoint,
+            .cluster_id = event->cluster_id,
+            .cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+            .attr_id = event->id,
+            .manuf_code = ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
+        };
+        entry->last_report_us = -1;
+    }
+
+    // The value at configuration time is the reference for the reportable change
+    const zbsim_attr_t *attr = zbsim_find_attr(endpoint, event->cluster_id, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, event->id);
+    entry->info.u.send_info.min_interval = event->min_interval;
+    entry->info.u.send_info.max_interval = event->max_interval;
+    entry->info.u.send_info.delta = event->delta;
+    entry->info.u.send_info.reported_value = zbsim_attr_widen(attr);
+}
+
+static void zbsim_write_attr(zbsim_attr_t *attr, uint8_t endpoint, uint16_t cluster_id, const void *value) {
+    memcpy(attr->value, value, zbsim_value_size(attr->type, value));
+    zbsim_reporting_t *entry = zbsim_find_reporting(endpoint, cluster_id, attr->id);
+    if (entry != NULL)
+        zbsim_reporting_check(entry);
+}
+
+/* --- scheduler --- */
+
+static void zbsim_add_alarm(esp_zb_callback_t cb, uint8_t param, int64_t due_us) {
+    for (size_t i = 0; i < ZBSIM_MAX_ALARMS; i++) {
+        if (!alarms[i].active) {
+            alarms[i] = (zbsim_alarm_t){.due_us = due_us, .cb = cb, .param = param, .active = true};
+            // The stack loop may be waiting for a later alarm
+            if (xTaskGetCurrentTaskHandle() != stack_task)
+                zbsim_post(&(zbsim_event_t){.type = ZBSIM_EVENT_WAKE});
+            return;
+        }
+    }
+    zbsim_fatal("too many scheduler alarms");
+}
+
+// Ticks until the earliest alarm, rounded up to the tick it is due in
+static TickType_t zbsim_alarm_wait_ticks(void) {
+    int64_t due_us = INT64_MAX;
+    for (size_t i = 0; i < ZBSIM_MAX_ALARMS; i++) {
+        if (alarms[i].active && alarms[i].due_us < due_us)
+            due_us = alarms[i].due_us;
+    }
+    if (due_us == INT64_MAX)
+        return portMAX_DELAY;
+
+    int64_t tick_us = 1000000 / configTICK_RATE_HZ;
+    int64_t due_tick = (due_us + tick_us - 1) / tick_us;
+    int64_t now_tick = xTaskGetTickCount();
+    return due_tick > now_tick ? (TickType_t)(due_tick - now_tick) : 0;
+}
+
+static void zbsim_run_alarms(void) {
+    int64_t now_us = sim_now_us();
+    for (size_t i = 0; i < ZBSIM_MAX_ALARMS; i++) {
+        if (alarms[i].active && alarms[i].due_us <= now_us) {
+            alarms[i].active = false;
+            alarms[i].cb(alarms[i].param);
+        }
+    }
+}
+
+/* --- commissioning --- */
+
+static void zbsim_save_joined(void) {
+    nvs_handle_t handle;
+    if (nvs_open(ZBSIM_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot open NVS to store the network");
+        return;
+    }
+    if (joined)
+        nvs_set_u8(handle, ZBSIM_NVS_KEY_JOINED, 1);
+    else
+        nvs_erase_all(handle);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static bool zbsim_load_joined(void) {
+    nvs_handle_t handle;
+    uint8_t value = 0;
+    if (nvs_open(ZBSIM_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return false;
+    nvs_get_u8(handle, ZBSIM_NVS_KEY_JOINED, &value);
+    nvs_close(handle);
+    return value != 0;
+}
+
+static void zbsim_signal(esp_zb_app_signal_type_t signal, esp_err_t status) {
+    zbsim_post(&(zbsim_event_t){.type = ZBSIM_EVENT_SIGNAL, .id = signal, .status = status});
+}
+
+static void zbsim_steering_done(uint8_t unused) {
+    if (!joinable) {
+        zbsim_signal(ESP_ZB_BDB_SIGNAL_STEERING, ESP_FAIL);
+        return;
+    }
+    joined = true;
+    factory_new = false;
+    zbsim_save_joined();
+    zbsim_signal(ESP_ZB_BDB_SIGNAL_STEERING, ESP_OK);
+}
+
+/* --- frame processing --- */
+
+static void zbsim_call_action(esp_zb_core_action_callback_id_t callback_id, const void *message) {
+    if (action_handler == NULL)
+        return;
+
+    int64_t start_ns = zbsim_host_ns();
+    esp_err_t ret = action_handler(callback_id, message);
+    uint64_t elapsed_ns = (uint64_t)(zbsim_host_ns() - start_ns);
+
+    stats.actions++;
+    stats.action_host_ns += elapsed_ns;
+    if (elapsed_ns > stats.action_max_host_ns)
+        stats.action_max_host_ns = elapsed_ns;
+    if (ret != ESP_OK)
+        stats.action_errors++;
+}
+
+static esp_zb_device_cb_common_info_t zbsim_common_info(uint16_t cluster_id) {
+    return (esp_zb_device_cb_common_info_t){.status = ESP_ZB_ZCL_STATUS_SUCCESS, .dst_endpoint = zbsim_app_endpoint(), .cluster = cluster_id};
+}
+
+// The stack writes the attribute, then tells the application
+static void zbsim_set_attr(zbsim_event_t *event) {
+    uint8_t endpoint = zbsim_app_endpoint();
+    zbsim_attr_t *attr = zbsim_find_attr(endpoint, event->cluster_id, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, event->id);
+    if (attr == NULL || attr->type != event->attr_type) {
+        stats.unsupported++;
+        return;
+    }
+    zbsim_write_attr(attr, endpoint, event->cluster_id, event->payload);
+
+    esp_zb_zcl_set_attr_value_message_t message = {
+        .info = zbsim_common_info(event->cluster_id),
+        .attribute =
+            {
+                .id = event->id,
+                .data = {.type = attr->type, .size = (uint16_t)zbsim_value_size(attr->type, attr->value), .value = attr->value},
+            },
+    };
+    zbsim_call_action(ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID, &message);
+}
+
+static bool zbsim_is_privilege_command(uint8_t endpoint, uint16_t cluster_id, uint16_t command_id) {
+    for (size_t i = 0; i < privilege_command_count; i++) {
+        const zbsim_privilege_command_t *cmd = &privilege_commands[i];
+        if (cmd->endpoint == endpoint && cmd->cluster_id == cluster_id && cmd->command_id == command_id)
+            return true;
+    }
+    return false;
+}
+
+// The raw command handler sees the command first, true when the application handled it
+static bool zbsim_raw_command(zbsim_event_t *event, uint8_t endpoint) {
+    if (raw_command_handler == NULL)
+        return false;
+
+    raw_buf.hdr = (zb_zcl_parsed_hdr_t){
+        .addr_data.common_data = {.dst_endpoint = endpoint, .src_endpoint = 1},
+        .cluster_id = event->cluster_id,
+        .profile_id = ESP_ZB_AF_HA_PROFILE_ID,
+        .cmd_id = (uint8_t)event->id,
+        .cmd_direction = ZB_ZCL_FRAME_DIRECTION_TO_SRV,
+    };
+    raw_buf.data = event->payload;
+    raw_buf.size = event->size;
+    bool handled = raw_command_handler(ZBSIM_RAW_BUFID);
+    raw_buf.data = NULL;
+    return handled;
+}
+
+// Group table of the stack: AddGroup, RemoveGroup and RemoveAllGroups received by the endpoint
+static void zbsim_group_command(zbsim_event_t *event, uint8_t endpoint) {
+    uint16_t group_id = event->size >= 2 ? (uint16_t)(event->payload[0] | event->payload[1] << 8) : 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < group_count; i++) {
+        bool removed = event->id == ESP_ZB_ZCL_CMD_GROUPS_REMOVE_ALL_GROUPS ||
+                       (event->id == ESP_ZB_ZCL_CMD_GROUPS_REMOVE_GROUP && groups[i].group_id == group_id);
+        removed = removed && groups[i].endpoint == endpoint;
+        if (!removed)
+            groups[kept++] = groups[i];
+    }
+    group_count = kept;
+
+    if (event->id == ESP_ZB_ZCL_CMD_GROUPS_ADD_GROUP && event->size >= 2 && !zb_aps_is_endpoint_in_group(group_id, endpoint)) {
+        if (group_count == ZBSIM_MAX_GROUPS)
+            zbsim_fatal("AddGroup: group table full");
+        groups[group_count++] = (zbsim_group_t){.group_id = group_id, .endpoint = endpoint};
+    }
+}
+
+// Commands the application did not take over are handled inside the real stack, only the group table is modeled
+static void zbsim_command(zbsim_event_t *event) {
+    uint8_t endpoint = zbsim_app_endpoint();
+    if (zbsim_raw_command(event, endpoint))
+        return;
+    if (event->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_GROUPS) {
+        zbsim_group_command(event, endpoint);
+        return;
+    }
+    if (!zbsim_is_privilege_command(endpoint, event->cluster_id, event->id)) {
+        stats.unsupported++;
+        return;
+    }
+
+    esp_zb_zcl_privilege_command_message_t message = {
+        .info =
+            {
+                .status = ESP_ZB_ZCL_STATUS_SUCCESS,
+                .dst_endpoint = endpoint,
+                .cluster = event->cluster_id,
+                .command = {.id = (uint8_t)event->id, .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV},
+            },
+        .size = event->size,
+        .data = event->payload,
+    };
+    zbsim_call_action(ESP_ZB_CORE_CMD_PRIVILEGE_COMMAND_REQ_CB_ID, &message);
+}
+
+static void zbsim_recall_scene(zbsim_event_t *event) {
+    esp_zb_zcl_scenes_extension_field_t fields[ZBSIM_SCENE_FIELDS_MAX];
+    for (uint8_t i = 0; i < event->field_count; i++) {
+        fields[i] = (esp_zb_zcl_scenes_extension_field_t){
+            .cluster_id = event->fields[i].cluster_id,
+            .length = event->fields[i].length,
+            .extension_field_attribute_value_list = &event->payload[event->fields[i].offset],
+            .next = i + 1 < event->field_count ? &fields[i + 1] : NULL,
+        };
+    }
+
+    esp_zb_zcl_recall_scene_message_t message = {
+        .info = zbsim_common_info(ESP_ZB_ZCL_CLUSTER_ID_SCENES),
+        .group_id = event->group_id,
+        .scene_id = event->scene_id,
+        .transition_time = event->transition_time,
+        .field_set = event->field_count > 0 ? fields : NULL,
+    };
+    zbsim_call_action(ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID, &message);
+}
+
+static void zbsim_process(zbsim_event_t *event) {
+    switch (event->type) {
+    case ZBSIM_EVENT_SIGNAL: {
+        uint32_t signal = event->id;
+        esp_zb_app_signal_t app_signal = {.p_app_signal = &signal, .esp_err_status = event->status};
+        esp_zb_app_signal_handler(&app_signal);
+        break;
+    }
+    case ZBSIM_EVENT_SET_ATTR:
+        zbsim_set_attr(event);
+        break;
+    case ZBSIM_EVENT_COMMAND:
+        zbsim_command(event);
+        break;
+    case ZBSIM_EVENT_STORE_SCENE: {
+        esp_zb_zcl_store_scene_message_t message = {
+            .info = zbsim_common_info(ESP_ZB_ZCL_CLUSTER_ID_SCENES),
+            .group_id = event->group_id,
+            .scene_id = event->scene_id,
+        };
+        zbsim_call_action(ESP_ZB_CORE_SCENES_STORE_SCENE_CB_ID, &message);
+        break;
+    }
+    case ZBSIM_EVENT_RECALL_SCENE:
+        zbsim_recall_scene(event);
+        break;
+    case ZBSIM_EVENT_CONFIGURE_REPORTING:
+        zbsim_configure(event);
+        break;
+    default:
+        break;
+    }
+}
+
+/* --- esp_zb stack --- */
+
+void esp_zb_init(esp_zb_cfg_t *nwk_cfg) {
+    if (zb_lock == NULL)
+        zb_lock = xSemaphoreCreateRecursiveMutex();
+    zbsim_inbox();
+}
+
+esp_err_t esp_zb_platform_config(esp_zb_platform_config_t *config) { return config != NULL ? ESP_OK : ESP_ERR_INVALID_ARG; }
+
+esp_err_t esp_zb_start(bool autostart) {
+    if (device == NULL)
+        return ESP_ERR_INVALID_STATE;
+    started = true;
+    factory_new = !zbsim_load_joined();
+    zbsim_signal(ESP_ZB_ZDO_SIGNAL_SKIP_STARTUP, ESP_OK);
+    return ESP_OK;
+}
+
+void esp_zb_stack_main_loop(void) {
+    stack_task = xTaskGetCurrentTaskHandle();
+    while (1) {
+        zbsim_event_t event;
+        bool received = xQueueReceive(zbsim_inbox(), &event, zbsim_alarm_wait_ticks()) == pdPASS;
+        busy = received;
+
+        // The stack holds its own lock while it runs, application tasks wait for it
+        esp_zb_lock_acquire(portMAX_DELAY);
+        if (received)
+            zbsim_process(&event);
+        zbsim_run_alarms();
+        esp_zb_lock_release();
+        busy = false;
+    }
+}
+
+esp_err_t esp_zb_device_register(esp_zb_ep_list_t *ep_list) {
+    if (ep_list == NULL || ep_list->count == 0)
+        return ESP_ERR_INVALID_ARG;
+    device = ep_list;
+    return ESP_OK;
+}
+
+void esp_zb_core_action_handler_register(esp_zb_core_action_callback_t cb) { action_handler = cb; }
+
+void esp_zb_raw_command_handler_register(esp_zb_zcl_raw_command_callback_t cb) { raw_command_handler = cb; }
+
+esp_err_t esp_zb_set_primary_network_channel_set(uint32_t channel_mask) {
+    return (channel_mask & (1U << ZBSIM_CHANNEL)) != 0 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+void esp_zb_sleep_enable(bool enable) {}
+
+bool esp_zb_lock_acquire(uint32_t block_ticks) {
+    if (zb_lock == NULL)
+        zb_lock = xSemaphoreCreateRecursiveMutex();
+    return xSemaphoreTakeRecursive(zb_lock, block_ticks) == pdTRUE;
+}
+
+void esp_zb_lock_release(void) { xSemaphoreGiveRecursive(zb_lock); }
+
+void esp_zb_scheduler_alarm(esp_zb_callback_t cb, uint8_t param, uint32_t time) {
+    zbsim_check_locked("esp_zb_scheduler_alarm");
+    zbsim_add_alarm(cb, param, sim_now_us() + (int64_t)time * 1000);
+}
+
+esp_err_t esp_zb_bdb_start_top_level_commissioning(uint8_t mode_mask) {
+    zbsim_check_locked("esp_zb_bdb_start_top_level_commissioning");
+    if (!started)
+        return ESP_ERR_INVALID_STATE;
+
+    if (mode_mask == ESP_ZB_BDB_MODE_INITIALIZATION) {
+        joined = !factory_new;
+        zbsim_signal(factory_new ? ESP_ZB_BDB_SIGNAL_DEVICE_FIRST_START : ESP_ZB_BDB_SIGNAL_DEVICE_REBOOT, ESP_OK);
+    } else if (mode_mask & ESP_ZB_BDB_MODE_NETWORK_STEERING) {
+        zbsim_add_alarm(zbsim_steering_done, 0, sim_now_us() + ZBSIM_STEERING_TIME_MS * 1000);
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
+
+bool esp_zb_bdb_is_factory_new(void) { return factory_new; }
+
+void esp_zb_factory_reset(void) {
+    joined = false;
+    factory_new = true;
+    zbsim_save_joined();
+    esp_restart();
+}
+
+void esp_zb_get_extended_pan_id(esp_zb_ieee_addr_t ext_pan_id) {
+    static const esp_zb_ieee_addr_t sim_ext_pan_id = {0x62, 0x1a, 0x3f, 0xfe, 0xff, 0x7a, 0x57, 0x84};
+    memcpy(ext_pan_id, sim_ext_pan_id, sizeof(esp_zb_ieee_addr_t));
+}
+
+uint16_t esp_zb_get_pan_id(void) { return ZBSIM_PAN_ID; }
+
+uint8_t esp_zb_get_current_channel(void) { return ZBSIM_CHANNEL; }
+
+uint16_t esp_zb_get_short_address(void) { return joined ? ZBSIM_SHORT_ADDRESS : 0xFFFE; }
+
+const char *esp_zb_zdo_signal_to_string(esp_zb_app_signal_type_t signal) {
+    switch (signal) {
+    case ESP_ZB_ZDO_SIGNAL_DEFAULT_START:
+        return "ZDO_SIGNAL_DEFAULT_START";
+    case ESP_ZB_ZDO_SIGNAL_SKIP_STARTUP:
+        return "ZDO_SIGNAL_SKIP_STARTUP";
+    case ESP_ZB_ZDO_SIGNAL_DEVICE_ANNCE:
+        return "ZDO_SIGNAL_DEVICE_ANNCE";
+    case ESP_ZB_ZDO_SIGNAL_LEAVE:
+        return "ZDO_SIGNAL_LEAVE";
+    case ESP_ZB_ZDO_SIGNAL_ERROR:
+        return "ZDO_SIGNAL_ERROR";
+    case ESP_ZB_BDB_SIGNAL_DEVICE_FIRST_START:
+        return "BDB_SIGNAL_DEVICE_FIRST_START";
+    case ESP_ZB_BDB_SIGNAL_DEVICE_REBOOT:
+        return "BDB_SIGNAL_DEVICE_REBOOT";
+    case ESP_ZB_BDB_SIGNAL_STEERING:
+        return "BDB_SIGNAL_STEERING";
+    case ESP_ZB_BDB_SIGNAL_FORMATION:
+        return "BDB_SIGNAL_FORMATION";
+    case ESP_ZB_COMMON_SIGNAL_CAN_SLEEP:
+        return "COMMON_SIGNAL_CAN_SLEEP";
+    case ESP_ZB_ZDO_SIGNAL_PRODUCTION_CONFIG_READY:
+        return "ZDO_SIGNAL_PRODUCTION_CONFIG_READY";
+    default:
+        return "UNKNOWN_SIGNAL";
+    }
+}
+
+/* --- esp_zb data model --- */
+
+esp_zb_attribute_list_t *esp_zb_zcl_attr_list_create(uint16_t cluster_id) {
+    esp_zb_attribute_list_t *list = calloc(1, sizeof(*list));
+    if (list != NULL)
+        list->cluster_id = cluster_id;
+    return list;
+}
+
+esp_zb_attribute_list_t *esp_zb_basic_cluster_create(esp_zb_basic_cluster_cfg_t *basic_cfg) {
+    esp_zb_attribute_list_t *list = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_BASIC);
+    esp_zb_basic_cluster_cfg_t cfg = {.zcl_version = ESP_ZB_ZCL_BASIC_ZCL_VERSION_DEFAULT_VALUE};
+    if (basic_cfg != NULL)
+        cfg = *basic_cfg;
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_BASIC_ZCL_VERSION_ID, ESP_ZB_ZCL_ATTR_TYPE_U8, &cfg.zcl_version);
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_BASIC_POWER_SOURCE_ID, ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM, &cfg.power_source);
+    return list;
+}
+
+esp_zb_attribute_list_t *esp_zb_identify_cluster_create(esp_zb_identify_cluster_cfg_t *identify_cfg) {
+    esp_zb_attribute_list_t *list = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY);
+    uint16_t identify_time = identify_cfg != NULL ? identify_cfg->identify_time : 0;
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_IDENTIFY_IDENTIFY_TIME_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, &identify_time);
+    return list;
+}
+
+esp_zb_attribute_list_t *esp_zb_groups_cluster_create(esp_zb_groups_cluster_cfg_t *groups_cfg) {
+    esp_zb_attribute_list_t *list = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_GROUPS);
+    uint8_t name_support = groups_cfg != NULL ? groups_cfg->groups_name_support_id : 0;
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_GROUPS_NAME_SUPPORT_ID, ESP_ZB_ZCL_ATTR_TYPE_8BITMAP, &name_support);
+    return list;
+}
+
+esp_zb_attribute_list_t *esp_zb_scenes_cluster_create(esp_zb_scenes_cluster_cfg_t *scene_cfg) {
+    esp_zb_attribute_list_t *list = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_SCENES);
+    esp_zb_scenes_cluster_cfg_t cfg = scene_cfg != NULL ? *scene_cfg : (esp_zb_scenes_cluster_cfg_t){0};
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_SCENES_SCENE_COUNT_ID, ESP_ZB_ZCL_ATTR_TYPE_U8, &cfg.scenes_count);
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_SCENES_CURRENT_SCENE_ID, ESP_ZB_ZCL_ATTR_TYPE_U8, &cfg.current_scene);
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_SCENES_CURRENT_GROUP_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, &cfg.current_group);
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_SCENES_SCENE_VALID_ID, ESP_ZB_ZCL_ATTR_TYPE_BOOL, &cfg.scene_valid);
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_SCENES_NAME_SUPPORT_ID, ESP_ZB_ZCL_ATTR_TYPE_8BITMAP, &cfg.name_support);
+    return list;
+}
+
+esp_zb_attribute_list_t *esp_zb_on_off_cluster_create(esp_zb_on_off_cluster_cfg_t *on_off_cfg) {
+    esp_zb_attribute_list_t *list = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF);
+    bool on_off = on_off_cfg != NULL && on_off_cfg->on_off;
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, ESP_ZB_ZCL_ATTR_TYPE_BOOL, &on_off);
+    return list;
+}
+
+esp_zb_attribute_list_t *esp_zb_color_control_cluster_create(esp_zb_color_cluster_cfg_t *color_cfg) {
+    esp_zb_attribute_list_t *list = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL);
+    esp_zb_color_cluster_cfg_t cfg = color_cfg != NULL ? *color_cfg : (esp_zb_color_cluster_cfg_t){0};
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, &cfg.current_x);
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, &cfg.current_y);
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID, ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM, &cfg.color_mode);
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_OPTIONS_ID, ESP_ZB_ZCL_ATTR_TYPE_8BITMAP, &cfg.options);
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID, ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM, &cfg.enhanced_color_mode);
+    zbsim_add_attr(list, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_CAPABILITIES_ID, ESP_ZB_ZCL_ATTR_TYPE_16BITMAP, &cfg.color_capabilities);
+    return list;
+}
+
+esp_err_t esp_zb_basic_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p) {
+    return zbsim_add_standard_attr(attr_list, ESP_ZB_ZCL_CLUSTER_ID_BASIC, attr_id, value_p);
+}
+
+esp_err_t esp_zb_on_off_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p) {
+    return zbsim_add_standard_attr(attr_list, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, attr_id, value_p);
+}
+
+esp_err_t esp_zb_level_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p) {
+    return zbsim_add_standard_attr(attr_list, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, attr_id, value_p);
+}
+
+esp_err_t esp_zb_color_control_cluster_add_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, void *value_p) {
+    return zbsim_add_standard_attr(attr_list, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, attr_id, value_p);
+}
+
+esp_err_t esp_zb_custom_cluster_add_custom_attr(esp_zb_attribute_list_t *attr_list, uint16_t attr_id, uint8_t attr_type, uint8_t attr_access,
+                                                void *value_p) {
+    return zbsim_add_attr(attr_list, attr_id, attr_type, value_p);
+}
+
+esp_zb_cluster_list_t *esp_zb_zcl_cluster_list_create(void) { return calloc(1, sizeof(esp_zb_cluster_list_t)); }
+
+static esp_err_t zbsim_add_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask) {
+    if (cluster_list == NULL || attr_list == NULL || attr_list->next != NULL)
+        return ESP_ERR_INVALID_ARG;
+    attr_list->role = role_mask;
+
+    esp_zb_attribute_list_t **link = &cluster_list->clusters;
+    while (*link != NULL) {
+        if ((*link)->cluster_id == attr_list->cluster_id && ((*link)->role & role_mask) != 0)
+            return ESP_ERR_INVALID_STATE;
+        link = &(*link)->next;
+    }
+    *link = attr_list;
+    return ESP_OK;
+}
+
+esp_err_t esp_zb_cluster_list_add_basic_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask) {
+    return zbsim_add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_err_t esp_zb_cluster_list_add_identify_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask) {
+    return zbsim_add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_err_t esp_zb_cluster_list_add_groups_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask) {
+    return zbsim_add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_err_t esp_zb_cluster_list_add_scenes_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask) {
+    return zbsim_add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_err_t esp_zb_cluster_list_add_on_off_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask) {
+    return zbsim_add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_err_t esp_zb_cluster_list_add_level_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask) {
+    return zbsim_add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_err_t esp_zb_cluster_list_add_color_control_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list,
+                                                        uint8_t role_mask) {
+    return zbsim_add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_err_t esp_zb_cluster_list_add_custom_cluster(esp_zb_cluster_list_t *cluster_list, esp_zb_attribute_list_t *attr_list, uint8_t role_mask) {
+    return zbsim_add_cluster(cluster_list, attr_list, role_mask);
+}
+
+esp_zb_ep_list_t *esp_zb_ep_list_create(void) { return calloc(1, sizeof(esp_zb_ep_list_t)); }
+
+esp_err_t esp_zb_ep_list_add_ep(esp_zb_ep_list_t *ep_list, esp_zb_cluster_list_t *cluster_list, esp_zb_endpoint_config_t endpoint_config) {
+    if (ep_list == NULL || cluster_list == NULL)
+        return ESP_ERR_INVALID_ARG;
+    if (ep_list->count == ZBSIM_MAX_ENDPOINTS)
+        return ESP_ERR_NO_MEM;
+    ep_list->endpoints[ep_list->count++] = (zbsim_endpoint_t){.config = endpoint_config, .clusters = cluster_list};
+    return ESP_OK;
+}
+
+/* --- esp_zb ZCL --- */
+
+esp_zb_zcl_status_t esp_zb_zcl_set_attribute_val(uint8_t endpoint, uint16_t cluster_id, uint8_t cluster_role, uint16_t attr_id, void *value_p,
+                                                 bool check) {
+    zbsim_check_locked("esp_zb_zcl_set_attribute_val");
+    stats.attr_writes++;
+    zbsim_attr_t *attr = zbsim_find_attr(endpoint, cluster_id, cluster_role, attr_id);
+    if (attr == NULL)
+        return ESP_ZB_ZCL_STATUS_UNSUP_ATTRIB;
+    zbsim_write_attr(attr, endpoint, cluster_id, value_p);
+    return ESP_ZB_ZCL_STATUS_SUCCESS;
+}
+
+esp_err_t esp_zb_zcl_report_attr_cmd_req(esp_zb_zcl_report_attr_cmd_t *cmd_req) {
+    zbsim_check_locked("esp_zb_zcl_report_attr_cmd_req");
+    if (!joined)
+        return ESP_ERR_INVALID_STATE;
+
+    const zbsim_attr_t *attr =
+        zbsim_find_attr(cmd_req->zcl_basic_cmd.src_endpoint, cmd_req->clusterID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, cmd_req->attributeID);
+    if (attr == NULL)
+        return ESP_ERR_NOT_FOUND;
+    zbsim_capture_report(cmd_req->clusterID, cmd_req->attributeID, zbsim_attr_widen(attr), ZBSIM_REPORT_APP);
+    return ESP_OK;
+}
+
+esp_zb_zcl_reporting_info_t *esp_zb_zcl_find_reporting_info(esp_zb_zcl_attr_location_info_t attr_info) {
+    zbsim_check_locked("esp_zb_zcl_find_reporting_info");
+    zbsim_reporting_t *entry = zbsim_find_reporting(attr_info.endpoint_id, attr_info.cluster_id, attr_info.attr_id);
+    return entry != NULL ? &entry->info : NULL;
+}
+
+esp_err_t esp_zb_zcl_add_privilege_command(uint8_t endpoint, uint16_t cluster, uint16_t command) {
+    if (zbsim_is_privilege_command(endpoint, cluster, command))
+        return ESP_OK;
+    if (privilege_command_count == ZBSIM_MAX_PRIVILEGE_COMMANDS)
+        return ESP_ERR_NO_MEM;
+    privilege_commands[privilege_command_count++] = (zbsim_privilege_command_t){.endpoint = endpoint, .cluster_id = cluster, .command_id = command};
+    return ESP_OK;
+}
+
+/* --- zboss buffers --- */
+
+void *zb_buf_get_tail_func(zb_bufid_t buf, zb_uint_t size) {
+    if (buf != ZBSIM_RAW_BUFID || raw_buf.data == NULL || size != sizeof(raw_buf.hdr))
+        zbsim_fatal("zb_buf_get_tail_func: no parsed header of that size in the buffer");
+    return &raw_buf.hdr;
+}
+
+void *zb_buf_begin(zb_bufid_t buf) {
+    if (buf != ZBSIM_RAW_BUFID || raw_buf.data == NULL)
+        zbsim_fatal("zb_buf_begin: buffer not in use");
+    return raw_buf.data;
+}
+
+zb_uint_t zb_buf_len(zb_bufid_t buf) { return buf == ZBSIM_RAW_BUFID && raw_buf.data != NULL ? raw_buf.size : 0; }
+
+zb_bool_t zb_aps_is_endpoint_in_group(uint16_t group_id, uint8_t endpoint) {
+    for (size_t i = 0; i < group_count; i++) {
+        if (groups[i].group_id == group_id && groups[i].endpoint == endpoint)
+            return ZB_TRUE;
+    }
+    return ZB_FALSE;
+}
+
+/* --- host API --- */
+
+void zbsim_set_joinable(bool value) { joinable = value; }
+
+bool zbsim_is_joined(void) { return joined; }
+
+bool zbsim_inject_set_attr(uint16_t cluster_id, uint16_t attr_id, esp_zb_zcl_attr_type_t type, const void *value) {
+    zbsim_event_t event = {.type = ZBSIM_EVENT_SET_ATTR, .cluster_id = cluster_id, .id = attr_id, .attr_type = (uint8_t)type};
+    size_t size = zbsim_value_size(type, value);
+    if (size == 0 || size > ZBSIM_PAYLOAD_MAX)
+        return false;
+    memcpy(event.payload, value, size);
+    event.size = (uint16_t)size;
+    return zbsim_post(&event);
+}
+
+bool zbsim_inject_command(uint16_t cluster_id, uint8_t command_id, const void *payload, uint16_t size) {
+    if (size > ZBSIM_PAYLOAD_MAX)
+        return false;
+    zbsim_event_t event = {.type = ZBSIM_EVENT_COMMAND, .cluster_id = cluster_id, .id = command_id, .size = size};
+    if (size > 0)
+        memcpy(event.payload, payload, size);
+    return zbsim_post(&event);
+}
+
+bool zbsim_inject_store_scene(uint16_t group_id, uint8_t scene_id) {
+    return zbsim_post(&(zbsim_event_t){.type = ZBSIM_EVENT_STORE_SCENE, .group_id = group_id, .scene_id = scene_id});
+}
+
+bool zbsim_inject_recall_scene(uint16_t group_id, uint8_t scene_id, uint16_t transition_time, const esp_zb_zcl_scenes_extension_field_t *fields) {
+    zbsim_event_t event = {.type = ZBSIM_EVENT_RECALL_SCENE, .group_id = group_id, .scene_id = scene_id, .transition_time = transition_time};
+    for (const esp_zb_zcl_scenes_extension_field_t *field = fields; field != NULL; field = field->next) {
+        if (event.field_count == ZBSIM_SCENE_FIELDS_MAX || event.size + field->length > ZBSIM_PAYLOAD_MAX)
+            return false;
+        event.fields[event.field_count++] =
+            (zbsim_scene_field_t){.cluster_id = field->cluster_id, .length = field->length, .offset = (uint8_t)event.size};
+        memcpy(&event.payload[event.size], field->extension_field_attribute_value_list, field->length);
+        event.size += field->length;
+    }
+    return zbsim_post(&event);
+}
+
+bool zbsim_inject_signal(esp_zb_app_signal_type_t signal, esp_err_t status) {
+    return zbsim_post(&(zbsim_event_t){.type = ZBSIM_EVENT_SIGNAL, .id = signal, .status = status});
+}
+
+bool zbsim_configure_reporting(uint16_t cluster_id, uint16_t attr_id, uint16_t min_interval_s, uint16_t max_interval_s, uint32_t delta) {
+    return zbsim_post(&(zbsim_event_t){
+        .type = ZBSIM_EVENT_CONFIGURE_REPORTING,
+        .cluster_id = cluster_id,
+        .id = attr_id,
+        .min_interval = min_interval_s,
+        .max_interval = max_interval_s,
+        .delta = delta,
+    });
+}
+
+void zbsim_flush(void) {
+    while (uxQueueMessagesWaiting(zbsim_inbox()) > 0 || busy) {
+        vTaskDelay(1);
+    }
+}
+
+bool zbsim_read_attribute(uint16_t cluster_id, uint16_t attr_id, uint32_t *value) {
+    const zbsim_attr_t *attr = zbsim_find_attr(zbsim_app_endpoint(), cluster_id, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr_id);
+    if (attr == NULL)
+        return false;
+    *value = zbsim_attr_widen(attr);
+    return true;
+}
+
+const zbsim_report_t *zbsim_reports(size_t *count) {
+    *count = report_count;
+    return reports;
+}
+
+void zbsim_clear_reports(void) { report_count = 0; }
+
+size_t zbsim_count_reports(uint16_t cluster_id, uint16_t attr_id) {
+    size_t count = 0;
+    for (size_t i = 0; i < report_count; i++) {
+        if (reports[i].cluster_id == cluster_id && reports[i].attr_id == attr_id)
+            count++;
+    }
+    return count;
+}
+
+void zbsim_get_stats(zbsim_stats_t *out) { *out = stats; }
+
+void zbsim_reset_stats(void) { stats = (zbsim_stats_t){0}; }
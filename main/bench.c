@@ -0,0 +1,311 @@
+#include "bench.h"
+
+#if BENCH_ENABLE == 1
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "driver/ledc.h"
+#include "esp_idf_version.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "led_controller.h"
+#include "zb_attr_report.h"
+#include "zb_config.h"
+#include "zigbee_cct_light_model.h"
+
+#if BENCH_HOST_CLOCK == 1
+#include "sim.h"
+#define BENCH_TARGET "host"
+#define BENCH_CLOCK "host_ns"
+#else
+#include "esp_cpu.h"
+#include "sdkconfig.h"
+#define BENCH_TARGET CONFIG_IDF_TARGET
+#define BENCH_CLOCK "cpu_cycles"
+#endif
+
+#define BENCH_MAX_CASES 16
+
+static bench_result_t results[BENCH_MAX_CASES];
+static size_t result_count;
+
+static uint32_t samples[BENCH_ITERATIONS];
+static size_t sample_count;
+static int64_t case_start_us;
+static uint32_t clock_mhz;
+// Keeps results of pure functions alive
+static volatile uint32_t sink;
+
+typedef uint32_t bench_stamp_t;
+
+static inline bench_stamp_t bench_now() {
+#if BENCH_HOST_CLOCK == 1
+    return (bench_stamp_t)sim_host_ns();
+#else
+    return (bench_stamp_t)esp_cpu_get_cycle_count();
+#endif
+}
+
+static inline void bench_add(bench_stamp_t start, bench_stamp_t end) {
+    if (sample_count < BENCH_ITERATIONS)
+        samples[sample_count++] = end - start;
+}
+
+// Let the tasks fed by the last call drain their queues, outside of the timed region
+static inline void bench_yield() { vTaskDelay(1); }
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static inline uint32_t cycles_to_ns(uint32_t cycles) { return (uint32_t)((uint64_t)cycles * 1000 / clock_mhz); }
+
+static void bench_begin() {
+    sample_count = 0;
+    case_start_us = esp_timer_get_time();
+}
+
+static void bench_end(const char *name) {
+    int64_t wall_us = esp_timer_get_time() - case_start_us;
+    if (result_count == BENCH_MAX_CASES)
+        return;
+
+    bench_result_t *result = &results[result_count++];
+    *result = (bench_result_t){.name = name, .iterations = sample_count, .wall_us = wall_us};
+    if (sample_count > 0) {
+        uint64_t total = 0;
+        for (size_t i = 0; i < sample_count; i++)
+            total += samples[i];
+        qsort(samples, sample_count, sizeof(samples[0]), compare_u32);
+        result->cycles_min = samples[0];
+        result->cycles_p50 = samples[sample_count / 2];
+        result->cycles_avg = (uint32_t)(total / sample_count);
+        result->cycles_max = samples[sample_count - 1];
+    }
+
+    printf(BENCH_LOG_PREFIX "{\"name\":\"%s\",\"iterations\":%" PRIu32 ",\"cycles_min\":%" PRIu32 ",\"cycles_p50\":%" PRIu32
+                            ",\"cycles_avg\":%" PRIu32 ",\"cycles_max\":%" PRIu32 ",\"ns_p50\":%" PRIu32 ",\"ns_avg\":%" PRIu32
+                            ",\"wall_us\":%" PRId64 "}\n",
+           result->name, result->iterations, result->cycles_min, result->cycles_p50, result->cycles_avg, result->cycles_max,
+           cycles_to_ns(result->cycles_p50), cycles_to_ns(result->cycles_avg), result->wall_us);
+}
+
+/* --- cases --- */
+
+// Cost of reading the clock twice, included in every other sample
+static void bench_timer_overhead() {
+    bench_begin();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_stamp_t start = bench_now();
+        bench_add(start, bench_now());
+    }
+    bench_end("timer_overhead");
+}
+
+#if ZCCTLM_USE_GAMMA_CORRECTION == 1
+// Soft-float gamma the lookup table replaced, kept as the reference the table is measured against
+static uint16_t apply_gamma_correction_float(uint8_t brightness_raw) {
+    if (brightness_raw == 0)
+        return 0;
+
+    float norm = (float)brightness_raw / ZCCTLM_MAX_BRIGHTNESS;
+    float corrected = powf(norm, ZCCTLM_GAMMA_CORRECTION);
+    uint16_t pwm = (uint16_t)(corrected * (LC_MAX_DUTY - LC_MIN_DUTY)) + LC_MIN_DUTY;
+
+    if (pwm > LC_MAX_DUTY)
+        pwm = LC_MAX_DUTY;
+    return pwm;
+}
+
+static void bench_gamma() {
+    bench_begin();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        uint8_t brightness = i % (ZCCTLM_MAX_BRIGHTNESS + 1);
+        bench_stamp_t start = bench_now();
+        sink = apply_gamma_correction(brightness);
+        bench_add(start, bench_now());
+    }
+    bench_end("apply_gamma_correction");
+
+    bench_begin();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        uint8_t brightness = i % (ZCCTLM_MAX_BRIGHTNESS + 1);
+        bench_stamp_t start = bench_now();
+        sink = apply_gamma_correction_float(brightness);
+        bench_add(start, bench_now());
+    }
+    bench_end("apply_gamma_correction_float");
+}
+#endif
+
+// Locks the model, hands the current state to the transition engine and publishes the state
+static void bench_refresh_output() {
+    bench_begin();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_stamp_t start = bench_now();
+        zcctlm_refresh_output();
+        bench_add(start, bench_now());
+        bench_yield();
+    }
+    bench_end("zcctlm_refresh_output");
+}
+
+// The duty the LEDs already have, the lamp does not change while the case runs
+static void bench_lc_enqueue() {
+    uint16_t warm_duty = (uint16_t)ledc_get_duty(LC_LS_MODE, LC_WARM_CHANNEL);
+    uint16_t cold_duty = (uint16_t)ledc_get_duty(LC_LS_MODE, LC_COLD_CHANNEL);
+
+    bench_begin();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_stamp_t start = bench_now();
+        lc_set_duty(warm_duty, cold_duty, 0);
+        bench_add(start, bench_now());
+        bench_yield();
+    }
+    bench_end("lc_set_duty");
+}
+
+// A changed value of a reported attribute while joined: the caller marks the slot and arms the coalescing timer,
+// the frame is sent later by the report task and is not part of the timed call
+static void bench_attribute_report() {
+    bench_begin();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        uint8_t level = i % (ZCCTLM_MAX_BRIGHTNESS + 1);
+        bench_stamp_t start = bench_now();
+        zbattr_send_attribute_report(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, &level);
+        bench_add(start, bench_now());
+        bench_yield();
+    }
+    bench_end("zbattr_send_attribute_report_joined");
+}
+
+static void bench_nvs() {
+#if BENCH_NVS_WRITES == 1
+    bench_begin();
+    for (uint32_t i = 0; i < BENCH_NVS_SAVE_ITERATIONS; i++) {
+        bench_stamp_t start = bench_now();
+        zcctlm_save_to_nvs();
+        bench_add(start, bench_now());
+        bench_yield();
+    }
+    bench_end("zcctlm_save_to_nvs");
+#endif
+
+    bench_begin();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_stamp_t start = bench_now();
+        sink = zcctlm_load_from_nvs();
+        bench_add(start, bench_now());
+    }
+    bench_end("zcctlm_load_from_nvs");
+}
+
+static SemaphoreHandle_t mutex;
+static volatile bool holder_stop;
+static volatile bool holder_done;
+static volatile bench_stamp_t holder_give_stamp;
+
+// Keeps the mutex almost all the time, the caller of bench_mutex preempts it in the middle of a hold
+static void mutex_holder_task(void *arg) {
+    while (!holder_stop) {
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        esp_rom_delay_us(BENCH_MUTEX_HOLD_TICKS * portTICK_PERIOD_MS * 1000);
+        holder_give_stamp = bench_now();
+        xSemaphoreGive(mutex);
+        taskYIELD();
+    }
+    holder_done = true;
+    vTaskDelete(NULL);
+}
+
+static void bench_mutex() {
+    mutex = xSemaphoreCreateMutex();
+
+    bench_begin();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_stamp_t start = bench_now();
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        xSemaphoreGive(mutex);
+        bench_add(start, bench_now());
+    }
+    bench_end("mutex_take_give");
+
+    // Contended: the holder runs one priority below, it gets the CPU whenever this task sleeps
+    UBaseType_t priority = uxTaskPriorityGet(NULL);
+    holder_stop = false;
+    holder_done = false;
+    vTaskPrioritySet(NULL, priority + 1);
+    xTaskCreate(mutex_holder_task, "bench_holder", 2048, NULL, priority, NULL);
+
+    static uint32_t handoffs[BENCH_MUTEX_CONTENDED_ITERATIONS];
+    size_t handoff_count = 0;
+    bench_begin();
+    for (uint32_t attempt = 0; attempt < 4 * BENCH_MUTEX_CONTENDED_ITERATIONS && sample_count < BENCH_MUTEX_CONTENDED_ITERATIONS; attempt++) {
+        bench_yield();
+        if (xSemaphoreGetMutexHolder(mutex) == NULL)
+            continue;
+
+        bench_stamp_t start = bench_now();
+        xSemaphoreTake(mutex, portMAX_DELAY);
+        bench_stamp_t end = bench_now();
+        xSemaphoreGive(mutex);
+        bench_add(start, end);
+        handoffs[handoff_count++] = end - holder_give_stamp;
+    }
+    bench_end("mutex_contended_wait");
+
+    // Holder gives the mutex until the waiter runs with it: priority inheritance and the context switch
+    bench_begin();
+    for (size_t i = 0; i < handoff_count; i++)
+        samples[sample_count++] = handoffs[i];
+    bench_end("mutex_contended_handoff");
+
+    holder_stop = true;
+    vTaskPrioritySet(NULL, priority);
+    while (!holder_done)
+        bench_yield();
+    vSemaphoreDelete(mutex);
+}
+
+// public
+
+void bench_run() {
+    clock_mhz = BENCH_HOST_CLOCK == 1 ? 1000 : esp_rom_get_cpu_ticks_per_us();
+    if (clock_mhz == 0)
+        clock_mhz = 1;
+    result_count = 0;
+
+    printf(BENCH_LOG_PREFIX "{\"format\":%d,\"target\":\"%s\",\"idf\":\"%d.%d.%d\",\"clock\":\"%s\",\"clock_mhz\":%" PRIu32
+                            ",\"tick_hz\":%d}\n",
+           BENCH_FORMAT_VERSION, BENCH_TARGET, ESP_IDF_VERSION_MAJOR, ESP_IDF_VERSION_MINOR, ESP_IDF_VERSION_PATCH, BENCH_CLOCK, clock_mhz,
+           (int)configTICK_RATE_HZ);
+
+    bench_timer_overhead();
+#if ZCCTLM_USE_GAMMA_CORRECTION == 1
+    bench_gamma();
+#endif
+    bench_refresh_output();
+    bench_lc_enqueue();
+    bench_attribute_report();
+    bench_nvs();
+    bench_mutex();
+
+    // The LED case bypassed the transition engine, drive the LEDs from the model again
+    zcctlm_refresh_output();
+}
+
+const bench_result_t *bench_get_results(size_t *count) {
+    *count = result_count;
+    return results;
+}
+
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Microbenchmarks of the control hot path.
+
+    bench_run times each case call by call with the CPU cycle counter and prints one line per case, starting
+    with BENCH_LOG_PREFIX and followed by a JSON object (a header line names the chip, the IDF version and the
+    clock), so the output of two firmware versions or of a C6 and an H2 can be extracted with grep and diffed.
+    Lines are printed with printf, the log level does not hide them.
+
+    Cases that hand work to another task (LED jobs, transitions, reports) yield for a tick between calls
+    outside the timed region, so every call finds the queues drained. The mutex cases use a mutex of their own
+    and a holder task one priority below the caller, state_mutex of the model is only measured as part of
+    zcctlm_refresh_output. zcctlm_save_to_nvs writes the current state record, as the next write-behind commit would,
+    only with BENCH_NVS_WRITES set to 1 so that a bench build does not wear the flash on every boot.
+    zbattr_send_attribute_report_joined only times the caller's part of a report (the frame goes out later).
+    apply_gamma_correction_float is the powf gamma the lookup table replaced, timed as the reference for it.
+
+    With BENCH_ENABLE set to 1 app_main runs the suite once after the device has joined the network, then goes
+    on as usual. With BENCH_ENABLE set to 0 bench_run is an empty inline function and compiles out.
+*/
+#ifndef BENCH_ENABLE
+#define BENCH_ENABLE 0
+#endif
+
+// Time BENCH_NVS_SAVE_ITERATIONS flash writes of the state record
+#ifndef BENCH_NVS_WRITES
+#define BENCH_NVS_WRITES 0
+#endif
+
+// Time with the host clock (ns) instead of the cycle counter, for the host build where code takes no virtual time
+#ifndef BENCH_HOST_CLOCK
+#define BENCH_HOST_CLOCK 0
+#endif
+
+#define BENCH_LOG_PREFIX "BENCH "
+// Bump when fields of the output lines change meaning
+#define BENCH_FORMAT_VERSION 1
+
+// Calls timed per case, fewer for the flash writes
+#define BENCH_ITERATIONS 256
+#define BENCH_NVS_SAVE_ITERATIONS 32
+#define BENCH_MUTEX_CONTENDED_ITERATIONS 32
+// The holder task keeps the mutex for this many ticks, the caller wakes up in the middle of it
+#define BENCH_MUTEX_HOLD_TICKS 2
+
+typedef struct {
+    const char *name;
+    uint32_t iterations;
+    uint32_t cycles_min;
+    uint32_t cycles_p50;
+    uint32_t cycles_avg;
+    uint32_t cycles_max;
+    int64_t wall_us; // whole case, yields between calls included
+} bench_result_t;
+
+#if BENCH_ENABLE == 1
+// Run every case from a low priority task like app_main, prints the results and keeps them for bench_get_results
+void bench_run();
+const bench_result_t *bench_get_results(size_t *count);
+#else
+static inline void bench_run() {}
+static inline const bench_result_t *bench_get_results(size_t *count) {
+    *count = 0;
+    return NULL;
+}
+#endif
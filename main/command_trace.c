@@ -0,0 +1,156 @@
+#include "command_trace.h"
+
+#if CTR_ENABLE == 1
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "CTR";
+
+// Header in front, filled in when the trace is read
+static uint8_t trace[CTR_BUFFER_SIZE];
+static size_t trace_size = sizeof(ctr_header_t);
+static uint16_t record_count;
+static uint32_t lost;
+static int64_t start_us;
+static int64_t last_us;
+static bool alarm_armed;
+
+static size_t put_u16(uint8_t *data, uint16_t value) {
+    data[0] = value & 0xff;
+    data[1] = value >> 8;
+    return 2;
+}
+
+static void fill_header() {
+    ctr_header_t header = {.magic = CTR_MAGIC, .version = CTR_VERSION, .record_count = record_count, .lost = lost};
+    memcpy(trace, &header, sizeof(header));
+}
+
+// The stack delivers alarms in its own task, like the action callbacks
+static void idle_alarm_cb(uint8_t param) {
+    int64_t idle_ms = (esp_timer_get_time() - last_us) / 1000;
+    if (idle_ms < CTR_IDLE_DUMP_MS) {
+        esp_zb_scheduler_alarm(idle_alarm_cb, 0, (uint32_t)(CTR_IDLE_DUMP_MS - idle_ms));
+        return;
+    }
+    alarm_armed = false;
+    ctr_dump();
+}
+
+static void append(ctr_kind_e kind, uint16_t cluster_id, uint16_t id, const uint8_t *data, size_t size) {
+    int64_t now_us = esp_timer_get_time();
+    if (record_count == 0 && lost == 0)
+        start_us = now_us;
+    last_us = now_us;
+    if (!alarm_armed) {
+        alarm_armed = true;
+        esp_zb_scheduler_alarm(idle_alarm_cb, 0, CTR_IDLE_DUMP_MS);
+    }
+
+    if (trace_size + sizeof(ctr_record_t) + size > sizeof(trace) || record_count == UINT16_MAX) {
+        lost++;
+        return;
+    }
+    ctr_record_t record = {
+        .time_us = (uint32_t)(now_us - start_us),
+        .kind = kind,
+        .size = (uint8_t)size,
+        .cluster_id = cluster_id,
+        .id = id,
+    };
+    memcpy(&trace[trace_size], &record, sizeof(record));
+    memcpy(&trace[trace_size + sizeof(record)], data, size);
+    trace_size += sizeof(record) + size;
+    record_count++;
+}
+
+void ctr_record_action(esp_zb_core_action_callback_id_t callback_id, const void *message) {
+    uint8_t data[CTR_DATA_MAX];
+    size_t size = 0;
+
+    switch (callback_id) {
+    case ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID: {
+        const esp_zb_zcl_set_attr_value_message_t *set_attr = message;
+        size_t value_size = set_attr->attribute.data.value != NULL ? set_attr->attribute.data.size : 0;
+        if (value_size > CTR_DATA_MAX - 1)
+            value_size = CTR_DATA_MAX - 1;
+        data[size++] = set_attr->attribute.data.type;
+        memcpy(&data[size], set_attr->attribute.data.value, value_size);
+        append(CTR_SET_ATTR, set_attr->info.cluster, set_attr->attribute.id, data, size + value_size);
+        break;
+    }
+
+    case ESP_ZB_CORE_CMD_PRIVILEGE_COMMAND_REQ_CB_ID: {
+        const esp_zb_zcl_privilege_command_message_t *command = message;
+        size = command->data != NULL ? command->size : 0;
+        if (size > CTR_DATA_MAX)
+            size = CTR_DATA_MAX;
+        memcpy(data, command->data, size);
+        append(CTR_COMMAND, command->info.cluster, command->info.command.id, data, size);
+        break;
+    }
+
+    case ESP_ZB_CORE_SCENES_STORE_SCENE_CB_ID: {
+        const esp_zb_zcl_store_scene_message_t *store = message;
+        data[size++] = store->scene_id;
+        append(CTR_STORE_SCENE, store->info.cluster, store->group_id, data, size);
+        break;
+    }
+
+    case ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID: {
+        const esp_zb_zcl_recall_scene_message_t *recall = message;
+        data[size++] = recall->scene_id;
+        size += put_u16(&data[size], recall->transition_time);
+        // Only whole extension fields are kept, a truncated one would recall something else
+        for (const esp_zb_zcl_scenes_extension_field_t *field = recall->field_set; field != NULL; field = field->next) {
+            uint8_t length = field->extension_field_attribute_value_list != NULL ? field->length : 0;
+            if (size + 3 + length > CTR_DATA_MAX)
+                continue;
+            size += put_u16(&data[size], field->cluster_id);
+            data[size++] = length;
+            memcpy(&data[size], field->extension_field_attribute_value_list, length);
+            size += length;
+        }
+        append(CTR_RECALL_SCENE, recall->info.cluster, recall->group_id, data, size);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+void ctr_dump() {
+    if (record_count == 0 && lost == 0)
+        return;
+
+    fill_header();
+    char line[CTR_LOG_LINE_BYTES * 2 + 1];
+    for (size_t offset = 0; offset < trace_size; offset += CTR_LOG_LINE_BYTES) {
+        size_t count = trace_size - offset < CTR_LOG_LINE_BYTES ? trace_size - offset : CTR_LOG_LINE_BYTES;
+        for (size_t i = 0; i < count; i++)
+            sprintf(&line[i * 2], "%02x", trace[offset + i]);
+        ESP_LOGI(TAG, CTR_LOG_PREFIX "%04x %s", (unsigned)offset, line);
+    }
+    ESP_LOGI(TAG, CTR_LOG_PREFIX "end, %u records, %" PRIu32 " lost", record_count, lost);
+
+    trace_size = sizeof(ctr_header_t);
+    record_count = 0;
+    lost = 0;
+}
+
+size_t ctr_get_trace(uint8_t *buffer, size_t size) {
+    if (size < trace_size)
+        return 0;
+    fill_header();
+    memcpy(buffer, trace, trace_size);
+    return trace_size;
+}
+
+#endif
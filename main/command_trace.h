@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "zb_config.h"
+
+/*
+    Command trace recorder.
+
+    Every Zigbee action that reaches zb_action_handler (attribute write, privilege command, scene store or
+    recall) is appended as a compact binary record to a RAM buffer, timestamped relative to the first record.
+    Once no action arrived for CTR_IDLE_DUMP_MS the trace is dumped to the log as hex lines starting with
+    CTR_LOG_PREFIX and the buffer starts over, so a slider drag or an automation burst ends up as one trace.
+    The host build replays such traces, from a binary file or straight from a captured log.
+
+    Recording and dumping both run in the Zigbee task (action handler and scheduler alarm), no locking.
+    With CTR_ENABLE set to 0 the recorder is empty inline functions and compiles out.
+*/
+#ifndef CTR_ENABLE
+#define CTR_ENABLE 0
+#endif
+
+// RAM kept for one trace, header included, records that do not fit are counted as lost
+#define CTR_BUFFER_SIZE 2048
+#define CTR_IDLE_DUMP_MS 3000
+// Data bytes kept per record, longer command payloads are truncated
+#define CTR_DATA_MAX 32
+// Bytes per dump line
+#define CTR_LOG_LINE_BYTES 32
+#define CTR_LOG_PREFIX "CTR "
+
+/* Trace format, little endian: ctr_header_t, then record_count records of ctr_record_t followed by size data bytes */
+
+#define CTR_MAGIC 0x5254435a // "ZCTR"
+#define CTR_VERSION 1
+
+typedef enum {
+    CTR_SET_ATTR = 0,   // id: attribute, data: attribute type, value
+    CTR_COMMAND,        // id: command, data: ZCL payload
+    CTR_STORE_SCENE,    // id: group, data: scene id
+    CTR_RECALL_SCENE,   // id: group, data: scene id, transition time (u16), extension fields (cluster u16, length u8, value)
+    CTR_KIND_COUNT,
+} ctr_kind_e;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t record_count;
+    uint32_t lost; // records that did not fit in the buffer
+} ctr_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t time_us; // since the first record of the trace
+    uint8_t kind;     // ctr_kind_e
+    uint8_t size;     // data bytes following the record
+    uint16_t cluster_id;
+    uint16_t id;
+} ctr_record_t;
+
+#if CTR_ENABLE == 1
+// Record an action callback, Zigbee task only
+void ctr_record_action(esp_zb_core_action_callback_id_t callback_id, const void *message);
+// Dump the trace recorded so far and start a new one, Zigbee task only (or with the Zigbee lock taken)
+void ctr_dump();
+// Copy of the trace recorded so far (header and records), returns its size, 0 if buffer is too small
+size_t ctr_get_trace(uint8_t *buffer, size_t size);
+#else
+static inline void ctr_record_action(esp_zb_core_action_callback_id_t callback_id, const void *message) {}
+static inline void ctr_dump() {}
+static inline size_t ctr_get_trace(uint8_t *buffer, size_t size) { return 0; }
+#endif
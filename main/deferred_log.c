@@ -0,0 +1,196 @@
+#include "deferred_log.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+_Static_assert((DLOG_RING_SIZE & (DLOG_RING_SIZE - 1)) == 0, "DLOG_RING_SIZE must be a power of two");
+
+static const char *TAG = "dlog";
+
+typedef struct {
+    // Sequence of the slot: equal to the write position when free, position + 1 once the record is complete
+    atomic_uint seq;
+    uint8_t level;
+    const char *tag;
+    const char *format;
+    uint32_t timestamp_ms;
+    uintptr_t args[DLOG_MAX_ARGS];
+} dlog_record_t;
+
+// Multi-producer / single-consumer ring, producers claim a slot by advancing ring_head with a CAS
+static dlog_record_t ring[DLOG_RING_SIZE];
+static atomic_uint ring_head;
+static atomic_uint ring_tail; // only advanced by the drain task
+
+static TaskHandle_t drain_task;
+
+static atomic_uint stat_written;
+static atomic_uint stat_dropped;
+static atomic_uint stat_high_water;
+static uint32_t dropped_reported;
+
+static char dlog_level_letter(esp_log_level_t level) {
+    switch (level) {
+    case ESP_LOG_ERROR:
+        return 'E';
+    case ESP_LOG_WARN:
+        return 'W';
+    case ESP_LOG_INFO:
+        return 'I';
+    case ESP_LOG_DEBUG:
+        return 'D';
+    default:
+        return 'V';
+    }
+}
+
+// Write the format one conversion at a time, so each argument is passed with the type its conversion expects
+static void dlog_print_format(esp_log_level_t level, const char *tag, const char *format, const uintptr_t *args) {
+    char segment[DLOG_MAX_SEGMENT_LEN + 1];
+    int arg = 0;
+
+    while (*format != '\0') {
+        // A segment is the text up to and including the next conversion
+        const char *end = format;
+        char conversion = '\0';
+        bool is_long = false;
+        while (*end != '\0' && conversion == '\0') {
+            if (*end++ != '%')
+                continue;
+            if (*end == '%') {
+                end++;
+                continue;
+            }
+            end += strspn(end, "-+ #0123456789.");
+            while (*end == 'h' || *end == 'l') {
+                is_long = *end++ == 'l';
+            }
+            if (*end != '\0')
+                conversion = *end++;
+        }
+
+        size_t len = (size_t)(end - format);
+        const char *text = format;
+        format = end;
+        if (len > DLOG_MAX_SEGMENT_LEN || (conversion != '\0' && arg == DLOG_MAX_ARGS)) {
+            // Not something the record can fill in, show it as it is
+            esp_log_write(level, tag, "%.*s", (int)len, text);
+            continue;
+        }
+        memcpy(segment, text, len);
+        segment[len] = '\0';
+
+        bool is_signed = conversion == 'd' || conversion == 'i';
+        if (conversion == '\0') {
+            esp_log_write(level, tag, segment);
+        } else if (conversion == 's') {
+            esp_log_write(level, tag, segment, (const char *)args[arg++]);
+        } else if (conversion == 'p') {
+            esp_log_write(level, tag, segment, (void *)args[arg++]);
+        } else if (is_long) {
+            if (is_signed)
+                esp_log_write(level, tag, segment, (long)(intptr_t)args[arg++]);
+            else
+                esp_log_write(level, tag, segment, (unsigned long)args[arg++]);
+        } else if (is_signed) {
+            esp_log_write(level, tag, segment, (int)(intptr_t)args[arg++]);
+        } else {
+            esp_log_write(level, tag, segment, (unsigned int)args[arg++]);
+        }
+    }
+}
+
+static void dlog_print(const dlog_record_t *record) {
+    esp_log_level_t level = (esp_log_level_t)record->level;
+
+    // Same layout as ESP_LOGx, with the time the record was written
+    esp_log_write(level, record->tag, "%c (%" PRIu32 ") %s: ", dlog_level_letter(level), record->timestamp_ms, record->tag);
+    dlog_print_format(level, record->tag, record->format, record->args);
+    esp_log_write(level, record->tag, "\n");
+}
+
+static void dlog_task(void *params) {
+    while (1) {
+        // Producers notify after every record (or drop), nothing to do until then
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        unsigned int tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+        while (1) {
+            dlog_record_t *record = &ring[tail & (DLOG_RING_SIZE - 1)];
+            if (atomic_load_explicit(&record->seq, memory_order_acquire) != tail + 1)
+                break;
+
+            dlog_print(record);
+            // Free the slot for the writer one lap ahead
+            atomic_store_explicit(&record->seq, tail + DLOG_RING_SIZE, memory_order_release);
+            atomic_store_explicit(&ring_tail, ++tail, memory_order_relaxed);
+        }
+
+        uint32_t dropped = atomic_load_explicit(&stat_dropped, memory_order_relaxed);
+        if (dropped != dropped_reported) {
+            ESP_LOGW(TAG, "%" PRIu32 " log records dropped", dropped - dropped_reported);
+            dropped_reported = dropped;
+        }
+    }
+}
+
+// --- PUBLIC ---
+
+void dlog_init() {
+    for (unsigned int i = 0; i < DLOG_RING_SIZE; i++) {
+        atomic_init(&ring[i].seq, i);
+    }
+    xTaskCreate(dlog_task, "dlog", DLOG_TASK_STACK_SIZE, NULL, DLOG_TASK_PRIORITY, &drain_task);
+}
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, const uintptr_t args[DLOG_MAX_ARGS]) {
+    if (esp_log_level_get(tag) < level)
+        return;
+
+    unsigned int pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    dlog_record_t *record;
+    while (1) {
+        record = &ring[pos & (DLOG_RING_SIZE - 1)];
+        int diff = (int)(atomic_load_explicit(&record->seq, memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring_head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // The slot still holds a record from the previous lap, the ring is full
+            atomic_fetch_add_explicit(&stat_dropped, 1, memory_order_relaxed);
+            if (drain_task != NULL)
+                xTaskNotifyGive(drain_task);
+            return;
+        } else {
+            pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+        }
+    }
+
+    record->level = (uint8_t)level;
+    record->tag = tag;
+    record->format = format;
+    record->timestamp_ms = esp_log_timestamp();
+    for (int i = 0; i < DLOG_MAX_ARGS; i++) {
+        record->args[i] = args[i];
+    }
+    atomic_store_explicit(&record->seq, pos + 1, memory_order_release);
+    // The drain task runs below every producer, the notification does not preempt the caller
+    if (drain_task != NULL)
+        xTaskNotifyGive(drain_task);
+
+    atomic_fetch_add_explicit(&stat_written, 1, memory_order_relaxed);
+    unsigned int used = pos + 1 - atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    if (used > atomic_load_explicit(&stat_high_water, memory_order_relaxed))
+        atomic_store_explicit(&stat_high_water, used, memory_order_relaxed);
+}
+
+void dlog_get_stats(dlog_stats_t *stats) {
+    stats->written = atomic_load_explicit(&stat_written, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&stat_dropped, memory_order_relaxed);
+    stats->high_water = atomic_load_explicit(&stat_high_water, memory_order_relaxed);
+}
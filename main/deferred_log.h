@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_log.h"
+
+/*
+    Deferred logging for the hot path.
+
+    DLOGI / DLOGD / DLOGW do not format anything: they copy a compact binary record (level, tag, format,
+    timestamp and up to DLOG_MAX_ARGS integer arguments) into a lock-free ring and return. A low priority
+    task drains the ring and formats the records through esp_log_write, so UART output never delays a
+    command. The tag and format are kept as pointers to their string literals, which serve as their ids.
+
+    Arguments are stored as pointer-wide integers, strings must be literals passed through DLOG_STR. The drain
+    task writes the format one conversion at a time and casts each argument to the type the conversion expects
+    (char pointer for %s, long with an l modifier, int otherwise, signed for %d and %i), so the same formats work on
+    a 64-bit host. 64-bit conversions and * widths are not supported.
+    Producers notify the drain task, which sleeps while the ring is empty.
+    When the ring is full records are dropped and counted, the drain task reports how many were lost.
+
+    Every module selects its level by defining DLOG_LOCAL_LEVEL (one of the DLOG_LEVEL_* below) before including
+    this header, records above it compile out entirely.
+*/
+
+// Ring capacity in records, must be a power of two
+#define DLOG_RING_SIZE 64
+#define DLOG_MAX_ARGS 6
+#define DLOG_TASK_STACK_SIZE 3072
+#define DLOG_TASK_PRIORITY 1
+// Longest piece of a format written at once (text up to and including one conversion), longer pieces are shown unformatted
+#define DLOG_MAX_SEGMENT_LEN 63
+
+// Per module levels, release builds (NDEBUG) keep warnings only
+#ifdef NDEBUG
+#define DLOG_DEFAULT_LEVEL ESP_LOG_WARN
+#else
+#define DLOG_DEFAULT_LEVEL ESP_LOG_INFO
+#endif
+#define DLOG_LEVEL_LEDC DLOG_DEFAULT_LEVEL
+#define DLOG_LEVEL_ATTR_HANDLERS DLOG_DEFAULT_LEVEL
+#define DLOG_LEVEL_CMD_HANDLERS DLOG_DEFAULT_LEVEL
+#define DLOG_LEVEL_ATTR_REPORT DLOG_DEFAULT_LEVEL
+#define DLOG_LEVEL_MODEL DLOG_DEFAULT_LEVEL
+#define DLOG_LEVEL_EFFECTS DLOG_DEFAULT_LEVEL
+#define DLOG_LEVEL_TRANSITION DLOG_DEFAULT_LEVEL
+
+#ifndef DLOG_LOCAL_LEVEL
+#define DLOG_LOCAL_LEVEL DLOG_DEFAULT_LEVEL
+#endif
+
+#define DLOG_STR(str) ((uintptr_t)(str))
+
+#define DLOG(level, tag, format, ...)                                                                                                            \
+    do {                                                                                                                                         \
+        if (DLOG_LOCAL_LEVEL >= (level))                                                                                                         \
+            dlog_write((level), (tag), (format), (const uintptr_t[DLOG_MAX_ARGS]){__VA_ARGS__});                                                 \
+    } while (0)
+#define DLOGW(tag, format, ...) DLOG(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...) DLOG(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...) DLOG(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+
+typedef struct {
+    uint32_t written;    // records queued
+    uint32_t dropped;    // records lost because the ring was full
+    uint32_t high_water; // max records waiting at once
+} dlog_stats_t;
+
+void dlog_init();
+// Queue a record, format and tag must outlive it (string literals), callable from any task
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, const uintptr_t args[DLOG_MAX_ARGS]);
+void dlog_get_stats(dlog_stats_t *stats);
@@ -21,7 +21,6 @@ button_handle_t button;
 static void button_single_click_cb(void *arg, void *usr_data) {
     ESP_LOGI(TAG, "BUTTON_SINGLE_CLICK");
     zcctlm_toggle_on_off();
-    zcctlm_report_current_state();
 }
 
 static void button_double_click_cb(void *arg, void *usr_data) {
@@ -0,0 +1,124 @@
+#include "latency_trace.h"
+
+#if LTR_ENABLE == 1
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+
+static const char *TAG = "LTR";
+
+static const char *const stage_names[LTR_STAGE_COUNT] = {
+    [LTR_STAGE_STACK_CB] = "stack callback",
+    [LTR_STAGE_CMD_QUEUE] = "command queue",
+    [LTR_STAGE_MODEL_UPDATE] = "model update",
+    [LTR_STAGE_NVS_COMMIT] = "NVS commit",
+    [LTR_STAGE_LED_QUEUE] = "LED queue",
+    [LTR_STAGE_LEDC_UPDATE] = "LEDC update",
+    [LTR_STAGE_FADE_END] = "fade end",
+    [LTR_STAGE_END_TO_END] = "end to end",
+    [LTR_STAGE_LOCK_WAIT] = "state lock wait",
+};
+
+static ltr_histogram_t histograms[LTR_STAGE_COUNT];
+static portMUX_TYPE histograms_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static ltr_stamp_t callback_start;
+// Start of the command waiting for its first LEDC update, 0 = none
+static atomic_uint_least32_t origin;
+static uint32_t cycles_per_us;
+
+static inline uint32_t ltr_bucket(uint32_t us) {
+    uint32_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+    return bucket < LTR_BUCKETS ? bucket : LTR_BUCKETS - 1;
+}
+
+// Upper bound of bucket, in us
+static inline uint32_t ltr_bucket_limit(uint32_t bucket) { return bucket == 0 ? 1 : (1u << bucket); }
+
+#if LTR_DUMP_PERIOD_MS > 0
+static TimerHandle_t dump_timer;
+
+static void dump_timer_cb(TimerHandle_t timer) { ltr_dump(); }
+#endif
+
+// public
+
+void ltr_init() {
+    cycles_per_us = esp_rom_get_cpu_ticks_per_us();
+    if (cycles_per_us == 0)
+        cycles_per_us = 1;
+
+#if LTR_DUMP_PERIOD_MS > 0
+    dump_timer = xTimerCreate("ltr_dump", pdMS_TO_TICKS(LTR_DUMP_PERIOD_MS), pdTRUE, NULL, dump_timer_cb);
+    xTimerStart(dump_timer, 0);
+#endif
+}
+
+void ltr_record(ltr_stage_e stage, ltr_stamp_t start) {
+    uint32_t us = (ltr_now() - start) / cycles_per_us;
+    ltr_histogram_t *histogram = &histograms[stage];
+
+    portENTER_CRITICAL(&histograms_lock);
+    histogram->count++;
+    histogram->total_us += us;
+    if (us > histogram->max_us)
+        histogram->max_us = us;
+    histogram->buckets[ltr_bucket(us)]++;
+    portEXIT_CRITICAL(&histograms_lock);
+}
+
+void ltr_set_callback_start(ltr_stamp_t start) { callback_start = start; }
+
+ltr_stamp_t ltr_get_callback_start() { return callback_start; }
+
+void ltr_mark_origin(ltr_stamp_t start) { atomic_store_explicit(&origin, start != 0 ? start : 1, memory_order_relaxed); }
+
+void ltr_end_origin() {
+    ltr_stamp_t start = atomic_exchange_explicit(&origin, 0, memory_order_relaxed);
+    if (start != 0)
+        ltr_record(LTR_STAGE_END_TO_END, start);
+}
+
+void ltr_get_histogram(ltr_stage_e stage, ltr_histogram_t *histogram) {
+    portENTER_CRITICAL(&histograms_lock);
+    *histogram = histograms[stage];
+    portEXIT_CRITICAL(&histograms_lock);
+}
+
+uint32_t ltr_percentile(const ltr_histogram_t *histogram, uint32_t permille) {
+    uint64_t needed = ((uint64_t)histogram->count * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LTR_BUCKETS - 1; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= needed)
+            return ltr_bucket_limit(i);
+    }
+    return histogram->max_us;
+}
+
+void ltr_reset() {
+    portENTER_CRITICAL(&histograms_lock);
+    memset(histograms, 0, sizeof(histograms));
+    portEXIT_CRITICAL(&histograms_lock);
+}
+
+void ltr_dump() {
+    for (int stage = 0; stage < LTR_STAGE_COUNT; stage++) {
+        ltr_histogram_t histogram;
+        ltr_get_histogram((ltr_stage_e)stage, &histogram);
+        if (histogram.count == 0)
+            continue;
+
+        ESP_LOGI(TAG, "%-14s n %" PRIu32 ", avg %" PRIu32 " us, p50 < %" PRIu32 " us, p99 < %" PRIu32 " us, max %" PRIu32 " us", stage_names[stage],
+                 histogram.count, (uint32_t)(histogram.total_us / histogram.count), ltr_percentile(&histogram, 500),
+                 ltr_percentile(&histogram, 990), histogram.max_us);
+    }
+}
+
+#endif
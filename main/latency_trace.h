@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+    Command latency tracepoints.
+
+    Every stage between the Zigbee stack callback and the LEDs is timed with the CPU cycle counter and
+    aggregated into a fixed-bucket histogram in RAM: no samples are stored and recording a stage is a
+    handful of instructions. Histograms are dumped to the log every LTR_DUMP_PERIOD_MS (or on ltr_dump)
+    and can be read with ltr_get_histogram, e.g. for a diagnostics attribute.
+
+    With LTR_ENABLE set to 0 all tracepoints are empty inline functions and compile out.
+    The cycle counter assumes a fixed CPU frequency, with dynamic frequency scaling the values are approximate.
+*/
+#ifndef LTR_ENABLE
+#define LTR_ENABLE 0
+#endif
+
+// Bucket 0 counts latencies below 1 us, bucket i those in [2^(i-1), 2^i) us, the last one also everything longer
+#define LTR_BUCKETS 20
+// Periodic dump of all histograms to the log, 0 disables it
+#define LTR_DUMP_PERIOD_MS 60000
+
+typedef enum {
+    LTR_STAGE_STACK_CB = 0, // time spent inside zb_action_handler
+    LTR_STAGE_CMD_QUEUE,    // command posted from a stack callback until the model task takes it
+    LTR_STAGE_MODEL_UPDATE, // command executed by the model task
+    LTR_STAGE_NVS_COMMIT,   // state record written and committed to NVS
+    LTR_STAGE_LED_QUEUE,    // LED job enqueued until the leds task takes it
+    LTR_STAGE_LEDC_UPDATE,  // duty written or fades started by the leds task
+    LTR_STAGE_FADE_END,     // LED job enqueued until its fade has ended
+    LTR_STAGE_END_TO_END,   // stack callback until the first LEDC update caused by its command
+    LTR_STAGE_LOCK_WAIT,    // writer of the light model waiting for state_mutex, contended takes only
+    LTR_STAGE_COUNT,
+} ltr_stage_e;
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t buckets[LTR_BUCKETS];
+} ltr_histogram_t;
+
+// CPU cycle count of the start of a stage
+typedef uint32_t ltr_stamp_t;
+
+#if LTR_ENABLE == 1
+#include "esp_cpu.h"
+
+static inline ltr_stamp_t ltr_now() { return (ltr_stamp_t)esp_cpu_get_cycle_count(); }
+
+void ltr_init();
+// Add the time since start to the histogram of stage
+void ltr_record(ltr_stage_e stage, ltr_stamp_t start);
+// Start of the running stack callback, commands posted by it carry this stamp (Zigbee task only)
+void ltr_set_callback_start(ltr_stamp_t start);
+ltr_stamp_t ltr_get_callback_start();
+// A command from a stack callback started at start is being executed, the next LEDC update ends it (end to end)
+void ltr_mark_origin(ltr_stamp_t start);
+void ltr_end_origin();
+void ltr_get_histogram(ltr_stage_e stage, ltr_histogram_t *histogram);
+// Smallest bucket limit below which at least permille of the samples fall, in us
+uint32_t ltr_percentile(const ltr_histogram_t *histogram, uint32_t permille);
+void ltr_reset();
+void ltr_dump();
+#else
+#include <string.h>
+
+static inline ltr_stamp_t ltr_now() { return 0; }
+static inline void ltr_init() {}
+static inline void ltr_record(ltr_stage_e stage, ltr_stamp_t start) {}
+static inline void ltr_set_callback_start(ltr_stamp_t start) {}
+static inline ltr_stamp_t ltr_get_callback_start() { return 0; }
+static inline void ltr_mark_origin(ltr_stamp_t start) {}
+static inline void ltr_end_origin() {}
+static inline void ltr_get_histogram(ltr_stage_e stage, ltr_histogram_t *histogram) { memset(histogram, 0, sizeof(*histogram)); }
+static inline uint32_t ltr_percentile(const ltr_histogram_t *histogram, uint32_t permille) { return 0; }
+static inline void ltr_reset() {}
+static inline void ltr_dump() {}
+#endif
@@ -1,6 +1,10 @@
 #include "led_controller.h"
 
+#define DLOG_LOCAL_LEVEL DLOG_LEVEL_LEDC
+#include "deferred_log.h"
+
 #include <inttypes.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -12,25 +16,86 @@
 #include "driver/ledc.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+
+#include "latency_trace.h"
 
 // Number of channels (warm + cold = 2)
 #define LEDC_CH_NUM (2)
+#define LC_CH_WARM (0)
+#define LC_CH_COLD (1)
+
+#define LC_TASK_STACK_SIZE 3072
+
+// Task notification bits of the leds task
+#define LC_NOTIFY_JOB (1 << 0)
+#define LC_NOTIFY_FADE_END(ch) (1 << (1 + (ch)))
+#define LC_NOTIFY_FADE_END_ALL (LC_NOTIFY_FADE_END(LC_CH_WARM) | LC_NOTIFY_FADE_END(LC_CH_COLD))
+
+// Extra time given to the fade end interrupt before a fade is considered finished anyway
+#define LC_FADE_END_GRACE_MS 50
+
+// Pending bit of a chunk in which no channel changes, it ends at its deadline instead of with a fade end
+#define LC_PENDING_HOLD (1 << LEDC_CH_NUM)
 
 static const char *TAG = "LEDC";
 
+#if LC_FADE_MODE == LC_FADE_MODE_LATEST
+#define LC_JOB_QUEUE_SIZE 1
+#else
+#define LC_JOB_QUEUE_SIZE LC_QUEUE_SIZE
+#endif
+
+// Max value of a single LEDC fade parameter (cycle_num, scale, step_num)
+#define LC_FADE_PARAM_MAX ((1 << SOC_LEDC_FADE_PARAMS_BIT_WIDTH) - 1)
+
+// Combined job, both channels are always retargeted together
+// For curve jobs duty holds the final point and points the end of every segment
 typedef struct {
-    uint16_t duty;
+    uint16_t duty[LEDC_CH_NUM];
     uint32_t fade_time;
+    uint32_t seq;
+    int64_t enqueued_us;
+#if LTR_ENABLE == 1
+    ltr_stamp_t trace; // enqueue time
+#endif
+#if LC_HW_CURVE_FADE_SUPPORTED == 1
+    uint8_t segments;
+    uint16_t points[LEDC_CH_NUM][LC_CURVE_MAX_SEGMENTS];
+#endif
 } lc_job_params_t;
 
+// Fades longer than LC_FADE_MAX_TIME_MS play as consecutive chunks along the same line, each at most that long
+typedef struct {
+    uint16_t from[LEDC_CH_NUM]; // duty when the job started
+    uint32_t index;
+    uint32_t count;
+    uint32_t time_ms; // length of the current chunk
+} lc_chunks_t;
+
 typedef struct {
     const char *label;
     ledc_channel_config_t config;
-    QueueHandle_t queue;
-    TaskHandle_t task;
 } lc_channel_t;
 
 static lc_channel_t lc_channels[LEDC_CH_NUM];
+static QueueHandle_t lc_queue;
+static TaskHandle_t lc_task;
+static lc_stats_t lc_stats;
+
+static lc_done_cb_t done_cb;
+static void *done_cb_arg;
+
+// Sequence number of the last job accepted, jobs can be submitted from several tasks
+static atomic_uint job_seq;
+
+// Sequence number of the last fade started on each channel, of the fade currently armed (0 once it ended or was stopped)
+// and of the last one the ISR reported as finished. The ISR only acknowledges the armed fade, so the task can
+// ignore fade end events that belong to a fade it has already stopped.
+static uint32_t fade_seq[LEDC_CH_NUM];
+static volatile uint32_t armed_seq[LEDC_CH_NUM];
+static volatile uint32_t fade_end_seq[LEDC_CH_NUM];
+
 /*
  * Prepare and set configuration of timers
  * that will be used by LED Controller
@@ -45,50 +110,340 @@ ledc_timer_config_t ledc_timer = {
 
 /*
  * This callback function will be called when fade operation has ended
- * Use callback only if you are aware it is being called inside an ISR
- * Otherwise, you can use a semaphore to unblock tasks
+ * It is called inside an ISR, so it only records which fade ended and wakes the leds task
  */
-static IRAM_ATTR bool on_ledc_fade_end_event(const ledc_cb_param_t *param, void *user_arg) { return true; }
+static IRAM_ATTR bool on_ledc_fade_end_event(const ledc_cb_param_t *param, void *user_arg) {
+    BaseType_t task_woken = pdFALSE;
+    uint32_t ch = (uint32_t)(uintptr_t)user_arg;
 
-static void lc_leds_task(void *params) {
-    lc_channel_t *chan = (lc_channel_t *)params;
-    QueueHandle_t q = chan->queue;
+    if (param->event == LEDC_FADE_END_EVT && armed_seq[ch] != 0) {
+        fade_end_seq[ch] = armed_seq[ch];
+        armed_seq[ch] = 0;
+        xTaskNotifyFromISR(lc_task, LC_NOTIFY_FADE_END(ch), eSetBits, &task_woken);
+    }
+    return task_woken == pdTRUE;
+}
+
+static void lc_record_settled(const lc_job_params_t *job) {
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - job->enqueued_us);
+    lc_stats.last_settle_us = latency_us;
+    if (latency_us > lc_stats.max_settle_us)
+        lc_stats.max_settle_us = latency_us;
+#if LTR_ENABLE == 1
+    ltr_record(LTR_STAGE_FADE_END, job->trace);
+#endif
+}
+
+// Latch a new sequence number for the fade about to start on channel ch, before ledc_fade_start can raise its end
+static void lc_arm_fade(int ch) {
+    if (++fade_seq[ch] == 0)
+        fade_seq[ch] = 1;
+    armed_seq[ch] = fade_seq[ch];
+}
 
+#if LC_HW_CURVE_FADE_SUPPORTED == 1
+// Write one hardware fade range, a range without steps is left out. Returns the number of ranges written.
+static uint8_t lc_fade_range(ledc_fade_param_config_t *param, bool increase, uint32_t step_num, uint32_t cycle_num, uint32_t scale) {
+    if (step_num == 0)
+        return 0;
+    param->dir = increase ? LEDC_DUTY_DIR_INCREASE : LEDC_DUTY_DIR_DECREASE;
+    param->step_num = step_num;
+    param->cycle_num = cycle_num;
+    param->scale = scale;
+    return 1;
+}
+
+/*
+ * Compile one linear segment from duty *duty to `to` over `cycles` PWM periods into at most LC_CURVE_SEGMENT_RANGES
+ * hardware fade ranges. Steps are uniform within a range, so the segment is split into a base range and a remainder
+ * range whose steps take one PWM cycle more (slow segments) or one LSB more (fast segments): the hardware reaches `to`
+ * exactly after `cycles` periods. Returns the number of ranges written, *duty is set to the duty actually reached.
+ */
+static uint8_t lc_compile_segment(uint32_t *duty, uint32_t to, uint32_t cycles, ledc_fade_param_config_t *params) {
+    uint32_t from = *duty;
+    bool up = to > from;
+    uint32_t delta = up ? to - from : from - to;
+    uint8_t count = 0;
+    if (cycles == 0)
+        cycles = 1;
+
+    *duty = to;
+    if (delta == 0) {
+        // hold the duty, in as few steps as the parameter width allows
+        uint32_t steps = (cycles + LC_FADE_PARAM_MAX - 1) / LC_FADE_PARAM_MAX;
+        count += lc_fade_range(&params[count], up, cycles % steps, cycles / steps + 1, 0);
+        count += lc_fade_range(&params[count], up, steps - cycles % steps, cycles / steps, 0);
+        return count;
+    }
+
+    if (delta >= cycles && cycles <= LC_FADE_PARAM_MAX && delta / cycles < LC_FADE_PARAM_MAX) {
+        // fast segment, change the duty every PWM cycle
+        count += lc_fade_range(&params[count], up, delta % cycles, 1, delta / cycles + 1);
+        count += lc_fade_range(&params[count], up, cycles - delta % cycles, 1, delta / cycles);
+        return count;
+    }
+
+    if (delta < cycles && delta <= LC_FADE_PARAM_MAX && cycles / delta < LC_FADE_PARAM_MAX) {
+        // slow segment, change the duty by one LSB every cycle_num PWM cycles
+        count += lc_fade_range(&params[count], up, cycles % delta, cycles / delta + 1, 1);
+        count += lc_fade_range(&params[count], up, delta - cycles % delta, cycles / delta, 1);
+        return count;
+    }
+
+    if (delta < cycles && cycles / delta >= LC_FADE_PARAM_MAX) {
+        // too slow for one LSB per LC_FADE_PARAM_MAX cycles: hold, then step one LSB at a time.
+        // Take the longest ramp steps that leave a hold the parameter width splits evenly.
+        for (uint32_t ramp_cycles = LC_FADE_PARAM_MAX; ramp_cycles > 0; ramp_cycles--) {
+            uint32_t hold = cycles - delta * ramp_cycles;
+            uint32_t min_steps = hold > 0 ? (hold + LC_FADE_PARAM_MAX - 1) / LC_FADE_PARAM_MAX : 1;
+            for (uint32_t steps = min_steps; steps <= min_steps + 3 && steps <= LC_FADE_PARAM_MAX; steps++) {
+                if (hold % steps != 0)
+                    continue;
+                count += lc_fade_range(&params[count], up, hold > 0 ? steps : 0, hold / steps, 0);
+                count += lc_fade_range(&params[count], up, delta, ramp_cycles, 1);
+                return count;
+            }
+        }
+    }
+
+    // Out of the parameter range (the transition engine never asks for such segments): approximate with a single range,
+    // lc_settle_duty pins the final duty once the fade ends
+    uint32_t step_num, scale, cycle_num;
+    if (delta >= cycles) {
+        step_num = cycles < LC_FADE_PARAM_MAX ? cycles : LC_FADE_PARAM_MAX;
+        scale = delta / step_num < LC_FADE_PARAM_MAX ? delta / step_num : LC_FADE_PARAM_MAX;
+        cycle_num = 1;
+    } else {
+        step_num = delta < LC_FADE_PARAM_MAX ? delta : LC_FADE_PARAM_MAX;
+        scale = delta / step_num;
+        cycle_num = cycles / step_num < LC_FADE_PARAM_MAX ? cycles / step_num : LC_FADE_PARAM_MAX;
+    }
+    *duty = up ? from + scale * step_num : from - scale * step_num;
+    return lc_fade_range(params, up, step_num, cycle_num, scale);
+}
+
+static uint8_t lc_apply_curve_job(const lc_job_params_t *job) {
+    DLOGI(TAG, "Setting leds to warm %" PRIu16 ", cold %" PRIu16 " duty in %" PRIu32 "ms along %u segments", job->duty[LC_CH_WARM],
+          job->duty[LC_CH_COLD], job->fade_time, job->segments);
+
+    // Segment s ends after cycles * (s + 1) / segments PWM periods, the same instants the points were sampled at
+    uint64_t cycles = (uint64_t)job->fade_time * LC_FREQUENCY / 1000;
+    ledc_fade_param_config_t params[LC_CURVE_MAX_SEGMENTS * LC_CURVE_SEGMENT_RANGES];
+
+    for (int i = 0; i < LEDC_CH_NUM; i++) {
+        lc_channel_t *chan = &lc_channels[i];
+        uint32_t start = ledc_get_duty(chan->config.speed_mode, chan->config.channel);
+        uint32_t duty = start;
+        uint8_t count = 0;
+        for (int s = 0; s < job->segments; s++) {
+            uint32_t segment_cycles = (uint32_t)(cycles * (s + 1) / job->segments - cycles * s / job->segments);
+            count += lc_compile_segment(&duty, job->points[i][s], segment_cycles, &params[count]);
+        }
+        ledc_set_multi_fade(chan->config.speed_mode, chan->config.channel, start, params, count);
+        lc_arm_fade(i);
+    }
+
+    for (int i = 0; i < LEDC_CH_NUM; i++) {
+        ledc_fade_start(lc_channels[i].config.speed_mode, lc_channels[i].config.channel, LEDC_FADE_NO_WAIT);
+    }
+    return (1 << LC_CH_WARM) | (1 << LC_CH_COLD);
+}
+#endif
+
+/*
+ * Start the current chunk of a fading job, the chunk ends on the point of the job's line at its end time.
+ * Returns the mask of channels that are fading (their end is reported by on_ledc_fade_end_event),
+ * LC_PENDING_HOLD when neither channel changes during the chunk.
+ */
+static uint8_t lc_start_chunk(const lc_job_params_t *job, lc_chunks_t *chunks) {
+    uint32_t start_ms = (uint32_t)((uint64_t)job->fade_time * chunks->index / chunks->count);
+    uint32_t end_ms = (uint32_t)((uint64_t)job->fade_time * (chunks->index + 1) / chunks->count);
+    chunks->time_ms = end_ms - start_ms;
+
+    // Prepare both fades first so that both channels start in the same tick and run for the same time.
+    // A channel that is already at its target does not fade (and would not report a fade end).
+    uint8_t fading = 0;
+    for (int i = 0; i < LEDC_CH_NUM; i++) {
+        int32_t from = chunks->from[i];
+        uint32_t target = (uint32_t)(from + ((int32_t)job->duty[i] - from) * (int32_t)(chunks->index + 1) / (int32_t)chunks->count);
+        if (ledc_get_duty(lc_channels[i].config.speed_mode, lc_channels[i].config.channel) == target)
+            continue;
+
+        ledc_set_fade_with_time(lc_channels[i].config.speed_mode, lc_channels[i].config.channel, target, chunks->time_ms);
+        lc_arm_fade(i);
+        fading |= 1 << i;
+    }
+    for (int i = 0; i < LEDC_CH_NUM; i++) {
+        if (fading & (1 << i))
+            ledc_fade_start(lc_channels[i].config.speed_mode, lc_channels[i].config.channel, LEDC_FADE_NO_WAIT);
+    }
+    return fading != 0 ? fading : LC_PENDING_HOLD;
+}
+
+/*
+ * Start a job on both channels without waiting for it.
+ * Returns the pending mask of its first chunk (see lc_start_chunk), 0 when the job has already been applied.
+ */
+static uint8_t lc_apply_job(const lc_job_params_t *job, lc_chunks_t *chunks) {
+    *chunks = (lc_chunks_t){.count = 1, .time_ms = job->fade_time};
+#if LC_HW_CURVE_FADE_SUPPORTED == 1
+    if (job->segments > 0 && job->fade_time > 0) {
+        return lc_apply_curve_job(job);
+    }
+#endif
+
+    DLOGI(TAG, "Setting leds to warm %" PRIu16 ", cold %" PRIu16 " duty in %" PRIu32 "ms", job->duty[LC_CH_WARM], job->duty[LC_CH_COLD],
+          job->fade_time);
+
+    if (job->fade_time == 0) {
+        for (int i = 0; i < LEDC_CH_NUM; i++) {
+            ledc_set_duty(lc_channels[i].config.speed_mode, lc_channels[i].config.channel, job->duty[i]);
+        }
+        for (int i = 0; i < LEDC_CH_NUM; i++) {
+            ledc_update_duty(lc_channels[i].config.speed_mode, lc_channels[i].config.channel);
+        }
+        return 0;
+    }
+
+    chunks->count = (job->fade_time + LC_FADE_MAX_TIME_MS - 1) / LC_FADE_MAX_TIME_MS;
+    for (int i = 0; i < LEDC_CH_NUM; i++) {
+        chunks->from[i] = (uint16_t)ledc_get_duty(lc_channels[i].config.speed_mode, lc_channels[i].config.channel);
+    }
+    uint8_t pending = lc_start_chunk(job, chunks);
+    // A single fade that changes nothing is already applied
+    return chunks->count == 1 && pending == LC_PENDING_HOLD ? 0 : pending;
+}
+
+#if LC_FADE_MODE == LC_FADE_MODE_LATEST
+static void lc_stop_fades() {
+    for (int i = 0; i < LEDC_CH_NUM; i++) {
+        ledc_fade_stop(lc_channels[i].config.speed_mode, lc_channels[i].config.channel);
+        armed_seq[i] = 0;
+    }
+}
+#endif
+
+// Pin both channels to the exact final duty of a job (after a curve segment that had to be approximated)
+static void lc_settle_duty(const lc_job_params_t *job) {
+#if LC_HW_CURVE_FADE_SUPPORTED == 1
+    if (job->segments == 0)
+        return;
+
+    for (int i = 0; i < LEDC_CH_NUM; i++) {
+        if (ledc_get_duty(lc_channels[i].config.speed_mode, lc_channels[i].config.channel) != job->duty[i]) {
+            ledc_set_duty(lc_channels[i].config.speed_mode, lc_channels[i].config.channel, job->duty[i]);
+            ledc_update_duty(lc_channels[i].config.speed_mode, lc_channels[i].config.channel);
+        }
+    }
+#endif
+}
+
+static void lc_finish_job(const lc_job_params_t *job) {
+    lc_settle_duty(job);
+    lc_record_settled(job);
+
+    // Only the final state is worth reporting, skip jobs that are about to be replaced
+    if (done_cb != NULL && uxQueueMessagesWaiting(lc_queue) == 0) {
+        done_cb(job->duty[LC_CH_WARM], job->duty[LC_CH_COLD], job->seq, done_cb_arg);
+    }
+}
+
+static void lc_leds_task(void *params) {
     // Init
     // Set LED Controller with previously prepared configuration
-    ledc_channel_config(&chan->config);
-
     ledc_cbs_t callbacks = {.fade_cb = on_ledc_fade_end_event};
-    ledc_cb_register(chan->config.speed_mode, chan->config.channel, &callbacks, NULL);
+    for (int i = 0; i < LEDC_CH_NUM; i++) {
+        lc_channel_t *chan = &lc_channels[i];
+        ledc_channel_config(&chan->config);
+        ledc_cb_register(chan->config.speed_mode, chan->config.channel, &callbacks, (void *)(uintptr_t)i);
+        ledc_set_duty(chan->config.speed_mode, chan->config.channel, LC_OFF_DUTY);
+        ledc_update_duty(chan->config.speed_mode, chan->config.channel);
+    }
 
-    ledc_set_duty(chan->config.speed_mode, chan->config.channel, LC_OFF_DUTY);
-    ledc_update_duty(chan->config.speed_mode, chan->config.channel);
+    // Job currently fading, pending holds the channels whose fade has not ended yet (or LC_PENDING_HOLD)
+    lc_job_params_t active = {0};
+    lc_chunks_t chunks = {0};
+    uint8_t pending = 0;
+    uint32_t active_seq[LEDC_CH_NUM] = {0};
+    TickType_t deadline = 0;
+    bool chunk_ended = false;
 
     lc_job_params_t job_params;
     while (1) {
-        if (xQueueReceive(q, &job_params, portMAX_DELAY) == pdTRUE) {
-            ESP_LOGI(TAG, "(%s) -> Setting led to %" PRIu16 " duty in %" PRIu32 "ms", chan->label, job_params.duty, job_params.fade_time);
+        // Nothing blocks in the LEDC driver, the task only sleeps here until a new job or a fade end arrives
+        TickType_t wait = portMAX_DELAY;
+        if (pending) {
+            TickType_t now = xTaskGetTickCount();
+            wait = (int32_t)(deadline - now) > 0 ? deadline - now : 0;
+        }
 
-            if (job_params.fade_time == 0 || job_params.fade_time > LC_FADE_MAX_TIME_MS) {
-                ledc_set_duty(chan->config.speed_mode, chan->config.channel, job_params.duty);
-                ledc_update_duty(chan->config.speed_mode, chan->config.channel);
+        uint32_t events = 0;
+        if (xTaskNotifyWait(0, UINT32_MAX, &events, wait) != pdTRUE && pending) {
+            // A hold ends at its deadline, a fade end interrupt should have arrived before it
+            if (pending != LC_PENDING_HOLD)
+                ESP_LOGW(TAG, "Fade end timeout (pending 0x%x)", pending);
+            pending = 0;
+            chunk_ended = true;
+        }
+
+        for (int i = 0; i < LEDC_CH_NUM; i++) {
+            if ((events & LC_NOTIFY_FADE_END(i)) && (pending & (1 << i)) && fade_end_seq[i] == active_seq[i]) {
+                pending &= ~(1 << i);
+                chunk_ended = pending == 0;
+            }
+        }
+
+        if (chunk_ended) {
+            chunk_ended = false;
+            if (++chunks.index < chunks.count) {
+                pending = lc_start_chunk(&active, &chunks);
+                for (int i = 0; i < LEDC_CH_NUM; i++) {
+                    active_seq[i] = fade_seq[i];
+                }
+                deadline = xTaskGetTickCount() + pdMS_TO_TICKS(chunks.time_ms + (pending == LC_PENDING_HOLD ? 0 : LC_FADE_END_GRACE_MS));
             } else {
-                ledc_set_fade_with_time(chan->config.speed_mode, chan->config.channel, job_params.duty, job_params.fade_time);
-                ledc_fade_start(chan->config.speed_mode, chan->config.channel, LEDC_FADE_WAIT_DONE);
+                lc_finish_job(&active);
             }
         }
-    }
-}
 
-static void lc_set_duty_generic(lc_channel_t *chan, uint16_t duty, uint16_t fade_time) {
-    lc_job_params_t params = {.duty = duty, .fade_time = fade_time};
-#if LC_QUEUE_SIZE == 1
-    BaseType_t ret = xQueueOverwrite(chan->queue, &params);
+#if LC_FADE_MODE == LC_FADE_MODE_LATEST
+        if (xQueueReceive(lc_queue, &job_params, 0) != pdTRUE)
+            continue;
+
+        if (pending) {
+            // Freeze the running fade, the next one starts from the duty the hardware has reached
+            lc_stop_fades();
+            lc_stats.preempted++;
+            pending = 0;
+        }
 #else
-    BaseType_t ret = xQueueSend(chan->queue, &params, 0);
+        // Chain the next job only once the running fade has ended
+        if (pending || xQueueReceive(lc_queue, &job_params, 0) != pdTRUE)
+            continue;
+#endif
+
+#if LTR_ENABLE == 1
+        ltr_record(LTR_STAGE_LED_QUEUE, job_params.trace);
+#endif
+        ltr_stamp_t trace_start = ltr_now();
+        pending = lc_apply_job(&job_params, &chunks);
+        ltr_record(LTR_STAGE_LEDC_UPDATE, trace_start);
+        ltr_end_origin();
+        if (pending == 0) {
+            lc_finish_job(&job_params);
+        } else {
+            active = job_params;
+            for (int i = 0; i < LEDC_CH_NUM; i++) {
+                active_seq[i] = fade_seq[i];
+            }
+            deadline = xTaskGetTickCount() + pdMS_TO_TICKS(chunks.time_ms + (pending == LC_PENDING_HOLD ? 0 : LC_FADE_END_GRACE_MS));
+        }
+
+#if LC_FADE_MODE == LC_FADE_MODE_FIFO
+        // More jobs may be queued behind this one, come back for them without waiting
+        if (pending == 0 && uxQueueMessagesWaiting(lc_queue) > 0)
+            xTaskNotify(lc_task, LC_NOTIFY_JOB, eSetBits);
 #endif
-    if (ret != pdTRUE) {
-        ESP_LOGW(TAG, "Error while adding %s leds job", chan->label);
     }
 }
 
@@ -102,37 +457,86 @@ void lc_init() {
     // Initialize fade service.
     ledc_fade_func_install(0);
 
-    lc_channels[0] = (lc_channel_t){.label = "warm",
-                                    .config =
-                                        {
-                                            .channel = LC_WARM_CHANNEL,
-                                            .gpio_num = LC_WARM_GPIO,
-                                            .duty = 0,
-                                            .speed_mode = LC_LS_MODE,
-                                            .hpoint = 0,
-                                            .timer_sel = LC_LS_TIMER,
-                                            .flags.output_invert = 0,
-                                        },
-                                    .queue = xQueueCreate(LC_QUEUE_SIZE, sizeof(lc_job_params_t))};
-
-    lc_channels[1] = (lc_channel_t){.label = "cold",
-                                    .config =
-                                        {
-                                            .channel = LC_COLD_CHANNEL,
-                                            .gpio_num = LC_COLD_GPIO,
-                                            .duty = 0,
-                                            .speed_mode = LC_LS_MODE,
-                                            .hpoint = 0,
-                                            .timer_sel = LC_LS_TIMER,
-                                            .flags.output_invert = 0,
-                                        },
-                                    .queue = xQueueCreate(LC_QUEUE_SIZE, sizeof(lc_job_params_t))};
+    lc_channels[LC_CH_WARM] = (lc_channel_t){.label = "warm",
+                                             .config = {
+                                                 .channel = LC_WARM_CHANNEL,
+                                                 .gpio_num = LC_WARM_GPIO,
+                                                 .duty = 0,
+                                                 .speed_mode = LC_LS_MODE,
+                                                 .hpoint = 0,
+                                                 .timer_sel = LC_LS_TIMER,
+                                                 .flags.output_invert = 0,
+                                             }};
 
-    for (int i = 0; i < LEDC_CH_NUM; i++) {
-        xTaskCreate(lc_leds_task, lc_channels[i].label, 3072, &lc_channels[i], 1, &lc_channels[i].task);
+    lc_channels[LC_CH_COLD] = (lc_channel_t){.label = "cold",
+                                             .config = {
+                                                 .channel = LC_COLD_CHANNEL,
+                                                 .gpio_num = LC_COLD_GPIO,
+                                                 .duty = 0,
+                                                 .speed_mode = LC_LS_MODE,
+                                                 .hpoint = 0,
+                                                 .timer_sel = LC_LS_TIMER,
+                                                 .flags.output_invert = 0,
+                                             }};
+
+    lc_queue = xQueueCreate(LC_JOB_QUEUE_SIZE, sizeof(lc_job_params_t));
+    xTaskCreate(lc_leds_task, "leds", LC_TASK_STACK_SIZE, NULL, 1, &lc_task);
+}
+
+static uint32_t lc_enqueue_job(lc_job_params_t *params) {
+#if LTR_ENABLE == 1
+    params->trace = ltr_now();
+#endif
+    do {
+        params->seq = atomic_fetch_add_explicit(&job_seq, 1, memory_order_relaxed) + 1;
+    } while (params->seq == 0);
+#if LC_JOB_QUEUE_SIZE == 1
+    BaseType_t ret = xQueueOverwrite(lc_queue, params);
+#else
+    BaseType_t ret = xQueueSend(lc_queue, params, 0);
+#endif
+    if (ret != pdTRUE) {
+        lc_stats.dropped++;
+        ESP_LOGW(TAG, "Error while adding leds job");
+        return 0;
+    }
+    lc_stats.jobs++;
+    UBaseType_t waiting = uxQueueMessagesWaiting(lc_queue);
+    if (waiting > lc_stats.high_water)
+        lc_stats.high_water = waiting;
+    xTaskNotify(lc_task, LC_NOTIFY_JOB, eSetBits);
+    return params->seq;
+}
+
+uint32_t lc_set_duty(uint16_t warm_duty, uint16_t cold_duty, uint32_t fade_time) {
+    lc_job_params_t params = {.duty = {[LC_CH_WARM] = warm_duty, [LC_CH_COLD] = cold_duty},
+                              .fade_time = fade_time,
+                              .enqueued_us = esp_timer_get_time()};
+    return lc_enqueue_job(&params);
+}
+
+#if LC_HW_CURVE_FADE_SUPPORTED == 1
+uint32_t lc_set_duty_curve(const uint16_t *warm_points, const uint16_t *cold_points, uint8_t segments, uint32_t fade_time) {
+    if (segments == 0 || segments > LC_CURVE_MAX_SEGMENTS) {
+        ESP_LOGW(TAG, "Invalid number of curve segments: %u", segments);
+        return 0;
     }
+
+    lc_job_params_t params = {.duty = {[LC_CH_WARM] = warm_points[segments - 1], [LC_CH_COLD] = cold_points[segments - 1]},
+                              .fade_time = fade_time,
+                              .enqueued_us = esp_timer_get_time(),
+                              .segments = segments};
+    for (int s = 0; s < segments; s++) {
+        params.points[LC_CH_WARM][s] = warm_points[s];
+        params.points[LC_CH_COLD][s] = cold_points[s];
+    }
+    return lc_enqueue_job(&params);
 }
+#endif
 
-void lc_set_duty_warm(uint16_t duty, uint16_t fade_time) { lc_set_duty_generic(&lc_channels[0], duty, fade_time); }
+void lc_get_stats(lc_stats_t *stats) { *stats = lc_stats; }
 
-void lc_set_duty_cold(uint16_t duty, uint16_t fade_time) { lc_set_duty_generic(&lc_channels[1], duty, fade_time); }
\ No newline at end of file
+void lc_register_done_cb(lc_done_cb_t cb, void *arg) {
+    done_cb_arg = arg;
+    done_cb = cb;
+}
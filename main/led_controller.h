@@ -1,6 +1,10 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "driver/ledc.h"
+#include "esp_idf_version.h"
+#include "soc/soc_caps.h"
 
 #define LC_LS_TIMER LEDC_TIMER_1
 #define LC_LS_MODE LEDC_LOW_SPEED_MODE
@@ -23,14 +27,59 @@
 // Frequency in Hz
 #define LC_FREQUENCY (25000)
 
+// Fade scheduling mode
+// LC_FADE_MODE_LATEST - latest wins: a new job interrupts the running fade and retargets from the current hardware duty,
+//                       only the newest pending job is kept (xQueueOverwrite), so latency does not depend on burst length
+// LC_FADE_MODE_FIFO   - every job plays out as a full fade, one after another (preserves intermediate states)
+#define LC_FADE_MODE_LATEST 0
+#define LC_FADE_MODE_FIFO 1
+#ifndef LC_FADE_MODE
+#define LC_FADE_MODE LC_FADE_MODE_LATEST
+#endif
+
 // Queue size
+// Used only in LC_FADE_MODE_FIFO, latest wins mode always uses a single slot queue
 // Set to 1 for real-time behavior: xQueueOverwrite() will be used to always keep the latest command
 // Set >1 to buffer multiple LED jobs (slower but preserves intermediate states)
 #define LC_QUEUE_SIZE 16
 
-// Fade max time
+// Longest single LEDC fade, longer fades play as consecutive fades of at most this length along the same line
 #define LC_FADE_MAX_TIME_MS 5000
 
+// Hardware multi-segment (gamma curve) fades, available on ESP32-C6/H2
+// A curve job is compiled into a LEDC fade parameter list and runs without any CPU wakeups until it ends
+#if defined(SOC_LEDC_GAMMA_CURVE_FADE_SUPPORTED) && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+#define LC_HW_CURVE_FADE_SUPPORTED 1
+// Every segment takes up to two fade ranges (base steps and remainder steps) to hit its end duty and time exactly
+#define LC_CURVE_SEGMENT_RANGES 2
+#define LC_CURVE_MAX_SEGMENTS (SOC_LEDC_GAMMA_CURVE_FADE_RANGE_MAX / LC_CURVE_SEGMENT_RANGES)
+#else
+#define LC_HW_CURVE_FADE_SUPPORTED 0
+#define LC_CURVE_MAX_SEGMENTS 1
+#endif
+
+typedef struct {
+    uint32_t jobs;            // jobs accepted by lc_set_duty
+    uint32_t dropped;         // jobs rejected because the queue was full
+    uint32_t high_water;      // max jobs waiting at once
+    uint32_t preempted;       // fades interrupted by a newer job (latest wins mode)
+    uint32_t last_settle_us;  // command-to-settled latency of the last settled job
+    uint32_t max_settle_us;   // worst command-to-settled latency since boot
+} lc_stats_t;
+
+/*
+ * Called from the leds task when a job has settled (fade ended or duty applied) and no newer job is queued,
+ * i.e. when the LEDs have reached their final state. job_seq is the number lc_set_duty returned for the job.
+ * Must not block.
+ */
+typedef void (*lc_done_cb_t)(uint16_t warm_duty, uint16_t cold_duty, uint32_t job_seq, void *arg);
+
 void lc_init();
-void lc_set_duty_warm(uint16_t duty, uint16_t fade_time);
-void lc_set_duty_cold(uint16_t duty, uint16_t fade_time);
\ No newline at end of file
+void lc_get_stats(lc_stats_t *stats);
+void lc_register_done_cb(lc_done_cb_t cb, void *arg);
+// Returns the sequence number of the job (never 0), 0 when the job was dropped
+uint32_t lc_set_duty(uint16_t warm_duty, uint16_t cold_duty, uint32_t fade_time);
+#if LC_HW_CURVE_FADE_SUPPORTED == 1
+// Fade along a piecewise linear curve, segment i lasts fade_time / segments and ends at warm_points[i] / cold_points[i]
+uint32_t lc_set_duty_curve(const uint16_t *warm_points, const uint16_t *cold_points, uint8_t segments, uint32_t fade_time);
+#endif
\ No newline at end of file
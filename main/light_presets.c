@@ -23,7 +23,6 @@ void light_presets_cycle() {
 
     zcctlm_set_brightness(preset.brightness);
     zcctlm_set_color_temp(preset.mireds);
-    zcctlm_report_current_state();
 
     ++current_preset_index;
     if (current_preset_index >= light_presets_count)
@@ -0,0 +1,287 @@
+#include "light_transition.h"
+
+#define DLOG_LOCAL_LEVEL DLOG_LEVEL_TRANSITION
+#include "deferred_log.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "led_controller.h"
+
+static const char *TAG = "LT";
+
+typedef struct {
+    int32_t from_level_q8;
+    int32_t to_level_q8;
+    int32_t from_mireds;
+    int32_t to_mireds;
+    int64_t start_us;
+    uint32_t duration_us;
+    uint32_t output_us; // hardware mode: end of the part of the transition already handed to the LEDs
+    uint32_t output_seq; // hardware mode: LED job of that part, 0 while it is being handed out or once it has settled
+    bool done_reported;
+} lt_transition_t;
+
+// transition and lt_stats are shared by the model task, the timer task and the leds task, both only change under lt_lock
+static lt_transition_t transition;
+static lt_mix_fn_t mix_fn;
+static lt_done_cb_t done_fn;
+static portMUX_TYPE lt_lock = portMUX_INITIALIZER_UNLOCKED;
+static lt_stats_t lt_stats;
+
+#if LT_USE_HW_CURVE_FADE == 1
+// Last LED job reported settled, under lt_lock
+static uint32_t settled_seq;
+#else
+static esp_timer_handle_t tick_timer;
+
+// last duty written to the LEDs, used to skip updates that would not change the output
+static uint16_t last_warm_duty;
+static uint16_t last_cold_duty;
+#endif
+
+// Time since the transition started, must be called with lt_lock taken
+static inline uint32_t lt_elapsed_us(int64_t now_us) {
+    int64_t elapsed_us = now_us - transition.start_us;
+    return elapsed_us > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed_us;
+}
+
+static inline int32_t lt_lerp(int32_t from, int32_t to, uint32_t elapsed_us, uint32_t duration_us) {
+    return from + (int32_t)(((int64_t)(to - from) * elapsed_us) / duration_us);
+}
+
+/*
+ * Point of the transition `elapsed_us` after its start, must be called with lt_lock taken.
+ * Returns false once the transition has reached its target.
+ */
+static bool lt_point_at(uint32_t elapsed_us, uint16_t *level_q8, uint16_t *mireds) {
+    if (elapsed_us >= transition.duration_us) {
+        *level_q8 = (uint16_t)transition.to_level_q8;
+        *mireds = (uint16_t)transition.to_mireds;
+        return false;
+    }
+
+    *level_q8 = (uint16_t)lt_lerp(transition.from_level_q8, transition.to_level_q8, elapsed_us, transition.duration_us);
+    *mireds = (uint16_t)lt_lerp(transition.from_mireds, transition.to_mireds, elapsed_us, transition.duration_us);
+    return true;
+}
+
+#if LT_USE_HW_CURVE_FADE == 1
+static void lt_output_settled();
+
+// The LED job of the part just handed out is seq, it may already have settled (single immediate update)
+static void lt_output_started(uint32_t seq) {
+    portENTER_CRITICAL(&lt_lock);
+    bool settled = seq != 0 && seq == settled_seq;
+    transition.output_seq = settled ? 0 : seq;
+    portEXIT_CRITICAL(&lt_lock);
+
+    if (settled)
+        lt_output_settled();
+}
+
+// Sample the next part of the transition and hand it to the LEDC hardware as one multi-segment fade
+static void lt_start_output() {
+    esp_cpu_cycle_count_t start_cycles = esp_cpu_get_cycle_count();
+
+    portENTER_CRITICAL(&lt_lock);
+    uint32_t chunk_start_us = transition.output_us;
+    uint32_t chunk_us = transition.duration_us - chunk_start_us;
+    if (chunk_us > LC_FADE_MAX_TIME_MS * 1000)
+        chunk_us = LC_FADE_MAX_TIME_MS * 1000;
+    transition.output_us = chunk_start_us + chunk_us;
+    // Jobs handed out before this one no longer end a part of the transition
+    transition.output_seq = 0;
+    portEXIT_CRITICAL(&lt_lock);
+
+    uint32_t time_ms = chunk_us / 1000;
+    uint32_t segments = time_ms / LT_CURVE_MIN_SEGMENT_MS;
+    if (segments > LC_CURVE_MAX_SEGMENTS)
+        segments = LC_CURVE_MAX_SEGMENTS;
+
+    if (segments == 0) {
+        uint16_t level_q8, mireds, warm_duty, cold_duty;
+        portENTER_CRITICAL(&lt_lock);
+        lt_point_at(chunk_start_us + chunk_us, &level_q8, &mireds);
+        portEXIT_CRITICAL(&lt_lock);
+
+        mix_fn(level_q8, mireds, &warm_duty, &cold_duty);
+        portENTER_CRITICAL(&lt_lock);
+        lt_stats.cpu_cycles += esp_cpu_get_cycle_count() - start_cycles;
+        lt_stats.steps++;
+        portEXIT_CRITICAL(&lt_lock);
+
+        lt_output_started(lc_set_duty(warm_duty, cold_duty, time_ms));
+        return;
+    }
+
+    uint16_t warm_points[LC_CURVE_MAX_SEGMENTS];
+    uint16_t cold_points[LC_CURVE_MAX_SEGMENTS];
+    for (uint32_t s = 0; s < segments; s++) {
+        uint16_t level_q8, mireds;
+        portENTER_CRITICAL(&lt_lock);
+        lt_point_at(chunk_start_us + (uint32_t)(((uint64_t)chunk_us * (s + 1)) / segments), &level_q8, &mireds);
+        portEXIT_CRITICAL(&lt_lock);
+
+        mix_fn(level_q8, mireds, &warm_points[s], &cold_points[s]);
+    }
+    portENTER_CRITICAL(&lt_lock);
+    lt_stats.cpu_cycles += esp_cpu_get_cycle_count() - start_cycles;
+    lt_stats.steps += segments;
+    portEXIT_CRITICAL(&lt_lock);
+
+    lt_output_started(lc_set_duty_curve(warm_points, cold_points, (uint8_t)segments, time_ms));
+}
+
+// The part of the transition handed out last has played out: continue with the next one or report the end
+static void lt_output_settled() {
+    portENTER_CRITICAL(&lt_lock);
+    bool next_chunk = transition.output_us < transition.duration_us;
+    bool finished = !next_chunk && !transition.done_reported;
+    if (finished)
+        transition.done_reported = true;
+    uint16_t level_q8 = (uint16_t)transition.to_level_q8;
+    uint16_t mireds = (uint16_t)transition.to_mireds;
+    portEXIT_CRITICAL(&lt_lock);
+
+    if (next_chunk)
+        lt_start_output();
+    if (finished && done_fn != NULL)
+        done_fn(level_q8, mireds);
+}
+#else
+static void lt_tick(void *arg) {
+    esp_cpu_cycle_count_t start_cycles = esp_cpu_get_cycle_count();
+
+    uint16_t level_q8, mireds;
+    portENTER_CRITICAL(&lt_lock);
+    bool running = lt_point_at(lt_elapsed_us(esp_timer_get_time()), &level_q8, &mireds);
+    portEXIT_CRITICAL(&lt_lock);
+
+    if (running) {
+        esp_timer_start_once(tick_timer, LT_TICK_PERIOD_US);
+    }
+
+    uint16_t warm_duty, cold_duty;
+    mix_fn(level_q8, mireds, &warm_duty, &cold_duty);
+
+    // The last point is always written, its LED job is the one whose completion ends the transition
+    bool write = !running || warm_duty != last_warm_duty || cold_duty != last_cold_duty;
+    portENTER_CRITICAL(&lt_lock);
+    lt_stats.cpu_cycles += esp_cpu_get_cycle_count() - start_cycles;
+    if (write)
+        lt_stats.steps++;
+    portEXIT_CRITICAL(&lt_lock);
+    if (!write)
+        return;
+
+    last_warm_duty = warm_duty;
+    last_cold_duty = cold_duty;
+    lc_set_duty(warm_duty, cold_duty, 0);
+}
+
+static void lt_start_output() {
+    // Ticks re-arm themselves while the transition runs, the first one is scheduled immediately
+    // so that all duty updates come from the timer task
+    esp_timer_stop(tick_timer);
+    esp_timer_start_once(tick_timer, 0);
+}
+#endif
+
+// LED controller completion, fires for every settled job - forward only the one that ends the transition
+static void lt_on_leds_done(uint16_t warm_duty, uint16_t cold_duty, uint32_t job_seq, void *arg) {
+#if LT_USE_HW_CURVE_FADE == 1
+    // Every chunk is a single job, continue once the job of the current chunk has played out
+    // (any other job belongs to a chunk the current transition has replaced, even when it ended on the same duty)
+    portENTER_CRITICAL(&lt_lock);
+    settled_seq = job_seq;
+    bool chunk_done = job_seq != 0 && job_seq == transition.output_seq;
+    if (chunk_done)
+        transition.output_seq = 0;
+    portEXIT_CRITICAL(&lt_lock);
+
+    if (chunk_done)
+        lt_output_settled();
+#else
+    portENTER_CRITICAL(&lt_lock);
+    bool finished = !transition.done_reported && lt_elapsed_us(esp_timer_get_time()) >= transition.duration_us;
+    if (finished)
+        transition.done_reported = true;
+    uint16_t level_q8 = (uint16_t)transition.to_level_q8;
+    uint16_t mireds = (uint16_t)transition.to_mireds;
+    portEXIT_CRITICAL(&lt_lock);
+
+    if (finished && done_fn != NULL)
+        done_fn(level_q8, mireds);
+#endif
+}
+
+// --- PUBLIC ---
+
+void lt_init(lt_mix_fn_t mix, lt_done_cb_t done, uint16_t level_q8, uint16_t mireds) {
+    mix_fn = mix;
+    done_fn = done;
+    transition = (lt_transition_t){
+        .from_level_q8 = level_q8,
+        .to_level_q8 = level_q8,
+        .from_mireds = mireds,
+        .to_mireds = mireds,
+        .done_reported = true,
+    };
+    lc_register_done_cb(lt_on_leds_done, NULL);
+
+#if LT_USE_HW_CURVE_FADE == 0
+    const esp_timer_create_args_t timer_args = {
+        .callback = lt_tick,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "lt_tick",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &tick_timer));
+#endif
+}
+
+void lt_set_target(uint16_t level_q8, uint16_t mireds, uint32_t time_ms) {
+    DLOGD(TAG, "Transition to level %u.%02u, %u mireds in %" PRIu32 "ms", level_q8 >> 8, ((level_q8 & 0xff) * 100) >> 8, mireds, time_ms);
+
+    if (time_ms > LT_MAX_TRANSITION_MS)
+        time_ms = LT_MAX_TRANSITION_MS;
+
+    // Retarget from wherever the running transition currently is
+    portENTER_CRITICAL(&lt_lock);
+    int64_t now_us = esp_timer_get_time();
+    uint16_t current_level_q8, current_mireds;
+    lt_point_at(lt_elapsed_us(now_us), &current_level_q8, &current_mireds);
+
+    transition.from_level_q8 = current_level_q8;
+    transition.from_mireds = current_mireds;
+    transition.to_level_q8 = level_q8;
+    transition.to_mireds = mireds;
+    transition.start_us = now_us;
+    transition.duration_us = time_ms * 1000;
+    transition.output_us = 0;
+    transition.done_reported = false;
+    lt_stats.transitions++;
+    lt_stats.fade_ms += time_ms;
+    portEXIT_CRITICAL(&lt_lock);
+
+    lt_start_output();
+}
+
+uint32_t lt_get_current(uint16_t *level_q8, uint16_t *mireds) {
+    portENTER_CRITICAL(&lt_lock);
+    uint32_t elapsed_us = lt_elapsed_us(esp_timer_get_time());
+    uint32_t remaining_us = elapsed_us < transition.duration_us ? transition.duration_us - elapsed_us : 0;
+    lt_point_at(elapsed_us, level_q8, mireds);
+    portEXIT_CRITICAL(&lt_lock);
+    return remaining_us / 1000;
+}
+
+void lt_get_stats(lt_stats_t *stats) {
+    portENTER_CRITICAL(&lt_lock);
+    *stats = lt_stats;
+    portEXIT_CRITICAL(&lt_lock);
+}
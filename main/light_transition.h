@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+    Software transition engine.
+
+    Interpolates brightness and color temperature together in (level, mireds) space, where level is the
+    ZCL CurrentLevel in Q8 fixed point. Level is perceptual (gamma is applied afterwards), so a linear ramp
+    of level looks like an even dim, and both parameters arrive at the same moment.
+    Every tick the current point is converted to warm/cold duty with the model's mixing function
+    and written to the LEDs as an immediate (non-fading) update.
+
+    On chips with hardware multi-segment fades (ESP32-C6/H2) the path is instead sampled when the
+    transition starts and handed to the LEDC peripheral as a piecewise linear curve, so the CPU does not
+    wake up at all until the fade ends. Transitions longer than LC_FADE_MAX_TIME_MS are handed out
+    in chunks, the next one is sampled when the previous one ends.
+*/
+
+#include "led_controller.h"
+
+// Tick of the interpolation timer (~200 Hz)
+#define LT_TICK_PERIOD_US 5000
+
+// Offload transitions to LEDC hardware curve fades when the chip supports them
+#define LT_USE_HW_CURVE_FADE LC_HW_CURVE_FADE_SUPPORTED
+// Shortest hardware segment, short fades use fewer segments (a single linear fade below this time)
+#define LT_CURVE_MIN_SEGMENT_MS 20
+
+// Longest transition, longer requests are clamped (the duration is kept in microseconds)
+#define LT_MAX_TRANSITION_MS (UINT32_MAX / 1000)
+
+// Fixed point helpers for level
+#define LT_LEVEL_Q8(level) ((uint16_t)((level) << 8))
+
+typedef void (*lt_mix_fn_t)(uint16_t level_q8, uint16_t mireds, uint16_t *warm_duty, uint16_t *cold_duty);
+// Called from the leds task once the LEDs have settled at the target of the latest transition
+typedef void (*lt_done_cb_t)(uint16_t level_q8, uint16_t mireds);
+
+typedef struct {
+    uint32_t transitions; // transitions started
+    uint32_t steps;       // duty updates emitted
+    uint32_t cpu_cycles;  // CPU cycles spent interpolating and mixing (excludes the LED controller)
+    uint32_t fade_ms;     // total requested fade time, divide cpu_cycles by it to get cost per second of fade
+} lt_stats_t;
+
+void lt_init(lt_mix_fn_t mix, lt_done_cb_t done, uint16_t level_q8, uint16_t mireds);
+void lt_set_target(uint16_t level_q8, uint16_t mireds, uint32_t time_ms);
+// Point the running transition has reached now (the target once it has ended), returns the time left in ms
+uint32_t lt_get_current(uint16_t *level_q8, uint16_t *mireds);
+void lt_get_stats(lt_stats_t *stats);
@@ -6,11 +6,15 @@
 #include "freertos/FreeRTOS.h"
 #include "nvs_flash.h"
 
+#include "bench.h"
+#include "deferred_log.h"
 #include "input_handler.h"
+#include "latency_trace.h"
 #include "led_controller.h"
 #include "zb_app.h"
 #include "zb_attr_report.h"
 #include "zb_config.h"
+#include "zcctlm_cmd.h"
 #include "zigbee_cct_light_model.h"
 
 #define LED_GPIO GPIO_NUM_15
@@ -28,6 +32,12 @@ void app_main(void) {
     // Initialize NVS (required for Zigbee stack and other components)
     init_nvs();
 
+    // Start the deferred logger first, hot path logs written before it are dropped
+    dlog_init();
+
+    // Latency histograms of the command path (no-op unless LTR_ENABLE is set)
+    ltr_init();
+
     // Configure status LED GPIO
     gpio_set_direction(LED_GPIO, GPIO_MODE_OUTPUT);
     gpio_set_level(LED_GPIO, LED_ACTIVE_LEVEL); // Turn LED on to indicate boot
@@ -38,6 +48,9 @@ void app_main(void) {
     // Initialize Zigbee CCT Light Model
     zcctlm_init();
 
+    // Start the model task consuming light commands posted from Zigbee callbacks
+    zcctlm_cmd_init();
+
     // Initialize input handler (button press detection)
     input_init();
 
@@ -47,7 +60,10 @@ void app_main(void) {
     // Wait until device joins Zigbee network
     wait_for_zigbee_connection();
 
-    // Report current device state to coordinator
+    // Hot path microbenchmarks, printed as BENCH lines (no-op unless BENCH_ENABLE is set), reports need the network
+    bench_run();
+
+    // Report current device state to coordinator, later changes are reported by the light model itself
     zcctlm_report_current_state();
 
     // Turn off LED to indicate end of init phase
@@ -2,12 +2,18 @@
 
 #include "esp_check.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/event_groups.h"
 #include "ha/esp_zigbee_ha_standard.h"
 
+#include "command_trace.h"
+#include "latency_trace.h"
 #include "led_controller.h"
 #include "zb_attr_handlers.h"
+#include "zb_attr_report.h"
 #include "zb_clusters_config.h"
+#include "zb_cmd_handlers.h"
+#include "zb_diagnostics.h"
 #include "zigbee_cct_light_model.h"
 
 static const char *TAG = "zbapp";
@@ -15,6 +21,7 @@ static const char *TAG = "zbapp";
 #define CONNECTED_BIT BIT0
 
 static EventGroupHandle_t connected_event_group;
+static appzb_action_stats_t action_stats;
 
 static void bdb_start_top_level_commissioning_cb(uint8_t mode_mask) {
     ESP_RETURN_ON_FALSE(esp_zb_bdb_start_top_level_commissioning(mode_mask) == ESP_OK, , TAG, "Failed to start Zigbee bdb commissioning");
@@ -33,6 +40,7 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct) {
     case ESP_ZB_BDB_SIGNAL_DEVICE_REBOOT:
         if (err_status == ESP_OK) {
             ESP_LOGI(TAG, "Device started up in%s factory-reset mode", esp_zb_bdb_is_factory_new() ? "" : " non");
+            zbdiag_start();
             if (esp_zb_bdb_is_factory_new()) {
                 ESP_LOGI(TAG, "Start network steering");
                 esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_MODE_NETWORK_STEERING);
@@ -77,16 +85,40 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct) {
 }
 
 esp_err_t zb_action_handler(esp_zb_core_action_callback_id_t callback_id, const void *message) {
+    int64_t start_us = esp_timer_get_time();
+    ltr_stamp_t trace_start = ltr_now();
+    ltr_set_callback_start(trace_start);
+    ctr_record_action(callback_id, message);
     esp_err_t ret = ESP_OK;
     switch (callback_id) {
     case ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID:
         ret = zb_attribute_handler((esp_zb_zcl_set_attr_value_message_t *)message);
         break;
 
+    case ESP_ZB_CORE_SCENES_STORE_SCENE_CB_ID:
+        ret = zb_store_scene_handler((esp_zb_zcl_store_scene_message_t *)message);
+        break;
+
+    case ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID:
+        ret = zb_recall_scene_handler((esp_zb_zcl_recall_scene_message_t *)message);
+        break;
+
+    case ESP_ZB_CORE_CMD_PRIVILEGE_COMMAND_REQ_CB_ID:
+        ret = zb_privilege_command_handler((esp_zb_zcl_privilege_command_message_t *)message);
+        break;
+
     default:
         ESP_LOGW(TAG, "(zb_action_handler) -> Receive Zigbee action(0x%x) callback", callback_id);
         break;
     }
+
+    // Time spent inside the stack callback, the stack cannot process anything else meanwhile
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+    action_stats.calls++;
+    action_stats.total_us += elapsed_us;
+    if (elapsed_us > action_stats.max_us)
+        action_stats.max_us = elapsed_us;
+    ltr_record(LTR_STAGE_STACK_CB, trace_start);
     return ret;
 }
 
@@ -112,7 +144,9 @@ static void esp_zb_task(void *pvParameters) {
     esp_zb_ep_list_add_ep(ep_list, cluster_list, ep_cfg);
 
     esp_zb_device_register(ep_list);
+    zb_register_privilege_commands();
     esp_zb_core_action_handler_register(zb_action_handler);
+    esp_zb_raw_command_handler_register(zb_raw_command_handler);
     esp_zb_set_primary_network_channel_set(ESP_ZB_PRIMARY_CHANNEL_MASK);
 
     ESP_ERROR_CHECK(esp_zb_start(false));
@@ -122,6 +156,7 @@ static void esp_zb_task(void *pvParameters) {
 // public
 void appzb_init() {
     connected_event_group = xEventGroupCreate();
+    zbattr_init();
 
     esp_zb_platform_config_t config = {
         .radio_config = ESP_ZB_DEFAULT_RADIO_CONFIG(),
@@ -141,6 +176,8 @@ bool appzb_is_connected() {
 
 void appzb_wait_until_connected() { xEventGroupWaitBits(connected_event_group, CONNECTED_BIT, false, true, portMAX_DELAY); }
 
+void appzb_get_action_stats(appzb_action_stats_t *stats) { *stats = action_stats; }
+
 void appzb_factory_reset() {
     ESP_LOGI(TAG, "Factory resetting Zigbee stack, device will reboot!");
     zcctlm_clear_nvs();
@@ -2,7 +2,14 @@
 
 #include "zb_config.h"
 
+typedef struct {
+    uint32_t calls;    // zb_action_handler invocations
+    uint64_t total_us; // time spent in zb_action_handler
+    uint32_t max_us;   // longest single invocation
+} appzb_action_stats_t;
+
 void appzb_init();
 bool appzb_is_connected();
 void appzb_wait_until_connected();
-void appzb_factory_reset();
\ No newline at end of file
+void appzb_factory_reset();
+void appzb_get_action_stats(appzb_action_stats_t *stats);
\ No newline at end of file
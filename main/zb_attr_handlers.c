@@ -1,10 +1,14 @@
 #include "zb_attr_handlers.h"
 
+#define DLOG_LOCAL_LEVEL DLOG_LEVEL_ATTR_HANDLERS
+#include "deferred_log.h"
+
 #include "esp_check.h"
 #include "esp_log.h"
 #include "freertos/event_groups.h"
 
 #include "led_controller.h"
+#include "zcctlm_cmd.h"
 #include "zigbee_cct_light_model.h"
 
 static const char *TAG = "zbapp handlers";
@@ -56,8 +60,8 @@ static void handle_on_off_attribute(const esp_zb_zcl_set_attr_value_message_t *m
     case ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID:
         if (message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_BOOL) {
             light_state = *(bool *)message->attribute.data.value;
-            ESP_LOGI(TAG, "Light sets to %s", light_state ? "On" : "Off");
-            zcctlm_set_on_off(light_state);
+            DLOGI(TAG, "Light sets to %s", DLOG_STR(light_state ? "On" : "Off"));
+            zcctlm_cmd_post(ZCCTLM_CMD_SET_ON_OFF, light_state);
         } else {
             ESP_LOGW(TAG, "Invalid type for ON_OFF attribute: 0x%x", message->attribute.data.type);
         }
@@ -67,8 +71,8 @@ static void handle_on_off_attribute(const esp_zb_zcl_set_attr_value_message_t *m
     case ESP_ZB_ZCL_ATTR_ON_OFF_START_UP_ON_OFF:
         if (message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM) {
             startup_on_off = *(uint8_t *)message->attribute.data.value;
-            ESP_LOGI(TAG, "StartUpOnOff changed to %d", startup_on_off);
-            zcctlm_set_startup_behavior((zcctl_startup_behavior_e)startup_on_off);
+            DLOGI(TAG, "StartUpOnOff changed to %d", startup_on_off);
+            zcctlm_cmd_post(ZCCTLM_CMD_SET_STARTUP_BEHAVIOR, startup_on_off);
         } else {
             ESP_LOGW(TAG, "Invalid type for StartUpOnOff: 0x%x", message->attribute.data.type);
         }
@@ -87,8 +91,8 @@ static void handle_color_control_attribute(const esp_zb_zcl_set_attr_value_messa
     case ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID:
         if (message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16) {
             uint16_t color_temperature = *(uint16_t *)message->attribute.data.value;
-            ESP_LOGI(TAG, "Color temperature set to %u mireds", color_temperature);
-            zcctlm_set_color_temp(color_temperature);
+            DLOGI(TAG, "Color temperature set to %u mireds", color_temperature);
+            zcctlm_cmd_post(ZCCTLM_CMD_SET_COLOR_TEMP, color_temperature);
         } else {
             ESP_LOGW(TAG, "Invalid type for ColorTemperature: 0x%x", message->attribute.data.type);
         }
@@ -106,8 +110,8 @@ static void handle_level_control_attribute(const esp_zb_zcl_set_attr_value_messa
     case ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID:
         if (message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) {
             uint8_t curent_level = *(uint8_t *)message->attribute.data.value;
-            ESP_LOGI(TAG, "Current level set to %u", curent_level);
-            zcctlm_set_brightness(curent_level);
+            DLOGI(TAG, "Current level set to %u", curent_level);
+            zcctlm_cmd_post(ZCCTLM_CMD_SET_BRIGHTNESS, curent_level);
         } else {
             ESP_LOGW(TAG, "Invalid type for CurrentLevel: 0x%x", message->attribute.data.type);
         }
@@ -116,8 +120,8 @@ static void handle_level_control_attribute(const esp_zb_zcl_set_attr_value_messa
     case ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_ON_TRANSITION_TIME_ID:
         if (message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16) {
             uint16_t on_transition_time = *(uint16_t *)message->attribute.data.value;
-            ESP_LOGI(TAG, "On transition time set to %u", on_transition_time);
-            zcctlm_set_on_transition_time(on_transition_time);
+            DLOGI(TAG, "On transition time set to %u/10 s", on_transition_time);
+            zcctlm_cmd_post(ZCCTLM_CMD_SET_ON_TRANSITION_TIME, on_transition_time);
         } else {
             ESP_LOGW(TAG, "Invalid type for OnTransitionTime: 0x%x", message->attribute.data.type);
         }
@@ -126,8 +130,8 @@ static void handle_level_control_attribute(const esp_zb_zcl_set_attr_value_messa
     case ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_OFF_TRANSITION_TIME_ID:
         if (message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16) {
             uint16_t off_transition_time = *(uint16_t *)message->attribute.data.value;
-            ESP_LOGI(TAG, "Off transition time set to %u", off_transition_time);
-            zcctlm_set_off_transition_time(off_transition_time);
+            DLOGI(TAG, "Off transition time set to %u/10 s", off_transition_time);
+            zcctlm_cmd_post(ZCCTLM_CMD_SET_OFF_TRANSITION_TIME, off_transition_time);
         } else {
             ESP_LOGW(TAG, "Invalid type for OffTransitionTime: 0x%x", message->attribute.data.type);
         }
@@ -140,6 +144,6 @@ static void handle_level_control_attribute(const esp_zb_zcl_set_attr_value_messa
 }
 
 static void handle_identify_attribute(const esp_zb_zcl_set_attr_value_message_t *message) {
-    ESP_LOGI(TAG, "Identify: %u", *(uint16_t *)message->attribute.data.value);
-    zcctlm_identify(*(uint16_t *)message->attribute.data.value);
+    DLOGI(TAG, "Identify: %u", *(uint16_t *)message->attribute.data.value);
+    zcctlm_cmd_post(ZCCTLM_CMD_IDENTIFY, *(uint16_t *)message->attribute.data.value);
 }
\ No newline at end of file
@@ -1,24 +1,53 @@
 #include "zb_attr_report.h"
 
+#define DLOG_LOCAL_LEVEL DLOG_LEVEL_ATTR_REPORT
+#include "deferred_log.h"
+
+#include <stdbool.h>
+
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "zb_app.h"
 
 static const char *TAG = "zb attr report";
 
-void zbattr_send_attribute_report(uint16_t cluster_id, uint16_t attr_id, void *value) {
-    // Check if connected to network
-    if (!appzb_is_connected()) {
-        ESP_LOGW(TAG, "Failed to send report, device is not connected to network");
-        return;
-    }
+typedef struct {
+    uint16_t cluster_id;
+    uint16_t attr_id;
+    uint8_t size;         // attribute size in bytes (1 or 2)
+    bool dirty;           // value changed since the last flush
+    bool reported;        // last_value holds what the network last heard
+    uint16_t value;       // latest value
+    uint16_t last_value;  // last reported value
+    int64_t last_sent_us; // time of the last report frame for this attribute
+} zbattr_report_slot_t;
 
+// Attributes the application reports on its own, anything else is reported immediately
+static zbattr_report_slot_t report_slots[] = {
+    {.cluster_id = ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, .attr_id = ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, .size = sizeof(bool)},
+    {.cluster_id = ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, .attr_id = ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, .size = sizeof(uint8_t)},
+    {.cluster_id = ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, .attr_id = ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, .size = sizeof(uint16_t)},
+};
+#define ZBATTR_REPORT_SLOTS (sizeof(report_slots) / sizeof(report_slots[0]))
+
+static esp_timer_handle_t report_timer;
+static TaskHandle_t report_task;
+static portMUX_TYPE report_lock = portMUX_INITIALIZER_UNLOCKED;
+static zbattr_report_stats_t report_stats;
+
+#define ZBATTR_REPORTING_OFF 0xFFFF
+
+// Set the local attribute and send one report frame for it, must be called with the Zigbee lock taken
+static esp_err_t zbattr_send_report_frame(uint16_t cluster_id, uint16_t attr_id, void *value) {
     // Save attribute localy
     esp_zb_zcl_status_t status =
         esp_zb_zcl_set_attribute_val(HA_ESP_LIGHT_ENDPOINT, cluster_id, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr_id, value, false);
 
     if (status != ESP_ZB_ZCL_STATUS_SUCCESS) {
         ESP_LOGW(TAG, "Failed to set attribute 0x%04X in cluster 0x%04X", attr_id, cluster_id);
-        return;
+        return ESP_FAIL;
     }
 
     // Prepare to send
@@ -41,8 +70,203 @@ void zbattr_send_attribute_report(uint16_t cluster_id, uint16_t attr_id, void *v
     esp_err_t err = esp_zb_zcl_report_attr_cmd_req(&report_cmd);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Failed to send report for attribute 0x%04X in cluster 0x%04X", attr_id, cluster_id);
+        return err;
+    }
+
+    DLOGI(TAG, "Sent report: cluster 0x%04X, attr 0x%04X", cluster_id, attr_id);
+    return ESP_OK;
+}
+
+static void zbattr_report_now(uint16_t cluster_id, uint16_t attr_id, void *value) {
+    // Check if connected to network
+    if (!appzb_is_connected()) {
+        ESP_LOGW(TAG, "Failed to send report, device is not connected to network");
+        return;
+    }
+
+    // Called from application tasks, the stack must be locked around every Zigbee API call
+    esp_zb_lock_acquire(portMAX_DELAY);
+    if (zbattr_send_report_frame(cluster_id, attr_id, value) == ESP_OK)
+        report_stats.frames++;
+    esp_zb_lock_release();
+}
+
+static zbattr_report_slot_t *zbattr_find_slot(uint16_t cluster_id, uint16_t attr_id) {
+    for (size_t i = 0; i < ZBATTR_REPORT_SLOTS; i++) {
+        if (report_slots[i].cluster_id == cluster_id && report_slots[i].attr_id == attr_id)
+            return &report_slots[i];
+    }
+    return NULL;
+}
+
+// Earliest time the cluster may send again, frames sent in the current flush (at now_us) do not count
+static int64_t zbattr_cluster_next_us(uint16_t cluster_id, int64_t now_us) {
+    int64_t next_us = 0;
+    for (size_t i = 0; i < ZBATTR_REPORT_SLOTS; i++) {
+        const zbattr_report_slot_t *slot = &report_slots[i];
+        if (slot->cluster_id != cluster_id || !slot->reported || slot->last_sent_us == now_us)
+            continue;
+
+        int64_t slot_next_us = slot->last_sent_us + ZBATTR_REPORT_CLUSTER_INTERVAL_MS * 1000;
+        if (slot_next_us > next_us)
+            next_us = slot_next_us;
+    }
+    return next_us;
+}
+
+// True when a remote has configured reporting of the attribute, must be called with the Zigbee lock taken
+static bool zbattr_reporting_configured(const zbattr_report_slot_t *slot) {
+    esp_zb_zcl_attr_location_info_t location = {
+        .endpoint_id = HA_ESP_LIGHT_ENDPOINT,
+        .cluster_id = slot->cluster_id,
+        .cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+        .manuf_code = ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
+        .attr_id = slot->attr_id,
+    };
+    esp_zb_zcl_reporting_info_t *info = esp_zb_zcl_find_reporting_info(location);
+
+    // Maximum interval 0xFFFF switches reporting of the attribute off
+    return info != NULL && info->u.send_info.max_interval != ZBATTR_REPORTING_OFF;
+}
+
+/*
+ * Coalescing window elapsed: send one frame per changed attribute, drop values the network already has.
+ * Attributes with a reporting configuration are only updated localy, the stack reports them honoring
+ * the configured min/max interval and reportable change.
+ */
+static void zbattr_report_flush() {
+    int64_t now_us = esp_timer_get_time();
+    int64_t retry_us = INT64_MAX;
+    bool connected = appzb_is_connected();
+
+    uint8_t send[ZBATTR_REPORT_SLOTS];
+    uint16_t values[ZBATTR_REPORT_SLOTS];
+    bool local_only[ZBATTR_REPORT_SLOTS];
+    bool configured[ZBATTR_REPORT_SLOTS];
+    size_t count = 0;
+
+    esp_zb_lock_acquire(portMAX_DELAY);
+    for (size_t i = 0; i < ZBATTR_REPORT_SLOTS; i++) {
+        configured[i] = connected && zbattr_reporting_configured(&report_slots[i]);
+    }
+
+    portENTER_CRITICAL(&report_lock);
+    for (size_t i = 0; i < ZBATTR_REPORT_SLOTS; i++) {
+        zbattr_report_slot_t *slot = &report_slots[i];
+        if (!slot->dirty)
+            continue;
+
+        bool local = !connected || configured[i];
+        if (configured[i]) {
+            // The stack decides, a manual report is sent again once the configuration is gone
+            slot->dirty = false;
+            slot->reported = false;
+            report_stats.delegated++;
+        } else if (connected && slot->reported && slot->value == slot->last_value) {
+            // No frame, but a remote may have written another value to the local attribute meanwhile
+            slot->dirty = false;
+            report_stats.suppressed++;
+            local = true;
+        } else {
+            int64_t next_us = zbattr_cluster_next_us(slot->cluster_id, now_us);
+            if (connected && next_us > now_us) {
+                // Cluster reported recently, keep the change and send its latest value later
+                report_stats.rate_limited++;
+                if (next_us < retry_us)
+                    retry_us = next_us;
+                continue;
+            }
+
+            slot->dirty = false;
+            if (connected) {
+                slot->reported = true;
+                slot->last_value = slot->value;
+                slot->last_sent_us = now_us;
+            }
+        }
+        send[count] = (uint8_t)i;
+        values[count] = slot->value;
+        local_only[count] = local;
+        count++;
+    }
+    portEXIT_CRITICAL(&report_lock);
+
+    for (size_t i = 0; i < count; i++) {
+        const zbattr_report_slot_t *slot = &report_slots[send[i]];
+        uint8_t value_u8 = (uint8_t)values[i];
+        void *value = slot->size == sizeof(uint8_t) ? (void *)&value_u8 : (void *)&values[i];
+
+        if (local_only[i]) {
+            // Keep the local attribute current, the stack or the first report after joining sends it
+            esp_zb_zcl_set_attribute_val(HA_ESP_LIGHT_ENDPOINT, slot->cluster_id, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, slot->attr_id, value, false);
+        } else if (zbattr_send_report_frame(slot->cluster_id, slot->attr_id, value) == ESP_OK) {
+            report_stats.frames++;
+        }
+    }
+    esp_zb_lock_release();
+
+    if (retry_us != INT64_MAX)
+        esp_timer_start_once(report_timer, (uint64_t)(retry_us - now_us));
+}
+
+// The flush waits for the Zigbee lock, so it runs in its own task instead of blocking the esp_timer task
+static void zbattr_report_task(void *params) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        zbattr_report_flush();
+    }
+}
+
+static void zbattr_report_timer_cb(void *arg) { xTaskNotifyGive(report_task); }
+
+// public
+
+void zbattr_init() {
+    xTaskCreate(zbattr_report_task, "zbattr_report", ZBATTR_REPORT_TASK_STACK_SIZE, NULL, ZBATTR_REPORT_TASK_PRIORITY, &report_task);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = zbattr_report_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "zbattr_report",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &report_timer));
+}
+
+void zbattr_send_attribute_report(uint16_t cluster_id, uint16_t attr_id, void *value) {
+    zbattr_report_slot_t *slot = zbattr_find_slot(cluster_id, attr_id);
+    if (slot == NULL) {
+        zbattr_report_now(cluster_id, attr_id, value);
         return;
     }
 
-    ESP_LOGI(TAG, "Sent report: cluster 0x%04X, attr 0x%04X", cluster_id, attr_id);
-}
\ No newline at end of file
+    uint16_t new_value = slot->size == sizeof(uint8_t) ? *(uint8_t *)value : *(uint16_t *)value;
+
+    portENTER_CRITICAL(&report_lock);
+    report_stats.changes++;
+    if (slot->dirty)
+        report_stats.coalesced++;
+    slot->value = new_value;
+    slot->dirty = true;
+    portEXIT_CRITICAL(&report_lock);
+
+    // Changes arriving within the window go out together (a rate limited flush may already be scheduled)
+    if (!esp_timer_is_active(report_timer))
+        esp_timer_start_once(report_timer, ZBATTR_REPORT_COALESCE_MS * 1000);
+}
+
+void zbattr_set_attribute(uint16_t cluster_id, uint16_t attr_id, void *value) {
+    esp_zb_lock_acquire(portMAX_DELAY);
+    esp_zb_zcl_status_t status =
+        esp_zb_zcl_set_attribute_val(HA_ESP_LIGHT_ENDPOINT, cluster_id, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr_id, value, false);
+    esp_zb_lock_release();
+
+    if (status != ESP_ZB_ZCL_STATUS_SUCCESS) {
+        ESP_LOGW(TAG, "Failed to set attribute 0x%04X in cluster 0x%04X", attr_id, cluster_id);
+    }
+}
+
+void zbattr_get_report_stats(zbattr_report_stats_t *stats) {
+    portENTER_CRITICAL(&report_lock);
+    *stats = report_stats;
+    portEXIT_CRITICAL(&report_lock);
+}
@@ -2,4 +2,35 @@
 
 #include "zb_config.h"
 
-void zbattr_send_attribute_report(uint16_t cluster_id, uint16_t attr_id, void *value);
\ No newline at end of file
+/*
+    Attribute reports of OnOff, CurrentLevel and ColorTemperature are scheduled instead of sent right away:
+    changes arriving within ZBATTR_REPORT_COALESCE_MS are merged into one frame per attribute, values the
+    network has already heard are dropped and every cluster sends at most once per ZBATTR_REPORT_CLUSTER_INTERVAL_MS
+    (the latest value is sent once the interval has passed).
+
+    Once a remote has configured reporting of an attribute (Configure Reporting), the scheduler only updates the
+    local value and the stack sends reports according to the configured min/max interval and reportable change.
+    Values of a running transition are set with zbattr_set_attribute, so they are only reported under such
+    a configuration and only when they cross its reportable change.
+
+    A timer ends the coalescing window and wakes a dedicated task, which takes the Zigbee lock and sends the frames.
+*/
+#define ZBATTR_REPORT_COALESCE_MS 100
+#define ZBATTR_REPORT_CLUSTER_INTERVAL_MS 500
+#define ZBATTR_REPORT_TASK_STACK_SIZE 3072
+#define ZBATTR_REPORT_TASK_PRIORITY 4
+
+typedef struct {
+    uint32_t changes;      // values handed to zbattr_send_attribute_report
+    uint32_t frames;       // report frames sent
+    uint32_t coalesced;    // changes replaced by a newer value before being sent
+    uint32_t suppressed;   // changes dropped because the value was already reported
+    uint32_t rate_limited; // flushes deferred by the per-cluster interval
+    uint32_t delegated;    // changes left to the reporting configuration of the stack
+} zbattr_report_stats_t;
+
+void zbattr_init();
+void zbattr_send_attribute_report(uint16_t cluster_id, uint16_t attr_id, void *value);
+// Update a local attribute value, it is only reported by a reporting configuration of the stack
+void zbattr_set_attribute(uint16_t cluster_id, uint16_t attr_id, void *value);
+void zbattr_get_report_stats(zbattr_report_stats_t *stats);
@@ -1,7 +1,13 @@
 #include "zb_clusters_config.h"
 
+#include "esp_log.h"
+
+#include "zb_config.h"
+#include "zb_diagnostics.h"
 #include "zigbee_cct_light_model.h"
 
+static const char *TAG = "zbapp clusters";
+
 esp_zb_attribute_list_t *zb_create_basic_cluster(void) {
     esp_zb_basic_cluster_cfg_t cfg = {
         .zcl_version = ESP_ZB_ZCL_BASIC_ZCL_VERSION_DEFAULT_VALUE,
@@ -52,9 +58,11 @@ esp_zb_attribute_list_t *zb_create_color_control_cluster(void) {
     static uint16_t color_attr = ZCCTLM_DEFAULT_TEMP;
     static uint16_t min_temp = ZCCTLM_MIN_TEMP;
     static uint16_t max_temp = ZCCTLM_MAX_TEMP;
+    static uint16_t remaining_time = 0;
     esp_zb_color_control_cluster_add_attr(cl, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, &color_attr);
     esp_zb_color_control_cluster_add_attr(cl, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MIN_MIREDS_ID, &min_temp);
     esp_zb_color_control_cluster_add_attr(cl, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MAX_MIREDS_ID, &max_temp);
+    esp_zb_color_control_cluster_add_attr(cl, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_REMAINING_TIME_ID, &remaining_time);
     return cl;
 }
 
@@ -62,8 +70,8 @@ esp_zb_attribute_list_t *zb_create_level_control_cluster(void) {
     esp_zb_attribute_list_t *cl = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL);
 
     static uint8_t level = ZCCTLM_DEFAULT_BRIGHTNESS;
-    static uint16_t off_transition_time = ZCCTLM_DEFAULT_TRANSITION_TIME_MS;
-    static uint16_t on_transition_time = ZCCTLM_DEFAULT_TRANSITION_TIME_MS;
+    static uint16_t off_transition_time = ZCCTLM_DEFAULT_TRANSITION_TIME_MS / ZB_TRANSITION_TIME_UNIT_MS;
+    static uint16_t on_transition_time = ZCCTLM_DEFAULT_TRANSITION_TIME_MS / ZB_TRANSITION_TIME_UNIT_MS;
 
     esp_zb_level_cluster_add_attr(cl, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, &level);
     esp_zb_level_cluster_add_attr(cl, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_OFF_TRANSITION_TIME_ID, &off_transition_time);
@@ -75,13 +83,63 @@ esp_zb_attribute_list_t *zb_create_groups_cluster(void) {
     return esp_zb_groups_cluster_create(NULL);
 }
 
+esp_zb_attribute_list_t *zb_create_scenes_cluster(void) {
+    esp_zb_scenes_cluster_cfg_t cfg = {
+        .scenes_count = 0,
+        .current_scene = 0,
+        .current_group = 0,
+        .scene_valid = false,
+        .name_support = 0,
+    };
+    return esp_zb_scenes_cluster_create(&cfg);
+}
+
 esp_zb_cluster_list_t *zb_create_cluster_list(void) {
     esp_zb_cluster_list_t *list = esp_zb_zcl_cluster_list_create();
     esp_zb_cluster_list_add_basic_cluster(list, zb_create_basic_cluster(), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
     esp_zb_cluster_list_add_identify_cluster(list, zb_create_identify_cluster(), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
     esp_zb_cluster_list_add_groups_cluster(list, zb_create_groups_cluster(), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+    esp_zb_cluster_list_add_scenes_cluster(list, zb_create_scenes_cluster(), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
     esp_zb_cluster_list_add_on_off_cluster(list, zb_create_onoff_cluster(), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
     esp_zb_cluster_list_add_level_cluster(list, zb_create_level_control_cluster(), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
     esp_zb_cluster_list_add_color_control_cluster(list, zb_create_color_control_cluster(), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+    esp_zb_cluster_list_add_custom_cluster(list, zbdiag_create_cluster(), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
     return list;
 }
+
+void zb_register_privilege_commands(void) {
+    // Level Control runs one local ramp per command instead of the stack stepping CurrentLevel through attribute writes
+    const uint16_t level_commands[] = {
+        ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL,
+        ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE,
+        ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STEP,
+        ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STOP,
+        ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL_WITH_ON_OFF,
+        ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_WITH_ON_OFF,
+        ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STEP_WITH_ON_OFF,
+        ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STOP_WITH_ON_OFF,
+    };
+    for (size_t i = 0; i < sizeof(level_commands) / sizeof(level_commands[0]); i++) {
+        if (esp_zb_zcl_add_privilege_command(HA_ESP_LIGHT_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, level_commands[i]) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to register Level Control command 0x%02x", level_commands[i]);
+        }
+    }
+
+    // Color temperature commands run as one local mireds ramp
+    const uint16_t color_commands[] = {
+        ESP_ZB_ZCL_CMD_COLOR_CONTROL_MOVE_TO_COLOR_TEMPERATURE,
+        ESP_ZB_ZCL_CMD_COLOR_CONTROL_MOVE_COLOR_TEMPERATURE,
+        ESP_ZB_ZCL_CMD_COLOR_CONTROL_STEP_COLOR_TEMPERATURE,
+        ESP_ZB_ZCL_CMD_COLOR_CONTROL_STOP_MOVE_STEP,
+    };
+    for (size_t i = 0; i < sizeof(color_commands) / sizeof(color_commands[0]); i++) {
+        if (esp_zb_zcl_add_privilege_command(HA_ESP_LIGHT_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, color_commands[i]) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to register Color Control command 0x%02x", color_commands[i]);
+        }
+    }
+
+    // Trigger Effect is played by the local effect sequencer
+    if (esp_zb_zcl_add_privilege_command(HA_ESP_LIGHT_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY, ESP_ZB_ZCL_CMD_IDENTIFY_TRIGGER_EFFECT_ID) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to register Identify command 0x%02x", ESP_ZB_ZCL_CMD_IDENTIFY_TRIGGER_EFFECT_ID);
+    }
+}
@@ -10,4 +10,6 @@
 // esp_zb_attribute_list_t *zb_create_color_control_cluster(void);
 // esp_zb_attribute_list_t *zb_create_level_control_cluster(void);
 
-esp_zb_cluster_list_t *zb_create_cluster_list(void); 
+esp_zb_cluster_list_t *zb_create_cluster_list(void);
+// Commands the application executes itself instead of the stack, delivered through ESP_ZB_CORE_CMD_PRIVILEGE_COMMAND_REQ_CB_ID
+void zb_register_privilege_commands(void);
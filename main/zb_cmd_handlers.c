@@ -0,0 +1,303 @@
+#include "zb_cmd_handlers.h"
+
+#define DLOG_LOCAL_LEVEL DLOG_LEVEL_CMD_HANDLERS
+#include "deferred_log.h"
+
+#include <inttypes.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+#include "zboss_api.h"
+
+#include "zcctlm_cmd.h"
+#include "zigbee_cct_light_model.h"
+
+static const char *TAG = "zbapp commands";
+
+static esp_err_t handle_level_control_command(const esp_zb_zcl_privilege_command_message_t *message);
+static esp_err_t handle_color_control_command(const esp_zb_zcl_privilege_command_message_t *message);
+static esp_err_t handle_identify_command(const esp_zb_zcl_privilege_command_message_t *message);
+
+static inline uint16_t read_u16(const uint8_t *data) { return (uint16_t)(data[0] | (data[1] << 8)); }
+
+esp_err_t zb_privilege_command_handler(const esp_zb_zcl_privilege_command_message_t *message) {
+    ESP_RETURN_ON_FALSE(message, ESP_FAIL, TAG, "Empty message");
+    ESP_RETURN_ON_FALSE(message->info.status == ESP_ZB_ZCL_STATUS_SUCCESS, ESP_ERR_INVALID_ARG, TAG, "Received message: error status(%d)",
+                        message->info.status);
+
+    if (message->info.dst_endpoint != HA_ESP_LIGHT_ENDPOINT) {
+        return ESP_OK;
+    }
+
+    switch (message->info.cluster) {
+    case ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL:
+        return handle_level_control_command(message);
+
+    case ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL:
+        return handle_color_control_command(message);
+
+    case ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY:
+        return handle_identify_command(message);
+
+    default:
+        ESP_LOGW(TAG, "(zb_privilege_command_handler) -> Received unhandled command: cluster(0x%x), command(0x%x), data size(%d)",
+                 message->info.cluster, message->info.command.id, message->size);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+/*
+ * Level Control commands, executed as a single ramp by the light model.
+ * The optional Options / OptionsOverride fields are ignored, a light that is off only reacts to the *WithOnOff variants.
+ */
+static esp_err_t handle_level_control_command(const esp_zb_zcl_privilege_command_message_t *message) {
+    const uint8_t *data = message->data;
+    uint8_t cmd_id = message->info.command.id;
+    uint8_t flags = cmd_id >= ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL_WITH_ON_OFF ? ZCCTLM_CMD_FLAG_WITH_ON_OFF : 0;
+
+    switch (cmd_id) {
+    // level (u8), transition time (u16, 1/10 s, 0xFFFF = OnTransitionTime / OffTransitionTime)
+    case ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL:
+    case ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL_WITH_ON_OFF: {
+        ESP_RETURN_ON_FALSE(message->size >= 3, ESP_ERR_INVALID_SIZE, TAG, "MoveToLevel: invalid payload size %u", message->size);
+        uint8_t level = data[0];
+        uint16_t time = read_u16(&data[1]);
+        uint32_t time_ms = time == ZB_TRANSITION_TIME_UNSPECIFIED ? ZCCTLM_TRANSITION_DEFAULT : ZB_TRANSITION_TIME_TO_MS(time);
+        DLOGI(TAG, "MoveToLevel%s: level %u in %u/10 s", DLOG_STR((flags & ZCCTLM_CMD_FLAG_WITH_ON_OFF) ? "WithOnOff" : ""), level, time);
+        zcctlm_cmd_post_ex(ZCCTLM_CMD_MOVE_TO_LEVEL, level, flags, time_ms);
+        break;
+    }
+
+    // mode (u8, 0 = up, 1 = down), rate (u8, levels per second, 0xFF = default rate)
+    case ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE:
+    case ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_WITH_ON_OFF: {
+        ESP_RETURN_ON_FALSE(message->size >= 2, ESP_ERR_INVALID_SIZE, TAG, "Move: invalid payload size %u", message->size);
+        ESP_RETURN_ON_FALSE(data[0] <= 1, ESP_ERR_INVALID_ARG, TAG, "Move: invalid mode %u", data[0]);
+        if (data[0] == 1)
+            flags |= ZCCTLM_CMD_FLAG_DOWN;
+        DLOGI(TAG, "Move%s: %s at rate %u", DLOG_STR((flags & ZCCTLM_CMD_FLAG_WITH_ON_OFF) ? "WithOnOff" : ""), DLOG_STR(data[0] ? "down" : "up"),
+              data[1]);
+        zcctlm_cmd_post_ex(ZCCTLM_CMD_MOVE_LEVEL, data[1], flags, 0);
+        break;
+    }
+
+    // mode (u8, 0 = up, 1 = down), step size (u8), transition time (u16, 1/10 s, 0xFFFF = as fast as possible)
+    case ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STEP:
+    case ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STEP_WITH_ON_OFF: {
+        ESP_RETURN_ON_FALSE(message->size >= 4, ESP_ERR_INVALID_SIZE, TAG, "Step: invalid payload size %u", message->size);
+        ESP_RETURN_ON_FALSE(data[0] <= 1, ESP_ERR_INVALID_ARG, TAG, "Step: invalid mode %u", data[0]);
+        if (data[0] == 1)
+            flags |= ZCCTLM_CMD_FLAG_DOWN;
+        uint16_t time = read_u16(&data[2]);
+        uint32_t time_ms = time == ZB_TRANSITION_TIME_UNSPECIFIED ? 0 : ZB_TRANSITION_TIME_TO_MS(time);
+        DLOGI(TAG, "Step%s: %s by %u in %u/10 s", DLOG_STR((flags & ZCCTLM_CMD_FLAG_WITH_ON_OFF) ? "WithOnOff" : ""),
+              DLOG_STR(data[0] ? "down" : "up"), data[1], time);
+        zcctlm_cmd_post_ex(ZCCTLM_CMD_STEP_LEVEL, data[1], flags, time_ms);
+        break;
+    }
+
+    case ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STOP:
+    case ESP_ZB_ZCL_CMD_LEVEL_CONTROL_STOP_WITH_ON_OFF:
+        DLOGI(TAG, "Stop");
+        zcctlm_cmd_post(ZCCTLM_CMD_STOP_LEVEL, 0);
+        break;
+
+    default:
+        ESP_LOGW(TAG, "Unhandled Level Control command: 0x%x", cmd_id);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
+
+/*
+ * Color temperature commands, executed as a single mireds ramp by the light model.
+ * Move / Step mode: 0x01 = up (warmer), 0x03 = down (colder), Move with mode 0x00 stops.
+ */
+static esp_err_t handle_color_control_command(const esp_zb_zcl_privilege_command_message_t *message) {
+    const uint8_t *data = message->data;
+    zcctlm_cmd_t cmd = {0};
+
+    switch (message->info.command.id) {
+    // color temperature (u16, mireds), transition time (u16, 1/10 s)
+    case ESP_ZB_ZCL_CMD_COLOR_CONTROL_MOVE_TO_COLOR_TEMPERATURE: {
+        ESP_RETURN_ON_FALSE(message->size >= 4, ESP_ERR_INVALID_SIZE, TAG, "MoveToColorTemperature: invalid payload size %u", message->size);
+        cmd.type = ZCCTLM_CMD_MOVE_TO_COLOR_TEMP;
+        cmd.value = read_u16(&data[0]);
+        cmd.time_ms = ZB_TRANSITION_TIME_TO_MS(read_u16(&data[2]));
+        DLOGI(TAG, "MoveToColorTemperature: %u mireds in %" PRIu32 "ms", cmd.value, cmd.time_ms);
+        break;
+    }
+
+    // mode (u8), rate (u16, mireds per second), min (u16), max (u16)
+    case ESP_ZB_ZCL_CMD_COLOR_CONTROL_MOVE_COLOR_TEMPERATURE: {
+        ESP_RETURN_ON_FALSE(message->size >= 7, ESP_ERR_INVALID_SIZE, TAG, "MoveColorTemperature: invalid payload size %u", message->size);
+        uint8_t mode = data[0];
+        ESP_RETURN_ON_FALSE(mode == 0x00 || mode == 0x01 || mode == 0x03, ESP_ERR_INVALID_ARG, TAG, "MoveColorTemperature: invalid mode %u", mode);
+        cmd.type = mode == 0x00 ? ZCCTLM_CMD_STOP_COLOR_TEMP : ZCCTLM_CMD_MOVE_COLOR_TEMP;
+        cmd.flags = mode == 0x03 ? ZCCTLM_CMD_FLAG_DOWN : 0;
+        cmd.value = read_u16(&data[1]);
+        cmd.min = read_u16(&data[3]);
+        cmd.max = read_u16(&data[5]);
+        DLOGI(TAG, "MoveColorTemperature: mode %u at %u mireds/s within [%u, %u]", mode, cmd.value, cmd.min, cmd.max);
+        break;
+    }
+
+    // mode (u8), step size (u16, mireds), transition time (u16, 1/10 s), min (u16), max (u16)
+    case ESP_ZB_ZCL_CMD_COLOR_CONTROL_STEP_COLOR_TEMPERATURE: {
+        ESP_RETURN_ON_FALSE(message->size >= 9, ESP_ERR_INVALID_SIZE, TAG, "StepColorTemperature: invalid payload size %u", message->size);
+        uint8_t mode = data[0];
+        ESP_RETURN_ON_FALSE(mode == 0x01 || mode == 0x03, ESP_ERR_INVALID_ARG, TAG, "StepColorTemperature: invalid mode %u", mode);
+        cmd.type = ZCCTLM_CMD_STEP_COLOR_TEMP;
+        cmd.flags = mode == 0x03 ? ZCCTLM_CMD_FLAG_DOWN : 0;
+        cmd.value = read_u16(&data[1]);
+        cmd.time_ms = ZB_TRANSITION_TIME_TO_MS(read_u16(&data[3]));
+        cmd.min = read_u16(&data[5]);
+        cmd.max = read_u16(&data[7]);
+        DLOGI(TAG, "StepColorTemperature: mode %u by %u mireds in %" PRIu32 "ms within [%u, %u]", mode, cmd.value, cmd.time_ms, cmd.min,
+              cmd.max);
+        break;
+    }
+
+    case ESP_ZB_ZCL_CMD_COLOR_CONTROL_STOP_MOVE_STEP:
+        DLOGI(TAG, "StopMoveStep");
+        cmd.type = ZCCTLM_CMD_STOP_COLOR_TEMP;
+        break;
+
+    default:
+        ESP_LOGW(TAG, "Unhandled Color Control command: 0x%x", message->info.command.id);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    zcctlm_cmd_submit(&cmd);
+    return ESP_OK;
+}
+
+/*
+ * Identify Trigger Effect, played by the light model's effect sequencer.
+ * effect identifier (u8), effect variant (u8)
+ */
+static esp_err_t handle_identify_command(const esp_zb_zcl_privilege_command_message_t *message) {
+    const uint8_t *data = message->data;
+
+    if (message->info.command.id != ESP_ZB_ZCL_CMD_IDENTIFY_TRIGGER_EFFECT_ID) {
+        ESP_LOGW(TAG, "Unhandled Identify command: 0x%x", message->info.command.id);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    ESP_RETURN_ON_FALSE(message->size >= 2, ESP_ERR_INVALID_SIZE, TAG, "TriggerEffect: invalid payload size %u", message->size);
+    DLOGI(TAG, "TriggerEffect: effect 0x%02x, variant %u", data[0], data[1]);
+    zcctlm_cmd_post(ZCCTLM_CMD_TRIGGER_EFFECT, (uint16_t)(data[0] | (data[1] << 8)));
+    return ESP_OK;
+}
+
+esp_err_t zb_store_scene_handler(const esp_zb_zcl_store_scene_message_t *message) {
+    ESP_RETURN_ON_FALSE(message, ESP_FAIL, TAG, "Empty message");
+    ESP_RETURN_ON_FALSE(message->info.status == ESP_ZB_ZCL_STATUS_SUCCESS, ESP_ERR_INVALID_ARG, TAG, "Received message: error status(%d)",
+                        message->info.status);
+
+    DLOGI(TAG, "StoreScene: group 0x%04x, scene %u", message->group_id, message->scene_id);
+    zcctlm_cmd_submit(&(zcctlm_cmd_t){.type = ZCCTLM_CMD_STORE_SCENE, .value = message->group_id, .scene.id = message->scene_id});
+    return ESP_OK;
+}
+
+/*
+ * RecallScene, the scene is applied as a single transition from the local scene table.
+ * The extension fields the stack keeps for scenes added with AddScene are passed along as a fallback:
+ * OnOff (u8), CurrentLevel (u8) and ColorTemperatureMireds of the Color Control field set (u16 at offset 11).
+ */
+esp_err_t zb_recall_scene_handler(const esp_zb_zcl_recall_scene_message_t *message) {
+    ESP_RETURN_ON_FALSE(message, ESP_FAIL, TAG, "Empty message");
+    ESP_RETURN_ON_FALSE(message->info.status == ESP_ZB_ZCL_STATUS_SUCCESS, ESP_ERR_INVALID_ARG, TAG, "Received message: error status(%d)",
+                        message->info.status);
+
+    zcctlm_cmd_t cmd = {
+        .type = ZCCTLM_CMD_RECALL_SCENE,
+        .value = message->group_id,
+        .time_ms = message->transition_time == ZB_TRANSITION_TIME_UNSPECIFIED ? ZCCTLM_TRANSITION_DEFAULT
+                                                                               : ZB_TRANSITION_TIME_TO_MS(message->transition_time),
+        .scene = {.id = message->scene_id,
+                  .on_off = ZCCTLM_SCENE_ON_OFF_UNSET,
+                  .level = ZCCTLM_SCENE_LEVEL_UNSET,
+                  .mireds = ZCCTLM_SCENE_MIREDS_UNSET},
+    };
+
+    for (const esp_zb_zcl_scenes_extension_field_t *field = message->field_set; field != NULL; field = field->next) {
+        const uint8_t *value = field->extension_field_attribute_value_list;
+        if (value == NULL)
+            continue;
+
+        if (field->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF && field->length >= 1) {
+            cmd.scene.on_off = value[0] != 0;
+            cmd.flags |= ZCCTLM_CMD_FLAG_SCENE_FIELDS;
+        } else if (field->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL && field->length >= 1) {
+            cmd.scene.level = value[0];
+            cmd.flags |= ZCCTLM_CMD_FLAG_SCENE_FIELDS;
+        } else if (field->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL && field->length >= 13) {
+            cmd.scene.mireds = read_u16(&value[11]);
+            cmd.flags |= ZCCTLM_CMD_FLAG_SCENE_FIELDS;
+        }
+    }
+
+    DLOGI(TAG, "RecallScene: group 0x%04x, scene %u, transition %u/10 s", message->group_id, message->scene_id, message->transition_time);
+    zcctlm_cmd_submit(&cmd);
+    return ESP_OK;
+}
+
+/*
+ * Scene and group commands handled by the stack itself, seen before it processes them.
+ * The local scene table must follow the scene table of the stack or RecallScene would apply stale values:
+ * AddScene (which overwrites) and RemoveScene drop the scene, RemoveAllScenes and RemoveGroup the scenes of
+ * the group, RemoveAllGroups the scenes of every group but 0x0000.
+ * Scene commands for a group the endpoint is not a member of are rejected by the stack, they keep the local scenes.
+ * Always returns false, the stack still processes the command.
+ */
+// The stack only changes scenes of the global scene group (0x0000) and of groups the endpoint is a member of
+static bool zb_scene_group_accepted(uint16_t group_id, uint8_t endpoint) {
+    return group_id == 0x0000 || zb_aps_is_endpoint_in_group(group_id, endpoint);
+}
+
+bool zb_raw_command_handler(uint8_t bufid) {
+    const zb_zcl_parsed_hdr_t *hdr = ZB_BUF_GET_PARAM(bufid, zb_zcl_parsed_hdr_t);
+    if (hdr->addr_data.common_data.dst_endpoint != HA_ESP_LIGHT_ENDPOINT || hdr->is_common_command ||
+        hdr->cmd_direction != ZB_ZCL_FRAME_DIRECTION_TO_SRV)
+        return false;
+
+    const uint8_t *data = zb_buf_begin(bufid);
+    zb_uint_t size = zb_buf_len(bufid);
+    ltr_set_callback_start(ltr_now());
+
+    if (hdr->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_SCENES) {
+        switch (hdr->cmd_id) {
+        case ESP_ZB_ZCL_CMD_SCENES_ADD_SCENE:
+        case ESP_ZB_ZCL_CMD_SCENES_REMOVE_SCENE:
+            if (size < 3)
+                break;
+            DLOGI(TAG, "Scenes command 0x%02x: group 0x%04x, scene %u", hdr->cmd_id, read_u16(data), data[2]);
+            if (!zb_scene_group_accepted(read_u16(data), hdr->addr_data.common_data.dst_endpoint))
+                break;
+            zcctlm_cmd_submit(&(zcctlm_cmd_t){.type = ZCCTLM_CMD_REMOVE_SCENE, .value = read_u16(data), .scene.id = data[2]});
+            break;
+
+        case ESP_ZB_ZCL_CMD_SCENES_REMOVE_ALL_SCENES:
+            if (size < 2)
+                break;
+            DLOGI(TAG, "RemoveAllScenes: group 0x%04x", read_u16(data));
+            if (!zb_scene_group_accepted(read_u16(data), hdr->addr_data.common_data.dst_endpoint))
+                break;
+            zcctlm_cmd_post(ZCCTLM_CMD_REMOVE_GROUP_SCENES, read_u16(data));
+            break;
+
+        default:
+            break;
+        }
+    } else if (hdr->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_GROUPS) {
+        if (hdr->cmd_id == ESP_ZB_ZCL_CMD_GROUPS_REMOVE_GROUP && size >= 2) {
+            DLOGI(TAG, "RemoveGroup: group 0x%04x", read_u16(data));
+            zcctlm_cmd_post(ZCCTLM_CMD_REMOVE_GROUP_SCENES, read_u16(data));
+        } else if (hdr->cmd_id == ESP_ZB_ZCL_CMD_GROUPS_REMOVE_ALL_GROUPS) {
+            DLOGI(TAG, "RemoveAllGroups");
+            zcctlm_cmd_post(ZCCTLM_CMD_REMOVE_GROUP_SCENES, ZCCTLM_SCENES_ALL_GROUPS);
+        }
+    }
+    return false;
+}
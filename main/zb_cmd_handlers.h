@@ -0,0 +1,8 @@
+#pragma once
+
+#include "zb_config.h"
+
+esp_err_t zb_privilege_command_handler(const esp_zb_zcl_privilege_command_message_t *message);
+esp_err_t zb_store_scene_handler(const esp_zb_zcl_store_scene_message_t *message);
+esp_err_t zb_recall_scene_handler(const esp_zb_zcl_recall_scene_message_t *message);
+bool zb_raw_command_handler(uint8_t bufid);
@@ -9,6 +9,11 @@
 #define HA_ESP_LIGHT_ENDPOINT 10 /* esp light bulb device endpoint, used to process light controlling commands */
 #define ESP_ZB_PRIMARY_CHANNEL_MASK ESP_ZB_TRANSCEIVER_ALL_CHANNELS_MASK /* Zigbee primary channel mask use in the example */
 
+/* ZCL transition times (Level Control TransitionTime, On/OffTransitionTime) are in 1/10 s */
+#define ZB_TRANSITION_TIME_UNIT_MS 100
+#define ZB_TRANSITION_TIME_TO_MS(time) ((uint32_t)(time) * ZB_TRANSITION_TIME_UNIT_MS)
+#define ZB_TRANSITION_TIME_UNSPECIFIED 0xFFFF
+
 #define ESP_ZB_ZED_CONFIG()                                                                                                                          \
     {                                                                                                                                                \
         .esp_zb_role = ESP_ZB_DEVICE_TYPE_ED,                                                                                                        \
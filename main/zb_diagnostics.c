@@ -0,0 +1,138 @@
+#include "zb_diagnostics.h"
+
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "deferred_log.h"
+#include "latency_trace.h"
+#include "led_controller.h"
+#include "zb_app.h"
+#include "zb_attr_report.h"
+#include "zcctlm_cmd.h"
+#include "zigbee_cct_light_model.h"
+
+static const char *TAG = "zb diagnostics";
+
+typedef struct {
+    uint16_t attr_id;
+    uint32_t value; // last sample, also the storage the stack created the attribute with
+} zbdiag_attr_t;
+
+static zbdiag_attr_t diag_attrs[] = {
+    {.attr_id = ZBDIAG_ATTR_UPTIME},           {.attr_id = ZBDIAG_ATTR_FREE_HEAP},          {.attr_id = ZBDIAG_ATTR_MIN_FREE_HEAP},
+    {.attr_id = ZBDIAG_ATTR_LED_JOBS},         {.attr_id = ZBDIAG_ATTR_LED_DROPPED},        {.attr_id = ZBDIAG_ATTR_LED_HIGH_WATER},
+    {.attr_id = ZBDIAG_ATTR_LED_MAX_SETTLE_US}, {.attr_id = ZBDIAG_ATTR_CMD_STALLED},        {.attr_id = ZBDIAG_ATTR_CMD_HIGH_WATER},
+    {.attr_id = ZBDIAG_ATTR_NVS_COMMITS},      {.attr_id = ZBDIAG_ATTR_REPORT_FRAMES},      {.attr_id = ZBDIAG_ATTR_LOCK_MAX_WAIT_US},
+    {.attr_id = ZBDIAG_ATTR_ACTION_MAX_US},    {.attr_id = ZBDIAG_ATTR_STACK_ZIGBEE},       {.attr_id = ZBDIAG_ATTR_STACK_CMD},
+    {.attr_id = ZBDIAG_ATTR_STACK_LEDS},       {.attr_id = ZBDIAG_ATTR_END_TO_END_MAX_US},   {.attr_id = ZBDIAG_ATTR_LOG_DROPPED},
+};
+#define ZBDIAG_ATTRS (sizeof(diag_attrs) / sizeof(diag_attrs[0]))
+
+static bool refresh_started;
+
+// Unused stack of a task in bytes, 0 when the task does not exist
+static uint32_t zbdiag_stack_free(const char *task_name) {
+    TaskHandle_t task = xTaskGetHandle(task_name);
+    return task != NULL ? (uint32_t)uxTaskGetStackHighWaterMark(task) * sizeof(StackType_t) : 0;
+}
+
+static uint32_t zbdiag_sample(uint16_t attr_id) {
+    lc_stats_t lc_stats;
+    zcctlm_cmd_stats_t cmd_stats;
+    zcctlm_persist_stats_t persist_stats;
+    zbattr_report_stats_t report_stats;
+    zcctlm_lock_stats_t lock_stats;
+    appzb_action_stats_t action_stats;
+    ltr_histogram_t histogram;
+    dlog_stats_t log_stats;
+
+    switch (attr_id) {
+    case ZBDIAG_ATTR_UPTIME:
+        return (uint32_t)(esp_timer_get_time() / 1000000);
+    case ZBDIAG_ATTR_FREE_HEAP:
+        return esp_get_free_heap_size();
+    case ZBDIAG_ATTR_MIN_FREE_HEAP:
+        return esp_get_minimum_free_heap_size();
+    case ZBDIAG_ATTR_LED_JOBS:
+        lc_get_stats(&lc_stats);
+        return lc_stats.jobs;
+    case ZBDIAG_ATTR_LED_DROPPED:
+        lc_get_stats(&lc_stats);
+        return lc_stats.dropped;
+    case ZBDIAG_ATTR_LED_HIGH_WATER:
+        lc_get_stats(&lc_stats);
+        return lc_stats.high_water;
+    case ZBDIAG_ATTR_LED_MAX_SETTLE_US:
+        lc_get_stats(&lc_stats);
+        return lc_stats.max_settle_us;
+    case ZBDIAG_ATTR_CMD_STALLED:
+        zcctlm_cmd_get_stats(&cmd_stats);
+        return cmd_stats.stalled;
+    case ZBDIAG_ATTR_CMD_HIGH_WATER:
+        zcctlm_cmd_get_stats(&cmd_stats);
+        return cmd_stats.high_water;
+    case ZBDIAG_ATTR_NVS_COMMITS:
+        zcctlm_get_persist_stats(&persist_stats);
+        return persist_stats.commits;
+    case ZBDIAG_ATTR_REPORT_FRAMES:
+        zbattr_get_report_stats(&report_stats);
+        return report_stats.frames;
+    case ZBDIAG_ATTR_LOCK_MAX_WAIT_US:
+        zcctlm_get_lock_stats(&lock_stats);
+        return lock_stats.lock_max_wait_us;
+    case ZBDIAG_ATTR_ACTION_MAX_US:
+        appzb_get_action_stats(&action_stats);
+        return action_stats.max_us;
+    case ZBDIAG_ATTR_STACK_ZIGBEE:
+        return zbdiag_stack_free("Zigbee_main");
+    case ZBDIAG_ATTR_STACK_CMD:
+        return zbdiag_stack_free("zcctlm_cmd");
+    case ZBDIAG_ATTR_STACK_LEDS:
+        return zbdiag_stack_free("leds");
+    case ZBDIAG_ATTR_END_TO_END_MAX_US:
+        ltr_get_histogram(LTR_STAGE_END_TO_END, &histogram);
+        return histogram.max_us;
+    case ZBDIAG_ATTR_LOG_DROPPED:
+        dlog_get_stats(&log_stats);
+        return log_stats.dropped;
+    default:
+        return 0;
+    }
+}
+
+// Runs in the Zigbee task (scheduler alarm), the attributes are set without taking the stack lock
+static void zbdiag_refresh(uint8_t unused) {
+    for (size_t i = 0; i < ZBDIAG_ATTRS; i++) {
+        diag_attrs[i].value = zbdiag_sample(diag_attrs[i].attr_id);
+        esp_zb_zcl_status_t status = esp_zb_zcl_set_attribute_val(HA_ESP_LIGHT_ENDPOINT, ZBDIAG_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+                                                                  diag_attrs[i].attr_id, &diag_attrs[i].value, false);
+        if (status != ESP_ZB_ZCL_STATUS_SUCCESS) {
+            ESP_LOGW(TAG, "Failed to set diagnostics attribute 0x%04X", diag_attrs[i].attr_id);
+        }
+    }
+
+    esp_zb_scheduler_alarm((esp_zb_callback_t)zbdiag_refresh, 0, ZBDIAG_REFRESH_PERIOD_MS);
+}
+
+// public
+
+esp_zb_attribute_list_t *zbdiag_create_cluster(void) {
+    esp_zb_attribute_list_t *cl = esp_zb_zcl_attr_list_create(ZBDIAG_CLUSTER_ID);
+    for (size_t i = 0; i < ZBDIAG_ATTRS; i++) {
+        esp_zb_custom_cluster_add_custom_attr(cl, diag_attrs[i].attr_id, ESP_ZB_ZCL_ATTR_TYPE_U32, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY,
+                                              &diag_attrs[i].value);
+    }
+    return cl;
+}
+
+void zbdiag_start(void) {
+    if (refresh_started)
+        return;
+    refresh_started = true;
+    zbdiag_refresh(0);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ha/esp_zigbee_ha_standard.h"
+
+/*
+    Manufacturer-specific diagnostics cluster on HA_ESP_LIGHT_ENDPOINT.
+
+    Exposes the runtime counters of the firmware as read-only uint32 attributes, so that slow or struggling
+    nodes can be found over the network without a serial console. The values are sampled in the Zigbee task
+    every ZBDIAG_REFRESH_PERIOD_MS, a read returns the last sample.
+*/
+#define ZBDIAG_CLUSTER_ID 0xFC01
+#define ZBDIAG_REFRESH_PERIOD_MS 10000
+
+// Attributes, all uint32
+#define ZBDIAG_ATTR_UPTIME 0x0000              // seconds since boot
+#define ZBDIAG_ATTR_FREE_HEAP 0x0001           // bytes
+#define ZBDIAG_ATTR_MIN_FREE_HEAP 0x0002       // lowest free heap since boot, bytes
+#define ZBDIAG_ATTR_LED_JOBS 0x0010            // LED jobs accepted
+#define ZBDIAG_ATTR_LED_DROPPED 0x0011         // LED jobs dropped because the queue was full
+#define ZBDIAG_ATTR_LED_HIGH_WATER 0x0012      // max LED jobs waiting at once
+#define ZBDIAG_ATTR_LED_MAX_SETTLE_US 0x0013   // worst command-to-settled latency of an LED job
+#define ZBDIAG_ATTR_CMD_STALLED 0x0014         // model commands that waited for space in the ring
+#define ZBDIAG_ATTR_CMD_HIGH_WATER 0x0015      // max model commands waiting at once
+#define ZBDIAG_ATTR_NVS_COMMITS 0x0020         // NVS commits performed
+#define ZBDIAG_ATTR_REPORT_FRAMES 0x0030       // attribute report frames sent
+#define ZBDIAG_ATTR_LOCK_MAX_WAIT_US 0x0040    // longest wait for the light model lock
+#define ZBDIAG_ATTR_ACTION_MAX_US 0x0041       // longest Zigbee stack callback
+#define ZBDIAG_ATTR_STACK_ZIGBEE 0x0050        // stack high water marks (bytes never used) of the tasks
+#define ZBDIAG_ATTR_STACK_CMD 0x0051
+#define ZBDIAG_ATTR_STACK_LEDS 0x0052
+#define ZBDIAG_ATTR_END_TO_END_MAX_US 0x0060   // worst command latency to the LEDs, 0 unless LTR_ENABLE is set
+#define ZBDIAG_ATTR_LOG_DROPPED 0x0070         // deferred log records lost because the log ring was full
+
+esp_zb_attribute_list_t *zbdiag_create_cluster(void);
+// Start sampling the counters, must be called from the Zigbee task
+void zbdiag_start(void);
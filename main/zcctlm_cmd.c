@@ -0,0 +1,183 @@
+#include "zcctlm_cmd.h"
+
+#include <stdatomic.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "zb_config.h"
+#include "zigbee_cct_light_model.h"
+
+_Static_assert((ZCCTLM_CMD_QUEUE_SIZE & (ZCCTLM_CMD_QUEUE_SIZE - 1)) == 0, "ZCCTLM_CMD_QUEUE_SIZE must be a power of two");
+
+static const char *TAG = "ZCCTLM cmd";
+
+// head is only written by the producer, tail only by the consumer
+static zcctlm_cmd_t ring[ZCCTLM_CMD_QUEUE_SIZE];
+static atomic_uint ring_head;
+static atomic_uint ring_tail;
+
+// Latest value of each SET_* command that found the ring full, applied once the ring has drained
+static atomic_uint pending_value[ZCCTLM_CMD_SET_COUNT];
+static atomic_uint pending_mask;
+
+static TaskHandle_t cmd_task;
+static zcctlm_cmd_stats_t cmd_stats;
+
+static bool zcctlm_cmd_is_set(uint8_t type) { return type < ZCCTLM_CMD_SET_COUNT; }
+
+static void zcctlm_cmd_dispatch(const zcctlm_cmd_t *cmd) {
+    switch (cmd->type) {
+    case ZCCTLM_CMD_SET_ON_OFF:
+        zcctlm_set_on_off((bool)cmd->value);
+        break;
+    case ZCCTLM_CMD_SET_BRIGHTNESS:
+        zcctlm_set_brightness((uint8_t)cmd->value);
+        break;
+    case ZCCTLM_CMD_SET_COLOR_TEMP:
+        zcctlm_set_color_temp(cmd->value);
+        break;
+    case ZCCTLM_CMD_SET_ON_TRANSITION_TIME:
+        zcctlm_set_on_transition_time(ZB_TRANSITION_TIME_TO_MS(cmd->value));
+        break;
+    case ZCCTLM_CMD_SET_OFF_TRANSITION_TIME:
+        zcctlm_set_off_transition_time(ZB_TRANSITION_TIME_TO_MS(cmd->value));
+        break;
+    case ZCCTLM_CMD_SET_STARTUP_BEHAVIOR:
+        zcctlm_set_startup_behavior((zcctl_startup_behavior_e)cmd->value);
+        break;
+    case ZCCTLM_CMD_IDENTIFY:
+        zcctlm_identify(cmd->value);
+        break;
+    case ZCCTLM_CMD_MOVE_TO_LEVEL:
+        zcctlm_move_to_level((uint8_t)cmd->value, cmd->time_ms, cmd->flags & ZCCTLM_CMD_FLAG_WITH_ON_OFF);
+        break;
+    case ZCCTLM_CMD_MOVE_LEVEL:
+        zcctlm_move_level(!(cmd->flags & ZCCTLM_CMD_FLAG_DOWN), (uint8_t)cmd->value, cmd->flags & ZCCTLM_CMD_FLAG_WITH_ON_OFF);
+        break;
+    case ZCCTLM_CMD_STEP_LEVEL:
+        zcctlm_step_level(!(cmd->flags & ZCCTLM_CMD_FLAG_DOWN), (uint8_t)cmd->value, cmd->time_ms, cmd->flags & ZCCTLM_CMD_FLAG_WITH_ON_OFF);
+        break;
+    case ZCCTLM_CMD_STOP_LEVEL:
+        zcctlm_stop_level();
+        break;
+    case ZCCTLM_CMD_MOVE_TO_COLOR_TEMP:
+        zcctlm_move_to_color_temp(cmd->value, cmd->time_ms);
+        break;
+    case ZCCTLM_CMD_MOVE_COLOR_TEMP:
+        zcctlm_move_color_temp(!(cmd->flags & ZCCTLM_CMD_FLAG_DOWN), cmd->value, cmd->min, cmd->max);
+        break;
+    case ZCCTLM_CMD_STEP_COLOR_TEMP:
+        zcctlm_step_color_temp(!(cmd->flags & ZCCTLM_CMD_FLAG_DOWN), cmd->value, cmd->time_ms, cmd->min, cmd->max);
+        break;
+    case ZCCTLM_CMD_STOP_COLOR_TEMP:
+        zcctlm_stop_color_temp();
+        break;
+    case ZCCTLM_CMD_STORE_SCENE:
+        zcctlm_store_scene(cmd->value, cmd->scene.id);
+        break;
+    case ZCCTLM_CMD_RECALL_SCENE: {
+        zcctlm_scene_t fields = {
+            .group_id = cmd->value,
+            .scene_id = cmd->scene.id,
+            .on_off = cmd->scene.on_off,
+            .level = cmd->scene.level,
+            .mireds = cmd->scene.mireds,
+            .transition_time = ZCCTLM_SCENE_TRANSITION_UNSET,
+        };
+        zcctlm_recall_scene(cmd->value, cmd->scene.id, cmd->time_ms, (cmd->flags & ZCCTLM_CMD_FLAG_SCENE_FIELDS) ? &fields : NULL);
+        break;
+    }
+    case ZCCTLM_CMD_REMOVE_SCENE:
+        zcctlm_scenes_remove(cmd->value, cmd->scene.id);
+        break;
+    case ZCCTLM_CMD_REMOVE_GROUP_SCENES:
+        zcctlm_scenes_remove_group(cmd->value);
+        break;
+    case ZCCTLM_CMD_TRIGGER_EFFECT:
+        zcctlm_trigger_effect((uint8_t)cmd->value, (uint8_t)(cmd->value >> 8));
+        break;
+    default:
+        ESP_LOGW(TAG, "Unknown command type %u", cmd->type);
+        break;
+    }
+}
+
+static void zcctlm_cmd_task(void *params) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        unsigned int tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+        while (tail != atomic_load_explicit(&ring_head, memory_order_acquire)) {
+            zcctlm_cmd_t cmd = ring[tail & (ZCCTLM_CMD_QUEUE_SIZE - 1)];
+            atomic_store_explicit(&ring_tail, ++tail, memory_order_release);
+
+#if LTR_ENABLE == 1
+            ltr_record(LTR_STAGE_CMD_QUEUE, cmd.trace);
+            ltr_mark_origin(cmd.trace);
+#endif
+            ltr_stamp_t trace_start = ltr_now();
+            zcctlm_cmd_dispatch(&cmd);
+            ltr_record(LTR_STAGE_MODEL_UPDATE, trace_start);
+        }
+
+        // Everything in the ring was submitted before the pending values, a value merged meanwhile sets its bit again
+        unsigned int pending = atomic_exchange_explicit(&pending_mask, 0, memory_order_acquire);
+        for (uint8_t type = 0; pending != 0; type++, pending >>= 1) {
+            if (pending & 1) {
+                zcctlm_cmd_t cmd = {.type = type, .value = (uint16_t)atomic_load_explicit(&pending_value[type], memory_order_relaxed)};
+                zcctlm_cmd_dispatch(&cmd);
+            }
+        }
+    }
+}
+
+// --- PUBLIC ---
+
+void zcctlm_cmd_init() { xTaskCreate(zcctlm_cmd_task, "zcctlm_cmd", ZCCTLM_CMD_TASK_STACK_SIZE, NULL, ZCCTLM_CMD_TASK_PRIORITY, &cmd_task); }
+
+void zcctlm_cmd_post(zcctlm_cmd_type_e type, uint16_t value) { zcctlm_cmd_post_ex(type, value, 0, 0); }
+
+void zcctlm_cmd_post_ex(zcctlm_cmd_type_e type, uint16_t value, uint8_t flags, uint32_t time_ms) {
+    zcctlm_cmd_submit(&(zcctlm_cmd_t){.type = (uint8_t)type, .flags = flags, .value = value, .time_ms = time_ms});
+}
+
+void zcctlm_cmd_submit(const zcctlm_cmd_t *cmd) {
+    unsigned int head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    unsigned int used = head - atomic_load_explicit(&ring_tail, memory_order_acquire);
+
+    // A SET_* command behind a pending value of any type must not overtake it either
+    if (zcctlm_cmd_is_set(cmd->type) && (used >= ZCCTLM_CMD_QUEUE_SIZE || atomic_load_explicit(&pending_mask, memory_order_relaxed) != 0)) {
+        atomic_store_explicit(&pending_value[cmd->type], cmd->value, memory_order_relaxed);
+        atomic_fetch_or_explicit(&pending_mask, 1U << cmd->type, memory_order_release);
+        cmd_stats.coalesced++;
+        xTaskNotifyGive(cmd_task);
+        return;
+    }
+
+    // Any other command changes state relative to the current one: wait for the model task instead of dropping it
+    if (used >= ZCCTLM_CMD_QUEUE_SIZE || atomic_load_explicit(&pending_mask, memory_order_relaxed) != 0) {
+        cmd_stats.stalled++;
+        ESP_LOGW(TAG, "Command queue full, waiting to post command %u", cmd->type);
+        do {
+            xTaskNotifyGive(cmd_task);
+            vTaskDelay(1);
+            used = head - atomic_load_explicit(&ring_tail, memory_order_acquire);
+        } while (used >= ZCCTLM_CMD_QUEUE_SIZE || atomic_load_explicit(&pending_mask, memory_order_relaxed) != 0);
+    }
+
+    ring[head & (ZCCTLM_CMD_QUEUE_SIZE - 1)] = *cmd;
+#if LTR_ENABLE == 1
+    ring[head & (ZCCTLM_CMD_QUEUE_SIZE - 1)].trace = ltr_get_callback_start();
+#endif
+    atomic_store_explicit(&ring_head, head + 1, memory_order_release);
+
+    cmd_stats.posted++;
+    if (used + 1 > cmd_stats.high_water)
+        cmd_stats.high_water = used + 1;
+
+    xTaskNotifyGive(cmd_task);
+}
+
+void zcctlm_cmd_get_stats(zcctlm_cmd_stats_t *stats) { *stats = cmd_stats; }
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "latency_trace.h"
+
+/*
+    Asynchronous command pipeline in front of the light model.
+
+    The Zigbee stack task posts typed commands into a lock-free single-producer/single-consumer ring
+    and returns to the stack immediately. A dedicated model task drains the ring and calls zcctlm_*,
+    so state_mutex, NVS and LEDC work never run inside a ZBOSS callback.
+
+    No command is dropped when the ring is full: a SET_* command is merged into a pending slot of its type
+    (the latest value wins) that is applied once the ring has drained, any other command waits for space.
+*/
+
+// Ring capacity, must be a power of two
+#define ZCCTLM_CMD_QUEUE_SIZE 32
+#define ZCCTLM_CMD_TASK_STACK_SIZE 3072
+#define ZCCTLM_CMD_TASK_PRIORITY 4
+
+typedef enum {
+    ZCCTLM_CMD_SET_ON_OFF = 0,
+    ZCCTLM_CMD_SET_BRIGHTNESS,
+    ZCCTLM_CMD_SET_COLOR_TEMP,
+    ZCCTLM_CMD_SET_ON_TRANSITION_TIME,  // value: ZCL transition time in 1/10 s
+    ZCCTLM_CMD_SET_OFF_TRANSITION_TIME, // value: ZCL transition time in 1/10 s
+    ZCCTLM_CMD_SET_STARTUP_BEHAVIOR,
+    ZCCTLM_CMD_IDENTIFY,
+    ZCCTLM_CMD_SET_COUNT, // commands above only set a value, a newer one replaces an older one
+    ZCCTLM_CMD_MOVE_TO_LEVEL = ZCCTLM_CMD_SET_COUNT,  // value: level, time_ms
+    ZCCTLM_CMD_MOVE_LEVEL,     // value: rate in levels per second
+    ZCCTLM_CMD_STEP_LEVEL,     // value: step size, time_ms
+    ZCCTLM_CMD_STOP_LEVEL,
+    ZCCTLM_CMD_MOVE_TO_COLOR_TEMP, // value: mireds, time_ms
+    ZCCTLM_CMD_MOVE_COLOR_TEMP,    // value: rate in mireds per second, min/max: bounds
+    ZCCTLM_CMD_STEP_COLOR_TEMP,    // value: step size in mireds, time_ms, min/max: bounds
+    ZCCTLM_CMD_STOP_COLOR_TEMP,
+    ZCCTLM_CMD_STORE_SCENE,  // value: group id, scene.id
+    ZCCTLM_CMD_RECALL_SCENE, // value: group id, scene, time_ms
+    ZCCTLM_CMD_REMOVE_SCENE, // value: group id, scene.id
+    ZCCTLM_CMD_REMOVE_GROUP_SCENES, // value: group id or ZCCTLM_SCENES_ALL_GROUPS
+    ZCCTLM_CMD_TRIGGER_EFFECT, // value: effect id (low byte), effect variant (high byte)
+} zcctlm_cmd_type_e;
+
+// Command flags
+#define ZCCTLM_CMD_FLAG_WITH_ON_OFF (1 << 0) // *WithOnOff variant of a level command
+#define ZCCTLM_CMD_FLAG_DOWN (1 << 1)        // Move / Step towards lower values
+#define ZCCTLM_CMD_FLAG_SCENE_FIELDS (1 << 2) // recall carries the scene's extension fields (scene.on_off/level/mireds)
+
+typedef struct {
+    uint8_t type; // zcctlm_cmd_type_e
+    uint8_t flags;
+    uint16_t value;
+    uint32_t time_ms;
+    union {
+        struct {
+            uint16_t min; // color Move / Step bounds in mireds, 0 = no bound
+            uint16_t max;
+        };
+        struct {
+            uint8_t id;
+            uint8_t on_off;
+            uint8_t level;
+            uint16_t mireds;
+        } scene;
+    };
+#if LTR_ENABLE == 1
+    ltr_stamp_t trace; // start of the stack callback that posted the command
+#endif
+} zcctlm_cmd_t;
+
+typedef struct {
+    uint32_t posted;     // commands accepted
+    uint32_t coalesced;  // SET_* commands merged into a pending slot because the ring was full
+    uint32_t stalled;    // other commands that had to wait for space in the ring
+    uint32_t high_water; // max commands waiting at once
+} zcctlm_cmd_stats_t;
+
+void zcctlm_cmd_init();
+// Single producer: must only be called from one task (the Zigbee stack task)
+void zcctlm_cmd_post(zcctlm_cmd_type_e type, uint16_t value);
+void zcctlm_cmd_post_ex(zcctlm_cmd_type_e type, uint16_t value, uint8_t flags, uint32_t time_ms);
+void zcctlm_cmd_submit(const zcctlm_cmd_t *cmd);
+void zcctlm_cmd_get_stats(zcctlm_cmd_stats_t *stats);
@@ -0,0 +1,217 @@
+#include "zcctlm_effects.h"
+
+#define DLOG_LOCAL_LEVEL DLOG_LEVEL_EFFECTS
+#include "deferred_log.h"
+
+#include <stddef.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+
+static const char *TAG = "ZCCTLM effects";
+
+#define ZCCTLM_EFFECT_MAX_LEVEL 254
+
+typedef struct {
+    uint8_t id;
+    uint8_t count;  // keyframes in one cycle
+    uint8_t cycles; // 0 = repeat until stopped or duration_ms has passed
+    const zcctlm_keyframe_t *frames;
+} zcctlm_effect_def_t;
+
+// Blink: on/off once
+static const zcctlm_keyframe_t blink_frames[] = {
+    {ZCCTLM_EFFECT_MAX_LEVEL, 0, ZCCTLM_EFFECT_MS(500)},
+    {0, 0, ZCCTLM_EFFECT_MS(500)},
+};
+
+// Breathe: fade off and on over a second, 15 times
+static const zcctlm_keyframe_t breathe_frames[] = {
+    {0, ZCCTLM_EFFECT_MS(1000), 0},
+    {ZCCTLM_EFFECT_MAX_LEVEL, ZCCTLM_EFFECT_MS(1000), 0},
+};
+
+// Okay: a light without color flashes twice
+static const zcctlm_keyframe_t okay_frames[] = {
+    {ZCCTLM_EFFECT_MAX_LEVEL, 0, ZCCTLM_EFFECT_MS(250)},
+    {0, 0, ZCCTLM_EFFECT_MS(250)},
+};
+
+// Channel change: maximum brightness for 0.5 s, then minimum for 7.5 s
+static const zcctlm_keyframe_t channel_change_frames[] = {
+    {ZCCTLM_EFFECT_MAX_LEVEL, 0, ZCCTLM_EFFECT_MS(500)},
+    {1, 0, ZCCTLM_EFFECT_MS(7500)},
+};
+
+// Identify: half a second at half brightness and off, for as long as IdentifyTime runs
+static const zcctlm_keyframe_t identify_frames[] = {
+    {ZCCTLM_EFFECT_MAX_LEVEL / 2, ZCCTLM_EFFECT_MS(200), ZCCTLM_EFFECT_MS(300)},
+    {0, ZCCTLM_EFFECT_MS(200), ZCCTLM_EFFECT_MS(300)},
+};
+
+#define ZCCTLM_EFFECT_DEF(effect_id, frame_table, n_cycles)                                                                                      \
+    {.id = (effect_id), .count = sizeof(frame_table) / sizeof(frame_table[0]), .cycles = (n_cycles), .frames = (frame_table)}
+
+static const zcctlm_effect_def_t effect_defs[] = {
+    ZCCTLM_EFFECT_DEF(ZCCTLM_EFFECT_BLINK, blink_frames, 1),
+    ZCCTLM_EFFECT_DEF(ZCCTLM_EFFECT_BREATHE, breathe_frames, 15),
+    ZCCTLM_EFFECT_DEF(ZCCTLM_EFFECT_OKAY, okay_frames, 2),
+    ZCCTLM_EFFECT_DEF(ZCCTLM_EFFECT_CHANNEL_CHANGE, channel_change_frames, 1),
+    ZCCTLM_EFFECT_DEF(ZCCTLM_EFFECT_IDENTIFY, identify_frames, 0),
+};
+
+// Running effect, guarded by effect_mutex
+typedef struct {
+    const zcctlm_effect_def_t *def; // NULL when no effect runs
+    uint8_t frame;
+    uint8_t cycle;
+    bool finishing; // Finish requested, end at the end of the current cycle
+    bool stopping;  // Stop requested, end on the next timer expiry
+    uint16_t mireds;
+    int64_t end_us; // 0 = no time limit
+} zcctlm_effect_run_t;
+
+static zcctlm_effect_run_t effect;
+static SemaphoreHandle_t effect_mutex;
+static TimerHandle_t effect_timer;
+static zcctlm_effect_output_fn_t effect_output;
+static zcctlm_effect_end_fn_t effect_end;
+static zcctlm_effect_stats_t effect_stats;
+
+static const zcctlm_effect_def_t *zcctlm_effects_find(uint8_t effect_id) {
+    for (size_t i = 0; i < sizeof(effect_defs) / sizeof(effect_defs[0]); i++) {
+        if (effect_defs[i].id == effect_id)
+            return &effect_defs[i];
+    }
+    return NULL;
+}
+
+// Output the current keyframe and arm the timer for its fade and hold, must be called with effect_mutex taken
+static void zcctlm_effects_play_frame() {
+    const zcctlm_keyframe_t *frame = &effect.def->frames[effect.frame];
+    uint32_t fade_ms = (uint32_t)frame->fade * ZCCTLM_EFFECT_TIME_UNIT_MS;
+    uint32_t frame_ms = fade_ms + (uint32_t)frame->hold * ZCCTLM_EFFECT_TIME_UNIT_MS;
+
+    effect_output((uint16_t)(frame->level << 8), effect.mireds, fade_ms);
+    effect_stats.frames++;
+
+    TickType_t ticks = pdMS_TO_TICKS(frame_ms);
+    xTimerChangePeriod(effect_timer, ticks > 0 ? ticks : 1, 0);
+}
+
+static void effect_timer_cb(TimerHandle_t timer) {
+    bool ended = false;
+
+    xSemaphoreTake(effect_mutex, portMAX_DELAY);
+    // The timer may have been restarted for a new effect while this callback waited for the mutex
+    if (effect.def != NULL && !xTimerIsTimerActive(effect_timer)) {
+        if (++effect.frame >= effect.def->count) {
+            effect.frame = 0;
+            effect.cycle++;
+        }
+
+        bool cycle_end = effect.frame == 0;
+        bool time_up = effect.end_us != 0 && esp_timer_get_time() >= effect.end_us;
+        bool done = effect.def->cycles != 0 && effect.cycle >= effect.def->cycles;
+
+        if (effect.stopping || (cycle_end && (effect.finishing || done)) || (time_up && effect.def->cycles == 0)) {
+            DLOGI(TAG, "Effect 0x%02x ended", effect.def->id);
+            if (effect.stopping)
+                effect_stats.interrupted++;
+            else
+                effect_stats.finished++;
+            effect.def = NULL;
+            ended = true;
+        } else {
+            zcctlm_effects_play_frame();
+        }
+    }
+    xSemaphoreGive(effect_mutex);
+
+    // The model takes its own lock to restore the state, never with effect_mutex held
+    if (ended && effect_end != NULL)
+        effect_end();
+}
+
+// public
+
+void zcctlm_effects_init(zcctlm_effect_output_fn_t output, zcctlm_effect_end_fn_t end) {
+    effect_output = output;
+    effect_end = end;
+    effect_mutex = xSemaphoreCreateMutex();
+    effect_timer = xTimerCreate("zcctlm_effect", 1, pdFALSE, NULL, effect_timer_cb);
+}
+
+bool zcctlm_effects_trigger(uint8_t effect_id, uint16_t mireds, uint32_t duration_ms) {
+    if (effect_id == ZCCTLM_EFFECT_FINISH || effect_id == ZCCTLM_EFFECT_STOP) {
+        xSemaphoreTake(effect_mutex, portMAX_DELAY);
+        if (effect.def != NULL) {
+            if (effect_id == ZCCTLM_EFFECT_STOP) {
+                // End from the timer task like every other effect end, right away
+                effect.stopping = true;
+                xTimerChangePeriod(effect_timer, 1, 0);
+            } else {
+                effect.finishing = true;
+            }
+        }
+        xSemaphoreGive(effect_mutex);
+        return true;
+    }
+
+    const zcctlm_effect_def_t *def = zcctlm_effects_find(effect_id);
+    if (def == NULL) {
+        ESP_LOGW(TAG, "Unknown effect 0x%02x", effect_id);
+        return false;
+    }
+
+    int64_t end_us = duration_ms != 0 ? esp_timer_get_time() + (int64_t)duration_ms * 1000 : 0;
+
+    xSemaphoreTake(effect_mutex, portMAX_DELAY);
+    if (effect.def == def && def->cycles == 0 && !effect.stopping) {
+        // Identify time rewritten while identifying, keep the running sequence and move its end
+        effect.end_us = end_us;
+        effect.finishing = false;
+        xSemaphoreGive(effect_mutex);
+        return true;
+    }
+
+    if (effect.def != NULL)
+        effect_stats.interrupted++;
+
+    effect.def = def;
+    effect.mireds = mireds;
+    effect.frame = 0;
+    effect.cycle = 0;
+    effect.finishing = false;
+    effect.stopping = false;
+    effect.end_us = end_us;
+    effect_stats.started++;
+
+    DLOGI(TAG, "Effect 0x%02x started", effect_id);
+    zcctlm_effects_play_frame();
+    xSemaphoreGive(effect_mutex);
+    return true;
+}
+
+void zcctlm_effects_cancel() {
+    xSemaphoreTake(effect_mutex, portMAX_DELAY);
+    if (effect.def != NULL) {
+        DLOGI(TAG, "Effect 0x%02x cancelled", effect.def->id);
+        effect.def = NULL;
+        effect_stats.interrupted++;
+        xTimerStop(effect_timer, 0);
+    }
+    xSemaphoreGive(effect_mutex);
+}
+
+bool zcctlm_effects_active() {
+    xSemaphoreTake(effect_mutex, portMAX_DELAY);
+    bool active = effect.def != NULL;
+    xSemaphoreGive(effect_mutex);
+    return active;
+}
+
+void zcctlm_effects_get_stats(zcctlm_effect_stats_t *stats) { *stats = effect_stats; }
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+    Effect sequencer for Identify and the Identify cluster Trigger Effect command.
+
+    Every effect is a short table of keyframes: a level the output fades to, and how long it is held there.
+    The sequencer plays one keyframe at a time through the output function of the light model (the same
+    fade engine used by every other transition) and advances from a single one-shot timer, so frames never
+    queue up behind each other. When an effect ends, or is stopped, the model re-applies its current state.
+
+    The output is a CCT light, so effects only change brightness, color temperature is kept.
+*/
+
+// Trigger Effect identifiers (ZCL Identify cluster)
+#define ZCCTLM_EFFECT_BLINK 0x00
+#define ZCCTLM_EFFECT_BREATHE 0x01
+#define ZCCTLM_EFFECT_OKAY 0x02
+#define ZCCTLM_EFFECT_CHANNEL_CHANGE 0x0b
+#define ZCCTLM_EFFECT_FINISH 0xfe
+#define ZCCTLM_EFFECT_STOP 0xff
+// Local effect played while IdentifyTime is counting down
+#define ZCCTLM_EFFECT_IDENTIFY 0x80
+
+// Keyframe times are kept in units of ZCCTLM_EFFECT_TIME_UNIT_MS to fit a byte
+#define ZCCTLM_EFFECT_TIME_UNIT_MS 50
+#define ZCCTLM_EFFECT_MS(ms) ((uint8_t)((ms) / ZCCTLM_EFFECT_TIME_UNIT_MS))
+
+typedef struct {
+    uint8_t level; // CurrentLevel to fade to
+    uint8_t fade;  // fade time, ZCCTLM_EFFECT_TIME_UNIT_MS units
+    uint8_t hold;  // time held at level after the fade, ZCCTLM_EFFECT_TIME_UNIT_MS units
+} zcctlm_keyframe_t;
+
+// Output of one keyframe, called with the effect lock taken, must not block on the light model
+typedef void (*zcctlm_effect_output_fn_t)(uint16_t level_q8, uint16_t mireds, uint32_t time_ms);
+// Called from the timer task once an effect has ended on its own or by Finish / Stop, the model state must be restored
+typedef void (*zcctlm_effect_end_fn_t)();
+
+typedef struct {
+    uint32_t started;     // effects started
+    uint32_t finished;    // effects that played to their end (including Finish)
+    uint32_t interrupted; // effects replaced, stopped or cancelled by a model change
+    uint32_t frames;      // keyframes output
+} zcctlm_effect_stats_t;
+
+void zcctlm_effects_init(zcctlm_effect_output_fn_t output, zcctlm_effect_end_fn_t end);
+/*
+ * Start effect `effect_id` at color temperature `mireds`, replacing a running effect.
+ * ZCCTLM_EFFECT_FINISH lets the running effect complete its current cycle, ZCCTLM_EFFECT_STOP ends it now.
+ * duration_ms limits looping effects (Identify), 0 plays the effect's own number of cycles.
+ * Returns false for an unknown effect.
+ */
+bool zcctlm_effects_trigger(uint8_t effect_id, uint16_t mireds, uint32_t duration_ms);
+// Drop the running effect without calling the end function, the caller applies the model state itself
+void zcctlm_effects_cancel();
+bool zcctlm_effects_active();
+void zcctlm_effects_get_stats(zcctlm_effect_stats_t *stats);
@@ -0,0 +1,35 @@
+#pragma once
+
+// Generated by tools/gen_gamma_lut.py - do not edit by hand.
+
+#include <stdint.h>
+
+#define ZCCTLM_GAMMA_LUT_GAMMA_X10 15
+#define ZCCTLM_GAMMA_LUT_MAX_BRIGHTNESS 254
+#define ZCCTLM_GAMMA_LUT_MIN_DUTY 150
+#define ZCCTLM_GAMMA_LUT_MAX_DUTY 2048
+
+static const uint16_t zcctlm_gamma_lut[255] = {
+       0,  150,  151,  152,  153,  155,  156,  158,  160,  162,  164,  167,
+     169,  171,  174,  177,  180,  182,  185,  188,  191,  195,  198,  201,
+     205,  208,  212,  215,  219,  223,  227,  230,  234,  238,  242,  247,
+     251,  255,  259,  264,  268,  273,  277,  282,  286,  291,  296,  301,
+     305,  310,  315,  320,  325,  330,  336,  341,  346,  351,  357,  362,
+     367,  373,  378,  384,  390,  395,  401,  407,  412,  418,  424,  430,
+     436,  442,  448,  454,  460,  466,  472,  479,  485,  491,  498,  504,
+     510,  517,  523,  530,  537,  543,  550,  557,  563,  570,  577,  584,
+     591,  597,  604,  611,  618,  625,  632,  640,  647,  654,  661,  668,
+     676,  683,  690,  698,  705,  713,  720,  728,  735,  743,  750,  758,
+     766,  774,  781,  789,  797,  805,  813,  821,  828,  836,  844,  852,
+     861,  869,  877,  885,  893,  901,  910,  918,  926,  935,  943,  951,
+     960,  968,  977,  985,  994, 1002, 1011, 1019, 1028, 1037, 1046, 1054,
+    1063, 1072, 1081, 1090, 1098, 1107, 1116, 1125, 1134, 1143, 1152, 1161,
+    1170, 1180, 1189, 1198, 1207, 1216, 1226, 1235, 1244, 1254, 1263, 1272,
+    1282, 1291, 1301, 1310, 1320, 1329, 1339, 1348, 1358, 1368, 1377, 1387,
+    1397, 1407, 1416, 1426, 1436, 1446, 1456, 1466, 1476, 1486, 1496, 1506,
+    1516, 1526, 1536, 1546, 1556, 1566, 1576, 1587, 1597, 1607, 1617, 1628,
+    1638, 1648, 1659, 1669, 1679, 1690, 1700, 1711, 1721, 1732, 1742, 1753,
+    1764, 1774, 1785, 1796, 1806, 1817, 1828, 1839, 1849, 1860, 1871, 1882,
+    1893, 1904, 1915, 1926, 1937, 1948, 1959, 1970, 1981, 1992, 2003, 2014,
+    2025, 2036, 2048,
+};
@@ -0,0 +1,135 @@
+#include "zcctlm_scenes.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "nvs_flash.h"
+
+static const char *TAG = "ZCCTLM scenes";
+
+// Table image stored in NVS, entries are kept in the order they were stored (oldest first)
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t count;
+    zcctlm_scene_t entries[ZCCTLM_SCENES_MAX];
+    uint32_t crc; // CRC32 of all preceding fields
+} zcctlm_scenes_table_t;
+
+// Only used from the model command task
+static zcctlm_scenes_table_t table;
+
+static uint32_t zcctlm_scenes_crc(const zcctlm_scenes_table_t *t) { return esp_rom_crc32_le(0, (const uint8_t *)t, offsetof(zcctlm_scenes_table_t, crc)); }
+
+static int zcctlm_scenes_index(uint16_t group_id, uint8_t scene_id) {
+    for (int i = 0; i < table.count; i++) {
+        if (table.entries[i].group_id == group_id && table.entries[i].scene_id == scene_id)
+            return i;
+    }
+    return -1;
+}
+
+static void zcctlm_scenes_remove_at(int index) {
+    memmove(&table.entries[index], &table.entries[index + 1], (table.count - index - 1) * sizeof(zcctlm_scene_t));
+    table.count--;
+}
+
+static void zcctlm_scenes_save() {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(ZCCTLM_SCENES_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return;
+    }
+
+    table.crc = zcctlm_scenes_crc(&table);
+    err = nvs_set_blob(handle, ZCCTLM_SCENES_NVS_KEY, &table, sizeof(table));
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to write scene table to NVS: %s", esp_err_to_name(err));
+    }
+
+    nvs_close(handle);
+}
+
+// --- PUBLIC ---
+
+void zcctlm_scenes_init() {
+    table = (zcctlm_scenes_table_t){.version = ZCCTLM_SCENES_NVS_VERSION};
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(ZCCTLM_SCENES_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "No scene table in NVS");
+        return;
+    }
+
+    zcctlm_scenes_table_t stored;
+    size_t size = sizeof(stored);
+    err = nvs_get_blob(handle, ZCCTLM_SCENES_NVS_KEY, &stored, &size);
+    nvs_close(handle);
+
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No scene table in NVS");
+    } else if (err != ESP_OK || size != sizeof(stored) || stored.version != ZCCTLM_SCENES_NVS_VERSION || stored.count > ZCCTLM_SCENES_MAX ||
+               stored.crc != zcctlm_scenes_crc(&stored)) {
+        ESP_LOGW(TAG, "Scene table in NVS is invalid (%s, size %u), starting empty", esp_err_to_name(err), (unsigned)size);
+    } else {
+        table = stored;
+        ESP_LOGI(TAG, "Loaded %u scenes from NVS", table.count);
+    }
+}
+
+void zcctlm_scenes_store(const zcctlm_scene_t *scene) {
+    int index = zcctlm_scenes_index(scene->group_id, scene->scene_id);
+    if (index >= 0) {
+        zcctlm_scenes_remove_at(index);
+    } else if (table.count == ZCCTLM_SCENES_MAX) {
+        ESP_LOGW(TAG, "Scene table full, replacing scene %u of group 0x%04x", table.entries[0].scene_id, table.entries[0].group_id);
+        zcctlm_scenes_remove_at(0);
+    }
+
+    table.entries[table.count++] = *scene;
+    zcctlm_scenes_save();
+    ESP_LOGI(TAG, "Stored scene %u of group 0x%04x: %s, level %u, %u mireds, %u/10 s", scene->scene_id, scene->group_id, scene->on_off ? "on" : "off",
+             scene->level, scene->mireds, scene->transition_time);
+}
+
+void zcctlm_scenes_remove(uint16_t group_id, uint8_t scene_id) {
+    int index = zcctlm_scenes_index(group_id, scene_id);
+    if (index < 0)
+        return;
+
+    zcctlm_scenes_remove_at(index);
+    zcctlm_scenes_save();
+    ESP_LOGI(TAG, "Removed scene %u of group 0x%04x", scene_id, group_id);
+}
+
+void zcctlm_scenes_remove_group(uint16_t group_id) {
+    uint8_t removed = 0;
+    for (int i = table.count - 1; i >= 0; i--) {
+        uint16_t entry_group = table.entries[i].group_id;
+        if (entry_group == group_id || (group_id == ZCCTLM_SCENES_ALL_GROUPS && entry_group != 0x0000)) {
+            zcctlm_scenes_remove_at(i);
+            removed++;
+        }
+    }
+    if (removed == 0)
+        return;
+
+    zcctlm_scenes_save();
+    ESP_LOGI(TAG, "Removed %u scenes of group 0x%04x", removed, group_id);
+}
+
+bool zcctlm_scenes_find(uint16_t group_id, uint8_t scene_id, zcctlm_scene_t *scene) {
+    int index = zcctlm_scenes_index(group_id, scene_id);
+    if (index < 0)
+        return false;
+
+    *scene = table.entries[index];
+    return true;
+}
+
+uint8_t zcctlm_scenes_count() { return table.count; }
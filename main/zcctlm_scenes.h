@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+    Local scene table.
+
+    Scenes stored with StoreScene are kept in a small fixed-size table in RAM and persisted as a single
+    CRC protected NVS blob, so a group RecallScene is served from memory and applied as one transition.
+    When the table is full the oldest stored scene is replaced.
+
+    The stack keeps its own scene table for AddScene, the local entry of a scene the stack removes
+    (RemoveScene, RemoveAllScenes, group removal) or overwrites (AddScene) is dropped, RecallScene
+    then uses the extension fields of the stack.
+*/
+
+#define ZCCTLM_SCENES_MAX 16
+#define ZCCTLM_SCENES_NVS_NAMESPACE "zcctlm"
+#define ZCCTLM_SCENES_NVS_KEY "scenes"
+#define ZCCTLM_SCENES_NVS_VERSION 1
+
+// Group id of zcctlm_scenes_remove_group for every group but the global scenes (group 0x0000)
+#define ZCCTLM_SCENES_ALL_GROUPS 0xffff
+
+// Field values meaning "not part of the scene, keep the current value"
+#define ZCCTLM_SCENE_ON_OFF_UNSET 0xff
+#define ZCCTLM_SCENE_LEVEL_UNSET 0xff
+#define ZCCTLM_SCENE_MIREDS_UNSET 0
+#define ZCCTLM_SCENE_TRANSITION_UNSET 0xffff
+
+typedef struct __attribute__((packed)) {
+    uint16_t group_id;
+    uint8_t scene_id;
+    uint8_t on_off;
+    uint8_t level;
+    uint16_t mireds;
+    uint16_t transition_time; // 1/10 s
+} zcctlm_scene_t;
+
+void zcctlm_scenes_init();
+// Add or replace a scene and persist the table
+void zcctlm_scenes_store(const zcctlm_scene_t *scene);
+// Remove one scene or all scenes of a group, the table is persisted when an entry was removed
+void zcctlm_scenes_remove(uint16_t group_id, uint8_t scene_id);
+void zcctlm_scenes_remove_group(uint16_t group_id);
+bool zcctlm_scenes_find(uint16_t group_id, uint8_t scene_id, zcctlm_scene_t *scene);
+uint8_t zcctlm_scenes_count();
@@ -1,16 +1,32 @@
 #include "zigbee_cct_light_model.h"
 
-#include <math.h>
+#define DLOG_LOCAL_LEVEL DLOG_LEVEL_MODEL
+#include "deferred_log.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "nvs_flash.h"
 
+#include "latency_trace.h"
 #include "led_controller.h"
+#include "light_transition.h"
 #include "zb_attr_report.h"
+#include "zcctlm_effects.h"
+#include "zcctlm_gamma_lut.h"
 
 #define ZCCTLM_NVS_NAMESPACE "zcctlm"
+#define ZCCTLM_NVS_KEY_RECORD "record"
+#define ZCCTLM_NVS_RECORD_VERSION 2
+
+// Legacy per-key layout, only read to migrate into the record
 #define ZCCTLM_NVS_KEY_ON_OFF "state"
 #define ZCCTLM_NVS_KEY_BRIGHTNESS "brightness"
 #define ZCCTLM_NVS_KEY_MIREDS "mireds"
@@ -18,146 +34,648 @@
 #define ZCCTLM_NVS_KEY_OFF_TRANSITION_TIME "offtime"
 #define ZCCTLM_NVS_KEY_STARTUP_ON_OFF "onoff"
 
+// Persistent values waiting for the write-behind commit
+#define ZCCTLM_DIRTY_ON_OFF (1 << 0)
+#define ZCCTLM_DIRTY_BRIGHTNESS (1 << 1)
+#define ZCCTLM_DIRTY_MIREDS (1 << 2)
+#define ZCCTLM_DIRTY_ON_TRANSITION_TIME (1 << 3)
+#define ZCCTLM_DIRTY_OFF_TRANSITION_TIME (1 << 4)
+#define ZCCTLM_DIRTY_STARTUP_ON_OFF (1 << 5)
+
 static const char *TAG = "ZCCTLM";
 
-typedef struct {
-    bool on_off;
+zcctlm_state_t state;
+
+// Persistent part of the state, stored as a single blob so that it is read in one access and never restored half-written
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t on_off;
     uint8_t brightness;
+    uint8_t startup_behavior;
     uint16_t mireds;
+    uint32_t on_transition_time;
+    uint32_t off_transition_time;
+    uint32_t crc; // CRC32 of all preceding fields
+} zcctlm_nvs_record_t;
 
-    // synchronized with NVS
+// Version 1 of the record, transition times were limited to UINT16_MAX ms
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t on_off;
+    uint8_t brightness;
+    uint8_t startup_behavior;
+    uint16_t mireds;
     uint16_t on_transition_time;
     uint16_t off_transition_time;
-    zcctl_startup_behavior_e startup_behavior;
-} zcctlm_state_t;
-
-zcctlm_state_t state;
+    uint32_t crc;
+} zcctlm_nvs_record_v1_t;
 
 static SemaphoreHandle_t state_mutex;
 
-#if ZCCTLM_ENABLE_ON_OFF_DUTY_BLOCK_WORKAROUND == 1
-void zcctlm_set_duty(); 
-static TimerHandle_t block_set_duty_timer;
-static volatile bool block_set_duty;
+// Copy of `state` published by every writer when it releases state_mutex. Readers copy it without blocking
+// and retry when state_seq changed (or was odd, a publish in progress) while they were copying.
+static zcctlm_state_t published_state;
+static atomic_uint state_seq;
+static portMUX_TYPE publish_lock = portMUX_INITIALIZER_UNLOCKED;
+// lock_* fields are only updated with state_mutex taken, readers of any task count in the snapshot atomics
+static zcctlm_lock_stats_t lock_stats;
+static atomic_uint snapshot_reads;
+static atomic_uint snapshot_retries;
+static atomic_uint snapshot_max_read_us;
 
-void block_set_duty_timer_cb(TimerHandle_t timer) {
-    if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
-        block_set_duty = false;
-        zcctlm_set_duty();
+// Take state_mutex within timeout ticks, counting how often and for how long writers wait for each other
+static bool zcctlm_lock_timeout(TickType_t timeout) {
+    if (xSemaphoreTake(state_mutex, 0)) {
+        lock_stats.lock_taken++;
+        return true;
+    }
+
+    int64_t wait_start_us = esp_timer_get_time();
+    ltr_stamp_t trace_start = ltr_now();
+    if (!xSemaphoreTake(state_mutex, timeout))
+        return false;
+
+    ltr_record(LTR_STAGE_LOCK_WAIT, trace_start);
+    uint32_t wait_us = (uint32_t)(esp_timer_get_time() - wait_start_us);
+    lock_stats.lock_taken++;
+    lock_stats.lock_contended++;
+    if (wait_us > lock_stats.lock_max_wait_us)
+        lock_stats.lock_max_wait_us = wait_us;
+    return true;
+}
+
+static inline bool zcctlm_lock() { return zcctlm_lock_timeout(portMAX_DELAY); }
+
+// Publish `state` for lock-free readers and release state_mutex
+static void zcctlm_unlock() {
+    // The copy is short and must not be preempted by a reader on the same core, which would spin on the odd sequence
+    portENTER_CRITICAL(&publish_lock);
+    unsigned seq = atomic_load_explicit(&state_seq, memory_order_relaxed);
+    atomic_store_explicit(&state_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    published_state = state;
+    atomic_store_explicit(&state_seq, seq + 2, memory_order_release);
+    portEXIT_CRITICAL(&publish_lock);
+
+    xSemaphoreGive(state_mutex);
+}
 
-        xSemaphoreGive(state_mutex);
+// Consistent copy of the last published state, never blocks on state_mutex
+static void zcctlm_read_state(zcctlm_state_t *out) {
+    int64_t start_us = esp_timer_get_time();
+    uint32_t retries = 0;
+
+    while (1) {
+        unsigned seq = atomic_load_explicit(&state_seq, memory_order_acquire);
+        if ((seq & 1) == 0) {
+            *out = published_state;
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&state_seq, memory_order_relaxed) == seq)
+                break;
+        }
+        retries++;
+    }
+
+    unsigned read_us = (unsigned)(esp_timer_get_time() - start_us);
+    atomic_fetch_add_explicit(&snapshot_reads, 1, memory_order_relaxed);
+    if (retries != 0)
+        atomic_fetch_add_explicit(&snapshot_retries, retries, memory_order_relaxed);
+    unsigned max_us = atomic_load_explicit(&snapshot_max_read_us, memory_order_relaxed);
+    while (read_us > max_us &&
+           !atomic_compare_exchange_weak_explicit(&snapshot_max_read_us, &max_us, read_us, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// Write-behind persistence, nvs_dirty is guarded by state_mutex
+static TimerHandle_t nvs_commit_timer;
+static uint8_t nvs_dirty;
+static zcctlm_persist_stats_t persist_stats;
+
+// Attributes reported once a ramp has settled
+#define ZCCTLM_REPORT_LEVEL (1 << 0) // OnOff and CurrentLevel
+#define ZCCTLM_REPORT_COLOR_TEMP (1 << 1)
+
+// Level / color command in progress, guarded by state_mutex: the light turns off once a *WithOnOff ramp down has ended,
+// the changed attributes are reported once the ramp has settled instead of for every step
+static bool off_at_transition_end;
+static uint8_t report_at_transition_end;
+
+#if ZCCTLM_USE_PERCEPTUAL_TRANSITIONS == 1
+// Samples the output of a long ramp so that a reporting configuration can report intermediate values
+static TimerHandle_t progress_timer;
+#endif
+
+#if ZCCTLM_ENABLE_SETTLE_WINDOW == 1
+// Settle window, guarded by state_mutex: output updates requested while it is open are merged into one applied at its end
+static TimerHandle_t settle_timer;
+static bool settle_open;
+static uint32_t settle_time_ms; // transition time of the latest merged update
+static bool output_lit;         // the last update applied to the LEDs left them lit
+static zcctlm_settle_stats_t settle_stats;
+
+static void zcctlm_apply_state(uint32_t time_ms);
+
+static void settle_timer_cb(TimerHandle_t timer) {
+    if (zcctlm_lock()) {
+        // A window reopened while this callback waited for the mutex is left to its own expiry
+        if (settle_open && !xTimerIsTimerActive(settle_timer)) {
+            settle_open = false;
+            // The merged update is the one lighting the LEDs, it must not open another window
+            output_lit = true;
+            zcctlm_apply_state(settle_time_ms);
+        }
+        zcctlm_unlock();
     }
 }
 #endif
 
 #if ZCCTLM_USE_GAMMA_CORRECTION == 1
+_Static_assert(ZCCTLM_GAMMA_LUT_MIN_DUTY == LC_MIN_DUTY && ZCCTLM_GAMMA_LUT_MAX_DUTY == LC_MAX_DUTY &&
+                   ZCCTLM_GAMMA_LUT_MAX_BRIGHTNESS == ZCCTLM_MAX_BRIGHTNESS,
+               "zcctlm_gamma_lut.h is out of date, regenerate it with tools/gen_gamma_lut.py");
+_Static_assert(ZCCTLM_GAMMA_LUT_GAMMA_X10 == (int)(ZCCTLM_GAMMA_CORRECTION * 10 + 0.5),
+               "zcctlm_gamma_lut.h was generated for another ZCCTLM_GAMMA_CORRECTION, regenerate it with tools/gen_gamma_lut.py");
+
 uint16_t apply_gamma_correction(uint8_t brightness_raw) {
-    if (brightness_raw == 0)
-        return 0;
+    if (brightness_raw > ZCCTLM_MAX_BRIGHTNESS)
+        brightness_raw = ZCCTLM_MAX_BRIGHTNESS;
+    return zcctlm_gamma_lut[brightness_raw];
+}
+#endif
 
-    float norm = (float)brightness_raw / ZCCTLM_MAX_BRIGHTNESS;
-    float corrected = powf(norm, ZCCTLM_GAMMA_CORRECTION);
-    uint16_t pwm = (uint16_t)(corrected * (LC_MAX_DUTY - LC_MIN_DUTY)) + LC_MIN_DUTY;
+static uint16_t zcctlm_total_duty(uint8_t brightness) {
+#if ZCCTLM_USE_GAMMA_CORRECTION == 1
+    // Gamma-corrected total duty
+    return apply_gamma_correction(brightness);
+#else
+    // Linear brightness
+    return (uint16_t)(((uint32_t)LC_MAX_DUTY * brightness) / ZCCTLM_MAX_BRIGHTNESS);
+#endif
+}
+
+static void zcctlm_mix_duty(uint16_t total_duty, uint16_t mireds, uint16_t *warm_duty, uint16_t *cold_duty) {
+    // Integer split of total_duty between channels, proportional to the position of mireds in the supported range
+    if (mireds < ZCCTLM_MIN_TEMP)
+        mireds = ZCCTLM_MIN_TEMP;
+    if (mireds > ZCCTLM_MAX_TEMP)
+        mireds = ZCCTLM_MAX_TEMP;
 
-    if (pwm > LC_MAX_DUTY)
-        pwm = LC_MAX_DUTY;
-    return pwm;
+    uint32_t cold_part = mireds - ZCCTLM_MIN_TEMP;
+    uint32_t warm_part = ZCCTLM_MAX_TEMP - mireds;
+
+    *warm_duty = (uint16_t)((total_duty * warm_part) / (ZCCTLM_MAX_TEMP - ZCCTLM_MIN_TEMP));
+    *cold_duty = (uint16_t)((total_duty * cold_part) / (ZCCTLM_MAX_TEMP - ZCCTLM_MIN_TEMP));
 }
-#endif
 
-void zcctlm_set_duty() {
-    // this function should be executed while state_mutex is taken
-    // calculate duty for warm and cold
+static void zcctlm_finish_transition(void *arg, uint32_t unused);
 
-#if ZCCTLM_ENABLE_ON_OFF_DUTY_BLOCK_WORKAROUND == 1
-    if (block_set_duty == true) {
-        ESP_LOGI(TAG, "Skipped zcctlm_set_duty due to active On/Off workaround (block_set_duty = true)");
-        return;
+#if ZCCTLM_USE_PERCEPTUAL_TRANSITIONS == 1
+// Mixing function used by the transition engine for every step, level_q8 is CurrentLevel in Q8 fixed point
+static void zcctlm_mix_level(uint16_t level_q8, uint16_t mireds, uint16_t *warm_duty, uint16_t *cold_duty) {
+    uint8_t level = level_q8 >> 8;
+    uint16_t frac = level_q8 & 0xff;
+
+    uint16_t total_duty = zcctlm_total_duty(level);
+    if (frac != 0 && level < ZCCTLM_MAX_BRIGHTNESS) {
+        // Interpolate the gamma curve between neighbouring levels
+        uint16_t next_duty = zcctlm_total_duty(level + 1);
+        total_duty += (uint16_t)(((uint32_t)(next_duty - total_duty) * frac) >> 8);
     }
+
+    zcctlm_mix_duty(total_duty, mireds, warm_duty, cold_duty);
+}
+
+// Called from the leds task once the output has settled at the end of a transition
+static void zcctlm_transition_done(uint16_t level_q8, uint16_t mireds) {
+    ESP_LOGD(TAG, "Output settled at level %u, %u mireds", level_q8 >> 8, mireds);
+    // The leds task must not block on state_mutex, finish in the timer task
+    xTimerPendFunctionCall(zcctlm_finish_transition, NULL, 0, 0);
+}
+#else
+static void zcctlm_leds_done(uint16_t warm_duty, uint16_t cold_duty, uint32_t job_seq, void *arg) {
+    xTimerPendFunctionCall(zcctlm_finish_transition, NULL, 0, 0);
+}
 #endif
 
-    if (!state.on_off || state.brightness == 0) {
-        lc_set_duty_warm(0, state.off_transition_time);
-        lc_set_duty_cold(0, state.off_transition_time);
+// Drive the LEDs to the current state in time_ms, must be called with state_mutex taken
+static void zcctlm_apply_state(uint32_t time_ms) {
+#if ZCCTLM_ENABLE_SETTLE_WINDOW == 1
+    bool lit = state.on_off && state.brightness != 0 && !off_at_transition_end;
+    if (lit && (settle_open || !output_lit)) {
+        // Lighting up: wait for the level / color that usually follow the On, the latest of them is applied at once
+        if (settle_open) {
+            settle_stats.merged++;
+        } else {
+            settle_open = true;
+            settle_stats.windows++;
+            xTimerStart(settle_timer, 0);
+        }
+        settle_time_ms = time_ms;
         return;
     }
+    if (settle_open) {
+        // Switched off again before the window ended, nothing to wait for
+        settle_open = false;
+        xTimerStop(settle_timer, 0);
+    }
+    output_lit = lit;
+#endif
+
+    // A model change ends a running effect, the state applied below is the one the effect would restore
+    zcctlm_effects_cancel();
 
     if (state.mireds < ZCCTLM_MIN_TEMP)
         state.mireds = ZCCTLM_MIN_TEMP;
     if (state.mireds > ZCCTLM_MAX_TEMP)
         state.mireds = ZCCTLM_MAX_TEMP;
 
-    float temp_frac = (state.mireds - ZCCTLM_MIN_TEMP) / (float)(ZCCTLM_MAX_TEMP - ZCCTLM_MIN_TEMP);
-    float warm_frac = 1.0f - temp_frac;
-    float cold_frac = temp_frac;
+#if ZCCTLM_USE_PERCEPTUAL_TRANSITIONS == 1
+    if (!state.on_off || state.brightness == 0 || off_at_transition_end) {
+        lt_set_target(LT_LEVEL_Q8(0), state.mireds, time_ms);
+        if (report_at_transition_end && time_ms > ZCCTLM_PROGRESS_SAMPLE_MS)
+            xTimerStart(progress_timer, 0);
+        return;
+    }
 
-#if ZCCTLM_USE_GAMMA_CORRECTION == 1
-    // Gamma-corrected total duty
-    uint16_t total_duty = apply_gamma_correction(state.brightness);
+    lt_set_target(LT_LEVEL_Q8(state.brightness), state.mireds, time_ms);
+    if (report_at_transition_end && time_ms > ZCCTLM_PROGRESS_SAMPLE_MS)
+        xTimerStart(progress_timer, 0);
 #else
-    // Linear brightness
-    float brightness_frac = state.brightness / 254.0f;
-    uint16_t total_duty = (uint16_t)(LC_MAX_DUTY * brightness_frac);
+    if (!state.on_off || state.brightness == 0 || off_at_transition_end) {
+        lc_set_duty(LC_OFF_DUTY, LC_OFF_DUTY, time_ms);
+        return;
+    }
+
+    uint16_t warm_duty, cold_duty;
+    zcctlm_mix_duty(zcctlm_total_duty(state.brightness), state.mireds, &warm_duty, &cold_duty);
+
+    lc_set_duty(warm_duty, cold_duty, time_ms);
 #endif
+}
 
-    uint16_t warm_duty = (uint16_t)(total_duty * warm_frac);
-    uint16_t cold_duty = (uint16_t)(total_duty * cold_frac);
+// Output of an effect keyframe, runs with the effect lock taken and must not take state_mutex
+static void zcctlm_effect_output(uint16_t level_q8, uint16_t mireds, uint32_t time_ms) {
+#if ZCCTLM_USE_PERCEPTUAL_TRANSITIONS == 1
+    lt_set_target(level_q8, mireds, time_ms);
+#else
+    if (level_q8 == 0) {
+        lc_set_duty(LC_OFF_DUTY, LC_OFF_DUTY, time_ms);
+        return;
+    }
 
-    lc_set_duty_warm(warm_duty, state.on_transition_time);
-    lc_set_duty_cold(cold_duty, state.on_transition_time);
+    uint16_t warm_duty, cold_duty;
+    zcctlm_mix_duty(zcctlm_total_duty(level_q8 >> 8), mireds, &warm_duty, &cold_duty);
+    lc_set_duty(warm_duty, cold_duty, time_ms);
+#endif
+}
+
+// An effect has ended, bring the LEDs back to the model state
+static void zcctlm_effect_end() {
+    if (zcctlm_lock()) {
+        zcctlm_apply_state(ZCCTLM_EFFECT_RESTORE_MS);
+        zcctlm_unlock();
+    }
+}
+
+void zcctlm_set_duty() {
+    // this function should be executed while state_mutex is taken
+    bool lit = state.on_off && state.brightness != 0;
+    zcctlm_apply_state(lit ? state.on_transition_time : state.off_transition_time);
+}
+
+static uint32_t zcctlm_record_crc(const zcctlm_nvs_record_t *record) {
+    return esp_rom_crc32_le(0, (const uint8_t *)record, offsetof(zcctlm_nvs_record_t, crc));
+}
+
+static void zcctlm_record_defaults(zcctlm_nvs_record_t *record) {
+    *record = (zcctlm_nvs_record_t){
+        .version = ZCCTLM_NVS_RECORD_VERSION,
+        .on_off = ZCCTLM_DEFAULT_ONOFF,
+        .brightness = ZCCTLM_MIN_BRIGHTNESS,
+        .startup_behavior = ZCCTLM_DEFAULT_STARTUP_BEHAVIOUR,
+        .mireds = ZCCTLM_AVG_TEMP,
+        .on_transition_time = ZCCTLM_DEFAULT_TRANSITION_TIME_MS,
+        .off_transition_time = ZCCTLM_DEFAULT_TRANSITION_TIME_MS,
+    };
+}
+
+static void zcctlm_record_from_state(zcctlm_nvs_record_t *record, const zcctlm_state_t *snapshot) {
+    *record = (zcctlm_nvs_record_t){
+        .version = ZCCTLM_NVS_RECORD_VERSION,
+        .on_off = snapshot->on_off,
+        .brightness = snapshot->brightness,
+        .startup_behavior = (uint8_t)snapshot->startup_behavior,
+        .mireds = snapshot->mireds,
+        .on_transition_time = snapshot->on_transition_time,
+        .off_transition_time = snapshot->off_transition_time,
+    };
+    record->crc = zcctlm_record_crc(record);
+}
+
+static esp_err_t zcctlm_write_record(nvs_handle_t handle, const zcctlm_nvs_record_t *record) {
+    esp_err_t err = nvs_set_blob(handle, ZCCTLM_NVS_KEY_RECORD, record, sizeof(*record));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to write state record to NVS: %s", esp_err_to_name(err));
+        return err;
+    }
+    return nvs_commit(handle);
 }
 
-void zcctlm_save_to_nvs(const char *key, uint16_t value) {
+static uint16_t zcctlm_load_legacy_key(nvs_handle_t handle, const char *key, uint16_t default_value) {
+    uint16_t value = default_value;
+    if (nvs_get_u16(handle, key, &value) != ESP_OK) {
+        return default_value;
+    }
+    return value;
+}
+
+// Build the record from the old one-key-per-value layout and replace it
+static void zcctlm_migrate_legacy_keys(nvs_handle_t handle, zcctlm_nvs_record_t *record) {
+    zcctlm_record_defaults(record);
+    record->on_off = (uint8_t)zcctlm_load_legacy_key(handle, ZCCTLM_NVS_KEY_ON_OFF, record->on_off);
+    record->brightness = (uint8_t)zcctlm_load_legacy_key(handle, ZCCTLM_NVS_KEY_BRIGHTNESS, record->brightness);
+    record->mireds = zcctlm_load_legacy_key(handle, ZCCTLM_NVS_KEY_MIREDS, record->mireds);
+    record->on_transition_time = zcctlm_load_legacy_key(handle, ZCCTLM_NVS_KEY_ON_TRANSITION_TIME, record->on_transition_time);
+    record->off_transition_time = zcctlm_load_legacy_key(handle, ZCCTLM_NVS_KEY_OFF_TRANSITION_TIME, record->off_transition_time);
+    record->startup_behavior = (uint8_t)zcctlm_load_legacy_key(handle, ZCCTLM_NVS_KEY_STARTUP_ON_OFF, record->startup_behavior);
+    record->crc = zcctlm_record_crc(record);
+
+    // Legacy keys are erased only once the record is safely written
+    if (zcctlm_write_record(handle, record) == ESP_OK) {
+        const char *legacy_keys[] = {ZCCTLM_NVS_KEY_ON_OFF,          ZCCTLM_NVS_KEY_BRIGHTNESS,          ZCCTLM_NVS_KEY_MIREDS,
+                                     ZCCTLM_NVS_KEY_ON_TRANSITION_TIME, ZCCTLM_NVS_KEY_OFF_TRANSITION_TIME, ZCCTLM_NVS_KEY_STARTUP_ON_OFF};
+        for (size_t i = 0; i < sizeof(legacy_keys) / sizeof(legacy_keys[0]); i++) {
+            nvs_erase_key(handle, legacy_keys[i]);
+        }
+        nvs_commit(handle);
+        ESP_LOGI(TAG, "Migrated legacy NVS keys to state record v%u", ZCCTLM_NVS_RECORD_VERSION);
+    }
+}
+
+// Convert a version 1 record read into the buffer of the current one, it is rewritten with the next commit
+static bool zcctlm_upgrade_record_v1(zcctlm_nvs_record_t *record) {
+    zcctlm_nvs_record_v1_t old;
+    memcpy(&old, record, sizeof(old));
+    if (old.version != 1 || old.crc != esp_rom_crc32_le(0, (const uint8_t *)&old, offsetof(zcctlm_nvs_record_v1_t, crc)))
+        return false;
+
+    *record = (zcctlm_nvs_record_t){
+        .version = ZCCTLM_NVS_RECORD_VERSION,
+        .on_off = old.on_off,
+        .brightness = old.brightness,
+        .startup_behavior = old.startup_behavior,
+        .mireds = old.mireds,
+        .on_transition_time = old.on_transition_time,
+        .off_transition_time = old.off_transition_time,
+    };
+    record->crc = zcctlm_record_crc(record);
+    return true;
+}
+
+// Restore the persistent state with a single NVS access, falls back to defaults when the record is missing or damaged
+// Returns false when the defaults are used
+static bool zcctlm_load_record(zcctlm_nvs_record_t *record) {
     nvs_handle_t handle;
+    zcctlm_record_defaults(record);
+
     esp_err_t err = nvs_open(ZCCTLM_NVS_NAMESPACE, NVS_READWRITE, &handle);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
-        return;
+        return false;
     }
 
-    err = nvs_set_u16(handle, key, value);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to write key '%s' to NVS: %s", key, esp_err_to_name(err));
+    bool loaded = false;
+    size_t size = sizeof(*record);
+    err = nvs_get_blob(handle, ZCCTLM_NVS_KEY_RECORD, record, &size);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        zcctlm_migrate_legacy_keys(handle, record);
+    } else if (err == ESP_OK && size == sizeof(zcctlm_nvs_record_v1_t) && zcctlm_upgrade_record_v1(record)) {
+        ESP_LOGI(TAG, "Loaded state record v1 from NVS");
+        loaded = true;
+    } else if (err != ESP_OK || size != sizeof(*record) || record->version != ZCCTLM_NVS_RECORD_VERSION ||
+               record->crc != zcctlm_record_crc(record)) {
+        ESP_LOGW(TAG, "State record in NVS is invalid (%s, size %u, version %u), using defaults", esp_err_to_name(err), (unsigned)size,
+                 record->version);
+        zcctlm_record_defaults(record);
     } else {
-        nvs_commit(handle);
-        ESP_LOGI(TAG, "Saved key '%s' = %u to NVS", key, value);
+        ESP_LOGD(TAG, "Loaded state record v%u from NVS", record->version);
+        loaded = true;
     }
 
     nvs_close(handle);
+    return loaded;
 }
 
-uint16_t zcctlm_load_from_nvs(const char *key, uint16_t default_value) {
+// Returns false when the state could not be written
+static bool zcctlm_commit_to_nvs(uint8_t dirty, const zcctlm_state_t *snapshot) {
     nvs_handle_t handle;
-    uint16_t value = default_value;
-
-    esp_err_t err = nvs_open(ZCCTLM_NVS_NAMESPACE, NVS_READONLY, &handle);
+    esp_err_t err = nvs_open(ZCCTLM_NVS_NAMESPACE, NVS_READWRITE, &handle);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
-        return default_value;
+        return false;
     }
 
-    err = nvs_get_u16(handle, key, &value);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGW(TAG, "Key '%s' not found in NVS. Using default: %u", key, default_value);
-    } else if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to read key '%s' from NVS: %s", key, esp_err_to_name(err));
-        value = default_value;
+    zcctlm_nvs_record_t record;
+    zcctlm_record_from_state(&record, snapshot);
+
+    ltr_stamp_t trace_start = ltr_now();
+    err = zcctlm_write_record(handle, &record);
+    ltr_record(LTR_STAGE_NVS_COMMIT, trace_start);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to commit NVS: %s", esp_err_to_name(err));
     } else {
-        ESP_LOGI(TAG, "Loaded key '%s' = %u from NVS", key, value);
+        persist_stats.commits++;
+        DLOGI(TAG, "Committed state to NVS (dirty 0x%02x)", dirty);
     }
 
     nvs_close(handle);
-    return value;
+    return err == ESP_OK;
+}
+
+// Mark persistent values as changed, they are written once the state has been quiet for ZCCTLM_NVS_COMMIT_DELAY_MS.
+// Must be called with state_mutex taken.
+static void zcctlm_mark_dirty(uint8_t keys) {
+    nvs_dirty |= keys;
+    persist_stats.changes += __builtin_popcount(keys);
+    xTimerReset(nvs_commit_timer, 0);
 }
 
+static void nvs_commit_timer_cb(TimerHandle_t timer) { zcctlm_flush_nvs(); }
+
 static inline bool zcctlm_should_persist_state() {
     return (state.startup_behavior == ZCCTL_STARTUP_PREVIOUS || state.startup_behavior == ZCCTL_STARTUP_TOGGLE);
 }
 
+/*
+ * Schedule reports of ZCCTLM_REPORT_* attributes, must be called with state_mutex taken so that the reports of two
+ * writers are scheduled in the order of their changes. The report scheduler only takes the Zigbee lock when it flushes.
+ */
+static void zcctlm_report_state(uint8_t attributes) {
+    zcctlm_state_t values = state;
+    if (attributes & ZCCTLM_REPORT_LEVEL) {
+        zbattr_send_attribute_report(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, &values.on_off);
+        zbattr_send_attribute_report(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, &values.brightness);
+    }
+    if (attributes & ZCCTLM_REPORT_COLOR_TEMP) {
+        zbattr_send_attribute_report(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, &values.mireds);
+    }
+}
+
+// Color Control RemainingTime (1/10 s) of the running color ramp, must be called with state_mutex released
+static void zcctlm_set_color_remaining_time(uint32_t time_ms) {
+    uint32_t remaining_time = (time_ms + ZB_TRANSITION_TIME_UNIT_MS - 1) / ZB_TRANSITION_TIME_UNIT_MS;
+    uint16_t value = remaining_time > UINT16_MAX ? UINT16_MAX : (uint16_t)remaining_time;
+    zbattr_set_attribute(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_REMAINING_TIME_ID, &value);
+}
+
+// Runs in the timer task after the output has settled, completes the level command that started the transition
+static void zcctlm_finish_transition(void *arg, uint32_t unused) {
+    uint8_t report = 0;
+
+    if (zcctlm_lock()) {
+        if (off_at_transition_end) {
+            off_at_transition_end = false;
+            state.on_off = false;
+            if (zcctlm_should_persist_state()) {
+                zcctlm_mark_dirty(ZCCTLM_DIRTY_ON_OFF);
+            }
+        }
+        report = report_at_transition_end;
+        report_at_transition_end = 0;
+        zcctlm_report_state(report);
+        zcctlm_unlock();
+    }
+
+    if (report & ZCCTLM_REPORT_COLOR_TEMP)
+        zcctlm_set_color_remaining_time(0);
+}
+
+#if ZCCTLM_USE_PERCEPTUAL_TRANSITIONS == 1
+// Publish the values of a running level / color ramp, the stack reports them only when they cross the configured reportable change
+static void zcctlm_progress_timer_cb(TimerHandle_t timer) {
+    uint8_t attributes = 0;
+    uint16_t level_q8 = 0, mireds = 0;
+    uint32_t remaining_ms = 0;
+
+    if (zcctlm_lock()) {
+        attributes = report_at_transition_end;
+        remaining_ms = lt_get_current(&level_q8, &mireds);
+        zcctlm_unlock();
+    }
+
+    // The final values are reported by zcctlm_finish_transition, the output of an effect is not a model value
+    if (attributes == 0 || remaining_ms == 0 || zcctlm_effects_active()) {
+        xTimerStop(timer, 0);
+        return;
+    }
+
+    if (attributes & ZCCTLM_REPORT_LEVEL) {
+        uint8_t level = (uint8_t)(((uint32_t)level_q8 + 0x80) >> 8);
+        if (level < ZCCTLM_MIN_ON_BRIGHTNESS)
+            level = ZCCTLM_MIN_ON_BRIGHTNESS;
+        zbattr_set_attribute(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, &level);
+    }
+    if (attributes & ZCCTLM_REPORT_COLOR_TEMP) {
+        zbattr_set_attribute(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, &mireds);
+        zcctlm_set_color_remaining_time(remaining_ms);
+    }
+}
+#endif
+
+// Level and mireds the LEDs show right now, a ramp starts from them. Returns the time left of the running transition.
+// Must be called with state_mutex taken.
+static uint32_t zcctlm_output_point(uint16_t *level_q8, uint16_t *mireds) {
+#if ZCCTLM_USE_PERCEPTUAL_TRANSITIONS == 1
+    return lt_get_current(level_q8, mireds);
+#else
+    *level_q8 = state.on_off ? LT_LEVEL_Q8(state.brightness) : 0;
+    *mireds = state.mireds;
+    return 0;
+#endif
+}
+
+static uint16_t zcctlm_clamp_mireds(uint32_t mireds, uint16_t min_mireds, uint16_t max_mireds) {
+    if (min_mireds < ZCCTLM_MIN_TEMP)
+        min_mireds = ZCCTLM_MIN_TEMP;
+    if (max_mireds == 0 || max_mireds > ZCCTLM_MAX_TEMP)
+        max_mireds = ZCCTLM_MAX_TEMP;
+
+    if (mireds < min_mireds)
+        mireds = min_mireds;
+    if (mireds > max_mireds)
+        mireds = max_mireds;
+    return (uint16_t)mireds;
+}
+
+/*
+ * Ramp ColorTemperatureMireds to `mireds` in time_ms, must be called with state_mutex taken.
+ * Returns the ramp time, RemainingTime has to be set with it once state_mutex is released.
+ */
+static uint32_t zcctlm_start_color_ramp(uint16_t mireds, uint32_t time_ms) {
+    if (time_ms == ZCCTLM_TRANSITION_DEFAULT)
+        time_ms = state.on_transition_time;
+
+    bool changed = mireds != state.mireds;
+    state.mireds = mireds;
+    report_at_transition_end |= ZCCTLM_REPORT_COLOR_TEMP;
+    zcctlm_apply_state(time_ms);
+
+    if (changed && zcctlm_should_persist_state()) {
+        zcctlm_mark_dirty(ZCCTLM_DIRTY_MIREDS);
+    }
+    return time_ms;
+}
+
+/*
+ * Ramp CurrentLevel to `level` in time_ms, must be called with state_mutex taken.
+ * With On/Off the light is switched on for a level above MinLevel and switched off once a ramp down to MinLevel ends.
+ */
+static void zcctlm_start_level_ramp(uint8_t level, uint32_t time_ms, bool with_on_off) {
+    bool was_on = state.on_off;
+    off_at_transition_end = false;
+
+    if (level < ZCCTLM_MIN_ON_BRIGHTNESS)
+        level = ZCCTLM_MIN_ON_BRIGHTNESS;
+    if (level > ZCCTLM_MAX_BRIGHTNESS)
+        level = ZCCTLM_MAX_BRIGHTNESS;
+
+    if (with_on_off) {
+        if (level > ZCCTLM_MIN_ON_BRIGHTNESS)
+            state.on_off = true;
+        else
+            off_at_transition_end = state.on_off;
+    }
+
+    if (time_ms == ZCCTLM_TRANSITION_DEFAULT)
+        time_ms = state.on_off && !off_at_transition_end ? state.on_transition_time : state.off_transition_time;
+
+    uint8_t dirty = 0;
+    if (state.on_off != was_on)
+        dirty |= ZCCTLM_DIRTY_ON_OFF;
+    if (level != state.brightness)
+        dirty |= ZCCTLM_DIRTY_BRIGHTNESS;
+
+    state.brightness = level;
+    report_at_transition_end |= ZCCTLM_REPORT_LEVEL;
+    zcctlm_apply_state(time_ms);
+
+    if (dirty && zcctlm_should_persist_state()) {
+        zcctlm_mark_dirty(dirty);
+    }
+}
+
 // public
 
 void zcctlm_init() {
     state_mutex = xSemaphoreCreateMutex();
+    nvs_commit_timer = xTimerCreate("zcctlm_nvs", pdMS_TO_TICKS(ZCCTLM_NVS_COMMIT_DELAY_MS), pdFALSE, NULL, nvs_commit_timer_cb);
+    esp_register_shutdown_handler(zcctlm_flush_nvs);
+#if ZCCTLM_ENABLE_SETTLE_WINDOW == 1
+    settle_timer = xTimerCreate("zcctlm_settle", pdMS_TO_TICKS(ZCCTLM_SETTLE_WINDOW_MS), pdFALSE, NULL, settle_timer_cb);
+#endif
+#if ZCCTLM_USE_PERCEPTUAL_TRANSITIONS == 1
+    progress_timer = xTimerCreate("zcctlm_progress", pdMS_TO_TICKS(ZCCTLM_PROGRESS_SAMPLE_MS), pdTRUE, NULL, zcctlm_progress_timer_cb);
+#endif
 
     // Defaults
     bool on_off = ZCCTLM_DEFAULT_ONOFF;
@@ -165,23 +683,30 @@ void zcctlm_init() {
     uint16_t mireds = ZCCTLM_AVG_TEMP;
 
     // Load persistent attributes
-    zcctl_startup_behavior_e startup_behavior =
-        (zcctl_startup_behavior_e)zcctlm_load_from_nvs(ZCCTLM_NVS_KEY_STARTUP_ON_OFF, (uint16_t)ZCCTLM_DEFAULT_STARTUP_BEHAVIOUR);
-    uint16_t on_transition_time = zcctlm_load_from_nvs(ZCCTLM_NVS_KEY_ON_TRANSITION_TIME, ZCCTLM_DEFAULT_TRANSITION_TIME_MS);
-    uint16_t off_transition_time = zcctlm_load_from_nvs(ZCCTLM_NVS_KEY_OFF_TRANSITION_TIME, ZCCTLM_DEFAULT_TRANSITION_TIME_MS);
+    int64_t load_start_us = esp_timer_get_time();
+    zcctlm_nvs_record_t record;
+    zcctlm_load_record(&record);
+    ESP_LOGI(TAG, "Persistent state restored in %lld us", (long long)(esp_timer_get_time() - load_start_us));
+
+    zcctlm_scenes_init();
+    zcctlm_effects_init(zcctlm_effect_output, zcctlm_effect_end);
+
+    zcctl_startup_behavior_e startup_behavior = (zcctl_startup_behavior_e)record.startup_behavior;
+    uint32_t on_transition_time = record.on_transition_time;
+    uint32_t off_transition_time = record.off_transition_time;
 
     // Decide how to initialize ON/OFF, brightness, temperature based on startup_behavior
     switch (startup_behavior) {
     case ZCCTL_STARTUP_PREVIOUS:
-        on_off = (bool)zcctlm_load_from_nvs(ZCCTLM_NVS_KEY_ON_OFF, (uint16_t)false);
-        brightness = (uint8_t)zcctlm_load_from_nvs(ZCCTLM_NVS_KEY_BRIGHTNESS, ZCCTLM_MIN_BRIGHTNESS);
-        mireds = zcctlm_load_from_nvs(ZCCTLM_NVS_KEY_MIREDS, ZCCTLM_AVG_TEMP);
+        on_off = (bool)record.on_off;
+        brightness = record.brightness;
+        mireds = record.mireds;
         break;
 
     case ZCCTL_STARTUP_TOGGLE:
-        on_off = !(bool)zcctlm_load_from_nvs(ZCCTLM_NVS_KEY_ON_OFF, (uint16_t)false);
-        brightness = on_off == true ? ZCCTLM_DEFAULT_BRIGHTNESS : (uint8_t)zcctlm_load_from_nvs(ZCCTLM_NVS_KEY_BRIGHTNESS, ZCCTLM_MIN_BRIGHTNESS);
-        mireds = zcctlm_load_from_nvs(ZCCTLM_NVS_KEY_MIREDS, ZCCTLM_AVG_TEMP);
+        on_off = !(bool)record.on_off;
+        brightness = on_off == true ? ZCCTLM_DEFAULT_BRIGHTNESS : record.brightness;
+        mireds = record.mireds;
         break;
 
     case ZCCTL_STARTUP_ON:
@@ -199,7 +724,7 @@ void zcctlm_init() {
     }
 
     // Save state
-    if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
+    if (zcctlm_lock()) {
         state.on_off = on_off;
         state.brightness = brightness;
         state.mireds = mireds;
@@ -207,143 +732,439 @@ void zcctlm_init() {
         state.off_transition_time = off_transition_time;
         state.startup_behavior = startup_behavior;
 
+#if ZCCTLM_USE_PERCEPTUAL_TRANSITIONS == 1
+        // LEDs start dark, the first transition fades them in to the restored state
+        lt_init(zcctlm_mix_level, zcctlm_transition_done, LT_LEVEL_Q8(0), mireds);
+#else
+        lc_register_done_cb(zcctlm_leds_done, NULL);
+#endif
+
         // Apply the new state to LEDs
         zcctlm_set_duty();
 
-        xSemaphoreGive(state_mutex);
+        zcctlm_unlock();
     }
 }
 
 void zcctlm_set_on_off(bool on_off) {
-    if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
-        if (on_off == state.on_off) {
-            xSemaphoreGive(state_mutex);
-            return;
-        }
+    if (zcctlm_lock()) {
+        // An explicit On/Off overrides a ramp that would switch the light off at its end
+        bool off_pending = off_at_transition_end;
+        off_at_transition_end = false;
 
-#if ZCCTLM_ENABLE_ON_OFF_DUTY_BLOCK_WORKAROUND == 1
-        if (on_off == true && state.on_off == false) {
-            block_set_duty = true;
-            block_set_duty_timer = xTimerCreate("block_set_duty", pdMS_TO_TICKS(ZCCTLM_DUTY_BLOCK_TIME_MS), pdFALSE, NULL, block_set_duty_timer_cb);
-            xTimerStart(block_set_duty_timer, 0);
+        if (on_off == state.on_off && !off_pending) {
+            zcctlm_unlock();
+            return;
         }
-#endif
 
         state.on_off = on_off;
 
         zcctlm_set_duty();
         if (zcctlm_should_persist_state()) {
-            zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_ON_OFF, (uint16_t)on_off);
+            zcctlm_mark_dirty(ZCCTLM_DIRTY_ON_OFF);
         }
-        xSemaphoreGive(state_mutex);
+        zcctlm_report_state(ZCCTLM_REPORT_LEVEL);
+        zcctlm_unlock();
     }
 }
 
 void zcctlm_toggle_on_off() {
-    if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
+    if (zcctlm_lock()) {
+        off_at_transition_end = false;
         state.on_off = !state.on_off;
         zcctlm_set_duty();
         if (zcctlm_should_persist_state()) {
-            zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_ON_OFF, (uint16_t)state.on_off);
+            zcctlm_mark_dirty(ZCCTLM_DIRTY_ON_OFF);
         }
-        xSemaphoreGive(state_mutex);
+        zcctlm_report_state(ZCCTLM_REPORT_LEVEL);
+        zcctlm_unlock();
     }
 }
 
 void zcctlm_set_brightness(uint8_t val) {
-    if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
+    if (zcctlm_lock()) {
         if (val == state.brightness) {
-            xSemaphoreGive(state_mutex);
+            zcctlm_unlock();
             return;
         }
 
+        off_at_transition_end = false;
         state.brightness = val;
         zcctlm_set_duty();
         if (zcctlm_should_persist_state()) {
-            zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_BRIGHTNESS, (uint16_t)val);
+            zcctlm_mark_dirty(ZCCTLM_DIRTY_BRIGHTNESS);
         }
-        xSemaphoreGive(state_mutex);
+        zcctlm_report_state(ZCCTLM_REPORT_LEVEL);
+        zcctlm_unlock();
     }
 }
 
 void zcctlm_set_color_temp(uint16_t mireds) {
-    if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
+    if (zcctlm_lock()) {
         if (mireds == state.mireds) {
-            xSemaphoreGive(state_mutex);
+            zcctlm_unlock();
             return;
         }
 
         state.mireds = mireds;
         zcctlm_set_duty();
         if (zcctlm_should_persist_state()) {
-            zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_MIREDS, (uint16_t)mireds);
+            zcctlm_mark_dirty(ZCCTLM_DIRTY_MIREDS);
+        }
+        zcctlm_report_state(ZCCTLM_REPORT_COLOR_TEMP);
+        zcctlm_unlock();
+    }
+}
+
+void zcctlm_move_to_level(uint8_t level, uint32_t time_ms, bool with_on_off) {
+    if (zcctlm_lock()) {
+        // Without On/Off the command has no effect on a light that is off
+        if (with_on_off || state.on_off) {
+            zcctlm_start_level_ramp(level, time_ms, with_on_off);
+        }
+        zcctlm_unlock();
+    }
+}
+
+void zcctlm_move_level(bool up, uint8_t rate, bool with_on_off) {
+    if (rate == 0)
+        return;
+    if (rate == 0xff)
+        rate = ZCCTLM_DEFAULT_MOVE_RATE;
+
+    if (zcctlm_lock()) {
+        if (with_on_off || state.on_off) {
+            // Move is a ramp to the end of the range, its time follows from the rate and the distance left
+            uint8_t level = up ? ZCCTLM_MAX_BRIGHTNESS : ZCCTLM_MIN_ON_BRIGHTNESS;
+            uint16_t level_q8, mireds;
+            zcctlm_output_point(&level_q8, &mireds);
+            int32_t distance_q8 = (int32_t)LT_LEVEL_Q8(level) - level_q8;
+            if (distance_q8 < 0)
+                distance_q8 = -distance_q8;
+
+            uint32_t time_ms = (uint32_t)distance_q8 * 1000 / LT_LEVEL_Q8(rate);
+            zcctlm_start_level_ramp(level, time_ms, with_on_off);
+        }
+        zcctlm_unlock();
+    }
+}
+
+void zcctlm_step_level(bool up, uint8_t step, uint32_t time_ms, bool with_on_off) {
+    if (zcctlm_lock()) {
+        if (with_on_off || state.on_off) {
+            int32_t level = state.brightness + (up ? step : -step);
+            if (level < 0)
+                level = 0;
+            if (level > ZCCTLM_MAX_BRIGHTNESS)
+                level = ZCCTLM_MAX_BRIGHTNESS;
+            zcctlm_start_level_ramp((uint8_t)level, time_ms, with_on_off);
+        }
+        zcctlm_unlock();
+    }
+}
+
+void zcctlm_stop_level() {
+    if (zcctlm_lock()) {
+#if ZCCTLM_USE_PERCEPTUAL_TRANSITIONS == 1
+        // Freeze the level where the ramp is now, a ramp down that was going to switch the light off leaves it on.
+        // A color ramp running at the same time continues to its target.
+        off_at_transition_end = false;
+        if (state.on_off) {
+            uint16_t level_q8, mireds;
+            uint32_t remaining_ms = zcctlm_output_point(&level_q8, &mireds);
+
+            uint32_t level = ((uint32_t)level_q8 + 0x80) >> 8;
+            if (level < ZCCTLM_MIN_ON_BRIGHTNESS)
+                level = ZCCTLM_MIN_ON_BRIGHTNESS;
+
+            bool changed = level != state.brightness;
+            state.brightness = (uint8_t)level;
+            report_at_transition_end |= ZCCTLM_REPORT_LEVEL;
+            zcctlm_apply_state(state.mireds != mireds ? remaining_ms : 0);
+
+            if (changed && zcctlm_should_persist_state()) {
+                zcctlm_mark_dirty(ZCCTLM_DIRTY_BRIGHTNESS);
+            }
+        }
+#else
+        // A running LEDC fade cannot be frozen at an intermediate level without the transition engine, the ramp completes
+        ESP_LOGW(TAG, "Stop is not supported without ZCCTLM_USE_PERCEPTUAL_TRANSITIONS");
+#endif
+        zcctlm_unlock();
+    }
+}
+
+void zcctlm_move_to_color_temp(uint16_t mireds, uint32_t time_ms) {
+    uint32_t ramp_ms = 0;
+    if (zcctlm_lock()) {
+        ramp_ms = zcctlm_start_color_ramp(zcctlm_clamp_mireds(mireds, 0, 0), time_ms);
+        zcctlm_unlock();
+    }
+    zcctlm_set_color_remaining_time(ramp_ms);
+}
+
+void zcctlm_move_color_temp(bool up, uint16_t rate, uint16_t min_mireds, uint16_t max_mireds) {
+    if (rate == 0) {
+        // Move with rate 0 stops like StopMoveStep
+        zcctlm_stop_color_temp();
+        return;
+    }
+
+    uint32_t ramp_ms = 0;
+    if (zcctlm_lock()) {
+        // Ramp to the bound in the direction of the move, its time follows from the rate and the distance left
+        uint16_t target = zcctlm_clamp_mireds(up ? UINT16_MAX : 0, min_mireds, max_mireds);
+        uint16_t level_q8, mireds;
+        zcctlm_output_point(&level_q8, &mireds);
+        uint32_t distance = target > mireds ? target - mireds : mireds - target;
+
+        ramp_ms = zcctlm_start_color_ramp(target, distance * 1000 / rate);
+        zcctlm_unlock();
+    }
+    zcctlm_set_color_remaining_time(ramp_ms);
+}
+
+void zcctlm_step_color_temp(bool up, uint16_t step, uint32_t time_ms, uint16_t min_mireds, uint16_t max_mireds) {
+    uint32_t ramp_ms = 0;
+    if (zcctlm_lock()) {
+        int32_t mireds = (int32_t)state.mireds + (up ? step : -step);
+        ramp_ms = zcctlm_start_color_ramp(zcctlm_clamp_mireds(mireds < 0 ? 0 : (uint32_t)mireds, min_mireds, max_mireds), time_ms);
+        zcctlm_unlock();
+    }
+    zcctlm_set_color_remaining_time(ramp_ms);
+}
+
+void zcctlm_stop_color_temp() {
+    if (zcctlm_lock()) {
+#if ZCCTLM_USE_PERCEPTUAL_TRANSITIONS == 1
+        // Freeze the color where the ramp is now, a level ramp running at the same time continues to its target
+        uint16_t level_q8, mireds;
+        uint32_t remaining_ms = zcctlm_output_point(&level_q8, &mireds);
+        uint16_t target_level_q8 = state.on_off && !off_at_transition_end ? LT_LEVEL_Q8(state.brightness) : LT_LEVEL_Q8(0);
+
+        bool changed = mireds != state.mireds;
+        state.mireds = mireds;
+        report_at_transition_end |= ZCCTLM_REPORT_COLOR_TEMP;
+        zcctlm_apply_state(target_level_q8 != level_q8 ? remaining_ms : 0);
+
+        if (changed && zcctlm_should_persist_state()) {
+            zcctlm_mark_dirty(ZCCTLM_DIRTY_MIREDS);
+        }
+#else
+        // A running LEDC fade cannot be frozen at an intermediate color without the transition engine, the ramp completes
+        ESP_LOGW(TAG, "Stop is not supported without ZCCTLM_USE_PERCEPTUAL_TRANSITIONS");
+#endif
+        zcctlm_unlock();
+    }
+    zcctlm_set_color_remaining_time(0);
+}
+
+void zcctlm_store_scene(uint16_t group_id, uint8_t scene_id) {
+    zcctlm_state_t snapshot;
+    zcctlm_read_state(&snapshot);
+
+    zcctlm_scene_t scene = {.group_id = group_id, .scene_id = scene_id};
+    scene.on_off = snapshot.on_off;
+    scene.level = snapshot.brightness;
+    scene.mireds = snapshot.mireds;
+    scene.transition_time = (uint16_t)(snapshot.on_transition_time / ZB_TRANSITION_TIME_UNIT_MS);
+
+    // Flash access happens outside of state_mutex
+    zcctlm_scenes_store(&scene);
+}
+
+void zcctlm_recall_scene(uint16_t group_id, uint8_t scene_id, uint32_t time_ms, const zcctlm_scene_t *fields) {
+    zcctlm_scene_t scene;
+    if (!zcctlm_scenes_find(group_id, scene_id, &scene)) {
+        if (fields == NULL) {
+            ESP_LOGW(TAG, "Scene %u of group 0x%04x not found", scene_id, group_id);
+            return;
         }
-        xSemaphoreGive(state_mutex);
+        scene = *fields;
     }
+
+    if (time_ms == ZCCTLM_TRANSITION_DEFAULT && scene.transition_time != ZCCTLM_SCENE_TRANSITION_UNSET)
+        time_ms = ZB_TRANSITION_TIME_TO_MS(scene.transition_time);
+
+    uint32_t color_ramp_ms = 0;
+    if (zcctlm_lock()) {
+        // Every part of the scene changes in one transition
+        uint8_t dirty = 0;
+        off_at_transition_end = false;
+
+        if (scene.on_off != ZCCTLM_SCENE_ON_OFF_UNSET && (bool)scene.on_off != state.on_off) {
+            state.on_off = scene.on_off;
+            dirty |= ZCCTLM_DIRTY_ON_OFF;
+        }
+        if (scene.level != ZCCTLM_SCENE_LEVEL_UNSET && scene.level != state.brightness) {
+            state.brightness = scene.level;
+            dirty |= ZCCTLM_DIRTY_BRIGHTNESS;
+        }
+        if (scene.mireds != ZCCTLM_SCENE_MIREDS_UNSET) {
+            uint16_t mireds = zcctlm_clamp_mireds(scene.mireds, 0, 0);
+            if (mireds != state.mireds) {
+                state.mireds = mireds;
+                dirty |= ZCCTLM_DIRTY_MIREDS;
+            }
+        }
+
+        if (time_ms == ZCCTLM_TRANSITION_DEFAULT)
+            time_ms = state.on_off ? state.on_transition_time : state.off_transition_time;
+        if (dirty & ZCCTLM_DIRTY_MIREDS)
+            color_ramp_ms = time_ms;
+
+        report_at_transition_end |= ZCCTLM_REPORT_LEVEL | ZCCTLM_REPORT_COLOR_TEMP;
+        zcctlm_apply_state(time_ms);
+
+        if (dirty && zcctlm_should_persist_state()) {
+            zcctlm_mark_dirty(dirty);
+        }
+        zcctlm_unlock();
+    }
+    zcctlm_set_color_remaining_time(color_ramp_ms);
 }
 
-void zcctlm_set_on_transition_time(uint16_t time_ms) {
-    if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
+void zcctlm_set_on_transition_time(uint32_t time_ms) {
+    if (zcctlm_lock()) {
         state.on_transition_time = time_ms;
-        zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_ON_TRANSITION_TIME, time_ms);
-        xSemaphoreGive(state_mutex);
+        zcctlm_mark_dirty(ZCCTLM_DIRTY_ON_TRANSITION_TIME);
+        zcctlm_unlock();
     }
 }
 
-void zcctlm_set_off_transition_time(uint16_t time_ms) {
-    if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
+void zcctlm_set_off_transition_time(uint32_t time_ms) {
+    if (zcctlm_lock()) {
         state.off_transition_time = time_ms;
-        zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_OFF_TRANSITION_TIME, time_ms);
-        xSemaphoreGive(state_mutex);
+        zcctlm_mark_dirty(ZCCTLM_DIRTY_OFF_TRANSITION_TIME);
+        zcctlm_unlock();
     }
 }
 
 void zcctlm_set_startup_behavior(zcctl_startup_behavior_e startup_behavior) {
-    if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
+    if (zcctlm_lock()) {
         state.startup_behavior = startup_behavior;
-        zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_STARTUP_ON_OFF, (uint16_t)startup_behavior);
+        zcctlm_mark_dirty(ZCCTLM_DIRTY_STARTUP_ON_OFF);
 
         // save current color, brightness, and state
         if (zcctlm_should_persist_state()) {
-            zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_ON_OFF, (uint16_t)state.on_off);
-            zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_BRIGHTNESS, (uint16_t)state.brightness);
-            zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_MIREDS, state.mireds);
+            zcctlm_mark_dirty(ZCCTLM_DIRTY_ON_OFF | ZCCTLM_DIRTY_BRIGHTNESS | ZCCTLM_DIRTY_MIREDS);
         }
 
-        xSemaphoreGive(state_mutex);
+        zcctlm_unlock();
     }
 }
 
 void zcctlm_clear_nvs() {
-    zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_ON_OFF, ZCCTLM_DEFAULT_ONOFF);
-    zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_BRIGHTNESS, ZCCTLM_MIN_BRIGHTNESS);
-    zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_MIREDS, ZCCTLM_DEFAULT_TEMP);
-    zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_STARTUP_ON_OFF, ZCCTLM_DEFAULT_STARTUP_BEHAVIOUR);
-    zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_ON_TRANSITION_TIME, ZCCTLM_DEFAULT_TRANSITION_TIME_MS);
-    zcctlm_save_to_nvs(ZCCTLM_NVS_KEY_OFF_TRANSITION_TIME, ZCCTLM_DEFAULT_TRANSITION_TIME_MS);
+    // Drop pending writes, they must not resurrect the old state after the reset
+    if (zcctlm_lock()) {
+        nvs_dirty = 0;
+        xTimerStop(nvs_commit_timer, 0);
+        zcctlm_unlock();
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(ZCCTLM_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return;
+    }
+
+    // Without a record (and legacy keys) the next boot starts from defaults
+    err = nvs_erase_all(handle);
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to clear NVS: %s", esp_err_to_name(err));
+    }
+
+    nvs_close(handle);
+}
+
+void zcctlm_flush_nvs() {
+    // Do not hold up the timer task behind a busy writer, try again after the commit delay
+    if (!zcctlm_lock_timeout(pdMS_TO_TICKS(ZCCTLM_NVS_FLUSH_TIMEOUT_MS))) {
+        ESP_LOGW(TAG, "Failed to acquire state mutex for NVS flush, retrying later");
+        xTimerReset(nvs_commit_timer, 0);
+        return;
+    }
+
+    uint8_t dirty = nvs_dirty;
+    nvs_dirty = 0;
+    zcctlm_state_t snapshot = state;
+    zcctlm_unlock();
+
+    // Flash access happens outside of state_mutex
+    if (dirty == 0 || zcctlm_commit_to_nvs(dirty, &snapshot))
+        return;
+
+    // Keep the changes pending and try again after the commit delay
+    if (zcctlm_lock()) {
+        nvs_dirty |= dirty;
+        xTimerReset(nvs_commit_timer, 0);
+        zcctlm_unlock();
+    }
+}
+
+void zcctlm_save_to_nvs() {
+    zcctlm_state_t snapshot;
+    zcctlm_read_state(&snapshot);
+    zcctlm_commit_to_nvs(0, &snapshot);
 }
 
+bool zcctlm_load_from_nvs() {
+    zcctlm_nvs_record_t record;
+    return zcctlm_load_record(&record);
+}
+
+void zcctlm_refresh_output() {
+    if (zcctlm_lock()) {
+        zcctlm_set_duty();
+        zcctlm_unlock();
+    }
+}
+
+void zcctlm_get_persist_stats(zcctlm_persist_stats_t *stats) {
+    *stats = persist_stats;
+    stats->commits_avoided = stats->changes > stats->commits ? stats->changes - stats->commits : 0;
+}
+
+#if ZCCTLM_ENABLE_SETTLE_WINDOW == 1
+void zcctlm_get_settle_stats(zcctlm_settle_stats_t *stats) { *stats = settle_stats; }
+#endif
+
+void zcctlm_get_lock_stats(zcctlm_lock_stats_t *stats) {
+    *stats = lock_stats;
+    stats->snapshot_reads = atomic_load_explicit(&snapshot_reads, memory_order_relaxed);
+    stats->snapshot_retries = atomic_load_explicit(&snapshot_retries, memory_order_relaxed);
+    stats->snapshot_max_read_us = atomic_load_explicit(&snapshot_max_read_us, memory_order_relaxed);
+}
+
+void zcctlm_get_state(zcctlm_state_t *snapshot) { zcctlm_read_state(snapshot); }
+
 void zcctlm_report_current_state() {
-    if (xSemaphoreTake(state_mutex, portMAX_DELAY)) {
-        // Send attribute values currently in `state`
-        zbattr_send_attribute_report(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, &state.on_off);
-        zbattr_send_attribute_report(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, &state.brightness);
-        zbattr_send_attribute_report(ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, &state.mireds);
-        xSemaphoreGive(state_mutex);
-    } else {
-        ESP_LOGW(TAG, "Failed to acquire state mutex for reporting");
+    // Under state_mutex, a value read before a concurrent change must not be reported after it
+    if (zcctlm_lock()) {
+        zcctlm_report_state(ZCCTLM_REPORT_LEVEL | ZCCTLM_REPORT_COLOR_TEMP);
+        zcctlm_unlock();
     }
 }
 
-void zcctlm_identify(uint16_t value) {
-    if (value == 0) {
-        zcctlm_set_duty(); // back to normal state
+void zcctlm_identify(uint16_t identify_time) {
+    if (identify_time == 0) {
+        zcctlm_effects_trigger(ZCCTLM_EFFECT_STOP, 0, 0); // back to normal state
         return;
     }
 
-    lc_set_duty_warm(LC_MAX_DUTY / 2, 200);
-    lc_set_duty_cold(LC_MAX_DUTY / 2, 200);
-    // vTaskDelay(pdMS_TO_TICKS(300));
-    lc_set_duty_warm(LC_OFF_DUTY, 200);
-    lc_set_duty_cold(LC_OFF_DUTY, 200);
-}
\ No newline at end of file
+    zcctlm_state_t snapshot;
+    zcctlm_read_state(&snapshot);
+    zcctlm_effects_trigger(ZCCTLM_EFFECT_IDENTIFY, snapshot.mireds, (uint32_t)identify_time * 1000);
+}
+
+void zcctlm_trigger_effect(uint8_t effect_id, uint8_t variant) {
+    // Only the default variant of each effect exists
+    DLOGI(TAG, "Trigger effect 0x%02x, variant %u", effect_id, variant);
+
+    zcctlm_state_t snapshot;
+    zcctlm_read_state(&snapshot);
+    zcctlm_effects_trigger(effect_id, snapshot.mireds, 0);
+}
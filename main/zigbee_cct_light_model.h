@@ -3,6 +3,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "zcctlm_scenes.h"
+
 #define ZCCTLM_MIN_TEMP 167
 #define ZCCTLM_MAX_TEMP 370
 #define ZCCTLM_DEFAULT_ONOFF 0
@@ -13,37 +15,127 @@
 #define ZCCTLM_DEFAULT_STARTUP_BEHAVIOUR 0
 #define ZCCTLM_DEFAULT_TEMP ((ZCCTLM_MIN_TEMP + ZCCTLM_MAX_TEMP) / 2)
 
+// Level Control commands
+// Lowest level of a light that is on (ZCL MinLevel), ramps down without On/Off stop here
+#define ZCCTLM_MIN_ON_BRIGHTNESS 1
+// Rate of a Move command that asks for the default rate (0xFF), in levels per second
+#define ZCCTLM_DEFAULT_MOVE_RATE 100
+// Transition time argument meaning "use OnTransitionTime / OffTransitionTime"
+#define ZCCTLM_TRANSITION_DEFAULT UINT32_MAX
+
 #define ZCCTLM_USE_GAMMA_CORRECTION 1
+// Gamma is applied through the precomputed table in zcctlm_gamma_lut.h,
+// regenerate it with tools/gen_gamma_lut.py after changing this value
 #define ZCCTLM_GAMMA_CORRECTION 1.5
 
+// Run transitions through the transition engine (light_transition.c), interpolating level and mireds together
+// instead of handing the LEDC hardware a linear duty ramp per channel. On chips with hardware curve fades (ESP32-C6/H2)
+// the path is sampled once and played by the LEDC as a multi-segment fade, elsewhere it is stepped in software at ~200 Hz
+#define ZCCTLM_USE_PERCEPTUAL_TRANSITIONS 1
+
 /*
-    This is a workaround that solves the issue of the LED strip briefly flashing with an old color temperature
-    when turning on a Zigbee lamp via Home Assistant. After sending the "on" command,
-    the ZHA integration would restore the previous brightness and color temperature (mireds)
-    before the new values from the UI or scene had time to arrive.
-    As a result, the lamp would light up for a brief moment using outdated parameters,
-    causing an unwanted flash of the previous color or brightness.
-
-    The workaround works by temporarily blocking any PWM updates (zcctlm_set_duty)
-    for a short period (e.g., 200 ms) after receiving the "on" command.
-    This gives Home Assistant enough time to send the updated brightness and color temperature values.
-    Once the timer expires, duty updates are enabled again and applied based on the latest state.
+    Settle window against the LED strip briefly flashing with an old color temperature when turning on
+    a Zigbee lamp via Home Assistant. After sending the "on" command, the ZHA integration sends the new
+    brightness and color temperature (mireds) as separate commands, so the lamp would light up for
+    a brief moment using the previous parameters.
+
+    When the light is about to light up, output updates are held for ZCCTLM_SETTLE_WINDOW_MS: On/Off, level and
+    mireds changes arriving within the window are merged and the latest state is applied in one update, with
+    the transition time of the last command. Changes made while the light is already lit are not delayed,
+    switching off closes the window at once.
 */
-#define ZCCTLM_ENABLE_ON_OFF_DUTY_BLOCK_WORKAROUND 1
-#define ZCCTLM_DUTY_BLOCK_TIME_MS 200
+#define ZCCTLM_ENABLE_SETTLE_WINDOW 1
+#define ZCCTLM_SETTLE_WINDOW_MS 200
 
 #define ZCCTLM_AVG_TEMP ((ZCCTLM_MIN_TEMP + ZCCTLM_MAX_TEMP) / 2)
 
+// Write-behind persistence: changes are committed to NVS together once no new change arrived for this time,
+// and on shutdown (esp_restart)
+#define ZCCTLM_NVS_COMMIT_DELAY_MS 2000
+#define ZCCTLM_NVS_FLUSH_TIMEOUT_MS 100
+
+// Period in which CurrentLevel / ColorTemperatureMireds follow a running ramp, a configured reportable change
+// decides which of these values are reported
+#define ZCCTLM_PROGRESS_SAMPLE_MS 500
+
+// Fade from the last effect keyframe back to the model state
+#define ZCCTLM_EFFECT_RESTORE_MS 300
+
+typedef struct {
+    uint32_t changes;         // persistent values changed, each of them used to be a separate NVS commit
+    uint32_t commits;         // NVS commits performed
+    uint32_t commits_avoided; // changes merged into another commit
+} zcctlm_persist_stats_t;
+
+typedef struct {
+    uint32_t windows; // settle windows opened
+    uint32_t merged;  // output updates merged into the update at the end of a window
+} zcctlm_settle_stats_t;
+
+typedef struct {
+    uint32_t lock_taken;           // state_mutex acquisitions by writers
+    uint32_t lock_contended;       // acquisitions that had to wait for another task
+    uint32_t lock_max_wait_us;     // longest wait for state_mutex
+    uint32_t snapshot_reads;       // lock-free reads of the published state
+    uint32_t snapshot_retries;     // copies repeated because a writer published meanwhile
+    uint32_t snapshot_max_read_us; // worst-case reader latency
+} zcctlm_lock_stats_t;
+
+#if ZCCTLM_USE_GAMMA_CORRECTION == 1
+// Total duty of both channels for a brightness, from zcctlm_gamma_lut.h
+uint16_t apply_gamma_correction(uint8_t brightness_raw);
+#endif
+
 typedef enum { ZCCTL_STARTUP_OFF = 0, ZCCTL_STARTUP_ON, ZCCTL_STARTUP_TOGGLE, ZCCTL_STARTUP_PREVIOUS = 255 } zcctl_startup_behavior_e;
 
+typedef struct {
+    bool on_off;
+    uint8_t brightness;
+    uint16_t mireds;
+
+    // synchronized with NVS
+    uint32_t on_transition_time; // ms
+    uint32_t off_transition_time; // ms
+    zcctl_startup_behavior_e startup_behavior;
+} zcctlm_state_t;
+
 void zcctlm_init();
 void zcctlm_set_on_off(bool on_off);
 void zcctlm_toggle_on_off();
 void zcctlm_set_brightness(uint8_t val);
 void zcctlm_set_color_temp(uint16_t mireds);
-void zcctlm_set_on_transition_time(uint16_t time_ms);
-void zcctlm_set_off_transition_time(uint16_t time_ms);
+void zcctlm_move_to_level(uint8_t level, uint32_t time_ms, bool with_on_off);
+void zcctlm_move_level(bool up, uint8_t rate, bool with_on_off);
+void zcctlm_step_level(bool up, uint8_t step, uint32_t time_ms, bool with_on_off);
+void zcctlm_stop_level();
+// Color ramps stay within [min_mireds, max_mireds] intersected with [ZCCTLM_MIN_TEMP, ZCCTLM_MAX_TEMP], 0 means no bound
+void zcctlm_move_to_color_temp(uint16_t mireds, uint32_t time_ms);
+void zcctlm_move_color_temp(bool up, uint16_t rate, uint16_t min_mireds, uint16_t max_mireds);
+void zcctlm_step_color_temp(bool up, uint16_t step, uint32_t time_ms, uint16_t min_mireds, uint16_t max_mireds);
+void zcctlm_stop_color_temp();
+void zcctlm_store_scene(uint16_t group_id, uint8_t scene_id);
+// fields: scene carried by the request (AddScene extension fields), used when the scene is not in the local table
+void zcctlm_recall_scene(uint16_t group_id, uint8_t scene_id, uint32_t time_ms, const zcctlm_scene_t *fields);
+void zcctlm_set_on_transition_time(uint32_t time_ms);
+void zcctlm_set_off_transition_time(uint32_t time_ms);
 void zcctlm_set_startup_behavior(zcctl_startup_behavior_e startup_behavior);
 void zcctlm_clear_nvs();
+void zcctlm_flush_nvs();
+// Write the current state record now, whether it changed or not
+void zcctlm_save_to_nvs();
+// Read and check the state record without applying it, false when a boot would fall back to defaults
+bool zcctlm_load_from_nvs();
+// Drive the LEDs to the current state again (zcctlm_set_duty with state_mutex taken)
+void zcctlm_refresh_output();
+void zcctlm_get_persist_stats(zcctlm_persist_stats_t *stats);
+#if ZCCTLM_ENABLE_SETTLE_WINDOW == 1
+void zcctlm_get_settle_stats(zcctlm_settle_stats_t *stats);
+#endif
+void zcctlm_get_lock_stats(zcctlm_lock_stats_t *stats);
+// Latest state published by a writer, read without taking state_mutex
+void zcctlm_get_state(zcctlm_state_t *snapshot);
 void zcctlm_report_current_state();
-void zcctlm_identify(uint16_t value);
\ No newline at end of file
+// Identify effect for identify_time seconds, 0 stops it
+void zcctlm_identify(uint16_t identify_time);
+// Trigger Effect command, effect_id is one of ZCCTLM_EFFECT_*
+void zcctlm_trigger_effect(uint8_t effect_id, uint8_t variant);
\ No newline at end of file
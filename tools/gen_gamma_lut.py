@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+"""
+Generates main/zcctlm_gamma_lut.h - the integer gamma table used by zcctlm_set_duty().
+
+The table reproduces the original float pipeline step by step in single precision:
+
+    norm      = (float)level / ZCCTLM_MAX_BRIGHTNESS
+    corrected = powf(norm, ZCCTLM_GAMMA_CORRECTION)
+    pwm       = (uint16_t)(corrected * (LC_MAX_DUTY - LC_MIN_DUTY)) + LC_MIN_DUTY
+
+Rerun after changing the gamma, the brightness range or the LEDC duty range:
+
+    python3 tools/gen_gamma_lut.py > main/zcctlm_gamma_lut.h
+"""
+
+import math
+import struct
+import sys
+
+GAMMA = 1.5
+MAX_BRIGHTNESS = 254
+DUTY_RESOLUTION = 11
+MIN_DUTY = 150
+MAX_DUTY = 1 << DUTY_RESOLUTION
+
+
+def f32(x):
+    return struct.unpack("f", struct.pack("f", x))[0]
+
+
+def gamma_pwm(level):
+    if level == 0:
+        return 0
+    norm = f32(f32(level) / f32(MAX_BRIGHTNESS))
+    corrected = f32(math.pow(norm, GAMMA))
+    pwm = int(f32(corrected * f32(MAX_DUTY - MIN_DUTY))) + MIN_DUTY
+    return min(pwm, MAX_DUTY)
+
+
+def main():
+    values = [gamma_pwm(level) for level in range(MAX_BRIGHTNESS + 1)]
+    out = sys.stdout
+    out.write("#pragma once\n\n")
+    out.write("// Generated by tools/gen_gamma_lut.py - do not edit by hand.\n\n")
+    out.write("#include <stdint.h>\n\n")
+    out.write(f"#define ZCCTLM_GAMMA_LUT_GAMMA_X10 {int(round(GAMMA * 10))}\n")
+    out.write(f"#define ZCCTLM_GAMMA_LUT_MAX_BRIGHTNESS {MAX_BRIGHTNESS}\n")
+    out.write(f"#define ZCCTLM_GAMMA_LUT_MIN_DUTY {MIN_DUTY}\n")
+    out.write(f"#define ZCCTLM_GAMMA_LUT_MAX_DUTY {MAX_DUTY}\n\n")
+    out.write(f"static const uint16_t zcctlm_gamma_lut[{len(values)}] = {{\n")
+    for i in range(0, len(values), 12):
+        row = ", ".join(f"{v:4d}" for v in values[i : i + 12])
+        out.write(f"    {row},\n")
+    out.write("};\n")
+
+
+if __name__ == "__main__":
+    main()